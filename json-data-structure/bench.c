@@ -0,0 +1,834 @@
+#include "json.h"
+#include "config_gen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//  性能基准测试，用法：./bench [用例名前缀]
+//  每个用例输出总耗时和平均每次操作的纳秒数
+
+#define BENCH_N     1000000     //大数组的元素个数
+#define BENCH_PASS  20          //扫描类用例重复扫描的遍数
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void report(const char *name, double ms, double ops)
+{
+    printf("%-28s %10.2f ms %10.2f ns/op\n", name, ms, ms * 1e6 / ops);
+}
+
+static volatile double sink;    //防止被测循环被优化掉
+
+static JSON *make_num_arr(U32 n)
+{
+    JSON *arr = json_new(JSON_ARR);
+    U32 i;
+
+    for (i = 0; i < n; ++i)
+        json_arr_add_num(arr, i);
+    return arr;
+}
+
+static JSON *make_str_arr(U32 n)
+{
+    JSON *arr = json_new(JSON_ARR);
+    char buf[32];
+    U32 i;
+
+    for (i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf), "200.200.%u.%u", i / 256 % 256, i % 256);
+        json_arr_add_str(arr, buf);
+    }
+    return arr;
+}
+
+static void bench_build_num_arr(void)
+{
+    double t = now_ms();
+    JSON *arr = make_num_arr(BENCH_N);
+    report("build_num_arr", now_ms() - t, BENCH_N);
+    json_free(arr);
+}
+
+static void bench_scan_num_arr(void)
+{
+    JSON *arr = make_num_arr(BENCH_N);
+    double sum = 0, t = now_ms();
+    int pass, i;
+
+    for (pass = 0; pass < BENCH_PASS; ++pass) {
+        for (i = 0; i < BENCH_N; ++i)
+            sum += json_arr_get_num(arr, i, 0);
+    }
+    report("scan_num_arr", now_ms() - t, (double)BENCH_N * BENCH_PASS);
+    sink = sum;
+    json_free(arr);
+}
+
+static void bench_scan_str_arr(void)
+{
+    JSON *arr = make_str_arr(BENCH_N);
+    double t = now_ms();
+    size_t len = 0;
+    int pass, i;
+
+    for (pass = 0; pass < BENCH_PASS; ++pass) {
+        for (i = 0; i < BENCH_N; ++i)
+            len += json_arr_get_str(arr, i, "")[0];
+    }
+    report("scan_str_arr", now_ms() - t, (double)BENCH_N * BENCH_PASS);
+    sink = len;
+    json_free(arr);
+}
+
+static void bench_scan_elements(void)
+{
+    JSON *arr = make_num_arr(BENCH_N);
+    double sum = 0, t = now_ms();
+    int pass;
+    U32 i;
+
+    for (pass = 0; pass < BENCH_PASS; ++pass) {
+        for (i = 0; i < BENCH_N; ++i)
+            sum += json_num(json_get_element(arr, i), 0);
+    }
+    report("scan_elements", now_ms() - t, (double)BENCH_N * BENCH_PASS);
+    sink = sum;
+    json_free(arr);
+}
+
+static void bench_get_nums(void)
+{
+    JSON *arr = make_num_arr(BENCH_N);
+    double *out = malloc(BENCH_N * sizeof(double));
+    double t = now_ms();
+    int pass;
+
+    for (pass = 0; pass < BENCH_PASS; ++pass)
+        json_arr_get_nums(arr, out, 0, BENCH_N);
+    report("get_nums", now_ms() - t, (double)BENCH_N * BENCH_PASS);
+    sink = out[BENCH_N - 1];
+    free(out);
+    json_free(arr);
+}
+
+static void bench_add_nums(void)
+{
+    double *nums = malloc(BENCH_N * sizeof(double));
+    double t;
+    JSON *arr;
+    int i;
+
+    for (i = 0; i < BENCH_N; ++i)
+        nums[i] = i;
+    t = now_ms();
+    arr = json_new(JSON_ARR);
+    json_arr_add_nums(arr, nums, BENCH_N);
+    report("add_nums", now_ms() - t, BENCH_N);
+    json_free(arr);
+    free(nums);
+}
+
+static void bench_free_num_arr(void)
+{
+    JSON *arr = make_num_arr(BENCH_N);
+    double t = now_ms();
+    json_free(arr);
+    report("free_num_arr", now_ms() - t, BENCH_N);
+}
+
+#define TREE_RECORDS    100000  //大树中记录的个数，每条记录10个JSON值，整棵树约100万个
+
+/**
+ * @brief 构造约100万个JSON值的大树：{"records": [{"id":..,"ok":..,"name":..,"score":..,"tags":[..]}, ...]}
+ */
+static JSON *make_tree(void)
+{
+    JSON *root = json_new(JSON_OBJ);
+    JSON *records = json_add_member(root, "records", json_new(JSON_ARR));
+    char name[32];
+    U32 i;
+
+    for (i = 0; i < TREE_RECORDS; ++i) {
+        JSON *rec = json_add_element(records, json_new(JSON_OBJ));
+        snprintf(name, sizeof(name), "host-%u", i);
+        json_obj_set_num(rec, "id", i);
+        json_obj_set_bool(rec, "ok", i % 2);
+        json_obj_set_str(rec, "name", name);
+        json_obj_set_num(rec, "score", i * 0.5);
+        JSON *tags = json_add_member(rec, "tags", json_new(JSON_ARR));
+        json_arr_add_num(tags, i);
+        json_arr_add_num(tags, i + 1);
+        json_arr_add_num(tags, i + 2);
+        json_arr_add_bool(tags, TRUE);
+    }
+    return root;
+}
+
+static void bench_build_tree(void)
+{
+    double t = now_ms();
+    JSON *root = make_tree();
+    report("build_tree", now_ms() - t, TREE_RECORDS * 10.0);
+    json_free(root);
+}
+
+/**
+ * @brief 用json_builder构造和make_tree相同的树
+ */
+static JSON *make_tree_builder(void)
+{
+    json_builder *b = json_builder_new();
+    char name[32];
+    U32 i;
+
+    json_builder_begin_obj(b);
+    json_builder_key(b, "records");
+    json_builder_begin_arr(b);
+    for (i = 0; i < TREE_RECORDS; ++i) {
+        snprintf(name, sizeof(name), "host-%u", i);
+        json_builder_begin_obj(b);
+        json_builder_key(b, "id");
+        json_builder_num(b, i);
+        json_builder_key(b, "ok");
+        json_builder_bool(b, i % 2);
+        json_builder_key(b, "name");
+        json_builder_str(b, name);
+        json_builder_key(b, "score");
+        json_builder_num(b, i * 0.5);
+        json_builder_key(b, "tags");
+        json_builder_begin_arr(b);
+        json_builder_num(b, i);
+        json_builder_num(b, i + 1);
+        json_builder_num(b, i + 2);
+        json_builder_bool(b, TRUE);
+        json_builder_end(b);
+        json_builder_end(b);
+    }
+    json_builder_end(b);
+    json_builder_end(b);
+    return json_builder_finish(b);
+}
+
+static void bench_builder(void)
+{
+    double t = now_ms();
+    JSON *root = make_tree_builder();
+    report("builder", now_ms() - t, TREE_RECORDS * 10.0);
+    json_free(root);
+}
+
+#define MERGE_KEYS  100000  //merge用例中每个对象的成员数
+
+/**
+ * @brief 合并两个各有MERGE_KEYS个成员、一半键名重叠的对象
+ */
+static JSON *make_big_obj(U32 base)
+{
+    json_builder *b = json_builder_new();
+    char key[32];
+    U32 i;
+
+    // json_obj_set_*要先查重，大对象是私有形状，逐个加入是O(n^2)的
+    json_builder_begin_obj(b);
+    for (i = 0; i < MERGE_KEYS; ++i) {
+        snprintf(key, sizeof(key), "key-%u", base + i);
+        json_builder_key(b, key);
+        json_builder_num(b, i);
+    }
+    json_builder_end(b);
+    return json_builder_finish(b);
+}
+
+static void bench_merge(void)
+{
+    JSON *dst = make_big_obj(0), *src = make_big_obj(MERGE_KEYS / 2);
+    double t;
+
+    t = now_ms();
+    json_merge(dst, src, JSON_MERGE_REPLACE);
+    report("merge", now_ms() - t, MERGE_KEYS);
+    json_free(dst);
+}
+
+static void bench_walk_tree(void)
+{
+    JSON *root = make_tree();
+    const JSON *records = json_get_member(root, "records");
+    double sum = 0, t = now_ms();
+    int pass, i, j;
+
+    for (pass = 0; pass < BENCH_PASS / 4; ++pass) {
+        for (i = 0; i < TREE_RECORDS; ++i) {
+            const JSON *rec = json_get_element(records, i);
+            const JSON *tags = json_get_member(rec, "tags");
+            sum += json_obj_get_num(rec, "id", 0) + json_obj_get_num(rec, "score", 0);
+            sum += json_obj_get_bool(rec, "ok") + json_obj_get_str(rec, "name", "")[0];
+            for (j = 0; j < json_arr_count(tags); ++j)
+                sum += json_arr_get_num(tags, j, 0);
+        }
+    }
+    report("walk_tree", now_ms() - t, TREE_RECORDS * 10.0 * (BENCH_PASS / 4));
+    sink = sum;
+    json_free(root);
+}
+
+static void bench_member_ic(void)
+{
+    JSON *root = make_tree();
+    const JSON *records = json_get_member(root, "records");
+    double sum = 0, t;
+    int pass, i;
+
+    // 每条记录都是同一个形状，取靠后的键名
+    t = now_ms();
+    for (pass = 0; pass < BENCH_PASS / 4; ++pass) {
+        for (i = 0; i < TREE_RECORDS; ++i)
+            sum += json_num(json_get_member(json_get_element(records, i), "score"), 0);
+    }
+    report("get_member", now_ms() - t, TREE_RECORDS * (double)(BENCH_PASS / 4));
+    t = now_ms();
+    for (pass = 0; pass < BENCH_PASS / 4; ++pass) {
+        for (i = 0; i < TREE_RECORDS; ++i)
+            sum += json_num(JSON_GET_MEMBER(json_get_element(records, i), "score"), 0);
+    }
+    report("get_member_ic", now_ms() - t, TREE_RECORDS * (double)(BENCH_PASS / 4));
+    sink = sum;
+    json_free(root);
+}
+
+static void bench_tree_memory(void)
+{
+    JSON *root = make_tree();
+    json_mem_report mem;
+
+    json_memory_usage(root, &mem);
+    printf("%-28s %10.2f MB %10.2f B/node\n", "tree_memory", mem.total / 1048576.0,
+        (double)mem.total / mem.nodes);
+    json_free(root);
+}
+
+#define DOC_LOOPS   200000  //小文档加载类用例重复的次数
+
+static char doc_text[4096];     //config.json的内容，由json_gen生成的加载函数和通用解析共用
+static size_t doc_len;
+
+static int load_doc(void)
+{
+    FILE *fp = fopen("config.json", "rb");
+
+    if (!fp)
+        return -1;
+    doc_len = fread(doc_text, 1, sizeof(doc_text), fp);
+    fclose(fp);
+    return 0;
+}
+/**
+ * @brief 通过json_get_member逐个取出和config结构体相同的字段
+ */
+static double read_doc(const JSON *json)
+{
+    const JSON *basic = json_get_member(json, "basic");
+    const JSON *advance = json_get_member(json, "advance");
+    const JSON *dns = json_get_member(basic, "dns");
+    const JSON *pool = json_get_member(advance, "portpool");
+    double sum = 0;
+    int i;
+
+    sum += json_obj_get_bool(basic, "enable") + json_obj_get_str(basic, "ip", "")[0];
+    sum += json_obj_get_num(basic, "port", 0) + json_obj_get_num(basic, "timeout", 0);
+    sum += json_obj_get_str(basic, "basedn", "")[0] + json_obj_get_num(basic, "fd", 0);
+    sum += json_obj_get_num(basic, "maxcnt", 0);
+    for (i = 0; i < json_arr_count(dns); ++i)
+        sum += json_arr_get_str(dns, i, "")[0];
+    dns = json_get_member(advance, "dns");
+    for (i = 0; i < json_arr_count(dns); ++i) {
+        const JSON *host = json_get_element(dns, i);
+        sum += json_obj_get_str(host, "name", "")[0] + json_obj_get_str(host, "ip", "")[0];
+    }
+    for (i = 0; i < json_arr_count(pool); ++i)
+        sum += json_arr_get_num(pool, i, 0);
+    sum += json_obj_get_str(advance, "url", "")[0] + json_obj_get_str(advance, "path", "")[0];
+    return sum + json_obj_get_num(advance, "value", 0);
+}
+
+static void bench_gen_parse(void)
+{
+    double sum = 0, t = now_ms();
+    config cfg;
+    int i;
+
+    for (i = 0; i < DOC_LOOPS; ++i) {
+        config_parse(doc_text, doc_len, &cfg);
+        sum += cfg.basic.port + cfg.advance.value;
+        config_free(&cfg);
+    }
+    report("gen_parse", now_ms() - t, DOC_LOOPS);
+    sink = sum;
+}
+
+static void bench_generic_parse(void)
+{
+    double sum = 0, t = now_ms();
+    int i;
+
+    for (i = 0; i < DOC_LOOPS; ++i) {
+        JSON *json = json_parse(doc_text, doc_len);
+        sum += read_doc(json);
+        json_free(json);
+    }
+    report("generic_parse", now_ms() - t, DOC_LOOPS);
+    sink = sum;
+}
+
+static void bench_generic_get(void)
+{
+    JSON *json = json_parse(doc_text, doc_len);
+    double sum = 0, t = now_ms();
+    int i;
+
+    for (i = 0; i < DOC_LOOPS; ++i)
+        sum += read_doc(json);
+    report("generic_get", now_ms() - t, DOC_LOOPS);
+    sink = sum;
+    json_free(json);
+}
+
+#define LINES_RECORDS   200000  //JSON Lines用例的记录数
+
+static int lines_count(void *arg, JSON *json, U64 offset)
+{
+    ++*(U32 *)arg;
+    json_free(json);
+    return 0;
+}
+
+static void bench_lines(void)
+{
+    JSON *root = make_tree();
+    const JSON *records = json_get_member(root, "records");
+    const JSON **recs = malloc(TREE_RECORDS * sizeof(JSON *));
+    U32 i, nthreads;
+    char name[32];
+
+    for (i = 0; i < TREE_RECORDS; ++i)
+        recs[i] = json_get_element(records, i);
+    for (nthreads = 1; nthreads <= 8; nthreads *= 2) {
+        double t = now_ms();
+        json_lines *lines;
+        U32 count = 0;
+
+        json_lines_write("bench.jsonl", recs, TREE_RECORDS, nthreads);
+        snprintf(name, sizeof(name), "lines_write/%u", nthreads);
+        report(name, now_ms() - t, TREE_RECORDS);
+
+        t = now_ms();
+        lines = json_lines_open("bench.jsonl", nthreads);
+        json_lines_read(lines, TRUE, lines_count, &count);
+        json_lines_close(lines);
+        snprintf(name, sizeof(name), "lines_read/%u", nthreads);
+        report(name, now_ms() - t, count);
+    }
+    remove("bench.jsonl");
+    free(recs);
+    json_free(root);
+}
+
+static void bench_parse_parallel(void)
+{
+    JSON *root = make_tree();
+    size_t len;
+    char *text = json_dump(json_get_member(root, "records"), &len);
+    char name[32];
+    U32 nthreads;
+    double t;
+
+    json_free(root);
+    json_free(json_parse(text, len));   //预热分配器
+    t = now_ms();
+    json_free(json_parse(text, len));
+    t = now_ms() - t;
+    printf("%-28s %10.2f ms %10.2f MB/s\n", "parse_serial", t, len / 1048.576 / t);
+    for (nthreads = 1; nthreads <= 32; nthreads *= 2) {
+        JSON *json;
+        t = now_ms();
+        json = json_parse_parallel(text, len, nthreads);
+        t = now_ms() - t;
+        snprintf(name, sizeof(name), "parse_parallel/%u", nthreads);
+        printf("%-28s %10.2f ms %10.2f MB/s\n", name, t, len / 1048.576 / t);
+        json_free(json);
+    }
+    free(text);
+}
+
+static void bench_free_deferred(void)
+{
+    JSON *root = make_tree();
+    double t = now_ms();
+    json_free(root);
+    printf("%-28s %10.2f ms\n", "free_tree", now_ms() - t);
+
+    root = make_tree();
+    t = now_ms();
+    json_free_deferred(root);
+    printf("%-28s %10.4f ms\n", "free_deferred", now_ms() - t);
+    t = now_ms();
+    json_reclaim_drain();
+    printf("%-28s %10.2f ms\n", "reclaim_drain", now_ms() - t);
+}
+
+static void bench_save_parallel(void)
+{
+    JSON *root = make_tree();
+    const JSON *records = json_get_member(root, "records");
+    char name[32];
+    U32 nthreads;
+    double t;
+
+    t = now_ms();
+    json_save(records, "bench.yml");
+    report("save_serial", now_ms() - t, TREE_RECORDS);
+    for (nthreads = 2; nthreads <= 32; nthreads *= 2) {
+        t = now_ms();
+        json_save_parallel(records, "bench.yml", nthreads);
+        snprintf(name, sizeof(name), "save_parallel/%u", nthreads);
+        report(name, now_ms() - t, TREE_RECORDS);
+    }
+    remove("bench.yml");
+    json_free(root);
+}
+
+static void bench_path_query(void)
+{
+    static const char *exprs[] = {
+        "$.records[*].name",
+        "$.records[?(@.ok == true)].id",
+        "$.records[?(@.score >= 25000)].tags[-1]",
+        "$..tags[0]",
+    };
+    JSON *root = make_tree();
+    json_result res = {0};
+    char name[64];
+    size_t i;
+    int pass, n = 0;
+    double t;
+
+    for (i = 0; i < sizeof(exprs) / sizeof(exprs[0]); ++i) {
+        json_path *path = json_path_compile(exprs[i]);
+        t = now_ms();
+        for (pass = 0; pass < BENCH_PASS / 4; ++pass)
+            n = json_path_query(path, root, &res);
+        snprintf(name, sizeof(name), "path_query/%zu", i);
+        report(name, now_ms() - t, (double)TREE_RECORDS * (BENCH_PASS / 4));
+        printf("    %s: %d results\n", exprs[i], n);
+        json_path_free(path);
+    }
+
+    //同样的过滤条件手写循环，作为对照
+    const JSON *records = json_get_member(root, "records");
+    t = now_ms();
+    for (pass = 0; pass < BENCH_PASS / 4; ++pass) {
+        res.count = 0;
+        for (n = 0; n < json_arr_count(records); ++n) {
+            const JSON *rec = json_get_element(records, n);
+            if (json_obj_get_bool(rec, "ok") && res.count < res.cap)
+                res.items[res.count++] = json_get_member(rec, "id");
+        }
+    }
+    report("hand_filter", now_ms() - t, (double)TREE_RECORDS * (BENCH_PASS / 4));
+    json_result_free(&res);
+    json_free(root);
+}
+
+#define MANY_SECTIONS   20      //批量路径用例的配置段数，每段10个键加4个dns
+#define MANY_PATHS      (MANY_SECTIONS * 14)
+
+/**
+ * @brief 从根开始逐段解析路径并查找，作为json_get_many的对照
+ */
+static const JSON *get_one(const JSON *json, const char *path)
+{
+    char key[64];
+    size_t len;
+
+    while (json && *path) {
+        if (*path == '[') {
+            char *end;
+            U32 idx = strtoul(path + 1, &end, 10);
+            json = json_type(json) == JSON_ARR ? json_get_element(json, idx) : NULL;
+            path = end + 1;
+        } else {
+            path += *path == '.';
+            len = strcspn(path, ".[");
+            memcpy(key, path, len);
+            key[len] = '\0';
+            json = json_type(json) == JSON_OBJ ? json_get_member(json, key) : NULL;
+            path += len;
+        }
+    }
+    return json;
+}
+
+static void bench_get_many(void)
+{
+    static char bufs[MANY_PATHS][32];
+    const char *paths[MANY_PATHS];
+    const JSON *out[MANY_PATHS];
+    JSON *root = json_new(JSON_OBJ);
+    json_paths *compiled;
+    char name[32];
+    U32 i, j, n = 0;
+    int loop, found = 0;
+    double t;
+
+    for (i = 0; i < MANY_SECTIONS; ++i) {
+        snprintf(name, sizeof(name), "section%u", i);
+        JSON *sec = json_add_member(root, name, json_new(JSON_OBJ));
+        for (j = 0; j < 10; ++j) {
+            snprintf(bufs[n], sizeof(bufs[n]), "key%u", j);
+            json_obj_set_num(sec, bufs[n], j);
+            snprintf(bufs[n], sizeof(bufs[n]), "section%u.key%u", i, j);
+            paths[n] = bufs[n];
+            n++;
+        }
+        JSON *dns = json_add_member(sec, "dns", json_new(JSON_ARR));
+        for (j = 0; j < 4; ++j) {
+            json_arr_add_str(dns, "200.200.3.254");
+            snprintf(bufs[n], sizeof(bufs[n]), "section%u.dns[%u]", i, j);
+            paths[n] = bufs[n];
+            n++;
+        }
+    }
+
+    t = now_ms();
+    for (loop = 0; loop < DOC_LOOPS / 100; ++loop) {
+        for (i = 0; i < n; ++i)
+            out[i] = get_one(root, paths[i]);
+    }
+    report("get_one_by_one", now_ms() - t, (double)n * (DOC_LOOPS / 100));
+
+    t = now_ms();
+    for (loop = 0; loop < DOC_LOOPS / 100; ++loop)
+        found = json_get_many(root, paths, out, n);
+    report("get_many", now_ms() - t, (double)n * (DOC_LOOPS / 100));
+
+    compiled = json_paths_compile(paths, n);
+    t = now_ms();
+    for (loop = 0; loop < DOC_LOOPS / 100; ++loop)
+        found = json_paths_get(compiled, root, out);
+    report("paths_get_compiled", now_ms() - t, (double)n * (DOC_LOOPS / 100));
+    printf("    %d of %u paths found\n", found, n);
+    json_paths_free(compiled);
+    json_free(root);
+}
+
+static void bench_int_io(void)
+{
+    JSON *ints = json_new(JSON_ARR), *nums = json_new(JSON_ARR);
+    size_t ilen, nlen;
+    char *itext, *ntext;
+    U32 i;
+    double t;
+
+    for (i = 0; i < BENCH_N; ++i) {
+        json_arr_add_int(ints, (long long)i * 7919);
+        json_arr_add_num(nums, i * 7919 + 0.5);
+    }
+    t = now_ms();
+    itext = json_dump(ints, &ilen);
+    report("dump_ints", now_ms() - t, BENCH_N);
+    t = now_ms();
+    ntext = json_dump(nums, &nlen);
+    report("dump_nums", now_ms() - t, BENCH_N);
+    json_free(ints);
+    json_free(nums);
+
+    t = now_ms();
+    ints = json_parse(itext, ilen);
+    report("parse_ints", now_ms() - t, BENCH_N);
+    t = now_ms();
+    nums = json_parse(ntext, nlen);
+    report("parse_nums", now_ms() - t, BENCH_N);
+    free(itext);
+    free(ntext);
+    json_free(ints);
+    json_free(nums);
+}
+
+static void bench_num_text(void)
+{
+    JSON *nums = json_new(JSON_ARR);
+    double *vals = malloc(BENCH_N * sizeof(double)), sum = 0;
+    char buf[32], *text, *p;
+    U64 seed = 88172645463325252ULL;
+    size_t len;
+    U32 i;
+    double t;
+
+    // 有效数字是随机的，大部分需要16、17位才能还原
+    for (i = 0; i < BENCH_N; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        vals[i] = (double)(seed >> 11) / (1 << 20) * (i % 2 ? 1e-6 : 1);
+        json_arr_add_num(nums, vals[i]);
+    }
+    t = now_ms();
+    for (i = 0; i < BENCH_N; ++i)
+        sum += snprintf(buf, sizeof(buf), "%.17g", vals[i]);
+    report("printf_17g", now_ms() - t, BENCH_N);
+    t = now_ms();
+    text = json_dump(nums, &len);
+    report("dump_doubles", now_ms() - t, BENCH_N);
+    json_free(nums);
+
+    t = now_ms();
+    for (p = text + 1; *p; ++p)
+        sum += strtod(p, &p);
+    report("strtod", now_ms() - t, BENCH_N);
+    t = now_ms();
+    nums = json_parse(text, len);
+    report("parse_doubles", now_ms() - t, BENCH_N);
+    if (sum == 0)
+        printf("%s\n", text);
+    free(text);
+    free(vals);
+    json_free(nums);
+}
+
+static void bench_str_text(void)
+{
+    JSON *strs = json_new(JSON_ARR);
+    char buf[64];
+    size_t len;
+    char *text;
+    U32 i;
+    double t;
+
+    // 常见的字符串：ASCII为主，夹杂少量中文，偶尔有需要转义的换行
+    t = now_ms();
+    for (i = 0; i < BENCH_N; ++i) {
+        snprintf(buf, sizeof(buf), "record-%u /var/lib/%s/data%s", i,
+                 i % 8 ? "service" : "服务", i % 64 ? "" : "\n");
+        json_arr_add_str(strs, buf);
+    }
+    report("new_strs", now_ms() - t, BENCH_N);
+    t = now_ms();
+    text = json_dump(strs, &len);
+    report("dump_strs", now_ms() - t, BENCH_N);
+    t = now_ms();
+    json_save(strs, "bench_str.yml");
+    report("save_strs", now_ms() - t, BENCH_N);
+    remove("bench_str.yml");
+    json_free(strs);
+    t = now_ms();
+    strs = json_parse(text, len);
+    report("parse_strs", now_ms() - t, BENCH_N);
+    free(text);
+    json_free(strs);
+}
+
+static void bench_tape(void)
+{
+    JSON *root = make_tree(), *json;
+    json_mem_report mem;
+    json_tape *tape;
+    size_t len;
+    char *text = json_dump(root, &len);
+    double sum = 0, t;
+    U32 records, rec, tags, c;
+    int i;
+
+    json_memory_usage(root, &mem);
+    json_free(root);
+    t = now_ms();
+    json = json_parse(text, len);
+    report("parse_tree", now_ms() - t, TREE_RECORDS * 10.0);
+    t = now_ms();
+    tape = json_tape_parse(text, len);
+    report("parse_tape", now_ms() - t, TREE_RECORDS * 10.0);
+    printf("%-28s %10.2f MB %10.2f MB\n", "tree_vs_tape_memory", mem.total / 1048576.0,
+        json_tape_bytes(tape) / 1048576.0);
+
+    // 按下标取元素要逐个跳过前面的元素，只抽样
+    records = json_tape_get_member(tape, 0, "records");
+    t = now_ms();
+    for (i = 0; i < TREE_RECORDS; i += 100) {
+        rec = json_tape_get_element(tape, records, i);
+        sum += json_tape_num(tape, json_tape_get_member(tape, rec, "score"), 0);
+    }
+    report("tape_get_element", now_ms() - t, TREE_RECORDS / 100);
+    // 顺序遍历才是tape擅长的用法
+    t = now_ms();
+    for (rec = json_tape_first(tape, records); rec != JSON_TAPE_NONE; rec = json_tape_next(tape, rec)) {
+        tags = json_tape_get_member(tape, rec, "tags");
+        sum += json_tape_num(tape, json_tape_get_member(tape, rec, "id"), 0);
+        for (c = json_tape_first(tape, tags); c != JSON_TAPE_NONE; c = json_tape_next(tape, c))
+            sum += json_tape_num(tape, c, 0);
+    }
+    report("tape_walk", now_ms() - t, TREE_RECORDS);
+    t = now_ms();
+    json_free(json);
+    report("free_tree", now_ms() - t, TREE_RECORDS * 10.0);
+    t = now_ms();
+    json_tape_free(tape);
+    report("free_tape", now_ms() - t, TREE_RECORDS * 10.0);
+    sink = sum;
+    free(text);
+}
+
+typedef struct bench_case {
+    const char *name;
+    void (*run)(void);
+} bench_case;
+
+static const bench_case cases[] = {
+    {"build_num_arr", bench_build_num_arr},
+    {"scan_num_arr", bench_scan_num_arr},
+    {"scan_str_arr", bench_scan_str_arr},
+    {"scan_elements", bench_scan_elements},
+    {"get_nums", bench_get_nums},
+    {"add_nums", bench_add_nums},
+    {"free_num_arr", bench_free_num_arr},
+    {"build_tree", bench_build_tree},
+    {"builder", bench_builder},
+    {"merge", bench_merge},
+    {"walk_tree", bench_walk_tree},
+    {"member_ic", bench_member_ic},
+    {"tree_memory", bench_tree_memory},
+    {"gen_parse", bench_gen_parse},
+    {"generic_parse", bench_generic_parse},
+    {"generic_get", bench_generic_get},
+    {"lines", bench_lines},
+    {"parse_parallel", bench_parse_parallel},
+    {"save_parallel", bench_save_parallel},
+    {"free_deferred", bench_free_deferred},
+    {"path_query", bench_path_query},
+    {"get_many", bench_get_many},
+    {"int_io", bench_int_io},
+    {"num_text", bench_num_text},
+    {"str_text", bench_str_text},
+    {"tape", bench_tape},
+};
+
+int main(int argc, char *argv[])
+{
+    size_t i;
+
+    if (load_doc() < 0) {
+        perror("config.json");
+        return 1;
+    }
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        if (argc > 1 && strncmp(cases[i].name, argv[1], strlen(argv[1])) != 0)
+            continue;
+        cases[i].run();
+    }
+    return 0;
+}
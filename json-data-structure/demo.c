@@ -80,9 +80,24 @@ typedef struct config_st {
     int port;
     BOOL enable;
     char *basedn;
-    //TODO: ...
+    int timeout;
+    char *dns[4];
+    U32 dns_count;
 } config_st;
 
+/**
+ * @brief config_st和JSON中basic对象的对应关系
+ */
+static const json_field_desc config_fields[] = {
+    JSON_FIELD_STR(config_st, ip, "ip", NULL),
+    JSON_FIELD_INT(config_st, port, "port", 80),
+    JSON_FIELD_BOL(config_st, enable, "enable", FALSE),
+    JSON_FIELD_STR(config_st, basedn, "basedn", NULL),
+    JSON_FIELD_INT(config_st, timeout, "timeout", 30),
+    JSON_FIELD_ARR(config_st, dns, dns_count, "dns", JSON_BIND_STR, NULL),
+    JSON_FIELD_END
+};
+
 /**
  * @brief 初始化为默认配置
  */
@@ -95,8 +110,7 @@ static void config_init(config_st *cfg)
  */
 static void config_clear(config_st *cfg)
 {
-    free(cfg->ip);
-    free(cfg->basedn);
+    json_bind_free(cfg, config_fields);
     memset(cfg, 0, sizeof(*cfg));
 }
 /**
@@ -107,12 +121,10 @@ static int config_load(config_st *cfg, const JSON *json)
     const JSON *basic = json_get_member(json, "basic");
     if (!basic)
         return -1;
-    const char *ip = json_obj_get_str(basic, "ip", NULL);
-    if (!ip)
+    if (json_bind(cfg, config_fields, basic) < 0)
+        return -1;
+    if (!cfg->ip)
         return -1;
-    cfg->ip = strdup(ip);
-    cfg->port = json_num(json_get_member(basic, "port"), 80);
-    // TODO: ...
     return 0;
 }
 
@@ -1,55 +1,505 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <malloc.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 #include "json.h"
+#include "json_num.h"
+#include "json_str.h"
+#ifdef JSON_STATS
+#include <time.h>
+#endif
 
+typedef struct string string;
+typedef struct bigint bigint;
 typedef struct array array;
 typedef struct object object;
 typedef struct value value;
-typedef struct keyvalue keyvalue;
+typedef struct shapekey shapekey;
+typedef struct shape shape;
 
 /**
  *  想想：这些结构体定义在.c是为什么？
  */
 /**
- *  想想：如果要提升内存分配效率，这个结构体该作什么变化？
+ *  JSON值采用NaN-boxing编码，每个值就是一个64位的字：
+ *  1. 数值直接存放double的位模式，NaN统一规整为0x7FF8000000000000；
+ *  2. 其余类型借用负的quiet NaN区间，高16位是标签，低48位是载荷：
+ *     null、BOOL值的载荷就是值本身，48位以内的整数载荷是其补码；
+ *     超出48位的整数存放在堆分配的bigint中，槽位中的载荷是它的地址；
+ *     字符串、数组、对象的值存放在堆分配的结构体中，载荷是结构体的地址。
+ *  堆分配的结构体以一个TAG_HEAD字开头，因此指向它的JSON *和指向标量字的JSON *
+ *  可以统一通过第一个字判断类型。
+ *  数组元素和对象成员直接存放在连续的value数组中(即槽位)，扫描数组时是顺序访存。
+ *  标量加入容器时内容被移入槽位；字符串、数组和对象加入容器时保持原地址，
+ *  槽位中只放它的地址，因为调用者常常挂到父节点之后还要继续往里添加成员。
+ */
+struct value {
+    U64 w;              //NaN-boxing编码的字
+};
+
+#define BOX_BASE    0xFFF8000000000000ULL   //不小于该值的字不是数值
+#define BOX_NAN     0x7FF8000000000000ULL   //规整后的NaN
+#define BOX_MASK    0x0000FFFFFFFFFFFFULL   //载荷部分
+#define TAG_INT     0xFFF8                  //48位以内的整数，载荷为补码；NaN已规整为正数，不会和它冲突
+#define TAG_NONE    0xFFF9                  //null
+#define TAG_BOOL    0xFFFA                  //BOOL值，载荷为0或1
+#define TAG_BIG     0xFFFB                  //槽位中超出48位的整数，载荷为bigint的地址
+#define TAG_STR     0xFFFC                  //槽位中的字符串，载荷为string的地址
+#define TAG_ARR     0xFFFD                  //槽位中的数组，载荷为array的地址
+#define TAG_OBJ     0xFFFE                  //槽位中的对象，载荷为object的地址
+#define TAG_HEAD    0xFFFF                  //堆分配结构体的首字，载荷低8位为json_e类型，其余为标志位
+#define HEAD_MIXED  (1ULL << 8)             //数组首字标志：含有非数值元素
+#define HEAD_INTS   (1ULL << 9)             //数组首字标志：含有内联的整数，elems不能直接当作double[]
+#define HEAD_FLAGS  (HEAD_MIXED | HEAD_INTS)
+#define BOX(tag, payload)   (((U64)(tag) << 48) | (U64)(payload))
+#define BOX_TAG(w)          ((U32)((w) >> 48))
+#define WORD_NULL           BOX(TAG_NONE, 0)
+#define WORD_HOLE           BOX(TAG_HEAD, JSON_NONE)    //对象中按顺序删除的成员留下的空位
+#define INT_INLINE_MAX      ((1LL << 47) - 1)   //可以直接放进字里的最大整数
+#define INT_INLINE_MIN      (-(1LL << 47))
+
+/**
+ * @brief 字符串
+ */
+struct string {
+    value head;         //BOX(TAG_HEAD, JSON_STR)
+    char *str;          //堆中分配的一个字符串，末尾有'\0'，中间也可以有'\0'
+    size_t len;         //字符串的字节数，不含末尾的'\0'
+};
+
+/**
+ * @brief 超出48位的整数
+ */
+struct bigint {
+    value head;         //BOX(TAG_HEAD, JSON_INT)
+    long long num;
+};
+
+/**
+ * @brief 数组，元素数组按容量倍增的方式扩充
+ * @details
+ *  数值的槽位就是double本身，所以全是数值的数组(首字没有HEAD_MIXED标志)，
+ *  元素都不用逐个释放；其中没有内联整数(也没有HEAD_INTS标志)时，
+ *  elems可以直接当作double[]使用，批量存取时一次memcpy即可。
+ *  一旦加入非数值元素，就打上HEAD_MIXED标志，退回逐个元素处理的方式。
  */
 struct array {
-    value **elems;      /* 想想: 这里如果定义为'value *elems'会怎样？ */
-    U32 count;          //elems中有多少个value*
+    value head;         //BOX(TAG_HEAD, JSON_ARR)，可能带HEAD_MIXED、HEAD_INTS标志
+    value *elems;       //元素数组
+    U32 count;          //elems中有多少个元素
+    U32 cap;            //elems的容量
+#ifndef NDEBUG
+    U32 mods;           //增删元素的次数，迭代器用它发现遍历期间的修改
+#endif
+};
+
+/**
+ * @brief 形状中的一个键名
+ */
+struct shapekey {
+    char *key;          //键名，末尾有'\0'
+    U32 klen;           //键名的字节数，查找时先比较长度
+    U32 hash;           //键名的哈希值，只有共享形状才计算
 };
 
 /**
- * @brief 对象的键值对
+ * @brief 形状：对象的键名序列
+ * @details
+ *  键名序列相同的对象共享同一个形状，对象里只存放值的槽位，不用每个对象各存一份键名。
+ *  共享形状从空形状出发，每追加一个键就沿着转换走到下一个形状，转换记在全局的转换表里，
+ *  所以按相同顺序加入相同键名的对象自然落到同一个形状上。
+ *  共享形状建好后不再修改也不释放，多个线程可以同时读，地址可以放心地缓存下来。
+ *  键名太多或者共享形状的总数到了上限时，对象改用私有形状，由对象独占，原地追加，随对象释放。
  */
-struct keyvalue {
-    char *key;          //键名
-    value *val;         //值
+struct shape {
+    shape *parent;          //少了最后一个键名的共享形状，私有形状为NULL
+    shapekey *keys;         //键名数组，共享形状和父形状共用键名字符串
+    U32 count;              //键名个数
+    U32 cap;                //私有形状keys的容量
+    unsigned char *table;   //共享形状键名较多时的查找表，按哈希值开放寻址，存放下标加1
+    U32 mask;               //table的大小减1
+    BOOL shared;            //是否共享形状
 };
 
 /**
- *  想想：如果要提升内存分配效率，这个结构体该作什么变化？
+ * @brief 对象，值的槽位数组同样按容量倍增的方式扩充，键名在形状里
+ * @details 按顺序删除的成员在vals中留下WORD_HOLE，键名还留在形状里，空位多了再一起去掉
  */
 struct object {
-    keyvalue *kvs;      //这是一个keyvalue的数组，可以通过realloc的方式扩充的动态数组
-    U32 count;          //数组kvs中有几个键值对
+    value head;         //BOX(TAG_HEAD, JSON_OBJ)
+    shape *shape;       //键名序列，vals[i]是键名shape->keys[i]的值
+    value *vals;        //值的槽位数组
+    U32 count;          //vals中有几个值(含空位)，和shape->count相同
+    U32 cap;            //vals的容量
+    U32 holes;          //vals中有几个空位
+#ifndef NDEBUG
+    U32 mods;           //增删成员的次数，迭代器用它发现遍历期间的修改
+#endif
 };
 
+#ifndef NDEBUG
+#define MOD_BUMP(c)     ((c)->mods++)
+#else
+#define MOD_BUMP(c)     ((void)0)
+#endif
+
+static shape shape_empty = {NULL, NULL, 0, 0, NULL, 0, TRUE};  //所有共享形状的起点，新对象的形状
+
+#define SLOTS_MIN   4   //容器首次分配的容量
+
 /**
- * @brief JSON值
+ * @brief 把double编码为字，NaN规整后才不会和标签冲突
  */
-struct value {
-    json_e type;        //JSON值的具体类型
-    union {
-        double num;     //数值，当type==JSON_NUM时有效
-        BOOL bol;       //布尔值，当type==JSON_BOL时有效
-        char *str;      //字符串值，堆中分配的一个字符串，当type==JSON_STR时有效
-        array arr;      //值数组，当type==JSON_ARR时有效
-        object obj;     //对象，当type==JSON_OBJ时有效
-    };
-};
+static inline U64 num_word(double num)
+{
+    U64 w;
+
+    if (num != num)
+        return BOX_NAN;
+    memcpy(&w, &num, sizeof(w));
+    return w;
+}
+
+static inline double word_num(U64 w)
+{
+    double num;
+
+    memcpy(&num, &w, sizeof(num));
+    return num;
+}
+/**
+ * @brief 把48位以内的整数编码为字
+ */
+static inline U64 int_word(long long num)
+{
+    return BOX(TAG_INT, (U64)num & BOX_MASK);
+}
+/**
+ * @brief 从TAG_INT字中取出整数，符号位扩展回64位
+ */
+static inline long long word_int(U64 w)
+{
+    return (long long)((w & BOX_MASK) ^ (1ULL << 47)) - (1LL << 47);
+}
+/**
+ * @brief 获取字w所表示的JSON值的类型，w可以是JSON值的首字，也可以是槽位
+ */
+static inline json_e word_type(U64 w)
+{
+    if (w < BOX_BASE)
+        return JSON_NUM;
+    switch (BOX_TAG(w)) {
+    case TAG_INT:   return JSON_INT;
+    case TAG_BOOL:  return JSON_BOL;
+    case TAG_BIG:   return JSON_INT;
+    case TAG_STR:   return JSON_STR;
+    case TAG_ARR:   return JSON_ARR;
+    case TAG_OBJ:   return JSON_OBJ;
+    case TAG_HEAD:  return (json_e)(w & 0xFF);
+    default:        return JSON_NONE;
+    }
+}
+/**
+ * @brief 获取槽位中存放的JSON值
+ * @param slot 容器的槽位
+ * @return value* 槽位引用堆分配的结构体时返回该结构体，否则就是槽位本身
+ */
+static inline value *slot_value(const value *slot)
+{
+    U32 tag = BOX_TAG(slot->w);
+
+    if (slot->w >= BOX_BASE && tag >= TAG_BIG && tag <= TAG_OBJ)
+        return (value *)(uintptr_t)(slot->w & BOX_MASK);
+    return (value *)slot;
+}
+
+static inline string *as_str(const value *json)
+{
+    assert(json->w == BOX(TAG_HEAD, JSON_STR));
+    return (string *)json;
+}
+
+static inline array *as_arr(const value *json)
+{
+    assert((json->w & ~HEAD_FLAGS) == BOX(TAG_HEAD, JSON_ARR));
+    return (array *)json;
+}
+/**
+ * @brief 数组是否全是数值(double或内联整数)，即元素都不用逐个释放
+ */
+static inline BOOL arr_packed(const array *arr)
+{
+    return !(arr->head.w & HEAD_MIXED);
+}
+/**
+ * @brief 数组是否全是double，即elems可以当作double[]使用
+ */
+static inline BOOL arr_doubles(const array *arr)
+{
+    return !(arr->head.w & HEAD_FLAGS);
+}
+
+static inline object *as_obj(const value *json)
+{
+    assert(json->w == BOX(TAG_HEAD, JSON_OBJ));
+    return (object *)json;
+}
+/**
+ * @brief 整数JSON值的值，json是slot_value的结果
+ */
+static inline long long value_int(const value *json)
+{
+    if (json->w == BOX(TAG_HEAD, JSON_INT))
+        return ((const bigint *)json)->num;
+    return word_int(json->w);
+}
+
+//-----------------------------------------------------------------------------
+//  运行统计
+//-----------------------------------------------------------------------------
+#ifdef JSON_STATS
+/**
+ * @brief 每个线程一份的计数块，计数时只写本线程的块，读取时再汇总
+ */
+typedef struct stats_slot {
+    json_stats st;
+    struct stats_slot *prev;
+    struct stats_slot *next;
+} stats_slot;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static stats_slot *stats_list;          //存活线程的计数块链表
+static json_stats stats_retired;        //已退出线程留下的计数
+static __thread stats_slot *stats_tls;  //本线程的计数块
+
+/**
+ * @brief 把src的计数累加到dst上
+ */
+static void stats_merge(json_stats *dst, const json_stats *src)
+{
+    const U64 *from = (const U64 *)src;
+    U64 *to = (U64 *)dst;
+    size_t i;
+
+    for (i = 0; i < sizeof(json_stats) / sizeof(U64); ++i)
+        to[i] += __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+/**
+ * @brief 线程退出时，把它的计数并入stats_retired，避免丢数
+ */
+static void stats_thread_exit(void *arg)
+{
+    stats_slot *slot = arg;
+
+    pthread_mutex_lock(&stats_lock);
+    stats_merge(&stats_retired, &slot->st);
+    if (slot->prev)
+        slot->prev->next = slot->next;
+    else
+        stats_list = slot->next;
+    if (slot->next)
+        slot->next->prev = slot->prev;
+    pthread_mutex_unlock(&stats_lock);
+    free(slot);
+}
+
+static void stats_init_key(void)
+{
+    pthread_key_create(&stats_key, stats_thread_exit);
+}
+/**
+ * @brief 获取本线程的计数块，首次使用时创建并登记
+ * @return stats_slot* 失败返回NULL，此时本次计数丢弃
+ */
+static stats_slot *stats_local(void)
+{
+    stats_slot *slot = stats_tls;
+
+    if (slot)
+        return slot;
+    pthread_once(&stats_once, stats_init_key);
+    slot = calloc(1, sizeof(*slot));
+    if (!slot)
+        return NULL;
+    pthread_mutex_lock(&stats_lock);
+    slot->next = stats_list;
+    if (stats_list)
+        stats_list->prev = slot;
+    stats_list = slot;
+    pthread_mutex_unlock(&stats_lock);
+    pthread_setspecific(stats_key, slot);
+    stats_tls = slot;
+    return slot;
+}
+/**
+ * @brief 计数加n，计数块只有本线程写，用relaxed读写即可，不需要锁总线
+ */
+static void stats_bump(U64 *cnt, U64 n)
+{
+    __atomic_store_n(cnt, __atomic_load_n(cnt, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static U64 stats_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+/**
+ * @brief 耗时us落在第几个直方图桶
+ */
+static U32 stats_lat_bucket(U64 us)
+{
+    U32 b = 0;
+
+    while (us > 1 && b < JSON_LAT_BUCKETS - 1) {
+        us >>= 1;
+        ++b;
+    }
+    return b;
+}
+
+#define STAT_ADD(field, n)      do {                        \
+        stats_slot *slot_ = stats_local();                  \
+        if (slot_)                                          \
+            stats_bump(&slot_->st.field, (n));              \
+    } while (0)
+#define STAT_ALLOC(type, bytes) STAT_ADD(bytes_alloc[type], (bytes))
+#define STAT_FREE(type, bytes)  STAT_ADD(bytes_freed[type], (bytes))
+#define STAT_TIMER(var)         U64 var = stats_now_us()
+#define STAT_LATENCY(hist, var) STAT_ADD(hist[stats_lat_bucket(stats_now_us() - (var))], 1)
+
+/**
+ * @brief 汇总所有线程的计数
+ * @param stats 输出的统计数据
+ * @return int 0成功，<0失败
+ */
+int json_stats_get(json_stats *stats)
+{
+    const stats_slot *slot;
+
+    if (!stats)
+        return -1;
+    pthread_mutex_lock(&stats_lock);
+    *stats = stats_retired;
+    for (slot = stats_list; slot; slot = slot->next)
+        stats_merge(stats, &slot->st);
+    pthread_mutex_unlock(&stats_lock);
+    return 0;
+}
+/**
+ * @brief 所有计数清零
+ */
+void json_stats_reset(void)
+{
+    stats_slot *slot;
+    U64 *cnt;
+    size_t i;
+
+    pthread_mutex_lock(&stats_lock);
+    memset(&stats_retired, 0, sizeof(stats_retired));
+    for (slot = stats_list; slot; slot = slot->next) {
+        cnt = (U64 *)&slot->st;
+        for (i = 0; i < sizeof(json_stats) / sizeof(U64); ++i)
+            __atomic_store_n(&cnt[i], 0, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+/**
+ * @brief 以文本形式输出统计数据
+ * @param fp 输出文件，如stderr
+ */
+void json_stats_dump(FILE *fp)
+{
+    static const char *names[JSON_TYPE_COUNT] = {"none", "bool", "num", "str", "arr", "obj", "int"};
+    json_stats st;
+    U32 i;
+
+    if (!fp || json_stats_get(&st) < 0)
+        return;
+    fprintf(fp, "%-6s %12s %12s %14s %14s\n", "type", "alloc", "freed", "bytes_alloc", "bytes_freed");
+    for (i = 0; i < JSON_TYPE_COUNT; ++i) {
+        fprintf(fp, "%-6s %12llu %12llu %14llu %14llu\n", names[i], st.nodes_alloc[i],
+            st.nodes_freed[i], st.bytes_alloc[i], st.bytes_freed[i]);
+    }
+    fprintf(fp, "member_reallocs: %llu\n", st.member_reallocs);
+    fprintf(fp, "element_reallocs: %llu\n", st.element_reallocs);
+    fprintf(fp, "member_cmps: %llu\n", st.member_cmps);
+    fprintf(fp, "save_bytes: %llu\n", st.save_bytes);
+    for (i = 0; i < JSON_LAT_BUCKETS; ++i) {
+        if (st.save_lat[i] || st.load_lat[i])
+            fprintf(fp, "latency <%lluus: save %llu, load %llu\n", 2ULL << i, st.save_lat[i], st.load_lat[i]);
+    }
+}
+#else
+#define STAT_ADD(field, n)      ((void)0)
+#define STAT_ALLOC(type, bytes) ((void)0)
+#define STAT_FREE(type, bytes)  ((void)0)
+#define STAT_TIMER(var)         
+#define STAT_LATENCY(hist, var) ((void)0)
+
+int json_stats_get(json_stats *stats)
+{
+    return -1;
+}
+
+void json_stats_reset(void)
+{
+}
 
+void json_stats_dump(FILE *fp)
+{
+}
+#endif //JSON_STATS
+
+/**
+ * @brief type类型的JSON值单独分配时结构体的大小
+ */
+static size_t node_size(json_e type)
+{
+    switch (type) {
+    case JSON_STR:  return sizeof(string);
+    case JSON_ARR:  return sizeof(array);
+    case JSON_OBJ:  return sizeof(object);
+    default:        return sizeof(value);
+    }
+}
+/**
+ * @brief 单独分配的JSON值json实际占用的结构体大小，和node_size的区别在于超出48位的整数
+ */
+static size_t value_size(const value *json)
+{
+    if (json->w == BOX(TAG_HEAD, JSON_INT))
+        return sizeof(bigint);
+    return node_size(word_type(json->w));
+}
+/**
+ * @brief type类型JSON值的缺省编码，堆分配的类型为其首字
+ */
+static U64 default_word(json_e type)
+{
+    switch (type) {
+    case JSON_NUM:  return num_word(0);
+    case JSON_INT:  return int_word(0);
+    case JSON_BOL:  return BOX(TAG_BOOL, FALSE);
+    case JSON_STR: case JSON_ARR: case JSON_OBJ:
+        return BOX(TAG_HEAD, type);
+    default:        return WORD_NULL;
+    }
+}
 /**
  *  @brief 新建一个type类型的JSON值，采用缺省值初始化
  *  
@@ -65,352 +515,5804 @@ struct value {
  */
 JSON *json_new(json_e type)
 {
-    JSON *json = (JSON *)calloc(1, sizeof(JSON));
+    JSON *json = (JSON *)calloc(1, node_size(type));
     if (!json) {
         //想想：为什么输出到stderr，不用printf输出到stdout？
-        fprintf(stderr, "json_new: calloc(%lu) failed\n", sizeof(JSON));
+        fprintf(stderr, "json_new: calloc(%lu) failed\n", node_size(type));
         return NULL;
     }
-    json->type = type;
+    json->w = default_word(type);
+    if (type == JSON_OBJ)
+        as_obj(json)->shape = &shape_empty;
+    STAT_ADD(nodes_alloc[type], 1);
+    STAT_ALLOC(type, node_size(type));
     return json;
 }
+static void shape_release(shape *s);
 /**
- * 释放一个JSON值
- * @param json json值
- * @details
- * 该JSON值可能含子成员，也要一起释放
+ * @brief 释放JSON值中的内容(含子成员)，但不释放JSON值本身
+ * @param val JSON值或容器的槽位，槽位引用的结构体会一起释放
  */
-void json_free(JSON *json) {
-    if (!json) return;  // 安全检查
+static void value_clear(value *val)
+{
+    json_e type = word_type(val->w);
 
-    switch (json->type) {
-        case JSON_STR:
-            free(json->str);  // 释放字符串内存
+    if (slot_value(val) != val) {
+        json_free(slot_value(val));  // 槽位引用的是堆分配的结构体
+        return;
+    }
+    switch (type) {
+        case JSON_STR: {
+            string *str = as_str(val);
+            if (str->str)
+                STAT_FREE(JSON_STR, str->len + 1);
+            free(str->str);  // 释放字符串内存
             break;
-
-        case JSON_ARR:
-            // 递归释放数组所有元素
-            for (size_t i = 0; i < json->arr.count; i++) {
-                json_free(json->arr.elems[i]);
+        }
+        case JSON_ARR: {
+            array *arr = as_arr(val);
+            // 递归释放数组所有元素，全是数值时元素不需要释放
+            if (arr_doubles(arr)) {
+                STAT_ADD(nodes_freed[JSON_NUM], arr->count);
+            } else if (arr_packed(arr)) {
+#ifdef JSON_STATS
+                for (size_t i = 0; i < arr->count; i++)
+                    STAT_ADD(nodes_freed[word_type(arr->elems[i].w)], 1);
+#endif
+            } else {
+                for (size_t i = 0; i < arr->count; i++) {
+                    value_clear(&arr->elems[i]);
+                }
             }
-            free(json->arr.elems);  // 释放元素指针数组
+            STAT_FREE(JSON_ARR, arr->cap * sizeof(value));
+            free(arr->elems);  // 释放元素数组
             break;
-
-        case JSON_OBJ:
-            // 递归释放对象所有键值对
-            for (size_t i = 0; i < json->obj.count; i++) {
-                free(json->obj.kvs[i].key);    // 释放键字符串
-                json_free(json->obj.kvs[i].val); // 释放值
+        }
+        case JSON_OBJ: {
+            object *obj = as_obj(val);
+            // 递归释放对象所有成员的值，键名在形状里
+            for (size_t i = 0; i < obj->count; i++) {
+                if (obj->vals[i].w != WORD_HOLE)
+                    value_clear(&obj->vals[i]);
             }
-            free(json->obj.kvs);  // 释放键值对数组
+            STAT_FREE(JSON_OBJ, obj->cap * sizeof(value));
+            free(obj->vals);  // 释放值的槽位数组
+            shape_release(obj->shape);  // 私有形状随对象释放
             break;
-
+        }
         case JSON_NUM:
+        case JSON_INT:
         case JSON_BOL:
         case JSON_NONE:
             // 基础类型无需额外释放
             break;
     }
+    STAT_ADD(nodes_freed[type], 1);
+}
+/**
+ * 释放一个JSON值
+ * @param json json值
+ * @details
+ * 该JSON值可能含子成员，也要一起释放
+ */
+void json_free(JSON *json) {
+    if (!json) return;  // 安全检查
 
+    STAT_FREE(word_type(json->w), value_size(json));
+    value_clear(json);
     free(json);  // 最后释放JSON结构体本身
 }
+
+//-----------------------------------------------------------------------------
+//  后台延迟释放
+//-----------------------------------------------------------------------------
+#define RECLAIM_BATCH   4096    //回收线程每释放这么多节点让出一次CPU
+
 /**
- * 获取JSON值json的类型
- * @param json json值
- * @return json的实际类型
+ * @brief 一棵待释放的树
  */
-json_e json_type(const JSON *json)
+typedef struct reclaim_item {
+    JSON *json;
+    struct reclaim_item *next;
+} reclaim_item;
+
+/**
+ * @brief 释放进行到一半的容器，前next个子成员已经释放
+ */
+typedef struct reclaim_frame {
+    value *node;
+    U32 next;
+} reclaim_frame;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t pending;     //有新的待释放树
+    pthread_cond_t idle;        //队列已清空且回收线程空闲
+    reclaim_item *head;         //待释放的树，先进先出
+    reclaim_item *tail;
+    BOOL started;               //回收线程是否已启动
+    BOOL busy;                  //回收线程正在释放一棵树
+} reclaim = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/**
+ * @brief 容器是否还有需要逐个释放的子成员
+ */
+static BOOL reclaim_deep(const value *node)
 {
-    assert(json);
-    return json ? json->type : JSON_NONE;
+    json_e type = word_type(node->w);
+
+    if (type == JSON_ARR)
+        return as_arr(node)->count && !arr_packed(as_arr(node));
+    return type == JSON_OBJ && as_obj(node)->count;
 }
+
 /**
- * 新建一个BOOL类型的JSON值
- * @param val 新建JSON的初值
- * @return JSON* JSON值，失败返回NULL
+ * @brief 非递归地释放整棵树，每释放RECLAIM_BATCH个节点让出一次CPU
+ * @details 用显式栈记录释放到一半的容器，栈深度等于树的深度；子成员释放完后把容器的
+ * count置0，再由json_free释放容器本身，统计口径和json_free完全一致
+ */
+static void reclaim_tree(JSON *json)
+{
+    reclaim_frame *stack = NULL, *top;
+    U32 depth = 0, cap = 0, done = 0;
+
+    if (!reclaim_deep(json)) {
+        json_free(json);
+        return;
+    }
+    stack = malloc(sizeof(*stack) * 16);
+    if (!stack) {
+        json_free(json);
+        return;
+    }
+    cap = 16;
+    stack[depth++] = (reclaim_frame){json, 0};
+    while (depth) {
+        value *slot, *child;
+
+        top = &stack[depth - 1];
+        if (word_type(top->node->w) == JSON_ARR) {
+            array *arr = as_arr(top->node);
+            if (top->next == arr->count) {
+                arr->count = 0;
+                json_free(top->node);
+                --depth;
+                continue;
+            }
+            slot = &arr->elems[top->next++];
+        } else {
+            object *obj = as_obj(top->node);
+            if (top->next == obj->count) {
+                obj->count = 0;
+                json_free(top->node);
+                --depth;
+                continue;
+            }
+            slot = &obj->vals[top->next++];
+            if (slot->w == WORD_HOLE)
+                continue;
+        }
+
+        child = slot_value(slot);
+        if (child == slot) {
+            value_clear(slot);      //槽位中的标量
+        } else if (!reclaim_deep(child)) {
+            json_free(child);
+        } else {
+            if (depth == cap) {
+                reclaim_frame *grown = realloc(stack, sizeof(*stack) * cap * 2);
+                if (!grown) {
+                    json_free(child);   //栈扩不了就在当前线程递归释放这棵子树
+                    continue;
+                }
+                stack = grown;
+                cap *= 2;
+            }
+            stack[depth++] = (reclaim_frame){child, 0};
+        }
+        if (++done % RECLAIM_BATCH == 0)
+            sched_yield();
+    }
+    free(stack);
+}
+
+static void *reclaim_worker(void *arg)
+{
+    reclaim_item *item;
+
+    (void)arg;
+    pthread_mutex_lock(&reclaim.lock);
+    for (;;) {
+        while (!reclaim.head) {
+            reclaim.busy = FALSE;
+            pthread_cond_broadcast(&reclaim.idle);
+            pthread_cond_wait(&reclaim.pending, &reclaim.lock);
+        }
+        item = reclaim.head;
+        reclaim.head = item->next;
+        if (!reclaim.head)
+            reclaim.tail = NULL;
+        reclaim.busy = TRUE;
+        pthread_mutex_unlock(&reclaim.lock);
+
+        reclaim_tree(item->json);
+        free(item);
+
+        pthread_mutex_lock(&reclaim.lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 把json交给后台回收线程释放，立即返回
+ * @param json 顶层JSON值，调用后不能再访问
+ * @details 回收线程在第一次调用时启动；启动失败或内存不足时在当前线程直接释放
+ */
+void json_free_deferred(JSON *json)
+{
+    reclaim_item *item;
+    pthread_t tid;
+
+    if (!json) return;
+
+    item = malloc(sizeof(*item));
+    if (!item) {
+        json_free(json);
+        return;
+    }
+    item->json = json;
+    item->next = NULL;
+
+    pthread_mutex_lock(&reclaim.lock);
+    if (!reclaim.started) {
+        if (pthread_create(&tid, NULL, reclaim_worker, NULL) != 0) {
+            pthread_mutex_unlock(&reclaim.lock);
+            free(item);
+            json_free(json);
+            return;
+        }
+        pthread_detach(tid);
+        reclaim.started = TRUE;
+    }
+    if (reclaim.tail)
+        reclaim.tail->next = item;
+    else
+        reclaim.head = item;
+    reclaim.tail = item;
+    pthread_cond_signal(&reclaim.pending);
+    pthread_mutex_unlock(&reclaim.lock);
+}
+
+/**
+ * @brief 等待回收线程把已交给它的树全部释放完
+ */
+void json_reclaim_drain(void)
+{
+    pthread_mutex_lock(&reclaim.lock);
+    while (reclaim.head || reclaim.busy)
+        pthread_cond_wait(&reclaim.idle, &reclaim.lock);
+    pthread_mutex_unlock(&reclaim.lock);
+}
+/**
+ * @brief 把堆分配的JSON值val移入槽位slot，转移所有权
+ * @return value* 移入后的JSON值
+ * @details 标量的字拷贝进槽位后释放val；字符串、数组、对象和bigint保持原地址，槽位中存放其地址
+ */
+static value *slot_move_in(value *slot, value *val)
+{
+    static const U32 tags[JSON_TYPE_COUNT] = {
+        [JSON_STR] = TAG_STR, [JSON_ARR] = TAG_ARR, [JSON_OBJ] = TAG_OBJ, [JSON_INT] = TAG_BIG,
+    };
+    json_e type = word_type(val->w);
+
+    if (BOX_TAG(val->w) == TAG_HEAD) {
+        slot->w = BOX(tags[type], (uintptr_t)val);
+        return val;
+    }
+    slot->w = val->w;
+    STAT_FREE(type, sizeof(value));
+    free(val);
+    return slot;
+}
+/**
+ * @brief 把新追加的槽位初始化为标量w
+ * @return value* 槽位本身
+ */
+static value *slot_init(value *slot, U64 w)
+{
+    slot->w = w;
+    STAT_ADD(nodes_alloc[word_type(w)], 1);
+    return slot;
+}
+/**
+ * @brief 把槽位数组的容量调整为new_cap
+ * @param items 槽位数组
+ * @param cap 槽位数组的容量
+ * @param new_cap 新的容量
+ * @param size 每个槽位的字节数
+ * @param type 容器类型，用于统计
+ * @return int 0成功，<0失败
+ */
+static int slots_resize(void **items, U32 *cap, U32 new_cap, size_t size, json_e type)
+{
+    void *new_items = realloc(*items, (size_t)new_cap * size);
+
+    if (!new_items) {
+        fprintf(stderr, "slots_resize: realloc(%lu) failed\n", (size_t)new_cap * size);
+        return -1;
+    }
+    if (type == JSON_OBJ)
+        STAT_ADD(member_reallocs, 1);
+    else
+        STAT_ADD(element_reallocs, 1);
+    STAT_FREE(type, *cap * size);
+    STAT_ALLOC(type, new_cap * size);
+    *items = new_items;
+    *cap = new_cap;
+    return 0;
+}
+/**
+ * @brief 确保槽位数组至少能容纳need个元素，容量不足时倍增
+ * @return int 0成功，<0失败
+ */
+static int slots_reserve(void **items, U32 *cap, U32 need, size_t size, json_e type)
+{
+    U32 new_cap;
+
+    if (need <= *cap)
+        return 0;
+    new_cap = *cap ? *cap : SLOTS_MIN;
+    while (new_cap < need)
+        new_cap *= 2;
+    return slots_resize(items, cap, new_cap, size, type);
+}
+/**
+ * @brief 在数组末尾追加一个槽位
+ * @return value* 新槽位，已初始化为null，失败返回NULL
+ */
+static value *arr_push(JSON *json)
+{
+    array *arr = as_arr(json);
+    value *slot;
+
+    if (slots_reserve((void **)&arr->elems, &arr->cap, arr->count + 1,
+                      sizeof(value), JSON_ARR) < 0)
+        return NULL;
+    slot = &arr->elems[arr->count++];
+    slot->w = WORD_NULL;
+    MOD_BUMP(arr);
+    return slot;
+}
+/**
+ * @brief 数组中写入了元素w，w是内联整数时记下HEAD_INTS，不是数值时数组退出全数值模式
+ */
+static inline void arr_note(array *arr, U64 w)
+{
+    if (w >= BOX_BASE)
+        arr->head.w |= BOX_TAG(w) == TAG_INT ? HEAD_INTS : HEAD_MIXED;
+}
+//-----------------------------------------------------------------------------
+//  对象形状
+//-----------------------------------------------------------------------------
+#define SHAPE_KEYS_MAX      32          //共享形状最多几个键名，更多时对象改用私有形状
+#define SHAPE_LINEAR_MAX    8           //键名不超过这么多时顺序比较，更多时建查找表
+#define SHAPE_TABLE_SIZE    32768       //转换表的槽数，2的幂
+#define SHAPE_LIMIT         (SHAPE_TABLE_SIZE / 2)  //共享形状总数的上限，转换表最多用一半
+#define SHAPE_NONE          0xFFFFFFFFu //shape_find找不到
+#define IC_MISSING          0xFFFF      //调用点缓存中的下标：该形状没有这个键名
+
+
+/**
+ * @brief 转换表：共享形状加上一个键名变成哪个共享形状
+ * @details 按(父形状, 键名)开放寻址，只增不删也不扩容，查找不加锁，新建时加锁
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_once_t once;
+    shape **table;      //SHAPE_TABLE_SIZE个槽，新形状填好后才发布到槽里
+    U32 count;          //已有几个共享形状
+} shapes = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_ONCE_INIT, NULL, 0};
+
+/**
+ * @brief 键名的FNV-1a哈希值，和bind_hash相同，只算前len个字节
+ */
+static U32 key_hash(const char *key, size_t len)
+{
+    U32 h = 2166136261u;
+
+    while (len--)
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h;
+}
+
+static void shapes_init(void)
+{
+    // 分配失败时table为NULL，所有对象都用私有形状
+    shapes.table = calloc(SHAPE_TABLE_SIZE, sizeof(shape *));
+}
+/**
+ * @brief 转换(from, 键名)在转换表中的起始槽位
+ */
+static inline U32 shapes_slot(const shape *from, U32 hash)
+{
+    return ((U32)(((U64)(uintptr_t)from * 0x9E3779B97F4A7C15ULL) >> 40) ^ hash) & (SHAPE_TABLE_SIZE - 1);
+}
+/**
+ * @brief s是不是from加上键名[key, key + len)得到的形状
+ */
+static inline BOOL shape_is_next(const shape *s, const shape *from, U32 hash, const char *key, size_t len)
+{
+    const shapekey *last = &s->keys[s->count - 1];
+    return s->parent == from && last->hash == hash && last->klen == len && memcmp(last->key, key, len) == 0;
+}
+/**
+ * @brief 新建共享形状：from加上键名[key, key + len)
+ * @return shape* 新形状，失败返回NULL
+ * @details 键名数组复制from的，键名字符串直接共用；共享形状不属于任何一棵树，不计入运行统计
+ */
+static shape *shape_new_next(const shape *from, const char *key, size_t len, U32 hash)
+{
+    shape *s = calloc(1, sizeof(shape));
+    shapekey *keys = malloc((from->count + 1) * sizeof(shapekey));
+    char *copy = malloc(len + 1);
+    U32 size = 16, i, h;
+
+    if (!s || !keys || !copy)
+        goto failed_;
+    if (from->count)
+        memcpy(keys, from->keys, from->count * sizeof(shapekey));
+    memcpy(copy, key, len);
+    copy[len] = '\0';
+    keys[from->count] = (shapekey){copy, (U32)len, hash};
+    s->parent = (shape *)from;
+    s->keys = keys;
+    s->count = from->count + 1;
+    s->shared = TRUE;
+    if (s->count > SHAPE_LINEAR_MAX) {
+        while (size < s->count * 2)
+            size *= 2;
+        s->table = calloc(size, 1);
+        if (!s->table)
+            goto failed_;
+        s->mask = size - 1;
+        // 按顺序插入，重复的键名先出现的在探测序列的前面
+        for (i = 0; i < s->count; ++i) {
+            for (h = keys[i].hash & s->mask; s->table[h]; h = (h + 1) & s->mask)
+                ;
+            s->table[h] = (unsigned char)(i + 1);
+        }
+    }
+    return s;
+failed_:
+    fprintf(stderr, "shape_new_next: out of memory\n");
+    free(s);
+    free(keys);
+    free(copy);
+    return NULL;
+}
+/**
+ * @brief 共享形状from加上键名[key, key + len)，得到的共享形状
+ * @return shape* 共享形状，键名太多、共享形状太多或者内存不足时返回NULL，由调用者改用私有形状
+ * @details 先不加锁查转换表，多数时候都能找到；找不到再加锁新建
+ */
+static shape *shape_next(shape *from, const char *key, size_t len)
+{
+    U32 hash, i;
+    shape *s;
+
+    if (from->count >= SHAPE_KEYS_MAX)
+        return NULL;
+    pthread_once(&shapes.once, shapes_init);
+    if (!shapes.table)
+        return NULL;
+    hash = key_hash(key, len);
+    for (i = shapes_slot(from, hash); (s = __atomic_load_n(&shapes.table[i], __ATOMIC_ACQUIRE)) != NULL;
+         i = (i + 1) & (SHAPE_TABLE_SIZE - 1)) {
+        if (shape_is_next(s, from, hash, key, len))
+            return s;
+    }
+    if (__atomic_load_n(&shapes.count, __ATOMIC_RELAXED) >= SHAPE_LIMIT)
+        return NULL;
+    pthread_mutex_lock(&shapes.lock);
+    // 等锁期间别的线程可能已经建好了，从刚才停下的空槽接着找
+    for (; (s = shapes.table[i]) != NULL; i = (i + 1) & (SHAPE_TABLE_SIZE - 1)) {
+        if (shape_is_next(s, from, hash, key, len))
+            break;
+    }
+    if (!s && shapes.count < SHAPE_LIMIT && (s = shape_new_next(from, key, len, hash)) != NULL) {
+        __atomic_store_n(&shapes.table[i], s, __ATOMIC_RELEASE);
+        __atomic_store_n(&shapes.count, shapes.count + 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&shapes.lock);
+    return s;
+}
+/**
+ * @brief 在私有形状末尾追加键名[key, key + len)，键名复制一份
+ * @return int 0成功，<0失败
+ */
+static int shape_append(shape *s, const char *key, size_t len)
+{
+    char *copy;
+
+    if (slots_reserve((void **)&s->keys, &s->cap, s->count + 1, sizeof(shapekey), JSON_OBJ) < 0)
+        return -1;
+    copy = malloc(len + 1);
+    if (!copy)
+        return -1;
+    memcpy(copy, key, len);
+    copy[len] = '\0';
+    STAT_ALLOC(JSON_OBJ, len + 1);
+    s->keys[s->count++] = (shapekey){copy, (U32)len, 0};
+    return 0;
+}
+/**
+ * @brief 释放私有形状，共享形状什么也不做
+ */
+static void shape_release(shape *s)
+{
+    U32 i;
+
+    if (s->shared)
+        return;
+    for (i = 0; i < s->count; ++i) {
+        STAT_FREE(JSON_OBJ, s->keys[i].klen + 1);
+        free(s->keys[i].key);
+    }
+    STAT_FREE(JSON_OBJ, s->cap * sizeof(shapekey) + sizeof(shape));
+    free(s->keys);
+    free(s);
+}
+/**
+ * @brief 让对象独占一个私有形状，之后可以原地修改键名
+ * @param cap 私有形状至少预留的键名个数
+ * @return int 0成功，<0失败，失败时对象不变
+ */
+static int obj_unshare(object *obj, U32 cap)
+{
+    shape *from = obj->shape, *s;
+    U32 i;
+
+    if (!from->shared)
+        return 0;
+    s = calloc(1, sizeof(shape));
+    if (!s)
+        return -1;
+    STAT_ALLOC(JSON_OBJ, sizeof(shape));
+    if (slots_reserve((void **)&s->keys, &s->cap, cap > from->count ? cap : from->count,
+                      sizeof(shapekey), JSON_OBJ) < 0)
+        goto failed_;
+    for (i = 0; i < from->count; ++i) {
+        if (shape_append(s, from->keys[i].key, from->keys[i].klen) < 0)
+            goto failed_;
+    }
+    obj->shape = s;
+    return 0;
+failed_:
+    shape_release(s);
+    return -1;
+}
+/**
+ * @brief 在对象的形状末尾加上键名[key, key + len)，不动值的槽位
+ * @return int 0成功，<0失败
+ * @details 共享形状沿转换走到下一个共享形状，走不通时改用私有形状
+ */
+static int obj_add_key(object *obj, const char *key, size_t len)
+{
+    shape *next;
+
+    if (obj->shape->shared && (next = shape_next(obj->shape, key, len)) != NULL) {
+        obj->shape = next;
+        return 0;
+    }
+    if (obj_unshare(obj, obj->cap) < 0)
+        return -1;
+    return shape_append(obj->shape, key, len);
+}
+/**
+ * @brief 在对象末尾追加一个键名为[key, key + len)的成员，不检查key是否已存在
+ * @return value* 新成员的值槽位，已初始化为null，失败返回NULL
+ */
+static value *obj_pushn(JSON *json, const char *key, size_t len)
+{
+    object *obj = as_obj(json);
+    value *slot;
+
+    if (len > UINT32_MAX || slots_reserve((void **)&obj->vals, &obj->cap, obj->count + 1,
+                                          sizeof(value), JSON_OBJ) < 0
+        || obj_add_key(obj, key, len) < 0)
+        return NULL;
+    slot = &obj->vals[obj->count++];
+    slot->w = WORD_NULL;
+    MOD_BUMP(obj);
+    return slot;
+}
+/**
+ * @brief 在对象末尾追加一个键名为key的成员，不检查key是否已存在
+ * @return value* 新成员的值槽位，已初始化为null，失败返回NULL
+ */
+static value *obj_push(JSON *json, const char *key)
+{
+    return obj_pushn(json, key, strlen(key));
+}
+/**
+ * @brief 在形状中查找键名[key, key + len)
+ * @return U32 先出现的那个键名的下标，找不到返回SHAPE_NONE
+ */
+static U32 shape_find(const shape *s, const char *key, size_t len)
+{
+    U32 i, h;
+
+    if (s->table) {
+        for (h = key_hash(key, len) & s->mask; (i = s->table[h]) != 0; h = (h + 1) & s->mask) {
+            STAT_ADD(member_cmps, 1);
+            if (s->keys[i - 1].klen == len && memcmp(s->keys[i - 1].key, key, len) == 0)
+                return i - 1;
+        }
+        return SHAPE_NONE;
+    }
+    for (i = 0; i < s->count; ++i) {
+        STAT_ADD(member_cmps, 1);
+        if (s->keys[i].klen == len && memcmp(s->keys[i].key, key, len) == 0)
+            return i;
+    }
+    return SHAPE_NONE;
+}
+/**
+ * @brief 在对象中查找键名为[key, key + len)的成员
+ * @return value* 先出现的那个成员的值槽位，找不到返回NULL
+ */
+static value *obj_find(const object *obj, const char *key, size_t len)
+{
+    U32 i = shape_find(obj->shape, key, len);
+    const shapekey *k;
+
+    if (i == SHAPE_NONE || obj->vals[i].w != WORD_HOLE)
+        return i == SHAPE_NONE ? NULL : &obj->vals[i];
+    // 先出现的那个已经删除了，往后找还在的同名成员
+    for (++i; i < obj->count; ++i) {
+        k = &obj->shape->keys[i];
+        if (obj->vals[i].w != WORD_HOLE && k->klen == len && memcmp(k->key, key, len) == 0)
+            return &obj->vals[i];
+    }
+    return NULL;
+}
+/**
+ * @brief 去掉对象中的空位，其余成员保持原来的顺序
+ * @return int 0成功，<0失败(内存不足)，失败时对象不变
+ */
+static int obj_compact(object *obj)
+{
+    shape *from = obj->shape, *s = from;
+    object tmp = {{BOX(TAG_HEAD, JSON_OBJ)}, &shape_empty, NULL, 0, obj->cap, 0};
+    U32 i, n = 0;
+
+    if (from->shared) {
+        // 共享形状不能修改，用留下的键名重新走一遍转换，键名和顺序相同的对象仍然共享形状
+        for (i = 0; i < obj->count; ++i) {
+            if (obj->vals[i].w != WORD_HOLE
+                && obj_add_key(&tmp, from->keys[i].key, from->keys[i].klen) < 0) {
+                shape_release(tmp.shape);
+                return -1;
+            }
+        }
+        s = tmp.shape;
+    }
+    // 读写两个游标原地挪动，私有形状的键名跟着挪，空位的键名释放
+    for (i = 0; i < obj->count; ++i) {
+        if (obj->vals[i].w == WORD_HOLE) {
+            if (!from->shared) {
+                STAT_FREE(JSON_OBJ, from->keys[i].klen + 1);
+                free(from->keys[i].key);
+            }
+            continue;
+        }
+        if (!from->shared)
+            from->keys[n] = from->keys[i];
+        obj->vals[n++] = obj->vals[i];
+    }
+    if (!from->shared)
+        from->count = n;
+    obj->shape = s;
+    obj->count = n;
+    obj->holes = 0;
+    return 0;
+}
+/**
+ * @brief 删除对象的第i个成员，值的槽位由调用者先取走
+ * @param ordered 是否保持其余成员的顺序
+ * @details
+ *  保持顺序时只把槽位标成空位，形状不变；空位超过一半时一起去掉，均摊O(1)。
+ *  不保持顺序时私有形状把最后一个槽位(可能是空位)挪到第i位，原地挪键名，O(1)；
+ *  共享形状同样只留下空位，不为换过顺序的键名登记新的共享形状
+ */
+static void obj_remove(object *obj, U32 i, BOOL ordered)
+{
+    shape *s = obj->shape;
+    U32 last = obj->count - 1;
+
+    MOD_BUMP(obj);
+    if (ordered || s->shared) {
+        obj->vals[i].w = WORD_HOLE;
+        obj->holes++;
+    } else {
+        STAT_FREE(JSON_OBJ, s->keys[i].klen + 1);
+        free(s->keys[i].key);
+        s->keys[i] = s->keys[last];
+        s->count--;
+        obj->vals[i] = obj->vals[last];
+        obj->count--;
+    }
+    if (obj->holes * 2 > obj->count)
+        obj_compact(obj);   // 失败时空位先留着，不影响使用
+}
+//-----------------------------------------------------------------------------
+//  内存占用统计
+//-----------------------------------------------------------------------------
+#define MALLOC_HEADER   sizeof(size_t)  //glibc每个堆块前面的块头大小
+
+/**
+ * @brief 统计一个堆块的实际占用
+ * @param ptr 堆块
+ * @param used 调用者实际用到的字节数
+ * @param report 占用报告，块头和用不到的部分计入overhead
+ * @return U64 堆块实际占用的字节数
+ */
+static U64 mem_block(const void *ptr, U64 used, json_mem_report *report)
+{
+    U64 size;
+
+    if (!ptr)
+        return 0;
+    size = malloc_usable_size((void *)ptr) + MALLOC_HEADER;
+    report->overhead += size - used;
+    return size;
+}
+/**
+ * @brief 把子树记入最重子树排行，排行按bytes从大到小有序
+ */
+static void mem_rank(json_mem_report *report, const JSON *json, U64 nodes, U64 bytes)
+{
+    U32 i;
+
+    if (report->top_count == JSON_MEM_TOPN && report->top[JSON_MEM_TOPN - 1].bytes >= bytes)
+        return;
+    if (report->top_count < JSON_MEM_TOPN)
+        ++report->top_count;
+    for (i = report->top_count - 1; i > 0 && report->top[i - 1].bytes < bytes; --i)
+        report->top[i] = report->top[i - 1];
+    report->top[i] = (json_mem_top){ .node = json, .nodes = nodes, .bytes = bytes };
+}
+/**
+ * @brief 递归统计json的内存占用
+ * @param json JSON值或容器的槽位
+ * @param report 占用报告
+ * @param nodes 输出子树中JSON值的个数
+ * @return U64 子树占用的总字节数，不含槽位本身(槽位算在父容器中)
+ */
+static U64 mem_walk(const value *json, json_mem_report *report, U64 *nodes)
+{
+    U64 bytes = 0, used, sub_nodes, sub_bytes;
+    const value *child;
+    json_e type = word_type(json->w);
+    U32 i;
+
+    if (slot_value(json) != json) {
+        json = slot_value(json);
+        report->node_bytes += value_size(json);
+        bytes = mem_block(json, value_size(json), report);
+    }
+    *nodes = 1;
+    ++report->nodes;
+
+    switch (type) {
+    case JSON_STR: {
+        const string *str = as_str(json);
+        if (str->str) {
+            used = str->len + 1;
+            report->str_bytes += used;
+            bytes += mem_block(str->str, used, report);
+        }
+        break;
+    }
+    case JSON_ARR: {
+        const array *arr = as_arr(json);
+        ++report->containers;
+        used = arr->count * sizeof(value);
+        report->slots_used += arr->count;
+        report->slots_cap += arr->elems ? malloc_usable_size(arr->elems) / sizeof(value) : 0;
+        report->slot_bytes += used;
+        bytes += mem_block(arr->elems, used, report);
+        if (arr_packed(arr)) {
+            report->nodes += arr->count;
+            *nodes += arr->count;
+            break;
+        }
+        for (i = 0; i < arr->count; ++i) {
+            sub_bytes = mem_walk(&arr->elems[i], report, &sub_nodes);
+            child = slot_value(&arr->elems[i]);
+            if (json_type(child) == JSON_ARR || json_type(child) == JSON_OBJ)
+                mem_rank(report, child, sub_nodes, sub_bytes);
+            *nodes += sub_nodes;
+            bytes += sub_bytes;
+        }
+        break;
+    }
+    case JSON_OBJ: {
+        const object *obj = as_obj(json);
+        ++report->containers;
+        used = obj->count * sizeof(value);
+        report->slots_used += obj->count;
+        report->slots_cap += obj->vals ? malloc_usable_size(obj->vals) / sizeof(value) : 0;
+        report->slot_bytes += used;
+        bytes += mem_block(obj->vals, used, report);
+        if (!obj->shape->shared) {      // 共享形状不属于这棵树
+            used = sizeof(shape) + obj->shape->count * sizeof(shapekey);
+            report->key_bytes += used;
+            bytes += mem_block(obj->shape, sizeof(shape), report);
+            bytes += mem_block(obj->shape->keys, used - sizeof(shape), report);
+            for (i = 0; i < obj->count; ++i) {
+                used = obj->shape->keys[i].klen + 1;
+                report->key_bytes += used;
+                bytes += mem_block(obj->shape->keys[i].key, used, report);
+            }
+        }
+        for (i = 0; i < obj->count; ++i) {
+            if (obj->vals[i].w == WORD_HOLE)
+                continue;
+            sub_bytes = mem_walk(&obj->vals[i], report, &sub_nodes);
+            child = slot_value(&obj->vals[i]);
+            if (json_type(child) == JSON_ARR || json_type(child) == JSON_OBJ)
+                mem_rank(report, child, sub_nodes, sub_bytes);
+            *nodes += sub_nodes;
+            bytes += sub_bytes;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return bytes;
+}
+/**
+ * @brief 统计JSON值(含所有子孙成员)实际占用的内存
+ * @param json JSON值
+ * @param report 输出的占用报告
+ * @return int 0成功，<0失败
+ * @details
+ *  字节数按glibc堆块的实际大小计算(malloc_usable_size加块头)，
+ *  因此total即是释放json后能归还给分配器的字节数。
+ *  top中只记录数组和对象，标量子树不参与排行。
+ */
+int json_memory_usage(const JSON *json, json_mem_report *report)
+{
+    U64 nodes;
+    size_t size;
+
+    if (!json || !report)
+        return -1;
+    memset(report, 0, sizeof(*report));
+    size = value_size(json);
+    report->node_bytes = size;
+    report->total = mem_block(json, size, report) + mem_walk(json, report, &nodes);
+    return 0;
+}
+/**
+ * 获取JSON值json的类型
+ * @param json json值
+ * @return json的实际类型
+ */
+json_e json_type(const JSON *json)
+{
+    assert(json);
+    return json ? word_type(json->w) : JSON_NONE;
+}
+/**
+ * 新建一个BOOL类型的JSON值
+ * @param val 新建JSON的初值
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_bool(BOOL val)
+{
+    //TODO:
+    JSON *json = json_new(JSON_BOL);
+    if (!json) return NULL;
+    json->w = BOX(TAG_BOOL, val ? TRUE : FALSE);
+    return json;
+}
+/**
+ * 新建一个数字类型的JSON值
+ * @param val 新建JSON的初值
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_num(double val)
+{
+    JSON *json = json_new(JSON_NUM);
+    if (!json) return NULL;
+    json->w = num_word(val);
+    return json;
+}
+/**
+ * 新建一个整数类型的JSON值
+ * @param val 新建JSON的初值
+ * @return JSON* JSON值，失败返回NULL
+ * @details 48位以内的整数直接编码在字中，更大的分配一个bigint
+ */
+JSON *json_new_int(long long val)
+{
+    JSON *json;
+
+    if (val >= INT_INLINE_MIN && val <= INT_INLINE_MAX) {
+        json = json_new(JSON_INT);
+        if (json)
+            json->w = int_word(val);
+        return json;
+    }
+    json = (JSON *)calloc(1, sizeof(bigint));
+    if (!json) {
+        fprintf(stderr, "json_new_int: calloc(%lu) failed\n", sizeof(bigint));
+        return NULL;
+    }
+    json->w = BOX(TAG_HEAD, JSON_INT);
+    ((bigint *)json)->num = val;
+    STAT_ADD(nodes_alloc[JSON_INT], 1);
+    STAT_ALLOC(JSON_INT, sizeof(bigint));
+    return json;
+}
+/**
+ * 新建一个字符串类型的JSON值
+ * @param str 新建JSON的初值，必须是合法的UTF-8
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_str(const char *str)
+{
+    assert(str);
+    return json_new_strn(str, strlen(str));
+}
+/**
+ * 新建一个字符串类型的JSON值，字符串由长度给出，中间可以有'\0'
+ * @param str 新建JSON的初值，必须是合法的UTF-8
+ * @param len 字节数
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_strn(const char *str, size_t len)
+{
+    JSON *json;
+    assert(str || !len);
+
+    if (!str_utf8_valid(str, len)) {
+        fprintf(stderr, "json_new_str: invalid UTF-8\n");
+        return NULL;
+    }
+    json = json_new(JSON_STR);
+    if (!json) return json;
+    as_str(json)->str = malloc(len + 1);
+    if (!as_str(json)->str) {
+        fprintf(stderr, "json_new_str: malloc(%lu) failed", len + 1);
+        json_free(json);
+        return NULL;
+    }
+    if (len)
+        memcpy(as_str(json)->str, str, len);
+    as_str(json)->str[len] = '\0';
+    as_str(json)->len = len;
+    STAT_ALLOC(JSON_STR, len + 1);
+    return json;
+}
+/**
+ * 用调用者malloc的字符串新建一个字符串类型的JSON值，不复制
+ * @param str 以'\0'结尾的合法UTF-8字符串，所有权转给新建的JSON值，失败时也会被释放
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_str_owned(char *str)
+{
+    JSON *json;
+    size_t len;
+
+    assert(str);
+    len = strlen(str);
+    if (!str_utf8_valid(str, len)) {
+        fprintf(stderr, "json_new_str_owned: invalid UTF-8\n");
+        free(str);
+        return NULL;
+    }
+    json = json_new(JSON_STR);
+    if (!json) {
+        free(str);
+        return NULL;
+    }
+    as_str(json)->str = str;
+    as_str(json)->len = len;
+    STAT_ALLOC(JSON_STR, len + 1);
+    return json;
+}
+//想想：json_num和json_str为什么带一个def参数？
+/**
+ * @brief 获取JSON_NUM或JSON_INT类型JSON值的数值
+ * 
+ * @param json 数值类型的JSON值
+ * @param def   类型不匹配时返回的缺省值
+ * @return double 如果json是合法的JSON_NUM类型，返回其数值；JSON_INT类型转换为double；否则返回缺省值def
+ */
+double json_num(const JSON *json, double def)
+{
+    //想想：为什么这里不assert(json)?
+    if (json && json->w < BOX_BASE)
+        return word_num(json->w);
+    return json && word_type(json->w) == JSON_INT ? (double)value_int(json) : def;
+}
+/**
+ * @brief 获取JSON_INT类型JSON值的整数
+ * 
+ * @param json 整数类型的JSON值
+ * @param def   类型不匹配时返回的缺省值
+ * @return long long JSON_INT类型返回其整数；值为整数且在范围内的JSON_NUM也可以取出；否则返回缺省值def
+ */
+long long json_int(const JSON *json, long long def)
+{
+    double num;
+
+    if (!json)
+        return def;
+    if (word_type(json->w) == JSON_INT)
+        return value_int(json);
+    if (json->w >= BOX_BASE)
+        return def;
+    num = word_num(json->w);
+    //-2^63可以精确表示，2^63已经超出范围
+    if (num >= -9223372036854775808.0 && num < 9223372036854775808.0 && num == (long long)num)
+        return (long long)num;
+    return def;
+}
+/**
+ * @brief 获取JSON_BOOL类型JSON值的布尔值
+ * 
+ * @param json 布尔值类型的JSON值
+ * @return BOOL 如果json是合法的JSON_BOL类型，返回其数值，否则返回FALSE
+ */
+BOOL json_bool(const JSON *json)
+{
+    //想想：为什么这里不assert(json)?
+    return json && BOX_TAG(json->w) == TAG_BOOL ? (BOOL)(json->w & 1) : FALSE;
+}
+/**
+ * @brief 获取JSON_STR类型JSON值的字符串值
+ * 
+ * @param json 字符串类型的JSON值
+ * @param def   类型不匹配时返回的缺省值
+ * @return const char* 如果json是合法的JSON_STR类型，返回其字符串值，否则返回def
+ */
+const char *json_str(const JSON *json, const char *def)
+{
+    //想想：为什么这里不assert(json)?
+    return json && json->w == BOX(TAG_HEAD, JSON_STR) ? ((const string *)json)->str : def;
+}
+/**
+ * @brief 获取字符串的字节数，不用扫描字符串
+ * @param json 字符串类型的JSON值
+ * @return size_t 字节数，不含末尾的'\0'；json不是字符串时返回0
+ */
+size_t json_str_len(const JSON *json)
+{
+    return json && json->w == BOX(TAG_HEAD, JSON_STR) ? ((const string *)json)->len : 0;
+}
+/**
+ * 从对象类型的JSON值中获取名字为key的成员(JSON值)
+ * @param json 对象类型的JSON值
+ * @param key  成员的键名
+ * @return 找到的成员
+ * @details 要求json是个对象类型
+ */
+const JSON *json_get_member(const JSON *json, const char *key)
+{
+    assert(key);
+    assert(key[0]);
+    return json_get_membern(json, key, strlen(key));
+}
+/**
+ * 从对象类型的JSON值中获取键名为[key, key + keylen)的成员
+ * @param json 对象类型的JSON值
+ * @param key  成员的键名，不要求以'\0'结尾
+ * @param keylen 键名的字节数
+ * @return 找到的成员
+ * @details 要求json是个对象类型
+ */
+const JSON *json_get_membern(const JSON *json, const char *key, size_t keylen)
+{
+    assert(json);
+    assert(json_type(json) == JSON_OBJ);
+    const object *obj = as_obj(json);
+    assert(!(obj->count > 0 && obj->vals == NULL));
+    assert(key || !keylen);
+
+    const value *slot = obj_find(obj, key, keylen);
+    return slot ? slot_value(slot) : NULL;
+}
+/**
+ * @brief 带调用点缓存的json_get_member，一般通过JSON_GET_MEMBER宏使用
+ * @param json 对象类型的JSON值，不是对象时返回NULL
+ * @param key 成员的键名，同一个缓存只能配同一个键名
+ * @param ic 调用点的缓存，初始化为{0}
+ * @return const JSON* 找到的成员，找不到返回NULL
+ * @details
+ *  缓存里记着上次查过的共享形状和键名的下标(找不到也记下)，对象还是这个形状时直接按下标取值，
+ *  不用比较键名。共享形状不会释放，记下的地址不会失效；私有形状不缓存。
+ *  形状和下标打包在一个字里，多个线程同时用一个缓存也不会读到半新半旧的内容。
+ */
+const JSON *json_get_member_ic(const JSON *json, const char *key, json_ic *ic)
+{
+    const object *obj;
+    const value *slot;
+    U64 w;
+    U32 idx;
+
+    if (!json || json->w != BOX(TAG_HEAD, JSON_OBJ) || !key || !ic)
+        return NULL;
+    obj = as_obj(json);
+    w = __atomic_load_n(&ic->word, __ATOMIC_RELAXED);
+    if ((w & BOX_MASK) == (uintptr_t)obj->shape) {
+        idx = (U32)(w >> 48);
+        if (idx == IC_MISSING)
+            return NULL;
+    } else {
+        idx = shape_find(obj->shape, key, strlen(key));
+        if (obj->shape->shared) {
+            w = (U64)(idx == SHAPE_NONE ? IC_MISSING : idx) << 48 | (uintptr_t)obj->shape;
+            __atomic_store_n(&ic->word, w, __ATOMIC_RELAXED);
+        }
+        if (idx == SHAPE_NONE)
+            return NULL;
+    }
+    if (obj->vals[idx].w == WORD_HOLE) {    // 成员已删除，后面可能还有同名的
+        slot = obj_find(obj, key, strlen(key));
+        return slot ? slot_value(slot) : NULL;
+    }
+    return slot_value(&obj->vals[idx]);
+}
+/**
+ * 从数组类型的JSON值中获取第idx个元素(子JSON值)
+ * @param json 数组类型的JSON值
+ * @param idx  元素的索引值
+ * @return 找到的元素(JSON值的指针)
+ * @details 要求json是个数组
+ */
+const JSON *json_get_element(const JSON *json, U32 idx)
+{
+    assert(json);
+    assert(json_type(json) == JSON_ARR);
+    const array *arr = as_arr(json);
+    assert(!(arr->count > 0 && arr->elems == NULL));
+    if (idx >= arr->count)
+        return NULL;
+    return slot_value(&arr->elems[idx]);
+}
+/**
+ * @brief 获取对象的成员个数
+ * @param json 对象类型的JSON值
+ * @return int 成员个数，json不是对象时返回-1
+ */
+int json_obj_count(const JSON *json)
+{
+    if (!json || json_type(json) != JSON_OBJ)
+        return -1;
+    return as_obj(json)->count - as_obj(json)->holes;
+}
+/**
+ * 按加入的顺序获取对象的第idx个成员，用于遍历对象
+ * @param json 对象类型的JSON值
+ * @param idx 成员的索引值
+ * @param key 输出成员的键名，可以为NULL
+ * @return 找到的成员，越界时返回NULL
+ * @details 要求json是个对象；对象里有按顺序删除留下的空位时要从头数过去
+ */
+const JSON *json_get_member_at(const JSON *json, U32 idx, const char **key)
+{
+    assert(json);
+    assert(json_type(json) == JSON_OBJ);
+    const object *obj = as_obj(json);
+    if (obj->holes) {   // 跳过空位数到第idx个成员
+        U32 i;
+        for (i = 0; i < obj->count; ++i) {
+            if (obj->vals[i].w != WORD_HOLE && idx-- == 0)
+                break;
+        }
+        idx = i;
+    }
+    if (idx >= obj->count)
+        return NULL;
+    if (key)
+        *key = obj->shape->keys[idx].key;
+    return slot_value(&obj->vals[idx]);
+}
+/**
+ * @brief 开始遍历对象的成员
+ * @param json 对象类型的JSON值
+ * @param it 迭代器，放在栈上即可，不需要释放
+ * @return int 0成功，json不是对象时返回-1，此时json_obj_iter_next直接返回NULL
+ * @details 遍历期间不能增删成员；没有定义NDEBUG时json_obj_iter_next比较对象的增删次数，assert检查这一点
+ */
+int json_obj_iter_begin(const JSON *json, json_iter *it)
+{
+    const object *obj;
+
+    assert(it);
+    memset(it, 0, sizeof(*it));
+    if (!json || json->w != BOX(TAG_HEAD, JSON_OBJ))
+        return -1;
+    obj = as_obj(json);
+    it->json = json;
+    it->slot = obj->vals;
+    it->end = obj->vals + obj->count;
+    it->key = obj->shape->keys;
+#ifndef NDEBUG
+    it->mods = obj->mods;
+#endif
+    return 0;
+}
+/**
+ * @brief 取对象的下一个成员
+ * @param key 输出键名，末尾有'\0'，可以为NULL
+ * @param klen 输出键名的字节数，可以为NULL
+ * @return const JSON* 成员的值，遍历完返回NULL
+ */
+const JSON *json_obj_iter_next(json_iter *it, const char **key, size_t *klen)
+{
+    const value *slot = it->slot;
+    const shapekey *k = it->key;
+
+    assert(!it->json || as_obj(it->json)->mods == it->mods);
+    while (slot != it->end && slot->w == WORD_HOLE) {
+        slot++;
+        k++;
+    }
+    if (slot == it->end)
+        return NULL;
+    if (key)
+        *key = k->key;
+    if (klen)
+        *klen = k->klen;
+    it->slot = slot + 1;
+    it->key = k + 1;
+    return slot_value(slot);
+}
+/**
+ * @brief 开始遍历数组的元素，参数和返回值同json_obj_iter_begin
+ */
+int json_arr_iter_begin(const JSON *json, json_iter *it)
+{
+    const array *arr;
+
+    assert(it);
+    memset(it, 0, sizeof(*it));
+    if (!json || (json->w & ~HEAD_FLAGS) != BOX(TAG_HEAD, JSON_ARR))
+        return -1;
+    arr = as_arr(json);
+    it->json = json;
+    it->slot = arr->elems;
+    it->end = arr->elems + arr->count;
+#ifndef NDEBUG
+    it->mods = arr->mods;
+#endif
+    return 0;
+}
+/**
+ * @brief 取数组的下一个元素
+ * @return const JSON* 元素，遍历完返回NULL
+ */
+const JSON *json_arr_iter_next(json_iter *it)
+{
+    const value *slot = it->slot;
+
+    assert(!it->json || as_arr(it->json)->mods == it->mods);
+    if (slot == it->end)
+        return NULL;
+    it->slot = slot + 1;
+    return slot_value(slot);
+}
+//-----------------------------------------------------------------------------
+//  文本缓冲区
+//-----------------------------------------------------------------------------
+#define TB_FLUSH    (64 << 10)  //带文件的缓冲区攒够这么多字节就写入文件
+
+/**
+ * @brief 按需扩充的文本缓冲区，指定了fp时攒够TB_FLUSH字节就写入文件，内存占用有上限
+ */
+typedef struct textbuf {
+    char *data;         //文本
+    size_t len;         //文本长度
+    size_t cap;         //data的容量
+    BOOL failed;        //是否发生过内存分配失败或写文件失败
+    FILE *fp;           //输出文件，为NULL时全部留在内存中
+} textbuf;
+
+/**
+ * @brief 把缓冲区中的文本写入文件
+ */
+static void tb_flush(textbuf *tb)
+{
+    if (tb->fp && tb->len && fwrite(tb->data, 1, tb->len, tb->fp) != tb->len)
+        tb->failed = TRUE;
+    tb->len = 0;
+}
+/**
+ * @brief 确保缓冲区还能写入n个字节
+ * @return int 0成功，<0失败
+ */
+static int tb_reserve(textbuf *tb, size_t n)
+{
+    size_t cap;
+    char *data;
+
+    if (tb->len + n <= tb->cap)
+        return 0;
+    if (tb->failed)
+        return -1;
+    if (tb->fp) {
+        tb_flush(tb);
+        if (n <= tb->cap)
+            return tb->failed ? -1 : 0;
+    }
+    cap = tb->cap ? tb->cap : (tb->fp ? TB_FLUSH : 256);
+    while (cap < tb->len + n)
+        cap *= 2;
+    data = realloc(tb->data, cap);
+    if (!data) {
+        fprintf(stderr, "tb_reserve: realloc(%lu) failed\n", cap);
+        tb->failed = TRUE;
+        return -1;
+    }
+    tb->data = data;
+    tb->cap = cap;
+    return 0;
+}
+static void tb_write(textbuf *tb, const char *str, size_t len)
+{
+    if (tb_reserve(tb, len) < 0)
+        return;
+    memcpy(tb->data + tb->len, str, len);
+    tb->len += len;
+}
+static void tb_putc(textbuf *tb, char c)
+{
+    if (tb_reserve(tb, 1) < 0)
+        return;
+    tb->data[tb->len++] = c;
+}
+static void tb_puts(textbuf *tb, const char *str)
+{
+    tb_write(tb, str, strlen(str));
+}
+/**
+ * @brief 输出十进制整数，每次除以100取两位查表
+ */
+static void tb_int(textbuf *tb, long long num)
+{
+    static const char digits[] =
+        "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+        "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+    char buf[24], *p = buf + sizeof(buf);
+    U64 n = num < 0 ? 0 - (U64)num : (U64)num;
+    U32 d;
+
+    while (n >= 100) {
+        d = (U32)(n % 100) * 2;
+        n /= 100;
+        *--p = digits[d + 1];
+        *--p = digits[d];
+    }
+    if (n >= 10) {
+        *--p = digits[n * 2 + 1];
+        *--p = digits[n * 2];
+    } else {
+        *--p = (char)('0' + n);
+    }
+    if (num < 0)
+        *--p = '-';
+    tb_write(tb, p, buf + sizeof(buf) - p);
+}
+static void tb_indent(textbuf *tb, int indent)
+{
+    if (indent == 0 || tb_reserve(tb, indent * 2) < 0)
+        return;
+    memset(tb->data + tb->len, ' ', indent * 2);
+    tb->len += indent * 2;
+}
+/**
+ * @brief 输出带双引号的字符串，转义双引号、反斜杠和控制字符('\0'也是控制字符)
+ * @details 用向量指令找需要转义的字节，中间不需要转义的一段整体拷贝
+ */
+static void tb_string(textbuf *tb, const char *str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t i = 0, n;
+
+    tb_putc(tb, '"');
+    while ((n = str_escape_scan(str + i, len - i)) < len - i) {
+        unsigned char c = str[i + n];
+        char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+        int k = 6;
+
+        tb_write(tb, str + i, n);
+        i += n + 1;
+        switch (c) {
+        case '"':  esc[1] = '"';  k = 2; break;
+        case '\\': esc[1] = '\\'; k = 2; break;
+        case '\n': esc[1] = 'n';  k = 2; break;
+        case '\r': esc[1] = 'r';  k = 2; break;
+        case '\t': esc[1] = 't';  k = 2; break;
+        case '\b': esc[1] = 'b';  k = 2; break;
+        case '\f': esc[1] = 'f';  k = 2; break;
+        }
+        tb_write(tb, esc, k);
+    }
+    tb_write(tb, str + i, len - i);
+    tb_putc(tb, '"');
+}
+/**
+ * @brief 判断字符串能不能不加引号作为YAML的纯量输出
+ * @details 空串、以YAML指示符或空格开头、以空格结尾、含控制字符、": "或" #"的，
+ *          以及会被当成null、布尔值、数值读回来的都要加引号
+ */
+static BOOL yaml_plain(const char *str, size_t len)
+{
+    static const char *const reserved[] = {"null", "~", "true", "false", "yes", "no", "on", "off",
+                                           "y", "n", ".inf", ".nan"};
+    size_t i;
+    char *end;
+
+    if (len == 0 || strchr("-?:,[]{}#&*!|>'\"%@` ", str[0]) || str[len - 1] == ' ')
+        return FALSE;
+    // 大部分字符串一个需要检查的字节都没有，向量指令直接扫到结尾
+    for (i = 0; (i += str_yaml_scan(str + i, len - i)) < len; ++i) {
+        unsigned char c = str[i];
+        if (c < 0x20 || (c == ':' && (i + 1 == len || str[i + 1] == ' ')) || (c == '#' && str[i - 1] == ' '))
+            return FALSE;
+    }
+    if (len <= 5) {     // 到这里已经没有控制字符了，str中间不会有'\0'
+        for (i = 0; i < sizeof(reserved) / sizeof(reserved[0]); ++i) {
+            if (!strcasecmp(str, reserved[i]))
+                return FALSE;
+        }
+    }
+    if ((str[0] >= '0' && str[0] <= '9') || str[0] == '+' || str[0] == '.') {
+        strtod(str, &end);
+        if (end == str + len)
+            return FALSE;
+    }
+    return TRUE;
+}
+/**
+ * @brief 输出YAML的字符串纯量，需要时加双引号并转义，双引号里的转义写法和JSON相同
+ */
+static void yaml_scalar(textbuf *tb, const char *str, size_t len)
+{
+    if (yaml_plain(str, len))
+        tb_write(tb, str, len);
+    else
+        tb_string(tb, str, len);
+}
+/**
+ * @brief 输出容器json的第from到to-1个子成员(YAML格式)，不含容器开头的换行
+ * @param indent 子成员的缩进级别
+ * @param fistLine 容器是否紧跟在"- "之后，是的话第一个成员不缩进
+ * @details 多线程输出时每个线程负责一段子成员，拼起来和一次输出全部子成员完全相同
+ */
+static void yaml_children(textbuf *tb, const JSON *json, int indent, BOOL fistLine, U32 from, U32 to);
+
+/**
+ * @brief 递归将JSON值输出到缓冲区（YAML格式）
+ * @param json JSON值
+ * @param tb 输出缓冲区
+ * @param indent 当前缩进级别
+ * @param fistLine 是否紧跟在"- "之后
+ */
+static void json_write_yaml(const JSON *json, textbuf *tb, int indent, BOOL fistLine) {
+    char buf[NUM_FORMAT_MAX];
+
+    if (!json || !tb) return;
+
+    switch (json_type(json)) {
+        case JSON_NONE:
+            tb_puts(tb, "null");
+            break;
+            
+        case JSON_BOL:
+            tb_puts(tb, json_bool(json) ? "true" : "false");
+            break;
+            
+        case JSON_INT:
+            tb_int(tb, value_int(json));
+            break;
+
+        case JSON_NUM: {
+            double num = word_num(json->w);
+            if (num != num) {
+                tb_puts(tb, ".nan");
+            } else if (num - num != 0) {
+                tb_puts(tb, num > 0 ? ".inf" : "-.inf");
+            } else if (num == (long long)num && num < 1e15 && num > -1e15) {
+                tb_int(tb, (long long)num);  // 整数
+            } else {
+                tb_write(tb, buf, num_format(num, buf));  // 最短的能精确还原的文本
+            }
+            break;
+        }
+            
+        case JSON_STR:
+            if (as_str(json)->str)
+                yaml_scalar(tb, as_str(json)->str, as_str(json)->len);
+            else
+                tb_puts(tb, "(null)");
+            break;
+            
+        case JSON_ARR: {
+            const array *arr = as_arr(json);
+            if (arr->count == 0) {
+                tb_puts(tb, "[]");
+                break;
+            }
+            tb_putc(tb, '\n');
+            yaml_children(tb, json, indent, fistLine, 0, arr->count);
+            break;
+        }
+            
+        case JSON_OBJ: {
+            const object *obj = as_obj(json);
+            if (obj->count == obj->holes) {
+                tb_puts(tb, "{}");
+                break;
+            }
+            if(!fistLine)
+                tb_putc(tb, '\n');
+            yaml_children(tb, json, indent, fistLine, 0, obj->count);
+            break;
+        }
+    }
+}
+static void yaml_children(textbuf *tb, const JSON *json, int indent, BOOL fistLine, U32 from, U32 to)
+{
+    U32 i;
+
+    if (json_type(json) == JSON_ARR) {
+        const array *arr = as_arr(json);
+        for (i = from; i < to; i++) {
+            tb_indent(tb, indent);
+            tb_puts(tb, "- ");
+            json_write_yaml(slot_value(&arr->elems[i]), tb, indent + 1, TRUE);
+            if (i != arr->count - 1) tb_putc(tb, '\n');
+        }
+        return;
+    }
+    const object *obj = as_obj(json);
+    U32 first = 0, last = obj->count - 1;
+    if (obj->holes) {   // 跳过空位，对象至少有一个成员
+        while (obj->vals[first].w == WORD_HOLE) first++;
+        while (obj->vals[last].w == WORD_HOLE) last--;
+    }
+    for (i = from; i < to; i++) {
+        if (obj->vals[i].w == WORD_HOLE)
+            continue;
+        if (!fistLine || i > first)
+            tb_indent(tb, indent);
+        yaml_scalar(tb, obj->shape->keys[i].key, obj->shape->keys[i].klen);
+        tb_puts(tb, ": ");
+        json_write_yaml(slot_value(&obj->vals[i]), tb, indent + 1, FALSE);
+        if (i != last) tb_putc(tb, '\n');
+    }
+}
+/**
+ * @brief 把JSON值以YAML格式保存到文件
+ * @param json JSON值
+ * @param fname 输出文件名
+ * @return int 0成功，<0失败
+ */
+int json_save(const JSON *json, const char *fname) {
+    if (!json || !fname) return -1;
+
+    STAT_TIMER(begin);
+    FILE *fp = fopen(fname, "w");
+    if (!fp) return -2;
+
+    textbuf tb = {NULL, 0, 0, FALSE, fp};
+    json_write_yaml(json, &tb, 0, TRUE);
+    tb_flush(&tb);
+    free(tb.data);
+    STAT_ADD(save_bytes, ftell(fp));
+    if (fclose(fp) != 0)
+        tb.failed = TRUE;
+    STAT_LATENCY(save_lat, begin);
+    return tb.failed ? -3 : 0;
+}
+
+//-----------------------------------------------------------------------------
+//  多线程保存
+//-----------------------------------------------------------------------------
+#define SAVE_SLICE_MIN  256     //每段至少包含的子成员数，太少时线程开销不划算
+#define SAVE_SLICES     8       //每个线程平均分到的段数，段多一些负载更均衡
+#define SAVE_WINDOW     4       //每个线程最多领先写入进度的段数，限制内存占用
+#define SAVE_IOV        64      //每次writev最多写入的段数
+
+/**
+ * @brief 一次多线程保存的共享状态
+ * @details 工作线程按序号领取段，把段中的子成员输出到各自的缓冲区；调用线程按顺序
+ * 把已输出完的连续几段用writev写入文件，写完后释放缓冲区
+ */
+typedef struct save_job {
+    const JSON *json;       //顶层数组或对象
+    U32 nslices;            //段数
+    U32 next;               //下一个待领取的段
+    U32 written;            //已写入文件的段数
+    U32 window;             //领取的段最多领先written多少
+    textbuf *bufs;          //每段的输出
+    BOOL *ready;            //每段是否已输出完
+    pthread_mutex_t lock;
+    pthread_cond_t rendered;    //有段输出完了
+    pthread_cond_t drained;     //有段写入文件了
+} save_job;
+
+/**
+ * @brief 第idx段的起始子成员下标
+ */
+static U32 save_bound(const save_job *job, U32 idx)
+{
+    U32 count = json_type(job->json) == JSON_ARR ? as_arr(job->json)->count : as_obj(job->json)->count;
+    return (U32)((U64)count * idx / job->nslices);
+}
+
+static void *save_worker(void *arg)
+{
+    save_job *job = arg;
+    U32 idx;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        idx = job->next++;
+        if (idx >= job->nslices) {
+            pthread_mutex_unlock(&job->lock);
+            return NULL;
+        }
+        while (idx >= job->written + job->window)
+            pthread_cond_wait(&job->drained, &job->lock);
+        pthread_mutex_unlock(&job->lock);
+
+        //顶层数组以换行开头，放在第0段里
+        if (idx == 0 && json_type(job->json) == JSON_ARR)
+            tb_putc(&job->bufs[idx], '\n');
+        yaml_children(&job->bufs[idx], job->json, 0, TRUE,
+                      save_bound(job, idx), save_bound(job, idx + 1));
+
+        pthread_mutex_lock(&job->lock);
+        job->ready[idx] = TRUE;
+        pthread_cond_signal(&job->rendered);
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+/**
+ * @brief 把iov中的n段全部写入fd，处理部分写入
+ * @return int 0成功，<0失败
+ */
+static int save_writev(int fd, struct iovec *iov, int n)
+{
+    ssize_t done;
+
+    while (n > 0) {
+        done = writev(fd, iov, n);
+        if (done < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (n > 0 && (size_t)done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 调用线程按顺序把输出完的段写入文件
+ * @return int 0成功，<0失败
+ */
+static int save_drain(save_job *job, int fd)
+{
+    struct iovec iov[SAVE_IOV];
+    U32 from, to, i;
+    BOOL failed = FALSE;
+
+    pthread_mutex_lock(&job->lock);
+    while (job->written < job->nslices) {
+        while (!job->ready[job->written])
+            pthread_cond_wait(&job->rendered, &job->lock);
+        from = job->written;
+        for (to = from; to < job->nslices && to - from < SAVE_IOV && job->ready[to]; to++)
+            ;
+        pthread_mutex_unlock(&job->lock);
+
+        for (i = from; i < to; i++) {
+            failed |= job->bufs[i].failed;
+            iov[i - from].iov_base = job->bufs[i].data;
+            iov[i - from].iov_len = job->bufs[i].len;
+            STAT_ADD(save_bytes, job->bufs[i].len);
+        }
+        if (!failed && save_writev(fd, iov, to - from) < 0)
+            failed = TRUE;
+        for (i = from; i < to; i++) {
+            free(job->bufs[i].data);
+            job->bufs[i].data = NULL;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        job->written = to;
+        pthread_cond_broadcast(&job->drained);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief 多线程把JSON值以YAML格式保存到文件，输出和json_save逐字节相同
+ * @param json JSON值
+ * @param fname 输出文件名
+ * @param nthreads 输出线程数
+ * @return int 0成功，-1参数错误，-2打开文件失败，-3写入失败
+ * @details 顶层数组或对象的子成员分段交给各线程输出到各自的缓冲区，调用线程按顺序用
+ * writev写入文件；顶层子成员较少或nthreads<2时退化为json_save
+ */
+int json_save_parallel(const JSON *json, const char *fname, U32 nthreads)
+{
+    pthread_t *tids;
+    save_job job;
+    U32 count, started = 0, i;
+    int fd, ret;
+
+    if (!json || !fname) return -1;
+    count = json_type(json) == JSON_ARR ? as_arr(json)->count
+          : json_type(json) == JSON_OBJ ? as_obj(json)->count - as_obj(json)->holes : 0;
+    if (nthreads < 2 || count < 2 * SAVE_SLICE_MIN)
+        return json_save(json, fname);
+
+    STAT_TIMER(begin);
+    fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -2;
+
+    memset(&job, 0, sizeof(job));
+    job.json = json;
+    job.nslices = nthreads * SAVE_SLICES;
+    if (job.nslices > count / SAVE_SLICE_MIN)
+        job.nslices = count / SAVE_SLICE_MIN;
+    job.window = nthreads * SAVE_WINDOW;
+    job.bufs = calloc(job.nslices, sizeof(*job.bufs));
+    job.ready = calloc(job.nslices, sizeof(*job.ready));
+    tids = malloc(nthreads * sizeof(*tids));
+    if (!job.bufs || !job.ready || !tids) {
+        free(job.bufs);
+        free(job.ready);
+        free(tids);
+        close(fd);
+        return json_save(json, fname);
+    }
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.rendered, NULL);
+    pthread_cond_init(&job.drained, NULL);
+
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&tids[started], NULL, save_worker, &job) == 0)
+            started++;
+    }
+    if (started == 0) {
+        //一个线程都没起来时在当前线程输出，窗口放开避免等待写入
+        job.window = job.nslices;
+        save_worker(&job);
+    }
+    ret = save_drain(&job, fd);
+    for (i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    if (close(fd) != 0)
+        ret = -1;
+
+    pthread_cond_destroy(&job.drained);
+    pthread_cond_destroy(&job.rendered);
+    pthread_mutex_destroy(&job.lock);
+    free(job.bufs);
+    free(job.ready);
+    free(tids);
+    STAT_LATENCY(save_lat, begin);
+    return ret < 0 ? -3 : 0;
+}
+
+//-----------------------------------------------------------------------------
+//  异步保存
+//-----------------------------------------------------------------------------
+/**
+ * @brief 等待保存结果的一个回调
+ */
+typedef struct save_waiter {
+    json_save_cb done;
+    void *arg;
+    struct save_waiter *next;
+} save_waiter;
+
+/**
+ * @brief 一个待保存的文件，同一路径上排队的多次保存合并成一个任务，只写最新的树
+ */
+typedef struct save_task {
+    char *fname;
+    JSON *json;                 //最新的树，任务结束后释放
+    save_waiter *waiters;       //所有被合并的保存的回调，按提交顺序
+    save_waiter **last;         //waiters链表的尾指针
+    struct save_task *next;
+} save_task;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t pending;     //有新的保存任务
+    pthread_cond_t idle;        //队列已清空且保存线程空闲
+    save_task *head;            //排队中的任务，先进先出
+    save_task *tail;
+    BOOL started;               //保存线程是否已启动
+    BOOL busy;                  //保存线程正在写一个文件
+} saver = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/**
+ * @brief 把fname所在目录的元数据刷到磁盘，确保rename本身落盘
+ */
+static int save_sync_dir(const char *fname)
+{
+    const char *slash = strrchr(fname, '/');
+    char *dir;
+    int fd, ret;
+
+    if (!slash)
+        dir = strdup(".");
+    else if (slash == fname)
+        dir = strdup("/");
+    else
+        dir = strndup(fname, slash - fname);
+    if (!dir)
+        return -1;
+    fd = open(dir, O_RDONLY);
+    free(dir);
+    if (fd < 0)
+        return -1;
+    ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
+/**
+ * @brief 把json写入同目录下的临时文件并fsync，再原子地rename到fname
+ * @return int 0成功，-2创建临时文件失败，-3写入失败，-4替换目标文件失败
+ * @details 任何时刻fname要么是旧内容要么是完整的新内容；临时文件沿用目标文件的权限，
+ * 目标文件不存在时为0644
+ */
+static int save_atomic(const JSON *json, const char *fname)
+{
+    struct stat st;
+    textbuf tb = {NULL, 0, 0, FALSE, NULL};
+    size_t n = strlen(fname);
+    char *tmp;
+    int fd;
+
+    STAT_TIMER(begin);
+    tmp = malloc(n + sizeof(".XXXXXX"));
+    if (!tmp)
+        return -2;
+    memcpy(tmp, fname, n);
+    memcpy(tmp + n, ".XXXXXX", sizeof(".XXXXXX"));
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return -2;
+    }
+    tb.fp = fdopen(fd, "w");
+    if (!tb.fp) {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return -2;
+    }
+    fchmod(fd, stat(fname, &st) == 0 ? (st.st_mode & 07777) : 0644);
+
+    json_write_yaml(json, &tb, 0, TRUE);
+    tb_flush(&tb);
+    free(tb.data);
+    STAT_ADD(save_bytes, ftell(tb.fp));
+    if (fflush(tb.fp) != 0 || fsync(fd) != 0)
+        tb.failed = TRUE;
+    if (fclose(tb.fp) != 0)
+        tb.failed = TRUE;
+    if (tb.failed) {
+        unlink(tmp);
+        free(tmp);
+        return -3;
+    }
+    if (rename(tmp, fname) != 0) {
+        unlink(tmp);
+        free(tmp);
+        return -4;
+    }
+    free(tmp);
+    save_sync_dir(fname);
+    STAT_LATENCY(save_lat, begin);
+    return 0;
+}
+
+static void *save_async_worker(void *arg)
+{
+    save_task *task;
+    save_waiter *w, *next;
+    int ret;
+
+    (void)arg;
+    pthread_mutex_lock(&saver.lock);
+    for (;;) {
+        while (!saver.head) {
+            saver.busy = FALSE;
+            pthread_cond_broadcast(&saver.idle);
+            pthread_cond_wait(&saver.pending, &saver.lock);
+        }
+        task = saver.head;
+        saver.head = task->next;
+        if (!saver.head)
+            saver.tail = NULL;
+        saver.busy = TRUE;
+        pthread_mutex_unlock(&saver.lock);
+
+        ret = save_atomic(task->json, task->fname);
+        json_free(task->json);
+        for (w = task->waiters; w; w = next) {
+            next = w->next;
+            if (w->done)
+                w->done(w->arg, task->fname, ret);
+            free(w);
+        }
+        free(task->fname);
+        free(task);
+
+        pthread_mutex_lock(&saver.lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 在后台线程把json保存到fname，写临时文件、fsync后原子地替换fname
+ * @param json 要保存的树，所有权交给保存线程，写完后释放，调用后不能再访问
+ * @param fname 输出文件名
+ * @param done 保存完成后在保存线程中调用，ret为save_atomic的返回值，可以为NULL
+ * @param arg 传给done的参数
+ * @return int 0已排队，-1参数错误，-2内存不足，-3保存线程启动失败；失败时json仍归调用者
+ * @details 同一路径上还没开始写的保存会被合并，只写最后提交的树，所有被合并的done都
+ * 收到这次写入的结果
+ */
+int json_save_async(JSON *json, const char *fname, json_save_cb done, void *arg)
+{
+    save_task *task;
+    save_waiter *w;
+    pthread_t tid;
+
+    if (!json || !fname || !fname[0]) return -1;
+
+    w = malloc(sizeof(*w));
+    if (!w) return -2;
+    w->done = done;
+    w->arg = arg;
+    w->next = NULL;
+
+    pthread_mutex_lock(&saver.lock);
+    //还没开始写的同路径任务直接换成新树，只写最新的快照
+    for (task = saver.head; task; task = task->next) {
+        if (strcmp(task->fname, fname) == 0) {
+            json_free(task->json);
+            task->json = json;
+            *task->last = w;
+            task->last = &w->next;
+            pthread_mutex_unlock(&saver.lock);
+            return 0;
+        }
+    }
+    if (!saver.started) {
+        if (pthread_create(&tid, NULL, save_async_worker, NULL) != 0) {
+            pthread_mutex_unlock(&saver.lock);
+            free(w);
+            return -3;
+        }
+        pthread_detach(tid);
+        saver.started = TRUE;
+    }
+    task = malloc(sizeof(*task));
+    if (task)
+        task->fname = strdup(fname);
+    if (!task || !task->fname) {
+        pthread_mutex_unlock(&saver.lock);
+        free(task);
+        free(w);
+        return -2;
+    }
+    task->json = json;
+    task->waiters = w;
+    task->last = &w->next;
+    task->next = NULL;
+    if (saver.tail)
+        saver.tail->next = task;
+    else
+        saver.head = task;
+    saver.tail = task;
+    pthread_cond_signal(&saver.pending);
+    pthread_mutex_unlock(&saver.lock);
+    return 0;
+}
+
+/**
+ * @brief 等待所有已提交的异步保存写完，用于退出前和测试
+ */
+void json_save_drain(void)
+{
+    pthread_mutex_lock(&saver.lock);
+    while (saver.head || saver.busy)
+        pthread_cond_wait(&saver.idle, &saver.lock);
+    pthread_mutex_unlock(&saver.lock);
+}
+//  想想：json_add_member和json_add_element中，val应该是堆分配，还是栈分配？
+//  想想：如果json_add_member失败，应该由谁来释放val？
+//-----------------------------------------------------------------------------
+//  解析JSON文本
+//-----------------------------------------------------------------------------
+#define PARSE_MAX_DEPTH     512     //数组和对象最多嵌套的层数
+#define PARSE_KEY_BUF       128     //键名原文不超过这么长时解码到栈上
+
+/**
+ * @brief 解析过程的上下文
+ */
+typedef struct parse_ctx {
+    const char *begin;  //文本开头，用于报告出错位置
+    const char *cur;    //当前解析到的位置
+    const char *end;    //文本结尾
+    U32 depth;          //当前嵌套层数
+} parse_ctx;
+
+static int parse_value(parse_ctx *ctx, value *slot);
+
+/**
+ * @brief 报告语法错误
+ * @return int 总是返回-1，方便调用者直接return
+ */
+static int parse_error(const parse_ctx *ctx, const char *info)
+{
+    fprintf(stderr, "json_parse: %s at offset %lu\n", info, (size_t)(ctx->cur - ctx->begin));
+    return -1;
+}
+/**
+ * @brief 跳过空白字符
+ */
+static inline void parse_ws(parse_ctx *ctx)
+{
+    while (ctx->cur < ctx->end && (*ctx->cur == ' ' || *ctx->cur == '\t'
+           || *ctx->cur == '\n' || *ctx->cur == '\r'))
+        ++ctx->cur;
+}
+/**
+ * @brief 解析4位十六进制数
+ * @return int 解析出的数值，非法时返回-1
+ */
+static int parse_hex4(const char *p)
+{
+    int i, code = 0;
+
+    for (i = 0; i < 4; ++i) {
+        char c = p[i];
+        code <<= 4;
+        if (c >= '0' && c <= '9')
+            code |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            code |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            code |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return code;
+}
+/**
+ * @brief 找到字符串结尾的双引号并校验UTF-8，当前位置是开头的双引号
+ * @return const char* 结尾双引号的位置，失败返回NULL
+ */
+static const char *string_end(parse_ctx *ctx)
+{
+    const char *p = ctx->cur + 1, *q = p;
+
+    while (q < ctx->end && *q != '"')
+        q += *q == '\\' ? 2 : 1;
+    if (q >= ctx->end) {
+        parse_error(ctx, "unterminated string");
+        return NULL;
+    }
+    // 转义序列都是ASCII，直接校验原文就行
+    if (!str_utf8_valid(p, q - p)) {
+        parse_error(ctx, "invalid UTF-8");
+        return NULL;
+    }
+    return q;
+}
+/**
+ * @brief 把开头的双引号到结尾的双引号q之间的原文解码到out，末尾补'\0'
+ * @param out 输出缓冲区，解码后的字符串不会比原文长，至少q - ctx->cur字节
+ * @return long 解码后的字节数，\u0000会解码成字符串中间的'\0'；失败返回-1
+ */
+static long string_decode(parse_ctx *ctx, const char *q, char *out)
+{
+    const char *p = ctx->cur + 1;
+    char *start = out;
+
+    while (p < q) {
+        int code, low;
+
+        if ((unsigned char)*p < 0x20) {
+            ctx->cur = p;
+            goto failed_;
+        }
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        switch (p[1]) {
+        case '"':  *out++ = '"';  break;
+        case '\\': *out++ = '\\'; break;
+        case '/':  *out++ = '/';  break;
+        case 'b':  *out++ = '\b'; break;
+        case 'f':  *out++ = '\f'; break;
+        case 'n':  *out++ = '\n'; break;
+        case 'r':  *out++ = '\r'; break;
+        case 't':  *out++ = '\t'; break;
+        case 'u':
+            code = q - p >= 6 ? parse_hex4(p + 2) : -1;
+            if (code < 0) {
+                ctx->cur = p;
+                goto failed_;
+            }
+            if (code >= 0xD800 && code <= 0xDBFF) {     // 代理对
+                low = q - p >= 12 && p[6] == '\\' && p[7] == 'u' ? parse_hex4(p + 8) : -1;
+                if (low < 0xDC00 || low > 0xDFFF) {
+                    ctx->cur = p;
+                    goto failed_;
+                }
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            } else if (code >= 0xDC00 && code <= 0xDFFF) {  // 单独的低位代理不能编码成UTF-8
+                ctx->cur = p;
+                goto failed_;
+            }
+            if (code < 0x80) {
+                *out++ = (char)code;
+            } else if (code < 0x800) {
+                *out++ = (char)(0xC0 | code >> 6);
+                *out++ = (char)(0x80 | (code & 0x3F));
+            } else if (code < 0x10000) {
+                *out++ = (char)(0xE0 | code >> 12);
+                *out++ = (char)(0x80 | (code >> 6 & 0x3F));
+                *out++ = (char)(0x80 | (code & 0x3F));
+            } else {
+                *out++ = (char)(0xF0 | code >> 18);
+                *out++ = (char)(0x80 | (code >> 12 & 0x3F));
+                *out++ = (char)(0x80 | (code >> 6 & 0x3F));
+                *out++ = (char)(0x80 | (code & 0x3F));
+            }
+            p += 4;
+            break;
+        default:
+            ctx->cur = p;
+            goto failed_;
+        }
+        p += 2;
+    }
+    *out = '\0';
+    ctx->cur = q + 1;
+    return out - start;
+failed_:
+    parse_error(ctx, "invalid string");
+    return -1;
+}
+/**
+ * @brief 解析字符串，当前位置是开头的双引号
+ * @param len 输出解码后的字节数
+ * @return char* 堆分配的解码后的字符串，末尾有'\0'，失败返回NULL
+ * @details 先找到结尾确定原文长度，按原文长度一次分配
+ */
+static char *parse_string(parse_ctx *ctx, size_t *len)
+{
+    const char *q = string_end(ctx);
+    char *str;
+    long n;
+
+    if (!q)
+        return NULL;
+    str = malloc(q - ctx->cur);
+    if (!str) {
+        fprintf(stderr, "parse_string: malloc(%lu) failed\n", (size_t)(q - ctx->cur));
+        return NULL;
+    }
+    n = string_decode(ctx, q, str);
+    if (n < 0) {
+        free(str);
+        return NULL;
+    }
+    *len = n;
+    return str;
+}
+/**
+ * @brief 按JSON的语法扫描数值
+ * @param ival 整数时输出其值
+ * @param dval 不是整数时输出转换结果
+ * @return int 1整数，0浮点数，<0失败
+ * @details 没有小数和指数部分且在long long范围内的按整数逐位累加，其余交给num_parse转换
+ */
+static int scan_number(parse_ctx *ctx, long long *ival, double *dval)
+{
+    const char *p = ctx->cur, *digits;
+    BOOL neg = FALSE;
+    U64 n = 0;
+
+    if (p < ctx->end && *p == '-') {
+        neg = TRUE;
+        ++p;
+    }
+    digits = p;
+    if (p < ctx->end && *p == '0') {
+        ++p;
+    } else if (p < ctx->end && *p >= '1' && *p <= '9') {
+        while (p < ctx->end && *p >= '0' && *p <= '9')
+            ++p;
+    } else {
+        return parse_error(ctx, "invalid number");
+    }
+    //19位十进制数不会超出U64，再和long long的范围比较
+    if ((p >= ctx->end || (*p != '.' && *p != 'e' && *p != 'E')) && p - digits <= 19) {
+        for (; digits < p; ++digits)
+            n = n * 10 + (U64)(*digits - '0');
+        if (n <= (U64)INT64_MAX || (neg && n == (U64)INT64_MAX + 1)) {
+            *ival = neg ? (long long)(0 - n) : (long long)n;
+            ctx->cur = p;
+            return 1;
+        }
+    }
+    if (p < ctx->end && *p == '.') {
+        if (++p >= ctx->end || *p < '0' || *p > '9')
+            return parse_error(ctx, "invalid number");
+        while (p < ctx->end && *p >= '0' && *p <= '9')
+            ++p;
+    }
+    if (p < ctx->end && (*p == 'e' || *p == 'E')) {
+        if (++p < ctx->end && (*p == '+' || *p == '-'))
+            ++p;
+        if (p >= ctx->end || *p < '0' || *p > '9')
+            return parse_error(ctx, "invalid number");
+        while (p < ctx->end && *p >= '0' && *p <= '9')
+            ++p;
+    }
+    if (num_parse(ctx->cur, p, dval) < 0)
+        return -1;
+    ctx->cur = p;
+    return 0;
+}
+/**
+ * @brief 解析数值写入槽位slot，超出48位的整数分配bigint
+ * @return int 0成功，<0失败
+ */
+static int parse_number(parse_ctx *ctx, value *slot)
+{
+    long long num;
+    double dval;
+    int ret = scan_number(ctx, &num, &dval);
+
+    if (ret < 0)
+        return -1;
+    if (ret == 0) {
+        slot_init(slot, num_word(dval));
+    } else if (num >= INT_INLINE_MIN && num <= INT_INLINE_MAX) {
+        slot_init(slot, int_word(num));
+    } else {
+        JSON *big = json_new_int(num);
+        if (!big)
+            return -1;
+        slot_move_in(slot, big);
+    }
+    return 0;
+}
+/**
+ * @brief 跳过字面量lit，不匹配时报错
+ * @return int 0成功，<0失败
+ */
+static int scan_literal(parse_ctx *ctx, const char *lit)
+{
+    size_t len = strlen(lit);
+
+    if ((size_t)(ctx->end - ctx->cur) < len || memcmp(ctx->cur, lit, len) != 0)
+        return parse_error(ctx, "invalid literal");
+    ctx->cur += len;
+    return 0;
+}
+/**
+ * @brief 解析字面量true/false/null
+ * @return int 0成功，<0失败
+ */
+static int parse_literal(parse_ctx *ctx, const char *lit, U64 w, value *slot)
+{
+    if (scan_literal(ctx, lit) < 0)
+        return -1;
+    slot_init(slot, w);
+    return 0;
+}
+/**
+ * @brief 解析逗号分隔的数组元素，直到遇到close
+ * @param close 结尾字符，为'\0'时解析到文本结尾
+ * @param limit 最多几个元素，预先分配好槽位的数组不能超过其容量
+ * @return int 0成功，<0失败，失败时已解析的元素留在数组中由调用者一起释放
+ */
+static int parse_elements(parse_ctx *ctx, JSON *json, char close, U32 limit)
+{
+    array *arr = as_arr(json);
+    value *slot;
+
+    for (;;) {
+        if (arr->count >= limit)
+            return parse_error(ctx, "unexpected element");
+        slot = arr_push(json);
+        if (!slot || parse_value(ctx, slot) < 0)
+            return -1;
+        arr_note(arr, slot->w);
+        parse_ws(ctx);
+        if (ctx->cur < ctx->end && *ctx->cur == ',') {
+            ++ctx->cur;
+            continue;
+        }
+        if (close ? ctx->cur < ctx->end && *ctx->cur == close : ctx->cur == ctx->end) {
+            ctx->cur += close != '\0';
+            return 0;
+        }
+        return parse_error(ctx, close ? "expect ',' or ']'" : "expect ','");
+    }
+}
+/**
+ * @brief 解析数组，元素直接写入数组的槽位
+ * @return int 0成功，<0失败，失败时已解析的元素留在数组中由调用者一起释放
+ */
+static int parse_array(parse_ctx *ctx, JSON *json)
+{
+    ++ctx->cur;
+    parse_ws(ctx);
+    if (ctx->cur < ctx->end && *ctx->cur == ']') {
+        ++ctx->cur;
+        return 0;
+    }
+    return parse_elements(ctx, json, ']', UINT32_MAX);
+}
+/**
+ * @brief 解析成员的键名，在对象末尾追加该成员，当前位置是键名开头的双引号
+ * @return value* 新成员的值槽位，失败返回NULL
+ * @details 键名短时解码到栈上，形状里已有这个键名时不用分配内存
+ */
+static value *parse_key(parse_ctx *ctx, JSON *json)
+{
+    char buf[PARSE_KEY_BUF], *key = buf;
+    const char *q = string_end(ctx);
+    value *slot = NULL;
+    long len;
+
+    if (!q)
+        return NULL;
+    if (q - ctx->cur > PARSE_KEY_BUF && !(key = malloc(q - ctx->cur))) {
+        fprintf(stderr, "parse_key: malloc(%lu) failed\n", (size_t)(q - ctx->cur));
+        return NULL;
+    }
+    len = string_decode(ctx, q, key);
+    if (len >= 0)
+        slot = obj_pushn(json, key, len);
+    if (key != buf)
+        free(key);
+    return slot;
+}
+/**
+ * @brief 解析逗号分隔的对象成员，直到遇到close，参数同parse_elements
+ * @details 不检查键名是否重复，重复时json_get_member返回先出现的那个
+ */
+static int parse_members(parse_ctx *ctx, JSON *json, char close, U32 limit)
+{
+    object *obj = as_obj(json);
+    value *slot;
+
+    for (;;) {
+        if (obj->count >= limit)
+            return parse_error(ctx, "unexpected member");
+        if (ctx->cur >= ctx->end || *ctx->cur != '"')
+            return parse_error(ctx, "expect key");
+        slot = parse_key(ctx, json);
+        if (!slot)
+            return -1;
+        parse_ws(ctx);
+        if (ctx->cur >= ctx->end || *ctx->cur != ':')
+            return parse_error(ctx, "expect ':'");
+        ++ctx->cur;
+        if (parse_value(ctx, slot) < 0)
+            return -1;
+        parse_ws(ctx);
+        if (ctx->cur < ctx->end && *ctx->cur == ',') {
+            ++ctx->cur;
+            parse_ws(ctx);
+            continue;
+        }
+        if (close ? ctx->cur < ctx->end && *ctx->cur == close : ctx->cur == ctx->end) {
+            ctx->cur += close != '\0';
+            return 0;
+        }
+        return parse_error(ctx, close ? "expect ',' or '}'" : "expect ','");
+    }
+}
+/**
+ * @brief 解析对象，成员直接写入对象的键值对数组
+ * @return int 0成功，<0失败，失败时已解析的成员留在对象中由调用者一起释放
+ */
+static int parse_object(parse_ctx *ctx, JSON *json)
+{
+    ++ctx->cur;
+    parse_ws(ctx);
+    if (ctx->cur < ctx->end && *ctx->cur == '}') {
+        ++ctx->cur;
+        return 0;
+    }
+    return parse_members(ctx, json, '}', UINT32_MAX);
+}
+/**
+ * @brief 解析一个JSON值，写入新追加的槽位slot(槽位已初始化为null)
+ * @return int 0成功，<0失败，失败时槽位中已解析的部分由调用者释放
+ */
+static int parse_value(parse_ctx *ctx, value *slot)
+{
+    JSON *json;
+    size_t len;
+    char *str;
+    int ret;
+
+    parse_ws(ctx);
+    if (ctx->cur >= ctx->end)
+        return parse_error(ctx, "unexpected end");
+    switch (*ctx->cur) {
+    case 't': return parse_literal(ctx, "true", BOX(TAG_BOOL, TRUE), slot);
+    case 'f': return parse_literal(ctx, "false", BOX(TAG_BOOL, FALSE), slot);
+    case 'n': return parse_literal(ctx, "null", WORD_NULL, slot);
+    case '"':
+        str = parse_string(ctx, &len);
+        if (!str)
+            return -1;
+        json = json_new(JSON_STR);
+        if (!json) {
+            free(str);
+            return -1;
+        }
+        as_str(json)->str = str;
+        as_str(json)->len = len;
+        STAT_ALLOC(JSON_STR, len + 1);
+        slot_move_in(slot, json);
+        return 0;
+    case '[':
+    case '{':
+        if (ctx->depth >= PARSE_MAX_DEPTH)
+            return parse_error(ctx, "too deep");
+        json = json_new(*ctx->cur == '[' ? JSON_ARR : JSON_OBJ);
+        if (!json)
+            return -1;
+        slot_move_in(slot, json);
+        ++ctx->depth;
+        ret = *ctx->cur == '[' ? parse_array(ctx, json) : parse_object(ctx, json);
+        --ctx->depth;
+        return ret;
+    default:
+        return parse_number(ctx, slot);
+    }
+}
+/**
+ * @brief 把栈上的根槽位变成可以交给用户的JSON值
+ * @return JSON* 容器和堆上的标量直接返回；写在槽位里的标量挪到堆上，失败返回NULL，槽位不变
+ */
+static JSON *root_detach(value *root)
+{
+    JSON *json;
+
+    if (slot_value(root) != root)
+        return slot_value(root);
+    // 写入root时已经计过数，这里只计字节
+    json = (JSON *)malloc(sizeof(value));
+    if (!json) {
+        fprintf(stderr, "json_parse: malloc(%lu) failed\n", sizeof(value));
+        return NULL;
+    }
+    STAT_ALLOC(word_type(root->w), sizeof(value));
+    json->w = root->w;
+    return json;
+}
+/**
+ * @brief 解析JSON文本
+ * 
+ * @param text JSON文本，不要求以'\0'结尾
+ * @param len 文本的长度
+ * @return JSON* 解析出的JSON值，语法错误或内存不足时返回NULL，错误位置输出到stderr
+ * @details 对象中重复的键名都会保留，json_get_member返回先出现的那个
+ */
+JSON *json_parse(const char *text, size_t len)
+{
+    parse_ctx ctx = {text, text, text + len, 0};
+    value root = {WORD_NULL};
+    JSON *json;
+
+    if (!text)
+        return NULL;
+    if (parse_value(&ctx, &root) < 0)
+        goto failed_;
+    parse_ws(&ctx);
+    if (ctx.cur != ctx.end) {
+        parse_error(&ctx, "trailing characters");
+        goto failed_;
+    }
+    if ((json = root_detach(&root)) != NULL)
+        return json;
+failed_:
+    value_clear(&root);
+    return NULL;
+}
+//-----------------------------------------------------------------------------
+//  多线程解析一个大文档
+//-----------------------------------------------------------------------------
+#define SPLIT_SEG_MIN       (64 << 10)  //每段至少多少字节，太小了线程开销不划算
+#define SPLIT_SEGS          4           //每个线程大约分到几段，段多了负载更均衡
+
+/**
+ * @brief 顶层容器的一段：若干个完整的元素(成员)，不含两端的逗号
+ */
+typedef struct split_seg {
+    const char *begin;  //段的开头
+    const char *end;    //段的结尾
+    U32 base;           //段中第一个元素(成员)在顶层容器中的序号
+    U32 count;          //段中有几个元素(成员)
+    U32 parsed;         //实际解析出几个，失败时用于释放
+    shape *shape;       //顶层是对象时，段中成员的键名
+} split_seg;
+
+/**
+ * @brief 多线程解析的任务
+ */
+typedef struct split_job {
+    const char *text;   //整个文本，用于报告出错位置
+    JSON *json;         //顶层容器，槽位已经按元素(成员)总数一次分配好
+    split_seg *segs;    //各段
+    U32 nsegs;          //段数
+    U32 next;           //下一个待领取的段，原子操作
+    int failed;         //是否有段解析失败，原子操作
+    U64 flags;          //各段数组首字标志的并集，原子操作
+} split_job;
+
+/**
+ * @brief 预扫描：跟踪字符串和转义状态找出顶层的逗号，在每个名义边界之后的第一个顶层逗号处切开
+ * @param open 顶层容器的开始括号
+ * @param nsegs 希望切成几段
+ * @return U32 实际切成的段数，0表示文本不完整、顶层容器为空或者首尾括号不配对，交给单线程解析处理
+ * @details 除了顶层的首尾括号，只统计元素个数、不做校验，文本中的语法错误由各段解析时发现
+ */
+static U32 split_scan(const char *open, const char *end, split_seg *segs, U32 nsegs)
+{
+    size_t step = (end - open) / nsegs;
+    const char *p = open + 1, *limit = open + step;
+    U32 depth = 1, n = 0, total = 0;
+
+    memset(segs, 0, nsegs * sizeof(split_seg));
+    segs[0].begin = p;
+    segs[0].count = 1;
+    for (; p < end; ++p) {
+        switch (*p) {
+        case '"':
+            for (++p; p < end && *p != '"'; ++p) {
+                if (*p == '\\')
+                    ++p;
+            }
+            break;
+        case '[': case '{':
+            ++depth;
+            break;
+        case ']': case '}':
+            if (--depth > 0)
+                break;
+            if (*p != (*open == '[' ? ']' : '}'))   // 各段看不到顶层的括号，只能在这里检查
+                return 0;
+            segs[n].end = p;
+            segs[n].base = total;
+            total += segs[n].count;
+            for (++p; p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'); ++p)
+                ;
+            if (p != end)       // 顶层容器之后还有内容
+                return 0;
+            for (p = segs[0].begin; p < segs[n].end
+                 && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'); ++p)
+                ;
+            return p == segs[n].end ? 0 : n + 1;
+        case ',':
+            if (depth != 1)
+                break;
+            if (p < limit || n + 1 == nsegs) {
+                ++segs[n].count;
+                break;
+            }
+            segs[n].end = p;
+            segs[n].base = total;
+            total += segs[n].count;
+            segs[++n].begin = p + 1;
+            segs[n].count = 1;
+            limit = open + step * (n + 1);
+            if (limit <= p)
+                limit = p + 1;
+            break;
+        }
+    }
+    return 0;
+}
+/**
+ * @brief 解析一段，元素(成员)直接写入顶层容器中属于该段的槽位
+ * @return int 0成功，<0失败，失败时已解析的部分留在该段的槽位中
+ */
+static int split_parse(split_job *job, split_seg *seg)
+{
+    parse_ctx ctx = {job->text, seg->begin, seg->end, 1};
+    U64 head = job->json->w;
+    int ret;
+
+    // 在该段的槽位上构造一个不会扩容的临时容器，解析过程与普通容器完全一样
+    if (word_type(head) == JSON_ARR) {
+        array view = {{head & ~HEAD_FLAGS}, as_arr(job->json)->elems + seg->base, 0, seg->count};
+        parse_ws(&ctx);
+        ret = parse_elements(&ctx, &view.head, '\0', seg->count);
+        if (view.head.w & HEAD_FLAGS)
+            __atomic_fetch_or(&job->flags, view.head.w & HEAD_FLAGS, __ATOMIC_RELAXED);
+        seg->parsed = view.count;
+    } else {
+        // 段中的键名只是任意一截前缀，用私有形状收集，不进转换表
+        object view = {{head}, &shape_empty, as_obj(job->json)->vals + seg->base, 0, seg->count, 0};
+        parse_ws(&ctx);
+        ret = obj_unshare(&view, seg->count);
+        if (ret == 0)
+            ret = parse_members(&ctx, &view.head, '\0', seg->count);
+        seg->parsed = view.count;
+        seg->shape = view.shape;
+    }
+    if (ret == 0 && seg->parsed != seg->count)
+        ret = parse_error(&ctx, "element count mismatch");
+    return ret;
+}
+/**
+ * @brief 顶层是对象时，把各段成员的键名依次接到顶层对象的形状上
+ * @return int 0成功，<0失败
+ * @details 键名不多时和串行解析一样走共享形状；多于SHAPE_KEYS_MAX个时最终反正是私有形状，
+ *  直接把各段的键名挪过去，不复制，也不在转换表里留下用不上的前缀
+ */
+static int split_join_keys(split_job *job)
+{
+    object *obj = as_obj(job->json);
+    shape *s;
+    U32 i, j, total = 0;
+
+    for (i = 0; i < job->nsegs; ++i)
+        total += job->segs[i].shape->count;
+    if (total <= SHAPE_KEYS_MAX) {
+        for (i = 0; i < job->nsegs; ++i) {
+            s = job->segs[i].shape;
+            for (j = 0; j < s->count; ++j) {
+                if (obj_add_key(obj, s->keys[j].key, s->keys[j].klen) < 0)
+                    return -1;
+            }
+        }
+        return 0;
+    }
+    if (obj_unshare(obj, total) < 0)
+        return -1;
+    for (i = 0; i < job->nsegs; ++i) {
+        s = job->segs[i].shape;
+        memcpy(&obj->shape->keys[obj->shape->count], s->keys, s->count * sizeof(shapekey));
+        obj->shape->count += s->count;
+        s->count = 0;   // 键名已经挪走，释放段的形状时只释放键名数组
+    }
+    return 0;
+}
+/**
+ * @brief 释放各段的形状和段数组
+ */
+static void split_release(split_job *job)
+{
+    U32 i;
+
+    for (i = 0; job->segs && i < job->nsegs; ++i) {
+        if (job->segs[i].shape)
+            shape_release(job->segs[i].shape);
+    }
+    free(job->segs);
+}
+/**
+ * @brief 工作线程：领取段解析，直到全部领完或者有段失败
+ */
+static void *split_worker(void *arg)
+{
+    split_job *job = arg;
+    U32 idx;
+
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)
+           && (idx = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nsegs) {
+        if (split_parse(job, &job->segs[idx]) < 0)
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+/**
+ * @brief 多线程解析一个顶层为数组或对象的大文档
+ * 
+ * @param text JSON文本，不要求以'\0'结尾
+ * @param len 文本的长度
+ * @param nthreads 线程数，0表示CPU核数
+ * @return JSON* 解析出的JSON值，失败返回NULL
+ * @details
+ *  1. 先单线程预扫描一遍，只跟踪字符串、转义和括号层次，在顶层逗号处把容器切成若干段，
+ *     同时数出每段有几个元素(成员)
+ *  2. 顶层容器的槽位按元素总数一次分配，各段由线程池并行解析，直接写入各自的槽位区间，
+ *     不需要再拼接或拷贝
+ *  3. 文本太小、顶层不是容器时退化为json_parse，结果与json_parse完全相同
+ */
+JSON *json_parse_parallel(const char *text, size_t len, U32 nthreads)
+{
+    const char *open = text, *end = text + len;
+    split_job job = {text, NULL, NULL, 0, 0, 0, 0};
+    pthread_t *tids = NULL;
+    U32 nsegs, total, started = 0, i, j;
+
+    if (!text)
+        return NULL;
+    if (!nthreads) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = n > 0 ? (U32)n : 1;
+    }
+    while (open < end && (*open == ' ' || *open == '\t' || *open == '\n' || *open == '\r'))
+        ++open;
+    nsegs = nthreads * SPLIT_SEGS;
+    if (nsegs > len / SPLIT_SEG_MIN)
+        nsegs = len / SPLIT_SEG_MIN;
+    if (nthreads < 2 || nsegs < 2 || open == end || (*open != '[' && *open != '{'))
+        return json_parse(text, len);
+
+    job.segs = malloc(nsegs * sizeof(split_seg));
+    if (!job.segs)
+        return json_parse(text, len);
+    job.nsegs = split_scan(open, end, job.segs, nsegs);
+    if (job.nsegs < 2) {
+        free(job.segs);
+        return json_parse(text, len);
+    }
+    total = job.segs[job.nsegs - 1].base + job.segs[job.nsegs - 1].count;
+    job.json = json_new(*open == '[' ? JSON_ARR : JSON_OBJ);
+    if (!job.json)
+        goto failed_;
+    if (*open == '[' ? slots_resize((void **)&as_arr(job.json)->elems, &as_arr(job.json)->cap,
+                                    total, sizeof(value), JSON_ARR) < 0
+                     : slots_resize((void **)&as_obj(job.json)->vals, &as_obj(job.json)->cap,
+                                    total, sizeof(value), JSON_OBJ) < 0)
+        goto failed_;
+
+    tids = malloc((nthreads - 1) * sizeof(pthread_t));
+    for (; tids && started < nthreads - 1; ++started) {
+        if (pthread_create(&tids[started], NULL, split_worker, &job) != 0)
+            break;
+    }
+    split_worker(&job);     // 调用线程也参与解析
+    for (i = 0; i < started; ++i)
+        pthread_join(tids[i], NULL);
+    free(tids);
+
+    if (job.failed) {       // 释放各段已经解析出的部分
+        for (i = 0; i < job.nsegs; ++i) {
+            for (j = 0; j < job.segs[i].parsed; ++j)
+                value_clear(*open == '[' ? &as_arr(job.json)->elems[job.segs[i].base + j]
+                                         : &as_obj(job.json)->vals[job.segs[i].base + j]);
+        }
+        goto failed_;
+    }
+    if (*open == '[') {
+        as_arr(job.json)->count = total;
+        job.json->w |= job.flags;
+    } else {
+        // 值和形状分开释放，键名接到一半失败时也可以整个释放
+        as_obj(job.json)->count = total;
+        if (split_join_keys(&job) < 0)
+            goto failed_;
+    }
+    split_release(&job);
+    return job.json;
+failed_:
+    json_free(job.json);
+    split_release(&job);
+    return NULL;
+}
+/**
+ * @brief 从文件中加载JSON
+ * 
+ * @param fname 文件名
+ * @return JSON* 加载的JSON值，打开失败、读取失败或者语法错误时返回NULL
+ */
+JSON *json_load(const char *fname)
+{
+    JSON *json = NULL;
+    char *text;
+    long len;
+    FILE *fp;
+
+    if (!fname)
+        return NULL;
+    STAT_TIMER(begin);
+    fp = fopen(fname, "rb");
+    if (!fp)
+        return NULL;
+    if (fseek(fp, 0, SEEK_END) < 0 || (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) < 0) {
+        fclose(fp);
+        return NULL;
+    }
+    text = malloc(len ? len : 1);
+    if (text && fread(text, 1, len, fp) == (size_t)len)
+        json = json_parse(text, len);
+    free(text);
+    fclose(fp);
+    STAT_LATENCY(load_lat, begin);
+    return json;
+}
+//-----------------------------------------------------------------------------
+//  输出JSON文本
+//-----------------------------------------------------------------------------
+/**
+ * @brief 输出数值，整数逐位输出，其余输出能精确还原的最短文本；NaN和无穷大输出null
+ */
+static void tb_number(textbuf *tb, double num)
+{
+    char buf[NUM_FORMAT_MAX];
+
+    if (num != num || num - num != 0) {
+        tb_write(tb, "null", 4);
+        return;
+    }
+    if (num == (long long)num && num < 1e15 && num > -1e15)
+        tb_int(tb, (long long)num);
+    else
+        tb_write(tb, buf, num_format(num, buf));
+}
+/**
+ * @brief 把JSON值输出为紧凑的JSON文本
+ */
+static void tb_value(textbuf *tb, const value *val)
+{
+    U32 i;
+
+    val = slot_value(val);
+    switch (word_type(val->w)) {
+    case JSON_NUM:
+        tb_number(tb, word_num(val->w));
+        break;
+    case JSON_INT:
+        tb_int(tb, value_int(val));
+        break;
+    case JSON_BOL:
+        if (val->w & 1)
+            tb_write(tb, "true", 4);
+        else
+            tb_write(tb, "false", 5);
+        break;
+    case JSON_STR:
+        if (as_str(val)->str)
+            tb_string(tb, as_str(val)->str, as_str(val)->len);
+        else
+            tb_write(tb, "null", 4);
+        break;
+    case JSON_ARR: {
+        const array *arr = as_arr(val);
+        tb_putc(tb, '[');
+        for (i = 0; i < arr->count; ++i) {
+            if (i)
+                tb_putc(tb, ',');
+            tb_value(tb, &arr->elems[i]);
+        }
+        tb_putc(tb, ']');
+        break;
+    }
+    case JSON_OBJ: {
+        const object *obj = as_obj(val);
+        BOOL first = TRUE;
+        tb_putc(tb, '{');
+        for (i = 0; i < obj->count; ++i) {
+            if (obj->vals[i].w == WORD_HOLE)
+                continue;
+            if (!first)
+                tb_putc(tb, ',');
+            first = FALSE;
+            tb_string(tb, obj->shape->keys[i].key, obj->shape->keys[i].klen);
+            tb_putc(tb, ':');
+            tb_value(tb, &obj->vals[i]);
+        }
+        tb_putc(tb, '}');
+        break;
+    }
+    default:
+        tb_write(tb, "null", 4);
+        break;
+    }
+}
+/**
+ * @brief 把JSON值输出为紧凑的单行JSON文本
+ * 
+ * @param json JSON值
+ * @param len 输出文本的长度，可以为NULL
+ * @return char* 堆分配的以'\0'结尾的文本，用完要free，失败返回NULL
+ * @details 输出的文本不含换行，可以直接作为JSON Lines的一行；json_parse可以把它还原
+ */
+char *json_dump(const JSON *json, size_t *len)
+{
+    textbuf tb = {NULL, 0, 0, FALSE, NULL};
+
+    if (!json)
+        return NULL;
+    tb_value(&tb, json);
+    tb_putc(&tb, '\0');
+    if (tb.failed) {
+        free(tb.data);
+        return NULL;
+    }
+    if (len)
+        *len = tb.len - 1;
+    return tb.data;
+}
+/**
+ * @brief 往对象类型的json中增加一个键值对，键名为key，值为val
+ * 
+ * @param json JSON对象
+ * @param key 键名，符合正则：[a-zA-Z_][a-zA-Z_-0-9]*
+ * @param val 键值，必须是堆分配拥有所有权的JSON值
+ * @return JSON* 成功返回加入后的成员值，失败返回NULL
+ * @details
+ *  json_add_member会转移val的所有权，所以调用json_add_member之后不用考虑释放val的问题
+ * 因为需要支持如下写法：
+ *  json_add_member(json, "port", json_new_num(80));
+ * 所以需要做到：
+ *  1) 允许val为NULL；
+ *  2) 当json_add_member内部发生失败时，需要释放val，满足将val的所有权转让给json_add_member的语义设定
+ *  数值、48位以内的整数、BOOL和null的内容会被移入对象的值槽位中，val随即释放，之后只能通过返回值
+ * 访问，且返回值在该对象再次增删成员后失效；字符串、超出48位的整数、数组和对象保持原地址，返回的就是val。
+ */
+JSON *json_add_member(JSON *json, const char *key, JSON *val)
+{
+    assert(json_type(json) == JSON_OBJ);
+    assert(!(as_obj(json)->count > 0 && as_obj(json)->vals == NULL));
+    assert(key);
+    assert(key[0]);
+    //想想: 为啥不用assert检查val？
+    //想想：如果json中已经存在名字为key的成员，怎么办？
+    if (!val)
+        return NULL;
+    // 1. 检查 key 是否已存在
+    if(json_get_member(json,key)){
+        json_free(val);
+        return NULL;                      
+    }
+    
+    // 2. key 不存在，新增键值对
+    value *slot = obj_push(json, key);
+    if (!slot) {
+        json_free(val);  // 内存分配失败，需释放 val
+        return NULL;
+    }
+    return slot_move_in(slot, val);
+}
+/**
+ * @brief 往数组类型的json中追加一个元素
+ * 
+ * @param json JSON数组
+ * @param val 加入到数组的元素，必须是堆分配拥有所有权的JSON值
+ * @return JSON* 成功返回加入后的元素，失败返回NULL
+ * @details
+ *  json_add_element会转移val的所有权，所以调用json_add_element之后不用考虑释放val的问题
+ *  与json_add_member一样，写在槽位里的标量val随即释放，返回值在该数组再次增删元素后失效；
+ * 字符串、超出48位的整数和容器保持原地址
+ */
+JSON *json_add_element(JSON *json, JSON *val)
+{
+    assert(json);
+    assert(json_type(json) == JSON_ARR);
+    assert(!(as_arr(json)->count > 0 && as_arr(json)->elems == NULL));
+
+    //想想：为啥不用assert检查val？
+    if (!val)
+        return NULL;
+    value *slot = arr_push(json);
+    if (!slot) {
+        json_free(val);
+        return NULL;
+    }
+    val = slot_move_in(slot, val);
+    arr_note(as_arr(json), slot->w);
+    return val;
+}
+/**
+ * @brief 从对象中删除键名为key的成员，把它的值交给调用者
+ * @param json 对象类型的JSON值
+ * @param key 成员的键名
+ * @param ordered TRUE时其余成员保持加入的顺序，FALSE时不保证顺序
+ * @return JSON* 被删除成员的值，调用者用json_free释放；json不是对象、没有这个成员或者内存不足时返回NULL，对象不变
+ * @details
+ *  两种方式都是均摊O(1)：保持顺序时先留下空位，空位超过一半时再一起去掉；
+ *  不保持顺序时私有形状的对象直接和最后一个成员交换，共享形状的对象也只留下空位。
+ *  键名重复时删除先出现的那个。
+ *  删除后之前取得的标量成员地址失效，数组和对象成员保持原地址
+ */
+JSON *json_remove_member(JSON *json, const char *key, BOOL ordered)
+{
+    object *obj;
+    value *slot;
+    JSON *val;
+
+    if (!json || json->w != BOX(TAG_HEAD, JSON_OBJ) || !key)
+        return NULL;
+    obj = as_obj(json);
+    slot = obj_find(obj, key, strlen(key));
+    if (!slot)
+        return NULL;
+    val = root_detach(slot);
+    if (!val)
+        return NULL;
+    obj_remove(obj, (U32)(slot - obj->vals), ordered);
+    return val;
+}
+/**
+ * @brief 从数组中删除第idx个元素，把它交给调用者
+ * @param json 数组类型的JSON值
+ * @param idx 元素的索引值
+ * @param ordered TRUE时其余元素保持顺序，FALSE时把最后一个元素挪到idx
+ * @return JSON* 被删除的元素，调用者用json_free释放；json不是数组、越界或者内存不足时返回NULL，数组不变
+ * @details 不保持顺序时O(1)；保持顺序时要把后面的元素前移，O(n)，数组按下标直接取元素，不能留空位
+ */
+JSON *json_remove_element(JSON *json, U32 idx, BOOL ordered)
+{
+    array *arr;
+    JSON *val;
+
+    if (!json || json_type(json) != JSON_ARR)
+        return NULL;
+    arr = as_arr(json);
+    if (idx >= arr->count)
+        return NULL;
+    val = root_detach(&arr->elems[idx]);
+    if (!val)
+        return NULL;
+    if (ordered)
+        memmove(&arr->elems[idx], &arr->elems[idx + 1], (arr->count - idx - 1) * sizeof(value));
+    else
+        arr->elems[idx] = arr->elems[arr->count - 1];
+    arr->count--;
+    MOD_BUMP(arr);
+    return val;
+}
+/**
+ * @brief 从对象中取走键名为key的成员，其余成员保持顺序，等同于json_remove_member(json, key, TRUE)
+ * @return JSON* 取走的值，调用者负责释放；没有这个成员时返回NULL
+ */
+JSON *json_take_member(JSON *json, const char *key)
+{
+    return json_remove_member(json, key, TRUE);
+}
+/**
+ * @brief 从数组中取走第idx个元素，其余元素保持顺序，等同于json_remove_element(json, idx, TRUE)
+ * @return JSON* 取走的元素，调用者负责释放；越界时返回NULL
+ */
+JSON *json_take_element(JSON *json, U32 idx)
+{
+    return json_remove_element(json, idx, TRUE);
+}
+/**
+ * @brief 把src中键名为srckey的成员挪到dst中，键名改为key
+ * @param dst 目标对象，已有名为key的成员时替换并释放它原来的值
+ * @param key 在dst中的键名
+ * @param src 源对象，可以就是dst，此时相当于改名
+ * @param srckey 在src中的键名
+ * @return JSON* 挪到dst中的值，失败返回NULL，此时两个对象都不变
+ * @details
+ *  只搬动值的槽位，不复制也不分配子树；src中按顺序删除这个成员。
+ *  dst不能在被挪动的子树里面。与json_add_member一样，返回的标量在dst再次增删成员后失效
+ */
+JSON *json_move_member(JSON *dst, const char *key, JSON *src, const char *srckey)
+{
+    value *from, *to;
+    BOOL fresh = FALSE;
+    U32 i;
+    U64 w;
+
+    if (!dst || dst->w != BOX(TAG_HEAD, JSON_OBJ) || !key
+        || !src || src->w != BOX(TAG_HEAD, JSON_OBJ) || !srckey)
+        return NULL;
+    from = obj_find(as_obj(src), srckey, strlen(srckey));
+    if (!from)
+        return NULL;
+    assert(slot_value(from) != dst);
+    i = (U32)(from - as_obj(src)->vals);
+    to = obj_find(as_obj(dst), key, strlen(key));
+    if (to == from)
+        return slot_value(to);
+    if (!to) {
+        to = obj_push(dst, key);
+        if (!to)
+            return NULL;
+        fresh = TRUE;
+    }
+    // 先从src中删除再释放dst中原来的值，原来的值可能包含src；删除不会失败
+    w = as_obj(src)->vals[i].w;
+    obj_remove(as_obj(src), i, TRUE);
+    if (src == dst)     // 槽位可能被压实挪动了
+        to = obj_find(as_obj(dst), key, strlen(key));
+    if (!fresh)
+        value_clear(to);
+    to->w = w;
+    return slot_value(to);
+}
+
+#define MERGE_INDEX_MIN     16      //两个对象合计超过这么多成员时给dst建临时的哈希索引
+
+/**
+ * @brief 合并时给dst对象建的临时索引，按键名哈希开放寻址，存放成员下标加1
+ * @details 共享形状最多SHAPE_KEYS_MAX个键名，键名多的对象都是私有形状，只能顺序查找，
+ * 合并两个大对象时要靠这个索引才是线性的
+ */
+typedef struct merge_index {
+    U32 *table;
+    U32 mask;
+} merge_index;
+
+static void merge_index_add(merge_index *mi, U32 hash, U32 i)
+{
+    U32 h;
+
+    // 重复的键名先加入的在探测序列前面，和obj_find一样找到先出现的那个
+    for (h = hash & mi->mask; mi->table[h]; h = (h + 1) & mi->mask)
+        ;
+    mi->table[h] = i + 1;
+}
+
+static U32 merge_index_find(const merge_index *mi, const object *obj, const char *key, U32 len, U32 hash)
+{
+    const shapekey *k;
+    U32 h, i;
+
+    for (h = hash & mi->mask; (i = mi->table[h]) != 0; h = (h + 1) & mi->mask) {
+        k = &obj->shape->keys[i - 1];
+        STAT_ADD(member_cmps, 1);
+        if (k->klen == len && memcmp(k->key, key, len) == 0)
+            return i - 1;
+    }
+    return SHAPE_NONE;
+}
+
+static int merge_obj(JSON *dst, JSON *src, U32 flags);
+
+/**
+ * @brief 把src数组的元素挪到dst数组末尾，然后释放src
+ * @return int 0成功，<0失败，失败时src也被释放
+ */
+static int merge_arr(JSON *dst, JSON *src)
+{
+    array *to = as_arr(dst), *from = as_arr(src);
+
+    if (slots_reserve((void **)&to->elems, &to->cap, to->count + from->count,
+                      sizeof(value), JSON_ARR) < 0) {
+        json_free(src);
+        return -1;
+    }
+    if (from->count)
+        memcpy(&to->elems[to->count], from->elems, (size_t)from->count * sizeof(value));
+    to->count += from->count;
+    to->head.w |= from->head.w & HEAD_FLAGS;
+    MOD_BUMP(to);
+    from->count = 0;    // 元素已经挪走，只释放数组本身
+    json_free(src);
+    return 0;
+}
+/**
+ * @brief 把src槽位中的值合并到dst槽位，src槽位中的值总是被取走(失败时释放)
+ * @return int 0成功，<0失败
+ */
+static int merge_value(value *dst, value *src, U32 flags)
+{
+    value *d = slot_value(dst), *s = slot_value(src);
+
+    if (d->w == BOX(TAG_HEAD, JSON_OBJ) && s->w == BOX(TAG_HEAD, JSON_OBJ))
+        return merge_obj(d, s, flags);
+    if ((flags & JSON_MERGE_APPEND) && json_type(d) == JSON_ARR && json_type(s) == JSON_ARR)
+        return merge_arr(d, s);
+    value_clear(dst);
+    dst->w = src->w;
+    return 0;
+}
+/**
+ * @brief 把src对象的成员逐个合并到dst对象，然后释放src
+ * @return int 0成功，<0失败，失败时src也被释放，dst中已合并的部分保留
+ */
+static int merge_obj(JSON *dst, JSON *src, U32 flags)
+{
+    object *to = as_obj(dst), *from = as_obj(src);
+    merge_index mi = {NULL, 0};
+    const shapekey *k;
+    value *slot;
+    U32 size = 16, hash = 0, i, j;
+    int ret = 0;
+
+    if (to->count + from->count > MERGE_INDEX_MIN) {
+        while (size < (to->count + from->count) * 2)
+            size *= 2;
+        mi.table = calloc(size, sizeof(U32));   // 分配失败就用obj_find，只是慢一些
+        mi.mask = size - 1;
+        for (j = 0; mi.table && j < to->count; ++j) {
+            k = &to->shape->keys[j];
+            if (to->vals[j].w != WORD_HOLE)
+                merge_index_add(&mi, key_hash(k->key, k->klen), j);
+        }
+    }
+    for (i = 0; i < from->count && ret == 0; ++i) {
+        if (from->vals[i].w == WORD_HOLE)
+            continue;
+        k = &from->shape->keys[i];
+        if (mi.table) {
+            hash = key_hash(k->key, k->klen);
+            j = merge_index_find(&mi, to, k->key, k->klen, hash);
+        } else {
+            slot = obj_find(to, k->key, k->klen);
+            j = slot ? (U32)(slot - to->vals) : SHAPE_NONE;
+        }
+        if (j != SHAPE_NONE) {
+            ret = merge_value(&to->vals[j], &from->vals[i], flags);
+        } else if ((slot = obj_pushn(dst, k->key, k->klen)) != NULL) {
+            slot->w = from->vals[i].w;     // 整个挪过去，不复制
+            if (mi.table)
+                merge_index_add(&mi, hash, to->count - 1);
+        } else {
+            ret = -1;
+            break;      // 这个成员还在src里，随src释放
+        }
+        from->vals[i].w = WORD_HOLE;    // 已经挪走，释放src时跳过
+    }
+    free(mi.table);
+    json_free(src);
+    return ret;
+}
+/**
+ * @brief 把对象src深度合并到对象dst中，src的节点直接挪进dst，不复制
+ * @param dst 目标对象
+ * @param src 要合并进来的对象，所有权转给json_merge，成功失败都会被释放
+ * @param flags JSON_MERGE_REPLACE或JSON_MERGE_APPEND，决定两边都是数组时怎么处理
+ * @return int 0成功，<0失败；dst或src不是对象时什么也不合并，内存不足时dst中已合并的部分保留
+ * @details
+ *  src的每个成员：dst中没有的追加到dst末尾；两边都是对象的递归合并；两边都是数组且指定了
+ *  JSON_MERGE_APPEND的把src的元素追加到后面；其余情况用src的值替换dst的值。
+ *  成员多的对象建临时的哈希索引，合并两个大对象的时间和成员总数成正比。
+ *  src不能是dst的一部分。
+ */
+int json_merge(JSON *dst, JSON *src, U32 flags)
+{
+    if (!dst || dst->w != BOX(TAG_HEAD, JSON_OBJ) || !src || src->w != BOX(TAG_HEAD, JSON_OBJ)) {
+        if (src != dst)
+            json_free(src);
+        return -1;
+    }
+    assert(src != dst);
+    return merge_obj(dst, src, flags);
+}
+
+/**
+ * @brief 从数值数组中批量读取数值
+ * 
+ * @param json 数组类型的JSON值
+ * @param out 输出缓冲区，至少能放n个double
+ * @param off 从第off个元素开始读
+ * @param n 最多读取的个数
+ * @return int 实际读取的个数，越界部分不读；json不是数组，或者范围内有非数值元素时返回-1
+ * @details 数组全是double时直接memcpy，只含double和内联整数时逐个转换，不用逐个取值
+ */
+int json_arr_get_nums(const JSON *json, double *out, U32 off, U32 n)
+{
+    const array *arr;
+    U32 i;
+
+    if (!json || json_type(json) != JSON_ARR || (n && !out))
+        return -1;
+    arr = as_arr(json);
+    if (off >= arr->count)
+        return 0;
+    if (n > arr->count - off)
+        n = arr->count - off;
+    if (arr_doubles(arr)) {
+        memcpy(out, &arr->elems[off], (size_t)n * sizeof(double));
+        return n;
+    }
+    if (arr_packed(arr)) {  // 只有double和内联整数，不用经过slot_value
+        for (i = 0; i < n; ++i) {
+            U64 w = arr->elems[off + i].w;
+            out[i] = w < BOX_BASE ? word_num(w) : (double)word_int(w);
+        }
+        return n;
+    }
+    for (i = 0; i < n; ++i) {
+        const value *val = slot_value(&arr->elems[off + i]);
+        if (word_type(val->w) == JSON_INT)
+            out[i] = (double)value_int(val);
+        else if (val->w < BOX_BASE)
+            out[i] = word_num(val->w);
+        else
+            return -1;
+    }
+    return n;
+}
+/**
+ * @brief 往数组末尾批量追加数值
+ * 
+ * @param json 数组类型的JSON值
+ * @param nums 待追加的数值
+ * @param n 数值的个数
+ * @return int 0成功，<0失败，失败时数组不变
+ * @details 一次扩容，一次memcpy，之后只需把其中的NaN规整一下
+ */
+int json_arr_add_nums(JSON *json, const double *nums, U32 n)
+{
+    array *arr;
+    U32 i;
+
+    if (!json || json_type(json) != JSON_ARR || (n && !nums))
+        return -1;
+    arr = as_arr(json);
+    if (slots_reserve((void **)&arr->elems, &arr->cap, arr->count + n,
+                      sizeof(value), JSON_ARR) < 0)
+        return -1;
+    memcpy(&arr->elems[arr->count], nums, (size_t)n * sizeof(double));
+    for (i = arr->count; i < arr->count + n; ++i) {
+        if ((arr->elems[i].w & ~(1ULL << 63)) > 0x7FF0000000000000ULL)  // NaN
+            arr->elems[i].w = BOX_NAN;
+    }
+    arr->count += n;
+    MOD_BUMP(arr);
+    STAT_ADD(nodes_alloc[JSON_NUM], n);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+//  结构体绑定
+//-----------------------------------------------------------------------------
+#define BIND_HASH_SIZE  (JSON_BIND_MAX_FIELDS * 2)  //键名散列表的桶数，装载率不超过1/2
+#define BIND_EMPTY      0xFF                        //空桶
+
+/**
+ * @brief 键名的FNV-1a散列值
+ */
+static U32 bind_hash(const char *key)
+{
+    U32 h = 2166136261u;
+
+    while (*key)
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h;
+}
+/**
+ * @brief 数一下描述表有几个字段
+ */
+static U32 bind_count(const json_field_desc *desc)
+{
+    U32 n = 0;
+
+    while (desc[n].key)
+        ++n;
+    return n;
+}
+/**
+ * @brief 把字段(或数组元素)field设为缺省值
+ * @param kind 字段的类型，数组元素时为desc->elem
+ * @return int 0成功，<0失败(只有复制缺省字符串会失败，字段置为NULL)
+ */
+static int bind_default(char *field, const json_field_desc *desc, json_bind_e kind)
+{
+    switch (kind) {
+    case JSON_BIND_BOL: *(BOOL *)field = desc->def_num != 0; break;
+    case JSON_BIND_INT: *(int *)field = (int)desc->def_num; break;
+    case JSON_BIND_NUM: *(double *)field = desc->def_num; break;
+    case JSON_BIND_STR:
+        *(char **)field = desc->def_str ? strdup(desc->def_str) : NULL;
+        if (desc->def_str && !*(char **)field)
+            return -1;
+        break;
+    case JSON_BIND_OBJ: return json_bind(field, desc->sub, NULL);
+    case JSON_BIND_ARR: break;      //元素个数在bind_field中清零
+    }
+    return 0;
+}
+/**
+ * @brief 用槽位slot中的JSON值填写字段(或数组元素)field
+ * @return int 1已填写，0类型不匹配未填写，<0失败
+ */
+static int bind_value(char *field, const json_field_desc *desc, json_bind_e kind, const value *slot)
+{
+    const value *val = slot_value(slot);
+
+    switch (kind) {
+    case JSON_BIND_BOL:
+        if (BOX_TAG(val->w) != TAG_BOOL)
+            return 0;
+        *(BOOL *)field = (BOOL)(val->w & 1);
+        return 1;
+    case JSON_BIND_INT:
+    case JSON_BIND_NUM:
+        if (word_type(val->w) == JSON_INT) {
+            long long num = value_int(val);
+            if (kind == JSON_BIND_NUM)
+                *(double *)field = (double)num;
+            else if (num >= INT_MIN && num <= INT_MAX)
+                *(int *)field = (int)num;
+            else
+                return 0;   //int放不下，当作类型不匹配
+            return 1;
+        }
+        if (val->w >= BOX_BASE)
+            return 0;
+        if (kind == JSON_BIND_NUM) {
+            *(double *)field = word_num(val->w);
+        } else {
+            double num = word_num(val->w);
+            if (!(num >= INT_MIN && num <= INT_MAX))    //NaN也不满足
+                return 0;
+            *(int *)field = (int)num;
+        }
+        return 1;
+    case JSON_BIND_STR:
+        if (val->w != BOX(TAG_HEAD, JSON_STR))
+            return 0;
+        *(char **)field = strdup(as_str(val)->str);
+        return *(char **)field ? 1 : -1;
+    case JSON_BIND_OBJ:
+        if (val->w != BOX(TAG_HEAD, JSON_OBJ))
+            return 0;
+        return json_bind(field, desc->sub, val) < 0 ? -1 : 1;
+    case JSON_BIND_ARR:
+        break;
+    }
+    return 0;
+}
+/**
+ * @brief 用数组val填写ARR字段，超出容量的元素忽略，类型不匹配的元素取缺省值
+ * @return int 1已填写，0类型不匹配未填写，<0失败
+ */
+static int bind_array(char *base, const json_field_desc *desc, const value *slot)
+{
+    const value *val = slot_value(slot);
+    const array *arr;
+    U32 i, n;
+    int ret = 1;
+
+    if (word_type(val->w) != JSON_ARR)
+        return 0;
+    arr = as_arr(val);
+    n = arr->count < desc->cap ? arr->count : desc->cap;
+    for (i = 0; i < n; ++i) {
+        char *elem = base + desc->offset + (size_t)i * desc->elem_size;
+        int r = bind_value(elem, desc, desc->elem, &arr->elems[i]);
+        if (r == 0)
+            r = bind_default(elem, desc, desc->elem);
+        if (r < 0)
+            ret = -1;
+    }
+    *(U32 *)(base + desc->count_offset) = n;
+    return ret;
+}
+/**
+ * @brief 按字段描述表，把对象json中的成员一次性填写到结构体out中
+ * 
+ * @param out 待填写的结构体
+ * @param desc 字段描述表，以JSON_FIELD_END结尾，最多JSON_BIND_MAX_FIELDS个字段
+ * @param json 对象类型的JSON值，为NULL或不是对象时全部字段取缺省值
+ * @return int 0成功，<0失败
+ * @details
+ *  1. 先用描述表的键名建一张小散列表，然后只顺序扫描一遍对象的键值对，
+ *     每个成员一次散列查找，F个字段、N个成员的代价是O(F+N)，而逐个json_get_member是O(F*N)
+ *  2. 对象中没有的成员、类型不匹配的成员，字段取缺省值；对象中多出来的成员忽略
+ *     INT字段遇到超出int范围的数或NaN，也按类型不匹配处理
+ *  3. 字符串字段都是strdup出来的，用完要调用json_bind_free释放；
+ *     失败时已填写的字段保持有效(复制失败的字符串为NULL)，同样用json_bind_free释放
+ */
+int json_bind(void *out, const json_field_desc *desc, const JSON *json)
+{
+    unsigned char table[BIND_HASH_SIZE];
+    U64 bound = 0;
+    char *base = out;
+    U32 nfields, i, h;
+    int ret = 0;
+
+    assert(out);
+    assert(desc);
+    nfields = bind_count(desc);
+    if (nfields > JSON_BIND_MAX_FIELDS) {
+        fprintf(stderr, "json_bind: too many fields(%u)\n", nfields);
+        return -1;
+    }
+    if (json && json->w == BOX(TAG_HEAD, JSON_OBJ)) {
+        const object *obj = as_obj(json);
+
+        memset(table, BIND_EMPTY, sizeof(table));
+        for (i = 0; i < nfields; ++i) {
+            h = bind_hash(desc[i].key) % BIND_HASH_SIZE;
+            while (table[h] != BIND_EMPTY)
+                h = (h + 1) % BIND_HASH_SIZE;
+            table[h] = (unsigned char)i;
+        }
+        for (i = 0; i < obj->count; ++i) {
+            const char *key = obj->shape->keys[i].key;
+            const json_field_desc *d = NULL;
+            int r;
+
+            if (obj->vals[i].w == WORD_HOLE)
+                continue;
+            for (h = bind_hash(key) % BIND_HASH_SIZE; table[h] != BIND_EMPTY;
+                 h = (h + 1) % BIND_HASH_SIZE) {
+                STAT_ADD(member_cmps, 1);
+                if (strcmp(desc[table[h]].key, key) == 0) {
+                    d = &desc[table[h]];
+                    break;
+                }
+            }
+            if (!d || (bound >> table[h] & 1))
+                continue;
+            if (d->type == JSON_BIND_ARR)
+                r = bind_array(base, d, &obj->vals[i]);
+            else
+                r = bind_value(base + d->offset, d, d->type, &obj->vals[i]);
+            if (r < 0)
+                ret = -1;
+            if (r != 0)
+                bound |= 1ULL << table[h];
+        }
+    }
+    for (i = 0; i < nfields; ++i) {
+        if (bound >> i & 1)
+            continue;
+        if (desc[i].type == JSON_BIND_ARR)
+            *(U32 *)(base + desc[i].count_offset) = 0;
+        else if (bind_default(base + desc[i].offset, &desc[i], desc[i].type) < 0)
+            ret = -1;
+    }
+    return ret;
+}
+/**
+ * @brief 释放json_bind填写到结构体中的字符串，释放后字符串字段为NULL
+ * @param out json_bind填写过的结构体
+ * @param desc 填写时用的字段描述表
+ */
+void json_bind_free(void *out, const json_field_desc *desc)
+{
+    char *base = out;
+    U32 i, n;
+
+    for (; desc->key; ++desc) {
+        char *field = base + desc->offset;
+
+        switch (desc->type) {
+        case JSON_BIND_STR:
+            free(*(char **)field);
+            *(char **)field = NULL;
+            break;
+        case JSON_BIND_OBJ:
+            json_bind_free(field, desc->sub);
+            break;
+        case JSON_BIND_ARR:
+            for (i = 0, n = *(U32 *)(base + desc->count_offset); i < n; ++i) {
+                char *elem = field + (size_t)i * desc->elem_size;
+                if (desc->elem == JSON_BIND_STR) {
+                    free(*(char **)elem);
+                    *(char **)elem = NULL;
+                } else if (desc->elem == JSON_BIND_OBJ) {
+                    json_bind_free(elem, desc->sub);
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+/**
+ * @brief 把字段(或数组元素)field的值写入新追加的槽位slot
+ * @return int 0成功，<0失败，失败时槽位保持为null
+ */
+static int unbind_value(value *slot, const char *field, const json_field_desc *desc, json_bind_e kind)
+{
+    JSON *val;
+
+    switch (kind) {
+    case JSON_BIND_BOL:
+        slot_init(slot, BOX(TAG_BOOL, *(const BOOL *)field ? TRUE : FALSE));
+        return 0;
+    case JSON_BIND_INT:
+        slot_init(slot, int_word(*(const int *)field));
+        return 0;
+    case JSON_BIND_NUM:
+        slot_init(slot, num_word(*(const double *)field));
+        return 0;
+    case JSON_BIND_STR:
+        if (!*(char *const *)field) {
+            slot_init(slot, WORD_NULL);
+            return 0;
+        }
+        val = json_new_str(*(char *const *)field);
+        break;
+    case JSON_BIND_OBJ:
+        val = json_unbind(field, desc->sub);
+        break;
+    default:
+        val = NULL;
+        break;
+    }
+    if (!val) {
+        slot_init(slot, WORD_NULL);
+        return -1;
+    }
+    slot_move_in(slot, val);
+    return 0;
+}
+/**
+ * @brief 把ARR字段转换为JSON数组
+ */
+static JSON *unbind_array(const char *base, const json_field_desc *desc)
+{
+    JSON *json = json_new(JSON_ARR);
+    array *arr;
+    U32 i, n = *(const U32 *)(base + desc->count_offset);
+
+    if (!json)
+        return NULL;
+    if (n > desc->cap)
+        n = desc->cap;
+    arr = as_arr(json);
+    if (n && slots_resize((void **)&arr->elems, &arr->cap, n, sizeof(value), JSON_ARR) < 0)
+        goto failed_;
+    for (i = 0; i < n; ++i) {
+        value *slot = arr_push(json);
+        if (unbind_value(slot, base + desc->offset + (size_t)i * desc->elem_size,
+                         desc, desc->elem) < 0)
+            goto failed_;
+        arr_note(arr, slot->w);
+    }
+    return json;
+failed_:
+    json_free(json);
+    return NULL;
+}
+/**
+ * @brief 按字段描述表，把结构体in转换为一个JSON对象，json_bind的逆操作
+ * 
+ * @param in 结构体
+ * @param desc 字段描述表
+ * @return JSON* 新建的对象，失败返回NULL
+ * @details 字段个数和数组元素个数事先已知，所有容器都按准确的大小一次分配，不会再realloc；
+ *  值为NULL的字符串字段输出为null
+ */
+JSON *json_unbind(const void *in, const json_field_desc *desc)
+{
+    const char *base = in;
+    U32 nfields = bind_count(desc);
+    JSON *json = json_new(JSON_OBJ);
+    object *obj;
+    U32 i;
+
+    assert(in);
+    if (!json)
+        return NULL;
+    obj = as_obj(json);
+    if (nfields && slots_resize((void **)&obj->vals, &obj->cap, nfields,
+                                sizeof(value), JSON_OBJ) < 0)
+        goto failed_;
+    for (i = 0; i < nfields; ++i) {
+        value *slot = obj_push(json, desc[i].key);
+        JSON *arr;
+
+        if (!slot)
+            goto failed_;
+        if (desc[i].type != JSON_BIND_ARR) {
+            if (unbind_value(slot, base + desc[i].offset, &desc[i], desc[i].type) < 0)
+                goto failed_;
+            continue;
+        }
+        arr = unbind_array(base, &desc[i]);
+        if (!arr)
+            goto failed_;
+        slot_move_in(slot, arr);
+    }
+    return json;
+failed_:
+    json_free(json);
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+//  JSONPath查询
+//-----------------------------------------------------------------------------
+/*
+json_path_compile所使用的路径表达式语法(RFC 9535的子集)：
+
+path     ::= ['$'] [name] segment*;
+segment  ::= ['.' | '..'] '*' | ('.' | '..') name | ['..'] '[' selector ']';
+selector ::= <integer> | '*' | slice | quoted | filter;
+slice    ::= [<integer>] ':' [<integer>] [':' [<integer>]];
+quoted   ::= "'" <chars> "'" | '"' <chars> '"';
+filter   ::= '?' ['('] '@' ('.' name | '[' quoted ']')* [op literal] [')'];
+op       ::= '==' | '!=' | '<' | '<=' | '>' | '>=';
+literal  ::= quoted | JSON数值 | true | false | null;
+
+开头的name兼容方案2的写法，如"basic.dns[1]"等价于"$.basic.dns[1]"
+ */
+#define PATH_RESULT_MIN 16      //结果数组的初始容量
+
+typedef enum path_sel_e {
+    SEL_NAME,       //成员名
+    SEL_WILD,       //所有子成员
+    SEL_INDEX,      //数组下标
+    SEL_SLICE,      //数组切片
+    SEL_FILTER,     //满足条件的子成员
+} path_sel_e;
+
+typedef enum path_op_e {
+    OP_EXISTS,      //只要求@后面的成员存在
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+} path_op_e;
+
+/**
+ * @brief 编译后的一个路径段
+ */
+typedef struct path_step {
+    path_sel_e sel;
+    BOOL descend;       //'..'：对当前节点及其所有子孙应用选择器
+    char *name;         //SEL_NAME的成员名
+    int index;          //SEL_INDEX的下标，负数从末尾数起
+    int slice[3];       //SEL_SLICE的start、end、step
+    BOOL has[2];        //SEL_SLICE是否给出了start、end
+    char **keys;        //SEL_FILTER中'@'之后的成员名
+    U32 nkeys;
+    path_op_e op;       //SEL_FILTER的比较运算
+    JSON *lit;          //SEL_FILTER比较的字面量
+} path_step;
+
+struct json_path {
+    path_step *steps;
+    U32 count;
+    U32 cap;
+};
+
+/**
+ * @brief 报告路径表达式的语法错误
+ * @return const char* 总是NULL，便于直接return
+ */
+static const char *path_error(const char *expr, const char *cur, const char *info)
+{
+    fprintf(stderr, "%s\n", info);
+    fprintf(stderr, "path: %s\n", expr);
+    fprintf(stderr, "%*s^\n", (int)(cur - expr + 6), " ");
+    return NULL;
+}
+
+static const char *path_ws(const char *cur)
+{
+    while (*cur == ' ' || *cur == '\t')
+        ++cur;
+    return cur;
+}
+
+/**
+ * @brief 解析点号后的成员名，到'.'、'['或结尾为止
+ * @return const char* 成员名之后的位置，失败返回NULL
+ */
+static const char *path_name(const char *expr, const char *cur, char **name)
+{
+    size_t len = strcspn(cur, ".[]()=!<> \t");
+
+    if (len == 0)
+        return path_error(expr, cur, "member name expected");
+    *name = strndup(cur, len);
+    if (!*name)
+        return path_error(expr, cur, "out of memory");
+    return cur + len;
+}
+
+/**
+ * @brief 解析单引号或双引号括起来的成员名，支持'\'转义
+ */
+static const char *path_quoted(const char *expr, const char *cur, char **name)
+{
+    char quote = *cur++;
+    size_t len = 0;
+    char *out;
+
+    out = malloc(strlen(cur) + 1);
+    if (!out)
+        return path_error(expr, cur, "out of memory");
+    while (*cur != quote) {
+        if (*cur == '\\' && cur[1])
+            ++cur;
+        if (*cur == '\0') {
+            free(out);
+            return path_error(expr, cur, "unterminated string");
+        }
+        out[len++] = *cur++;
+    }
+    out[len] = '\0';
+    *name = out;
+    return cur + 1;
+}
+
+/**
+ * @brief 解析可带负号的十进制整数
+ */
+static const char *path_int(const char *expr, const char *cur, int *val)
+{
+    char *end;
+    long n;
+
+    errno = 0;
+    n = strtol(cur, &end, 10);
+    if (end == cur || (*cur != '-' && (*cur < '0' || *cur > '9')))
+        return path_error(expr, cur, "integer expected");
+    if (errno || n > INT32_MAX || n < -INT32_MAX)
+        return path_error(expr, cur, "integer out of range");
+    *val = (int)n;
+    return end;
+}
+
+/**
+ * @brief 解析过滤条件"?(@.key op literal)"，cur指向'?'之后
+ */
+static const char *path_filter(const char *expr, const char *cur, path_step *step)
+{
+    static const struct { const char *text; path_op_e op; } ops[] = {
+        {"==", OP_EQ}, {"!=", OP_NE}, {"<=", OP_LE}, {">=", OP_GE}, {"<", OP_LT}, {">", OP_GT},
+    };
+    BOOL paren;
+    char *key;
+    size_t i;
+
+    cur = path_ws(cur);
+    paren = *cur == '(';
+    if (paren)
+        cur = path_ws(cur + 1);
+    if (*cur++ != '@')
+        return path_error(expr, cur - 1, "'@' expected");
+    for (;;) {
+        if (*cur == '.') {
+            cur = path_name(expr, cur + 1, &key);
+        } else if (*cur == '[' && (cur[1] == '\'' || cur[1] == '"')) {
+            cur = path_quoted(expr, cur + 1, &key);
+            if (cur && *cur++ != ']') {
+                free(key);
+                return path_error(expr, cur - 1, "']' expected");
+            }
+        } else {
+            break;
+        }
+        if (!cur)
+            return NULL;
+        char **keys = realloc(step->keys, sizeof(*keys) * (step->nkeys + 1));
+        if (!keys) {
+            free(key);
+            return path_error(expr, cur, "out of memory");
+        }
+        step->keys = keys;
+        step->keys[step->nkeys++] = key;
+    }
+
+    cur = path_ws(cur);
+    step->op = OP_EXISTS;
+    for (i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (strncmp(cur, ops[i].text, strlen(ops[i].text)) == 0) {
+            step->op = ops[i].op;
+            cur = path_ws(cur + strlen(ops[i].text));
+            break;
+        }
+    }
+    if (step->op != OP_EXISTS) {
+        if (*cur == '\'' || *cur == '"') {
+            char *str;
+            cur = path_quoted(expr, cur, &str);
+            if (!cur)
+                return NULL;
+            step->lit = json_new_str(str);
+            free(str);
+        } else {
+            size_t len = strcspn(cur, ")] \t");
+            step->lit = len ? json_parse(cur, len) : NULL;
+            cur += len;
+        }
+        if (!step->lit)
+            return path_error(expr, cur, "literal expected");
+        cur = path_ws(cur);
+    }
+    if (paren && *cur++ != ')')
+        return path_error(expr, cur - 1, "')' expected");
+    return cur;
+}
+
+/**
+ * @brief 解析方括号中的选择器，cur指向'['之后
+ */
+static const char *path_bracket(const char *expr, const char *cur, path_step *step)
+{
+    int i;
+
+    cur = path_ws(cur);
+    if (*cur == '*') {
+        step->sel = SEL_WILD;
+        cur++;
+    } else if (*cur == '\'' || *cur == '"') {
+        step->sel = SEL_NAME;
+        cur = path_quoted(expr, cur, &step->name);
+    } else if (*cur == '?') {
+        step->sel = SEL_FILTER;
+        cur = path_filter(expr, cur + 1, step);
+    } else {
+        //下标或切片，切片的三个整数都可以省略
+        step->sel = SEL_INDEX;
+        step->slice[2] = 1;
+        for (i = 0; i < 3 && cur; ++i) {
+            cur = path_ws(cur);
+            if (*cur != ':' && *cur != ']') {
+                cur = path_int(expr, cur, &step->slice[i]);
+                if (!cur)
+                    return NULL;
+                if (i < 2)
+                    step->has[i] = TRUE;
+                cur = path_ws(cur);
+            } else if (i == 0 && *cur == ']') {
+                return path_error(expr, cur, "index expected");
+            }
+            if (*cur != ':')
+                break;
+            step->sel = SEL_SLICE;
+            cur++;
+        }
+        if (step->sel == SEL_INDEX)
+            step->index = step->slice[0];
+    }
+    if (!cur)
+        return NULL;
+    cur = path_ws(cur);
+    if (*cur != ']')
+        return path_error(expr, cur, "']' expected");
+    return cur + 1;
+}
+
+/**
+ * @brief 在路径末尾追加一个空的段
+ */
+static path_step *path_add(json_path *path)
+{
+    path_step *steps;
+
+    if (path->count == path->cap) {
+        steps = realloc(path->steps, sizeof(*steps) * (path->cap ? path->cap * 2 : 4));
+        if (!steps)
+            return NULL;
+        path->steps = steps;
+        path->cap = path->cap ? path->cap * 2 : 4;
+    }
+    steps = &path->steps[path->count++];
+    memset(steps, 0, sizeof(*steps));
+    return steps;
+}
+
+/**
+ * @brief 编译JSONPath表达式
+ * @param expr 表达式，如"$.advance.dns[*].ip"、"$..records[?(@.name == 'huabei')]"
+ * @return json_path* 编译结果，语法错误时返回NULL并把错误位置输出到stderr
+ */
+json_path *json_path_compile(const char *expr)
+{
+    json_path *path;
+    const char *cur;
+    path_step *step;
+    BOOL bare = FALSE;
+
+    if (!expr) return NULL;
+    path = calloc(1, sizeof(*path));
+    if (!path) return NULL;
+
+    cur = expr;
+    if (*cur == '$')
+        cur++;
+    else if (*cur && *cur != '.' && *cur != '[')
+        bare = TRUE;    //方案2的写法，开头的成员名前没有'.'
+    while (cur && *cur) {
+        step = path_add(path);
+        if (!step) {
+            cur = path_error(expr, cur, "out of memory");
+            break;
+        }
+        if (bare || *cur == '.') {
+            if (!bare && *++cur == '.') {
+                step->descend = TRUE;
+                cur++;
+            }
+            bare = FALSE;
+            if (*cur == '*') {
+                step->sel = SEL_WILD;
+                cur++;
+            } else if (*cur == '[' && step->descend) {
+                cur = path_bracket(expr, cur + 1, step);
+            } else {
+                step->sel = SEL_NAME;
+                cur = path_name(expr, cur, &step->name);
+            }
+        } else if (*cur == '[') {
+            cur = path_bracket(expr, cur + 1, step);
+        } else {
+            cur = path_error(expr, cur, "'.' or '[' expected");
+        }
+    }
+    if (!cur) {
+        json_path_free(path);
+        return NULL;
+    }
+    return path;
+}
+
+/**
+ * @brief 释放编译后的路径
+ */
+void json_path_free(json_path *path)
+{
+    U32 i, j;
+
+    if (!path) return;
+    for (i = 0; i < path->count; ++i) {
+        free(path->steps[i].name);
+        for (j = 0; j < path->steps[i].nkeys; ++j)
+            free(path->steps[i].keys[j]);
+        free(path->steps[i].keys);
+        json_free(path->steps[i].lit);
+    }
+    free(path->steps);
+    free(path);
+}
+
+/**
+ * @brief 释放查询结果数组，res可以再次用于查询
+ */
+void json_result_free(json_result *res)
+{
+    if (!res) return;
+    free(res->items);
+    res->items = NULL;
+    res->count = res->cap = 0;
+}
+
+/**
+ * @brief 一次查询的状态
+ */
+typedef struct path_run {
+    const json_path *path;
+    json_result *res;
+    BOOL failed;        //结果数组扩容失败
+} path_run;
+
+static U32 path_count(const JSON *node)
+{
+    json_e type = json_type(node);
+
+    if (type == JSON_ARR)
+        return as_arr(node)->count;
+    return type == JSON_OBJ ? as_obj(node)->count : 0;
+}
+
+/**
+ * @brief 数组的元素或对象的成员值，i < path_count(node)，对象的空位返回NULL
+ */
+static const JSON *path_child(const JSON *node, U32 i)
+{
+    if (json_type(node) == JSON_ARR)
+        return slot_value(&as_arr(node)->elems[i]);
+    if (as_obj(node)->vals[i].w == WORD_HOLE)
+        return NULL;
+    return slot_value(&as_obj(node)->vals[i]);
+}
+
+/**
+ * @brief 在对象中查找成员，允许空键名，非对象返回NULL
+ */
+static const JSON *path_member(const JSON *node, const char *key)
+{
+    const value *slot;
+
+    if (json_type(node) != JSON_OBJ)
+        return NULL;
+    slot = obj_find(as_obj(node), key, strlen(key));
+    return slot ? slot_value(slot) : NULL;
+}
+
+/**
+ * @brief 比较两个JSON值
+ * @return int <0、0、>0表示小于、等于、大于；2表示不可比较(类型不同、容器、不相等的布尔值)
+ * @details 整数和数值之间按double比较，两个整数按long long比较
+ */
+static int path_compare(const JSON *lhs, const JSON *rhs)
+{
+    double a, b;
+    int c;
+
+    if (json_type(lhs) == JSON_INT && json_type(rhs) == JSON_INT) {
+        long long x = value_int(lhs), y = value_int(rhs);
+        return x < y ? -1 : x > y;
+    }
+    if ((json_type(lhs) == JSON_INT && json_type(rhs) == JSON_NUM)
+        || (json_type(lhs) == JSON_NUM && json_type(rhs) == JSON_INT)) {
+        a = json_num(lhs, 0);
+        b = json_num(rhs, 0);
+        return a < b ? -1 : a > b ? 1 : 0;
+    }
+    if (json_type(lhs) != json_type(rhs))
+        return 2;
+    switch (json_type(lhs)) {
+        case JSON_NONE:
+            return 0;
+        case JSON_BOL:
+            return json_bool(lhs) == json_bool(rhs) ? 0 : 2;
+        case JSON_NUM:
+            a = word_num(lhs->w);
+            b = word_num(rhs->w);
+            return a < b ? -1 : a > b ? 1 : a == b ? 0 : 2;
+        case JSON_STR: {
+            size_t m = as_str(lhs)->len, n = as_str(rhs)->len;
+            c = memcmp(as_str(lhs)->str, as_str(rhs)->str, m < n ? m : n);
+            if (c == 0)
+                return m < n ? -1 : m > n;
+            return c < 0 ? -1 : 1;
+        }
+        default:
+            return 2;
+    }
+}
+
+/**
+ * @brief node是否满足过滤条件
+ * @details '@'后面的成员不存在时只有'!='成立
+ */
+static BOOL path_test(const path_step *step, const JSON *node)
+{
+    U32 i;
+    int c;
+
+    for (i = 0; i < step->nkeys && node; ++i)
+        node = path_member(node, step->keys[i]);
+    if (step->op == OP_EXISTS)
+        return node != NULL;
+    if (!node)
+        return step->op == OP_NE;
+    c = path_compare(node, step->lit);
+    switch (step->op) {
+        case OP_EQ: return c == 0;
+        case OP_NE: return c != 0;
+        case OP_LT: return c == -1;
+        case OP_LE: return c == -1 || c == 0;
+        case OP_GT: return c == 1;
+        case OP_GE: return c == 1 || c == 0;
+        default:    return FALSE;
+    }
+}
+
+static void path_match(path_run *run, U32 i, const JSON *node);
+
+/**
+ * @brief 对node应用第i段的选择器，选中的子成员继续匹配第i+1段
+ */
+static void path_select(path_run *run, U32 i, const JSON *node)
+{
+    const path_step *step = &run->path->steps[i];
+    U32 count = path_count(node), k;
+    int len, start, end, idx;
+
+    switch (step->sel) {
+        case SEL_NAME:
+            node = path_member(node, step->name);
+            if (node)
+                path_match(run, i + 1, node);
+            break;
+        case SEL_WILD:
+            for (k = 0; k < count && !run->failed; ++k)
+                path_match(run, i + 1, path_child(node, k));
+            break;
+        case SEL_INDEX:
+            if (json_type(node) != JSON_ARR)
+                break;
+            idx = step->index < 0 ? step->index + (int)count : step->index;
+            if (idx >= 0 && (U32)idx < count)
+                path_match(run, i + 1, path_child(node, idx));
+            break;
+        case SEL_SLICE:
+            if (json_type(node) != JSON_ARR || step->slice[2] == 0)
+                break;
+            //按RFC 9535规范化，负数从末尾数起并截断到数组范围内
+            len = (int)count;
+            start = step->has[0] ? step->slice[0] : (step->slice[2] > 0 ? 0 : len - 1);
+            end = step->has[1] ? step->slice[1] : (step->slice[2] > 0 ? len : -len - 1);
+            start = start < 0 ? start + len : start;
+            end = end < 0 ? end + len : end;
+            if (step->slice[2] > 0) {
+                start = start < 0 ? 0 : start > len ? len : start;
+                end = end < 0 ? 0 : end > len ? len : end;
+                for (idx = start; idx < end && !run->failed; idx += step->slice[2])
+                    path_match(run, i + 1, path_child(node, idx));
+            } else {
+                start = start < -1 ? -1 : start > len - 1 ? len - 1 : start;
+                end = end < -1 ? -1 : end > len - 1 ? len - 1 : end;
+                for (idx = start; idx > end && !run->failed; idx += step->slice[2])
+                    path_match(run, i + 1, path_child(node, idx));
+            }
+            break;
+        case SEL_FILTER:
+            for (k = 0; k < count && !run->failed; ++k) {
+                const JSON *child = path_child(node, k);
+                if (child && path_test(step, child))
+                    path_match(run, i + 1, child);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief 对node及其所有子孙按文档顺序应用第i段的选择器
+ */
+static void path_descend(path_run *run, U32 i, const JSON *node)
+{
+    U32 count, k;
+
+    if (!node)      // 对象的空位
+        return;
+    count = path_count(node);
+    path_select(run, i, node);
+    for (k = 0; k < count && !run->failed; ++k)
+        path_descend(run, i, path_child(node, k));
+}
+
+/**
+ * @brief 从第i段开始匹配node，所有段都匹配完时node加入结果
+ */
+static void path_match(path_run *run, U32 i, const JSON *node)
+{
+    json_result *res = run->res;
+
+    if (!node)      // 对象的空位
+        return;
+    if (i < run->path->count) {
+        if (run->path->steps[i].descend)
+            path_descend(run, i, node);
+        else
+            path_select(run, i, node);
+        return;
+    }
+    if (res->count == res->cap) {
+        U32 cap = res->cap ? res->cap * 2 : PATH_RESULT_MIN;
+        const JSON **items = realloc(res->items, sizeof(*items) * cap);
+        if (!items) {
+            run->failed = TRUE;
+            return;
+        }
+        res->items = items;
+        res->cap = cap;
+    }
+    res->items[res->count++] = node;
+}
+
+/**
+ * @brief 在json中查询path匹配的所有JSON值
+ * @param path 编译后的路径
+ * @param json 被查询的树
+ * @param res 结果，原有内容被覆盖，按文档顺序排列
+ * @return int 结果个数，<0失败
+ * @details 只遍历一次树，不拷贝任何JSON值
+ */
+int json_path_query(const json_path *path, const JSON *json, json_result *res)
+{
+    path_run run = {path, res, FALSE};
+
+    if (!path || !json || !res) return -1;
+    res->count = 0;
+    path_match(&run, 0, json);
+    return run.failed ? -2 : (int)res->count;
+}
+
+//-----------------------------------------------------------------------------
+//  批量路径查询
+//-----------------------------------------------------------------------------
+/*
+json_paths_compile所使用的路径语法和方案2相同：
+
+root ::= member | index;
+member ::= <name> child;
+index ::= '[' <number> ']' child;
+child ::= dot_member | index | EOF;
+dot_member ::= '.' member;
+ */
+#define PATHS_NONE      UINT32_MAX  //链表结束
+#define PATHS_SEEN_BUF  512         //前缀树节点不多时已匹配标记放在栈上
+
+/**
+ * @brief 前缀树节点，对应路径中的一个成员名或下标
+ */
+typedef struct paths_node {
+    const char *key;    //成员名，不以'\0'结尾，NULL表示下标
+    U32 klen;           //成员名长度
+    U32 index;          //下标
+    U32 child;          //第一个子节点
+    U32 next;           //下一个兄弟节点
+    U32 end;            //在此结束的第一条路径，后续的在json_paths.ends中串起来
+    U32 nkeys;          //成员名子节点的个数
+    U32 *table;         //成员名子节点的开放寻址哈希表，容量是2的幂，指向json_paths.tables
+    U32 mask;
+} paths_node;
+
+struct json_paths {
+    paths_node *nodes;  //nodes[0]是根
+    U32 count;
+    U32 cap;
+    U32 *ends;          //ends[i]是和第i条路径在同一节点结束的下一条路径
+    U32 npaths;
+    U32 *tables;        //所有节点的哈希表
+    char *keys;         //成员名的拷贝，json_get_many直接引用调用者的路径时为NULL
+};
+
+/**
+ * @brief 在parent下找键为key(长度len)或下标为index的子节点，没有就新建
+ * @return U32 子节点编号，内存不足返回PATHS_NONE
+ */
+static U32 paths_child(json_paths *paths, U32 parent, const char *key, size_t len, U32 index)
+{
+    paths_node *node;
+    U32 c;
+
+    for (c = paths->nodes[parent].child; c != PATHS_NONE; c = paths->nodes[c].next) {
+        node = &paths->nodes[c];
+        if (key ? (node->key && node->klen == len && memcmp(node->key, key, len) == 0)
+                : (!node->key && node->index == index))
+            return c;
+    }
+    if (paths->count == paths->cap) {
+        U32 cap = paths->cap * 2;
+        node = realloc(paths->nodes, sizeof(*node) * cap);
+        if (!node)
+            return PATHS_NONE;
+        paths->nodes = node;
+        paths->cap = cap;
+    }
+    c = paths->count;
+    node = &paths->nodes[c];
+    memset(node, 0, sizeof(*node));
+    node->key = key;
+    node->klen = len;
+    paths->count++;
+    node->index = index;
+    node->child = PATHS_NONE;
+    node->end = PATHS_NONE;
+    node->next = paths->nodes[parent].child;
+    paths->nodes[parent].child = c;
+    if (key)
+        paths->nodes[parent].nkeys++;
+    return c;
+}
+
+/**
+ * @brief 把第i条路径插入前缀树
+ * @return int 0成功，-1语法错误，-2内存不足
+ */
+static int paths_insert(json_paths *paths, U32 i, const char *path)
+{
+    const char *cur = path, *begin;
+    U32 node = 0;
+    char *end;
+
+    if (!path || !*path)
+        return -1;
+    while (*cur) {
+        if (*cur == '[') {
+            begin = cur + 1;
+            unsigned long idx = strtoul(begin, &end, 10);
+            if (end == begin || *begin < '0' || *begin > '9' || *end != ']' || idx > UINT32_MAX - 1)
+                return -1;
+            node = paths_child(paths, node, NULL, 0, (U32)idx);
+            cur = end + 1;
+        } else {
+            if (cur != path && *cur++ != '.')
+                return -1;
+            begin = cur;
+            cur += strcspn(cur, ".[");
+            if (cur == begin)
+                return -1;
+            node = paths_child(paths, node, begin, cur - begin, 0);
+        }
+        if (node == PATHS_NONE)
+            return -2;
+    }
+    //同一路径出现多次时都在这个节点上结束
+    paths->ends[i] = paths->nodes[node].end;
+    paths->nodes[node].end = i;
+    return 0;
+}
+
+/**
+ * @brief 给有成员名子节点的节点建哈希表，所有表在一块内存中
+ * @return int 0成功，<0内存不足
+ */
+static int paths_index(json_paths *paths)
+{
+    U32 i, c, h, size, total = 0;
+    U32 *table;
+
+    for (i = 0; i < paths->count; ++i) {
+        if (!paths->nodes[i].nkeys)
+            continue;
+        for (size = 4; size < paths->nodes[i].nkeys * 2; size *= 2)
+            ;
+        paths->nodes[i].mask = size - 1;
+        total += size;
+    }
+    paths->tables = malloc(sizeof(U32) * (total ? total : 1));
+    if (!paths->tables)
+        return -1;
+    memset(paths->tables, 0xff, sizeof(U32) * total);
+
+    table = paths->tables;
+    for (i = 0; i < paths->count; ++i) {
+        paths_node *node = &paths->nodes[i];
+        if (!node->nkeys)
+            continue;
+        node->table = table;
+        table += node->mask + 1;
+        for (c = node->child; c != PATHS_NONE; c = paths->nodes[c].next) {
+            if (!paths->nodes[c].key)
+                continue;
+            for (h = key_hash(paths->nodes[c].key, paths->nodes[c].klen) & node->mask;
+                 node->table[h] != PATHS_NONE; h = (h + 1) & node->mask)
+                ;
+            node->table[h] = c;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 编译路径，borrow为TRUE时成员名直接引用paths中的字符串
+ */
+static json_paths *paths_compile(const char *const paths[], U32 n, BOOL borrow)
+{
+    json_paths *out;
+    size_t total = 0, len;
+    U32 i;
+    int ret;
+
+    if (!paths) return NULL;
+    out = calloc(1, sizeof(*out));
+    if (!out) return NULL;
+    out->cap = 16;
+    out->nodes = malloc(sizeof(*out->nodes) * out->cap);
+    out->ends = malloc(sizeof(*out->ends) * (n ? n : 1));
+    if (!out->nodes || !out->ends)
+        goto failed_;
+    memset(&out->nodes[0], 0, sizeof(out->nodes[0]));
+    out->nodes[0].child = PATHS_NONE;
+    out->nodes[0].next = PATHS_NONE;
+    out->nodes[0].end = PATHS_NONE;
+    out->count = 1;
+    out->npaths = n;
+    if (!borrow) {
+        //所有路径拷贝到一块内存中，成员名引用这份拷贝
+        for (i = 0; i < n; ++i)
+            total += paths[i] ? strlen(paths[i]) + 1 : 0;
+        out->keys = malloc(total ? total : 1);
+        if (!out->keys)
+            goto failed_;
+        total = 0;
+    }
+    for (i = 0; i < n; ++i) {
+        const char *path = paths[i];
+        if (!borrow && path) {
+            len = strlen(path) + 1;
+            memcpy(out->keys + total, path, len);
+            path = out->keys + total;
+            total += len;
+        }
+        ret = paths_insert(out, i, path);
+        if (ret == -1)
+            fprintf(stderr, "json_paths_compile: invalid path [%s]\n", paths[i] ? paths[i] : "(null)");
+        if (ret < 0)
+            goto failed_;
+    }
+    if (paths_index(out) < 0)
+        goto failed_;
+    return out;
+
+failed_:
+    json_paths_free(out);
+    return NULL;
+}
+
+/**
+ * @brief 把n条路径编译成前缀树，供json_paths_get反复使用
+ * @param paths 路径数组，语法同方案2，如"basic.dns[0]"
+ * @param n 路径条数
+ * @return json_paths* 编译结果，有路径语法错误或内存不足时返回NULL
+ */
+json_paths *json_paths_compile(const char *const paths[], U32 n)
+{
+    return paths_compile(paths, n, FALSE);
+}
+
+void json_paths_free(json_paths *paths)
+{
+    if (!paths) return;
+    free(paths->nodes);
+    free(paths->ends);
+    free(paths->tables);
+    free(paths->keys);
+    free(paths);
+}
+
+/**
+ * @brief 一次批量查询的状态
+ */
+typedef struct paths_run {
+    const json_paths *paths;
+    const JSON **out;
+    unsigned char *seen;    //成员名子节点是否已匹配过，重复的键只取第一个
+    int found;          //找到的路径条数
+} paths_run;
+
+static void paths_resolve(paths_run *run, U32 idx, const JSON *json)
+{
+    const paths_node *node = &run->paths->nodes[idx];
+    U32 i, c, h, matched = 0;
+
+    for (i = node->end; i != PATHS_NONE; i = run->paths->ends[i]) {
+        run->out[i] = json;
+        run->found++;
+    }
+    if (node->child == PATHS_NONE)
+        return;
+
+    if (json_type(json) == JSON_OBJ && node->nkeys) {
+        //对象只扫描一遍，每个键查一次哈希表，子节点都匹配上就提前结束
+        const object *obj = as_obj(json);
+        for (i = 0; i < obj->count && matched < node->nkeys; ++i) {
+            const shapekey *k = &obj->shape->keys[i];
+            if (obj->vals[i].w == WORD_HOLE)
+                continue;
+            //共享形状的键名已经算好了哈希值
+            for (h = (obj->shape->shared ? k->hash : key_hash(k->key, k->klen)) & node->mask;
+                 (c = node->table[h]) != PATHS_NONE; h = (h + 1) & node->mask) {
+                const paths_node *child = &run->paths->nodes[c];
+                STAT_ADD(member_cmps, 1);
+                if (child->klen == k->klen && memcmp(child->key, k->key, k->klen) == 0)
+                    break;
+            }
+            if (c == PATHS_NONE || run->seen[c])
+                continue;
+            run->seen[c] = 1;
+            matched++;
+            paths_resolve(run, c, slot_value(&obj->vals[i]));
+        }
+    } else if (json_type(json) == JSON_ARR) {
+        const array *arr = as_arr(json);
+        for (c = node->child; c != PATHS_NONE; c = run->paths->nodes[c].next) {
+            if (!run->paths->nodes[c].key && run->paths->nodes[c].index < arr->count)
+                paths_resolve(run, c, slot_value(&arr->elems[run->paths->nodes[c].index]));
+        }
+    }
+}
+
+/**
+ * @brief 在json中查找编译好的所有路径
+ * @param paths json_paths_compile的结果
+ * @param json 被查询的树
+ * @param out 输出，out[i]是第i条路径对应的JSON值，找不到为NULL
+ * @return int 找到的路径条数，<0失败
+ * @details 只遍历一次树，共同前缀上的对象只扫描一遍
+ */
+int json_paths_get(const json_paths *paths, const JSON *json, const JSON *out[])
+{
+    unsigned char seen_buf[PATHS_SEEN_BUF];
+    paths_run run = {paths, out, seen_buf, 0};
+    U32 i;
+
+    if (!paths || !json || !out) return -1;
+    if (paths->count > PATHS_SEEN_BUF) {
+        run.seen = calloc(paths->count, 1);
+        if (!run.seen)
+            return -2;
+    } else {
+        memset(seen_buf, 0, paths->count);
+    }
+    for (i = 0; i < paths->npaths; ++i)
+        out[i] = NULL;
+    paths_resolve(&run, 0, json);
+    if (run.seen != seen_buf)
+        free(run.seen);
+    return run.found;
+}
+
+/**
+ * @brief 一次查找多条路径，相当于json_paths_compile + json_paths_get
+ * @param json 被查询的树
+ * @param paths 路径数组，语法同方案2，如"basic.dns[0]"
+ * @param out 输出，out[i]是paths[i]对应的JSON值，找不到为NULL
+ * @param n 路径条数
+ * @return int 找到的路径条数，<0失败(路径语法错误或内存不足)
+ * @details 同一批路径要反复查询时，先json_paths_compile一次更快
+ */
+int json_get_many(const JSON *json, const char *const paths[], const JSON *out[], U32 n)
+{
+    json_paths *compiled;
+    int ret;
+
+    if (!json || !paths || !out) return -1;
+    compiled = paths_compile(paths, n, TRUE);
+    if (!compiled) return -2;
+    ret = json_paths_get(compiled, json, out);
+    json_paths_free(compiled);
+    return ret;
+}
+
+//-----------------------------------------------------------------------------
+//  只读的平铺文档(tape)
+//  整个文档按先序排成一串64位的字，高8位是标签，低56位是附加信息：
+//      'n' 't' 'f'     null、true、false
+//      'd' 'l'         double、整数，值的原始位放在下一个字里
+//      '"' 'k'         字符串、键名，附加信息是在字符串区的偏移，那里依次是U32的长度、内容和'\0'
+//      '[' '{'         容器开头，低32位是容器之后的位置，其上24位是元素(成员)个数，太多时饱和
+//      ']' '}'         容器结尾，附加信息是容器开头的位置
+//  对象中每个成员是一个'k'后面紧跟其值。容器记下了结束位置，跳过整个子树是O(1)的；
+//  整个文档只有两块内存，不用逐个节点分配和释放。
+//-----------------------------------------------------------------------------
+#define TAPE_DATA_MASK      0x00FFFFFFFFFFFFFFULL
+#define TAPE_COUNT_MAX      0xFFFFFFu           //容器开头的字能记下的最大元素个数
+#define TAPE_WORDS_MAX      0xFFFFFFF0u         //最多几个字，位置要能用U32表示
+#define TAPE_WORD(tag, data)    ((U64)(unsigned char)(tag) << 56 | (U64)(data))
+#define TAPE_TAG(w)             ((char)((w) >> 56))
+
+struct json_tape {
+    U64 *words;         //按先序排列的字
+    U32 count;          //words中有几个字
+    U32 cap;            //words的容量
+    char *strs;         //字符串区
+    size_t slen;        //字符串区已用的字节数
+    size_t scap;        //字符串区的容量
+};
+
+/**
+ * @brief 确保words至少还能追加n个字，容量不足时倍增
+ * @return int 0成功，<0失败
+ */
+static int tape_reserve(json_tape *tape, U32 n)
+{
+    U64 *words;
+    U32 cap;
+
+    if (tape->cap - tape->count >= n)
+        return 0;
+    if (TAPE_WORDS_MAX - tape->count < n)
+        return -1;
+    cap = tape->cap > TAPE_WORDS_MAX / 2 ? TAPE_WORDS_MAX : tape->cap * 2;
+    if (cap < tape->count + n)
+        cap = tape->count + n;
+    words = realloc(tape->words, (size_t)cap * sizeof(U64));
+    if (!words) {
+        fprintf(stderr, "tape_reserve: realloc(%lu) failed\n", (size_t)cap * sizeof(U64));
+        return -1;
+    }
+    tape->words = words;
+    tape->cap = cap;
+    return 0;
+}
+/**
+ * @brief 确保字符串区还能放下一个len字节的字符串
+ * @return int 0成功，<0失败
+ */
+static int tape_str_reserve(json_tape *tape, size_t len)
+{
+    size_t need = tape->slen + sizeof(U32) + len + 1, cap;
+    char *strs;
+
+    if (len > UINT32_MAX)
+        return -1;
+    if (need <= tape->scap)
+        return 0;
+    cap = tape->scap * 2 > need ? tape->scap * 2 : need;
+    strs = realloc(tape->strs, cap);
+    if (!strs) {
+        fprintf(stderr, "tape_str_reserve: realloc(%lu) failed\n", cap);
+        return -1;
+    }
+    tape->strs = strs;
+    tape->scap = cap;
+    return 0;
+}
+/**
+ * @brief 字符串区下一个字符串的内容写在哪里
+ */
+static inline char *tape_str_next(json_tape *tape)
+{
+    return tape->strs + tape->slen + sizeof(U32);
+}
+/**
+ * @brief 把写在tape_str_next处的len字节登记成一个字符串，并追加引用它的tag字
+ * @details 调用前已经用tape_reserve和tape_str_reserve预留好了位置
+ */
+static void tape_str_commit(json_tape *tape, char tag, size_t len)
+{
+    U32 n = (U32)len;
+
+    memcpy(tape->strs + tape->slen, &n, sizeof(n));
+    tape_str_next(tape)[len] = '\0';
+    tape->words[tape->count++] = TAPE_WORD(tag, tape->slen);
+    tape->slen += sizeof(n) + len + 1;
+}
+/**
+ * @brief 追加一个内容为[str, str + len)的字符串或键名
+ * @return int 0成功，<0失败
+ */
+static int tape_put_str(json_tape *tape, char tag, const char *str, size_t len)
+{
+    if (tape_reserve(tape, 1) < 0 || tape_str_reserve(tape, len) < 0)
+        return -1;
+    memcpy(tape_str_next(tape), str, len);
+    tape_str_commit(tape, tag, len);
+    return 0;
+}
+/**
+ * @brief 追加一个标签为tag的字，'d'和'l'再追加原始位raw
+ * @details 调用前已经预留了两个字
+ */
+static inline void tape_put(json_tape *tape, char tag, U64 raw)
+{
+    tape->words[tape->count++] = TAPE_WORD(tag, 0);
+    if (tag == 'd' || tag == 'l')
+        tape->words[tape->count++] = raw;
+}
+/**
+ * @brief 追加开头在open处、有count个元素的容器的结尾，并回填开头的字
+ * @return int 0成功，<0失败
+ */
+static int tape_close(json_tape *tape, U32 open, U32 count)
+{
+    char tag = TAPE_TAG(tape->words[open]);
+
+    if (tape_reserve(tape, 1) < 0)
+        return -1;
+    tape->words[tape->count++] = TAPE_WORD(tag == '[' ? ']' : '}', open);
+    if (count > TAPE_COUNT_MAX)
+        count = TAPE_COUNT_MAX;
+    tape->words[open] = TAPE_WORD(tag, (U64)count << 32 | tape->count);
+    return 0;
+}
+/**
+ * @brief 新建一个空的tape，预分配words个字和strs字节的字符串区
+ */
+static json_tape *tape_new(size_t words, size_t strs)
+{
+    json_tape *tape = calloc(1, sizeof(json_tape));
+
+    if (!tape)
+        return NULL;
+    if (words > TAPE_WORDS_MAX)
+        words = TAPE_WORDS_MAX;
+    if (tape_reserve(tape, (U32)words) < 0 || tape_str_reserve(tape, strs) < 0) {
+        json_tape_free(tape);
+        return NULL;
+    }
+    return tape;
+}
+/**
+ * @brief 构造完成后把两块内存缩小到实际用量
+ */
+static void tape_shrink(json_tape *tape)
+{
+    U64 *words = realloc(tape->words, (size_t)tape->count * sizeof(U64));
+    char *strs = realloc(tape->strs, tape->slen + 1);
+
+    // 缩小失败就继续用原来的
+    if (words) {
+        tape->words = words;
+        tape->cap = tape->count;
+    }
+    if (strs) {
+        tape->strs = strs;
+        tape->scap = tape->slen + 1;
+    }
+}
+
+static int tape_parse_value(parse_ctx *ctx, json_tape *tape);
+/**
+ * @brief 解析字符串，直接解码到字符串区，当前位置是开头的双引号
+ * @param tag '"'是字符串，'k'是键名
+ * @return int 0成功，<0失败
+ */
+static int tape_parse_string(parse_ctx *ctx, json_tape *tape, char tag)
+{
+    const char *q = string_end(ctx);
+    long len;
+
+    if (!q || tape_reserve(tape, 1) < 0 || tape_str_reserve(tape, q - ctx->cur) < 0)
+        return -1;
+    len = string_decode(ctx, q, tape_str_next(tape));
+    if (len < 0)
+        return -1;
+    tape_str_commit(tape, tag, len);
+    return 0;
+}
+/**
+ * @brief 解析数组或对象，当前位置是'['或'{'
+ * @return int 0成功，<0失败
+ */
+static int tape_parse_container(parse_ctx *ctx, json_tape *tape)
+{
+    char open = *ctx->cur, close = open == '[' ? ']' : '}';
+    U32 pos = tape->count, count = 0;
+
+    tape_put(tape, open, 0);
+    ++ctx->cur;
+    parse_ws(ctx);
+    if (ctx->cur < ctx->end && *ctx->cur == close) {
+        ++ctx->cur;
+        return tape_close(tape, pos, 0);
+    }
+    for (;;) {
+        if (open == '{') {
+            if (ctx->cur >= ctx->end || *ctx->cur != '"')
+                return parse_error(ctx, "expect key");
+            if (tape_parse_string(ctx, tape, 'k') < 0)
+                return -1;
+            parse_ws(ctx);
+            if (ctx->cur >= ctx->end || *ctx->cur != ':')
+                return parse_error(ctx, "expect ':'");
+            ++ctx->cur;
+        }
+        if (tape_parse_value(ctx, tape) < 0)
+            return -1;
+        ++count;
+        parse_ws(ctx);
+        if (ctx->cur < ctx->end && *ctx->cur == ',') {
+            ++ctx->cur;
+            parse_ws(ctx);
+            continue;
+        }
+        if (ctx->cur < ctx->end && *ctx->cur == close) {
+            ++ctx->cur;
+            return tape_close(tape, pos, count);
+        }
+        return parse_error(ctx, open == '[' ? "expect ',' or ']'" : "expect ',' or '}'");
+    }
+}
+/**
+ * @brief 解析一个JSON值追加到tape末尾
+ * @return int 0成功，<0失败
+ */
+static int tape_parse_value(parse_ctx *ctx, json_tape *tape)
+{
+    long long ival;
+    double dval;
+    U64 raw;
+    int ret;
+
+    parse_ws(ctx);
+    if (ctx->cur >= ctx->end)
+        return parse_error(ctx, "unexpected end");
+    if (tape_reserve(tape, 2) < 0)
+        return -1;
+    switch (*ctx->cur) {
+    case 'n':
+    case 't':
+    case 'f':
+        ret = *ctx->cur;
+        if (scan_literal(ctx, ret == 'n' ? "null" : ret == 't' ? "true" : "false") < 0)
+            return -1;
+        tape_put(tape, (char)ret, 0);
+        return 0;
+    case '"':
+        return tape_parse_string(ctx, tape, '"');
+    case '[':
+    case '{':
+        if (ctx->depth >= PARSE_MAX_DEPTH)
+            return parse_error(ctx, "too deep");
+        ++ctx->depth;
+        ret = tape_parse_container(ctx, tape);
+        --ctx->depth;
+        return ret;
+    default:
+        ret = scan_number(ctx, &ival, &dval);
+        if (ret < 0)
+            return -1;
+        if (ret) {
+            tape_put(tape, 'l', (U64)ival);
+        } else {
+            memcpy(&raw, &dval, sizeof(raw));
+            tape_put(tape, 'd', raw);
+        }
+        return 0;
+    }
+}
+/**
+ * @brief 把JSON文本直接解析成tape，不经过树
+ * 
+ * @param text JSON文本，不要求以'\0'结尾
+ * @param len 文本的长度
+ * @return json_tape* 解析出的文档，语法错误或内存不足时返回NULL，错误位置输出到stderr
+ * @details 语法检查和json_parse相同，对象中重复的键名都会保留，json_tape_get_member返回先出现的那个
+ */
+json_tape *json_tape_parse(const char *text, size_t len)
+{
+    parse_ctx ctx = {text, text, text + len, 0};
+    json_tape *tape;
+
+    if (!text)
+        return NULL;
+    // 按文本长度估个容量，避免反复realloc，解析完再缩小
+    tape = tape_new(len / 4 + 16, len / 2 + 16);
+    if (!tape)
+        return NULL;
+    if (tape_parse_value(&ctx, tape) < 0)
+        goto failed_;
+    parse_ws(&ctx);
+    if (ctx.cur != ctx.end) {
+        parse_error(&ctx, "trailing characters");
+        goto failed_;
+    }
+    tape_shrink(tape);
+    return tape;
+failed_:
+    json_tape_free(tape);
+    return NULL;
+}
+/**
+ * @brief 把树中的JSON值json追加到tape末尾
+ * @return int 0成功，<0失败
+ */
+static int tape_add(json_tape *tape, const JSON *json)
+{
+    U32 pos, i;
+    double num;
+    U64 raw;
+
+    if (tape_reserve(tape, 2) < 0)
+        return -1;
+    switch (json_type(json)) {
+    case JSON_NONE:
+        tape_put(tape, 'n', 0);
+        return 0;
+    case JSON_BOL:
+        tape_put(tape, json_bool(json) ? 't' : 'f', 0);
+        return 0;
+    case JSON_NUM:
+        num = word_num(json->w);
+        memcpy(&raw, &num, sizeof(raw));
+        tape_put(tape, 'd', raw);
+        return 0;
+    case JSON_INT:
+        tape_put(tape, 'l', (U64)value_int(json));
+        return 0;
+    case JSON_STR:
+        // json_new(JSON_STR)建出的字符串没有内容，当作空串
+        return tape_put_str(tape, '"', json_str(json, NULL) ? json_str(json, NULL) : "",
+                            json_str_len(json));
+    case JSON_ARR: {
+        const array *arr = as_arr(json);
+        pos = tape->count;
+        tape_put(tape, '[', 0);
+        for (i = 0; i < arr->count; ++i)
+            if (tape_add(tape, slot_value(&arr->elems[i])) < 0)
+                return -1;
+        return tape_close(tape, pos, arr->count);
+    }
+    case JSON_OBJ: {
+        const object *obj = as_obj(json);
+        pos = tape->count;
+        tape_put(tape, '{', 0);
+        for (i = 0; i < obj->count; ++i)
+            if (obj->vals[i].w != WORD_HOLE
+                && (tape_put_str(tape, 'k', obj->shape->keys[i].key, obj->shape->keys[i].klen) < 0
+                    || tape_add(tape, slot_value(&obj->vals[i])) < 0))
+                return -1;
+        return tape_close(tape, pos, obj->count - obj->holes);
+    }
+    default:
+        return -1;
+    }
+}
+/**
+ * @brief 把树转换成tape
+ * @param json 任意类型的JSON值，转换后与tape互不相干
+ * @return json_tape* 转换出的文档，失败返回NULL
+ */
+json_tape *json_tape_from(const JSON *json)
+{
+    json_tape *tape;
+
+    if (!json)
+        return NULL;
+    tape = tape_new(64, 256);
+    if (!tape)
+        return NULL;
+    if (tape_add(tape, json) < 0) {
+        json_tape_free(tape);
+        return NULL;
+    }
+    tape_shrink(tape);
+    return tape;
+}
+/**
+ * @brief 释放tape
+ */
+void json_tape_free(json_tape *tape)
+{
+    if (!tape)
+        return;
+    free(tape->words);
+    free(tape->strs);
+    free(tape);
+}
+/**
+ * @brief tape占用的堆内存字节数
+ */
+size_t json_tape_bytes(const json_tape *tape)
+{
+    if (!tape)
+        return 0;
+    return sizeof(json_tape) + (size_t)tape->cap * sizeof(U64) + tape->scap;
+}
+/**
+ * @brief pos是不是tape中一个值的开头，JSON_TAPE_NONE不是
+ */
+static inline BOOL tape_at(const json_tape *tape, U32 pos)
+{
+    return tape && pos < tape->count;
+}
+/**
+ * @brief 成员的位置换成其值的位置，其他位置不变
+ */
+static inline U32 tape_val(const json_tape *tape, U32 pos)
+{
+    return tape_at(tape, pos) && TAPE_TAG(tape->words[pos]) == 'k' ? pos + 1 : pos;
+}
+/**
+ * @brief 跳过pos处的值
+ * @return U32 下一个值的位置
+ */
+static inline U32 tape_skip(const json_tape *tape, U32 pos)
+{
+    U64 w = tape->words[pos];
+
+    switch (TAPE_TAG(w)) {
+    case '[':
+    case '{':
+        return (U32)w;
+    case 'd':
+    case 'l':
+        return pos + 2;
+    default:
+        return pos + 1;
+    }
+}
+/**
+ * @brief 字符串或键名的字w引用的内容
+ * @param len 输出字节数，可以为NULL
+ */
+static inline const char *tape_text(const json_tape *tape, U64 w, size_t *len)
+{
+    const char *p = tape->strs + (w & TAPE_DATA_MASK);
+    U32 n;
+
+    memcpy(&n, p, sizeof(n));
+    if (len)
+        *len = n;
+    return p + sizeof(n);
+}
+/**
+ * @brief 数组中第一个元素或对象中第一个成员的位置，对象成员的位置是其键名
+ */
+static inline U32 tape_child(const json_tape *tape, U32 pos)
+{
+    char end = TAPE_TAG(tape->words[pos]) == '[' ? ']' : '}';
+    return TAPE_TAG(tape->words[pos + 1]) == end ? JSON_TAPE_NONE : pos + 1;
+}
+/**
+ * @brief 获取tape中位于pos的值的类型
+ * @param pos 值的位置，根是0
+ * @return json_e 值的类型，pos不是一个值时返回JSON_NONE
+ */
+json_e json_tape_type(const json_tape *tape, U32 pos)
+{
+    static const json_e types[128] = {
+        ['n'] = JSON_NONE, ['t'] = JSON_BOL, ['f'] = JSON_BOL, ['d'] = JSON_NUM,
+        ['l'] = JSON_INT, ['"'] = JSON_STR, ['['] = JSON_ARR, ['{'] = JSON_OBJ,
+    };
+
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos))
+        return JSON_NONE;
+    return types[TAPE_TAG(tape->words[pos]) & 0x7F];
+}
+/**
+ * @brief 获取数组的元素个数或对象的成员个数
+ * @return int 个数，不是容器时返回-1
+ * @details 开头的字里放不下的个数要数一遍
+ */
+int json_tape_count(const json_tape *tape, U32 pos)
+{
+    U64 w;
+    U32 count, c;
+
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos))
+        return -1;
+    w = tape->words[pos];
+    if (TAPE_TAG(w) != '[' && TAPE_TAG(w) != '{')
+        return -1;
+    count = (U32)((w & TAPE_DATA_MASK) >> 32);
+    if (count < TAPE_COUNT_MAX)
+        return (int)count;
+    count = 0;
+    for (c = json_tape_first(tape, pos); c != JSON_TAPE_NONE; c = json_tape_next(tape, c))
+        ++count;
+    return (int)count;
+}
+/**
+ * @brief 获取数组中第一个元素或对象中第一个成员
+ * @return U32 对象返回成员键名的位置，可以传给json_tape_key，其他接口会自动跳到值上；
+ *         没有元素或不是容器时返回JSON_TAPE_NONE
+ */
+U32 json_tape_first(const json_tape *tape, U32 pos)
+{
+    char tag;
+
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos))
+        return JSON_TAPE_NONE;
+    tag = TAPE_TAG(tape->words[pos]);
+    return tag == '[' || tag == '{' ? tape_child(tape, pos) : JSON_TAPE_NONE;
+}
+/**
+ * @brief 获取同一个容器中的下一个元素(成员)
+ * @param pos json_tape_first或json_tape_next的结果
+ * @return U32 下一个元素(成员)，到结尾时返回JSON_TAPE_NONE
+ */
+U32 json_tape_next(const json_tape *tape, U32 pos)
+{
+    U32 next;
+
+    if (!tape_at(tape, pos))
+        return JSON_TAPE_NONE;
+    if (TAPE_TAG(tape->words[pos]) == 'k')
+        ++pos;
+    next = tape_skip(tape, pos);
+    if (next >= tape->count)
+        return JSON_TAPE_NONE;
+    switch (TAPE_TAG(tape->words[next])) {
+    case ']':
+    case '}':
+        return JSON_TAPE_NONE;
+    default:
+        return next;
+    }
+}
+/**
+ * @brief 获取对象成员的键名
+ * @param pos json_tape_first或json_tape_next在对象上的结果
+ * @param len 输出键名的字节数，可以为NULL
+ * @return const char* 键名，以'\0'结尾，tape释放前有效；pos不是成员时返回NULL
+ */
+const char *json_tape_key(const json_tape *tape, U32 pos, size_t *len)
+{
+    if (!tape_at(tape, pos) || TAPE_TAG(tape->words[pos]) != 'k')
+        return NULL;
+    return tape_text(tape, tape->words[pos], len);
+}
+/**
+ * @brief 获取对象中名字为key的成员
+ * @param pos 对象的位置
+ * @return U32 成员值的位置，找不到或不是对象时返回JSON_TAPE_NONE
+ * @details 逐个比较键名，其他成员的值整个跳过
+ */
+U32 json_tape_get_member(const json_tape *tape, U32 pos, const char *key)
+{
+    size_t klen, len;
+    const char *name;
+    U32 c;
+
+    pos = tape_val(tape, pos);
+    if (!key || !tape_at(tape, pos) || TAPE_TAG(tape->words[pos]) != '{')
+        return JSON_TAPE_NONE;
+    klen = strlen(key);
+    for (c = tape_child(tape, pos); c != JSON_TAPE_NONE; c = json_tape_next(tape, c)) {
+        name = tape_text(tape, tape->words[c], &len);
+        if (len == klen && memcmp(name, key, len) == 0)
+            return c + 1;
+    }
+    return JSON_TAPE_NONE;
+}
+/**
+ * @brief 获取数组中的第idx个元素
+ * @param pos 数组的位置
+ * @return U32 元素的位置，越界或不是数组时返回JSON_TAPE_NONE
+ */
+U32 json_tape_get_element(const json_tape *tape, U32 pos, U32 idx)
+{
+    U32 c;
+
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos) || TAPE_TAG(tape->words[pos]) != '[')
+        return JSON_TAPE_NONE;
+    for (c = tape_child(tape, pos); c != JSON_TAPE_NONE && idx; --idx)
+        c = json_tape_next(tape, c);
+    return c;
+}
+/**
+ * @brief 获取数值，整数转换成double
+ * @return double 数值，不是数值时返回def
+ */
+double json_tape_num(const json_tape *tape, U32 pos, double def)
+{
+    double num;
+
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos))
+        return def;
+    switch (TAPE_TAG(tape->words[pos])) {
+    case 'd':
+        memcpy(&num, &tape->words[pos + 1], sizeof(num));
+        return num;
+    case 'l':
+        return (double)(long long)tape->words[pos + 1];
+    default:
+        return def;
+    }
+}
+/**
+ * @brief 获取整数，规则同json_int
+ * @return long long 整数，不是数值或不能精确表示成整数时返回def
+ */
+long long json_tape_int(const json_tape *tape, U32 pos, long long def)
+{
+    double num;
+
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos))
+        return def;
+    switch (TAPE_TAG(tape->words[pos])) {
+    case 'l':
+        return (long long)tape->words[pos + 1];
+    case 'd':
+        memcpy(&num, &tape->words[pos + 1], sizeof(num));
+        if (num >= -9223372036854775808.0 && num < 9223372036854775808.0 && num == (long long)num)
+            return (long long)num;
+        return def;
+    default:
+        return def;
+    }
+}
+/**
+ * @brief 获取布尔值
+ * @return BOOL 不是布尔值时返回FALSE
+ */
+BOOL json_tape_bool(const json_tape *tape, U32 pos)
+{
+    pos = tape_val(tape, pos);
+    return tape_at(tape, pos) && TAPE_TAG(tape->words[pos]) == 't';
+}
+/**
+ * @brief 获取字符串
+ * @return const char* 字符串，以'\0'结尾，tape释放前有效；不是字符串时返回def
+ */
+const char *json_tape_str(const json_tape *tape, U32 pos, const char *def)
+{
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos) || TAPE_TAG(tape->words[pos]) != '"')
+        return def;
+    return tape_text(tape, tape->words[pos], NULL);
+}
+/**
+ * @brief 获取字符串的字节数
+ * @return size_t 字节数，不含末尾的'\0'；不是字符串时返回0
+ */
+size_t json_tape_str_len(const json_tape *tape, U32 pos)
+{
+    size_t len;
+
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos) || TAPE_TAG(tape->words[pos]) != '"')
+        return 0;
+    tape_text(tape, tape->words[pos], &len);
+    return len;
+}
+/**
+ * @brief 把tape中pos处的值建成树，写入槽位slot
+ * @return int 0成功，<0失败，已经建好的部分挂在slot上由调用者释放
+ */
+static int tape_build(const json_tape *tape, U32 pos, value *slot)
+{
+    U64 w = tape->words[pos];
+    const char *str;
+    size_t len;
+    long long ival;
+    double num;
+    JSON *json;
+    value *elem;
+    U32 c;
+
+    switch (TAPE_TAG(w)) {
+    case 'n':
+        slot_init(slot, WORD_NULL);
+        return 0;
+    case 't':
+    case 'f':
+        slot_init(slot, BOX(TAG_BOOL, TAPE_TAG(w) == 't'));
+        return 0;
+    case 'd':
+        memcpy(&num, &tape->words[pos + 1], sizeof(num));
+        slot_init(slot, num_word(num));
+        return 0;
+    case 'l':
+        ival = (long long)tape->words[pos + 1];
+        if (ival >= INT_INLINE_MIN && ival <= INT_INLINE_MAX) {
+            slot_init(slot, int_word(ival));
+            return 0;
+        }
+        json = json_new_int(ival);
+        break;
+    case '"':
+        str = tape_text(tape, w, &len);
+        json = json_new_strn(str, len);
+        break;
+    case '[':
+        json = json_new(JSON_ARR);
+        if (!json)
+            return -1;
+        slot_move_in(slot, json);
+        c = (U32)((w & TAPE_DATA_MASK) >> 32);
+        if (slots_reserve((void **)&as_arr(json)->elems, &as_arr(json)->cap, c,
+                          sizeof(value), JSON_ARR) < 0)
+            return -1;
+        for (c = tape_child(tape, pos); c != JSON_TAPE_NONE; c = json_tape_next(tape, c)) {
+            elem = arr_push(json);
+            if (!elem || tape_build(tape, c, elem) < 0)
+                return -1;
+            arr_note(as_arr(json), elem->w);
+        }
+        return 0;
+    case '{':
+        json = json_new(JSON_OBJ);
+        if (!json)
+            return -1;
+        slot_move_in(slot, json);
+        c = (U32)((w & TAPE_DATA_MASK) >> 32);
+        if (slots_reserve((void **)&as_obj(json)->vals, &as_obj(json)->cap, c,
+                          sizeof(value), JSON_OBJ) < 0)
+            return -1;
+        for (c = tape_child(tape, pos); c != JSON_TAPE_NONE; c = json_tape_next(tape, c)) {
+            str = tape_text(tape, tape->words[c], &len);
+            elem = obj_pushn(json, str, len);
+            if (!elem || tape_build(tape, c + 1, elem) < 0)
+                return -1;
+        }
+        return 0;
+    default:
+        return -1;
+    }
+    if (!json)
+        return -1;
+    slot_move_in(slot, json);
+    return 0;
+}
+/**
+ * @brief 把tape中的一个值转换成可以修改的树
+ * @param pos 值的位置，0是整个文档
+ * @return JSON* 新建的树，与tape互不相干，用完调用json_free；失败返回NULL
+ */
+JSON *json_tape_to_json(const json_tape *tape, U32 pos)
+{
+    value root = {WORD_NULL};
+    JSON *json;
+
+    pos = tape_val(tape, pos);
+    if (!tape_at(tape, pos))
+        return NULL;
+    if (tape_build(tape, pos, &root) < 0)
+        goto failed_;
+    if ((json = root_detach(&root)) != NULL)
+        return json;
+failed_:
+    value_clear(&root);
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+//  自底向上构建
+//  值和键名先压到构建器的栈上，容器结束时子成员的个数已经知道了，一次分配刚好大小的
+//  槽位数组，把栈顶的子成员整块挪进去。中间出错只记下第一个错误，之后的调用什么也不做，
+//  到json_builder_finish时才报告，调用者不用每一步都检查返回值。
+//  键名和字符串都带长度，解析器可以把解码好的内容直接交给构建器。
+//-----------------------------------------------------------------------------
+/**
+ * @brief 一个还没有结束的容器
+ */
+typedef struct build_frame {
+    U32 base;           //第一个子成员在值栈中的位置
+    U32 kbase;          //第一个键名在键名栈中的位置
+    BOOL obj;           //是否对象
+} build_frame;
+
+/**
+ * @brief 键名栈中的一个键名，内容在kbuf里
+ */
+typedef struct build_key {
+    size_t off;         //在kbuf中的偏移
+    U32 len;            //字节数
+} build_key;
+
+struct json_builder {
+    value *vals;            //值栈，存放已完成、还没有装进容器的值
+    U32 nvals;
+    U32 vcap;
+    build_frame *frames;    //还没有结束的容器
+    U32 depth;
+    U32 fcap;
+    build_key *keys;        //还没有装进对象的键名
+    U32 nkeys;
+    U32 kcap;
+    char *kbuf;             //键名的内容
+    size_t klen;
+    size_t kbcap;
+    const char *error;      //第一个错误，NULL表示没有出错
+};
+
+/**
+ * @brief 确保栈至少能容纳need个元素，容量不足时倍增；构建器的栈不属于任何一棵树，不计入运行统计
+ * @return int 0成功，<0失败
+ */
+static int builder_reserve(void **items, U32 *cap, U32 need, size_t size)
+{
+    U32 new_cap;
+    void *new_items;
+
+    if (need <= *cap)
+        return 0;
+    new_cap = *cap ? *cap : SLOTS_MIN;
+    while (new_cap < need)
+        new_cap *= 2;
+    new_items = realloc(*items, (size_t)new_cap * size);
+    if (!new_items)
+        return -1;
+    *items = new_items;
+    *cap = new_cap;
+    return 0;
+}
+/**
+ * @brief 记下第一个错误
+ * @return int 总是-1
+ */
+static int builder_fail(json_builder *b, const char *error)
+{
+    if (!b->error)
+        b->error = error;
+    return -1;
+}
+/**
+ * @brief 检查当前位置能不能放一个值：顶层只能有一个值，对象中的值前面要有键名
+ * @return int 0可以，<0不可以或者之前已经出错
+ */
+static int builder_check(json_builder *b)
+{
+    const build_frame *top;
+
+    if (!b || b->error)
+        return -1;
+    if (!b->depth)
+        return b->nvals ? builder_fail(b, "more than one root value") : 0;
+    top = &b->frames[b->depth - 1];
+    if (top->obj && b->nkeys - top->kbase != b->nvals - top->base + 1)
+        return builder_fail(b, "expect key");
+    return 0;
+}
+/**
+ * @brief 把一个写在字里的标量压到值栈上
+ */
+static int builder_put(json_builder *b, U64 w)
+{
+    if (builder_check(b) < 0)
+        return -1;
+    if (builder_reserve((void **)&b->vals, &b->vcap, b->nvals + 1, sizeof(value)) < 0)
+        return builder_fail(b, "out of memory");
+    slot_init(&b->vals[b->nvals++], w);
+    return 0;
+}
+/**
+ * @brief 把堆上的JSON值压到值栈上，val的所有权转给构建器，失败时释放
+ */
+static int builder_adopt(json_builder *b, JSON *val)
+{
+    if (!val) {
+        if (b)
+            builder_fail(b, "bad value");
+        return -1;
+    }
+    if (builder_check(b) < 0) {
+        json_free(val);
+        return -1;
+    }
+    if (builder_reserve((void **)&b->vals, &b->vcap, b->nvals + 1, sizeof(value)) < 0) {
+        json_free(val);
+        return builder_fail(b, "out of memory");
+    }
+    slot_move_in(&b->vals[b->nvals++], val);
+    return 0;
+}
+/**
+ * @brief 开始一个容器
+ */
+static int builder_begin(json_builder *b, BOOL obj)
+{
+    if (builder_check(b) < 0)
+        return -1;
+    if (builder_reserve((void **)&b->frames, &b->fcap, b->depth + 1, sizeof(build_frame)) < 0)
+        return builder_fail(b, "out of memory");
+    b->frames[b->depth++] = (build_frame){b->nvals, b->nkeys, obj};
+    return 0;
+}
+/**
+ * @brief 用栈顶的n个值填满刚建好的容器，对象的键名按顺序加到形状上
+ * @return int 0成功，<0失败，失败时容器和值栈都不变
+ */
+static int builder_fill(json_builder *b, JSON *json, const build_frame *top, U32 n)
+{
+    const value *vals = &b->vals[top->base];
+    U32 i;
+
+    if (!top->obj) {
+        array *arr = as_arr(json);
+        if (slots_resize((void **)&arr->elems, &arr->cap, n, sizeof(value), JSON_ARR) < 0)
+            return -1;
+        memcpy(arr->elems, vals, (size_t)n * sizeof(value));
+        for (i = 0; i < n; ++i)
+            arr_note(arr, vals[i].w);
+        arr->count = n;
+        return 0;
+    }
+    object *obj = as_obj(json);
+    if (slots_resize((void **)&obj->vals, &obj->cap, n, sizeof(value), JSON_OBJ) < 0)
+        return -1;
+    // 先加键名，失败时值还在栈上；私有形状按vals的容量预留，也刚好是n
+    for (i = 0; i < n; ++i) {
+        const build_key *k = &b->keys[top->kbase + i];
+        if (obj_add_key(obj, b->kbuf + k->off, k->len) < 0)
+            return -1;
+    }
+    memcpy(obj->vals, vals, (size_t)n * sizeof(value));
+    obj->count = n;
+    return 0;
+}
+
+/**
+ * @brief 新建一个构建器
+ * @return json_builder* 构建器，失败返回NULL；传给其他接口时和出错的构建器一样处理
+ */
+json_builder *json_builder_new(void)
+{
+    json_builder *b = calloc(1, sizeof(json_builder));
+
+    if (!b)
+        fprintf(stderr, "json_builder_new: calloc(%lu) failed\n", sizeof(json_builder));
+    return b;
+}
+/**
+ * @brief 开始一个对象，之后交替调用json_builder_key和放值的接口，最后调用json_builder_end
+ * @return int 0成功，<0失败；失败会记在构建器里，可以不检查
+ */
+int json_builder_begin_obj(json_builder *b)
+{
+    return builder_begin(b, TRUE);
+}
+/**
+ * @brief 开始一个数组，之后依次放入元素，最后调用json_builder_end
+ * @return int 0成功，<0失败
  */
-JSON *json_new_bool(BOOL val)
+int json_builder_begin_arr(json_builder *b)
 {
-    //TODO:
-    JSON *json = json_new(JSON_BOL);
-    if (!json) return NULL;
-    json->bol = val;
-    return json;
+    return builder_begin(b, FALSE);
 }
 /**
- * 新建一个数字类型的JSON值
- * @param val 新建JSON的初值
- * @return JSON* JSON值，失败返回NULL
+ * @brief 给当前对象的下一个成员指定键名
+ * @return int 0成功，<0失败
  */
-JSON *json_new_num(double val)
+int json_builder_key(json_builder *b, const char *key)
 {
-    JSON *json = json_new(JSON_NUM);
-    if (!json) return NULL;
-    json->num = val;
-    return json;
+    return json_builder_keyn(b, key, key ? strlen(key) : 0);
 }
 /**
- * 新建一个字符串类型的JSON值
- * @param str 新建JSON的初值
- * @return JSON* JSON值，失败返回NULL
+ * @brief 同json_builder_key，键名由长度给出，不要求以'\0'结尾，中间可以有'\0'
+ * @return int 0成功，<0失败
  */
-JSON *json_new_str(const char *str)
+int json_builder_keyn(json_builder *b, const char *key, size_t len)
 {
-    JSON *json;
-    assert(str);
-    
-    json = json_new(JSON_STR);
-    if (!json) return json;
-    json->str = strdup(str);
-    if (!json->str) {
-        fprintf(stderr, "json_new_str: strdup(%s) failed", str);
-        json_free(json);
-        return NULL;
+    const build_frame *top;
+
+    if (!b || b->error)
+        return -1;
+    top = b->depth ? &b->frames[b->depth - 1] : NULL;
+    if (!top || !top->obj || b->nkeys - top->kbase != b->nvals - top->base)
+        return builder_fail(b, "unexpected key");
+    if ((!key && len) || len > UINT32_MAX)
+        return builder_fail(b, "bad key");
+    if (builder_reserve((void **)&b->keys, &b->kcap, b->nkeys + 1, sizeof(build_key)) < 0)
+        return builder_fail(b, "out of memory");
+    if (b->klen + len > b->kbcap || !b->kbuf) {
+        size_t cap = b->kbcap ? b->kbcap * 2 : 64;
+        while (cap < b->klen + len)
+            cap *= 2;
+        char *kbuf = realloc(b->kbuf, cap);
+        if (!kbuf)
+            return builder_fail(b, "out of memory");
+        b->kbuf = kbuf;
+        b->kbcap = cap;
     }
-    return json;
+    if (len)
+        memcpy(b->kbuf + b->klen, key, len);
+    b->keys[b->nkeys++] = (build_key){b->klen, (U32)len};
+    b->klen += len;
+    return 0;
 }
-//想想：json_num和json_str为什么带一个def参数？
 /**
- * @brief 获取JSON_NUM类型JSON值的数值
- * 
- * @param json 数值类型的JSON值
- * @param def   类型不匹配时返回的缺省值
- * @return double 如果json是合法的JSON_NUM类型，返回其数值，否则返回缺省值def
+ * @brief 结束当前容器，一次分配刚好大小的槽位数组，把子成员挪进去
+ * @return int 0成功，<0失败
  */
-double json_num(const JSON *json, double def)
+int json_builder_end(json_builder *b)
 {
-    //想想：为什么这里不assert(json)?
-    return json && json->type == JSON_NUM ? json->num : def;
+    const build_frame *top;
+    JSON *json;
+    U32 n;
+
+    if (!b || b->error)
+        return -1;
+    if (!b->depth)
+        return builder_fail(b, "unexpected end");
+    top = &b->frames[b->depth - 1];
+    n = b->nvals - top->base;
+    if (top->obj && b->nkeys - top->kbase != n)
+        return builder_fail(b, "expect value");
+    json = json_new(top->obj ? JSON_OBJ : JSON_ARR);
+    if (!json)
+        return builder_fail(b, "out of memory");
+    if (n && builder_fill(b, json, top, n) < 0) {
+        json_free(json);
+        return builder_fail(b, "out of memory");
+    }
+    // 子成员已经挪走，弹出它们和容器，容器在父容器中的位置开始时检查过了
+    if (top->obj && b->nkeys > top->kbase)
+        b->klen = b->keys[top->kbase].off;
+    b->nvals = top->base;
+    b->nkeys = top->kbase;
+    b->depth--;
+    return builder_adopt(b, json);
 }
 /**
- * @brief 获取JSON_BOOL类型JSON值的布尔值
- * 
- * @param json 布尔值类型的JSON值
- * @return BOOL 如果json是合法的JSON_BOL类型，返回其数值，否则返回FALSE
+ * @brief 放入null
+ * @return int 0成功，<0失败
  */
-BOOL json_bool(const JSON *json)
+int json_builder_null(json_builder *b)
 {
-    //想想：为什么这里不assert(json)?
-    return json && json->type == JSON_BOL ? json->bol : FALSE;
+    return builder_put(b, WORD_NULL);
 }
 /**
- * @brief 获取JSON_STR类型JSON值的字符串值
- * 
- * @param json 字符串类型的JSON值
- * @param def   类型不匹配时返回的缺省值
- * @return const char* 如果json是合法的JSON_STR类型，返回其字符串值，否则返回def
+ * @brief 放入BOOL值
+ * @return int 0成功，<0失败
  */
-const char *json_str(const JSON *json, const char *def)
+int json_builder_bool(json_builder *b, BOOL val)
 {
-    //想想：为什么这里不assert(json)?
-    return json && json->type == JSON_STR ? json->str : def;
+    return builder_put(b, BOX(TAG_BOOL, val ? TRUE : FALSE));
 }
 /**
- * 从对象类型的JSON值中获取名字为key的成员(JSON值)
- * @param json 对象类型的JSON值
- * @param key  成员的键名
- * @return 找到的成员
- * @details 要求json是个对象类型
+ * @brief 放入整数
+ * @return int 0成功，<0失败
  */
-const JSON *json_get_member(const JSON *json, const char *key)
+int json_builder_int(json_builder *b, long long val)
 {
-    U32 i;
-    assert(json);
-    assert(json->type == JSON_OBJ);
-    assert(!(json->obj.count > 0 && json->obj.kvs == NULL));
-    assert(key);
-    assert(key[0]);
-
-    for (i = 0; i < json->obj.count; ++i) {
-        if (strcmp(json->obj.kvs[i].key, key) == 0)
-            return json->obj.kvs[i].val;
-    }
-    return NULL;
+    if (val >= INT_INLINE_MIN && val <= INT_INLINE_MAX)
+        return builder_put(b, int_word(val));
+    return builder_check(b) < 0 ? -1 : builder_adopt(b, json_new_int(val));
 }
 /**
- * 从数组类型的JSON值中获取第idx个元素(子JSON值)
- * @param json 数组类型的JSON值
- * @param idx  元素的索引值
- * @return 找到的元素(JSON值的指针)
- * @details 要求json是个数组
+ * @brief 放入数值
+ * @return int 0成功，<0失败
  */
-const JSON *json_get_element(const JSON *json, U32 idx)
+int json_builder_num(json_builder *b, double val)
 {
-    assert(json);
-    assert(json->type == JSON_ARR);
-    assert(!(json->arr.count > 0 && json->arr.elems == NULL));
-    if (idx >= json->arr.count)
-        return NULL;
-    return json->arr.elems[idx];
+    return builder_put(b, num_word(val));
 }
 /**
- * @brief 递归将JSON值写入文件（YAML格式）
- * @param json JSON值
- * @param fp 文件指针
- * @param indent 当前缩进级别
+ * @brief 放入字符串，复制一份
+ * @param str 以'\0'结尾的合法UTF-8字符串
+ * @return int 0成功，<0失败
  */
-static void json_write_yaml(const JSON *json, FILE *fp, int indent,BOOL fistLine) {
-    if (!json || !fp) return;
-
-    char indentation[indent * 2 + 1];
-    memset(indentation, ' ', indent * 2);
-    indentation[indent * 2] = '\0';
-
-    switch (json->type) {
-        case JSON_NONE:
-            fprintf(fp, "null");
-            break;
-            
-        case JSON_BOL:
-            fprintf(fp, "%s", json->bol ? "true" : "false");
-            break;
-            
-        case JSON_NUM:
-            if (json->num == (long long)json->num) {
-                fprintf(fp, "%lld", (long long)json->num);  // 整数
-            } else {
-                fprintf(fp, "%g", json->num);  // 浮点数
-            }
-            break;
-            
-        case JSON_STR:
-            fprintf(fp, "%s", json->str);
-            break;
-            
-        case JSON_ARR:
-            if (json->arr.count == 0) {
-                fprintf(fp, "[]");
-                break;
-            }
-            fprintf(fp, "\n");
-            for (size_t i = 0; i < json->arr.count; i++) {
-                fprintf(fp, "%s- ", indentation);
-                json_write_yaml(json->arr.elems[i], fp, indent + 1,TRUE);
-                if (i != json->arr.count - 1) fprintf(fp, "\n");
-            }
-            break;
-            
-        case JSON_OBJ:
-            if (json->obj.count == 0) {
-                fprintf(fp, "{}");
-                break;
-            }
-            if(!fistLine)
-                fprintf(fp, "\n");
-            for (size_t i = 0; i < json->obj.count; i++) {
-                if(!fistLine){
-                    fprintf(fp, "%s%s: ", indentation, json->obj.kvs[i].key);
-                }
-                else{
-                    fprintf(fp, "%s: ", json->obj.kvs[i].key);
-                }
-                fistLine=FALSE;
-                json_write_yaml(json->obj.kvs[i].val, fp, indent + 1,FALSE);
-                if (i != json->obj.count - 1) fprintf(fp, "\n");
-            }
-            break;
-    }
+int json_builder_str(json_builder *b, const char *str)
+{
+    return json_builder_strn(b, str, str ? strlen(str) : 0);
 }
 /**
- * @brief 把JSON值以YAML格式保存到文件
- * @param json JSON值
- * @param fname 输出文件名
+ * @brief 放入由长度给出的字符串，复制一份，中间可以有'\0'
  * @return int 0成功，<0失败
  */
-int json_save(const JSON *json, const char *fname) {
-    if (!json || !fname) return -1;
-
-    FILE *fp = fopen(fname, "w");
-    if (!fp) return -2;
-
-    json_write_yaml(json, fp, 0, TRUE);
-    fclose(fp);
-    return 0;
+int json_builder_strn(json_builder *b, const char *str, size_t len)
+{
+    if (builder_check(b) < 0)
+        return -1;
+    if (!str && len)
+        return builder_fail(b, "bad value");
+    return builder_adopt(b, json_new_strn(str ? str : "", len));
 }
-//  想想：json_add_member和json_add_element中，val应该是堆分配，还是栈分配？
-//  想想：如果json_add_member失败，应该由谁来释放val？
 /**
- * @brief 往对象类型的json中增加一个键值对，键名为key，值为val
- * 
- * @param json JSON对象
- * @param key 键名，符合正则：[a-zA-Z_][a-zA-Z_-0-9]*
- * @param val 键值，必须是堆分配拥有所有权的JSON值
- * @return JSON* 成功返回val，失败返回NULL
- * @details
- *  json_add_member会转移val的所有权，所以调用json_add_member之后不用考虑释放val的问题
- * 因为需要支持如下写法：
- *  json_add_member(json, "port", json_new_num(80));
- * 所以需要做到：
- *  1) 允许val为NULL；
- *  2) 当json_add_member内部发生失败时，需要释放val，满足将val的所有权转让给json_add_member的语义设定
+ * @brief 放入一个已有的JSON值(可以是整棵树)，不复制
+ * @param val 堆分配的JSON值，所有权转给构建器，失败时也会被释放
+ * @return int 0成功，<0失败
  */
-JSON *json_add_member(JSON *json, const char *key, JSON *val)
+int json_builder_value(json_builder *b, JSON *val)
 {
-    assert(json->type == JSON_OBJ);
-    assert(!(json->obj.count > 0 && json->obj.kvs == NULL));
-    assert(key);
-    assert(key[0]);
-    //想想: 为啥不用assert检查val？
-    //想想：如果json中已经存在名字为key的成员，怎么办？
-    //TODO:
-    // 1. 检查 key 是否已存在
-    if(json_get_member(json,key)){
-        json_free(val);
-        return NULL;                      
-    }
-    
-    // 2. key 不存在，新增键值对
-    U32 new_count = json->obj.count + 1;
-    struct keyvalue *new_kvs = realloc(json->obj.kvs, new_count * sizeof(struct keyvalue));
-    if (!new_kvs) {
-        json_free(val);  // 内存分配失败，需释放 val
-        return NULL;
-    }
-
-    char *key_copy = strdup(key);  // 深拷贝 key
-    if (!key_copy) {
-        free(new_kvs);
-        json_free(val);
-        return NULL;
-    }
-
-    // 写入新键值对
-    new_kvs[json->obj.count] = (struct keyvalue){ .key = key_copy, .val = val };
-    json->obj.kvs = new_kvs;
-    json->obj.count = new_count;
-
-    return val;  // 成功返回 val
+    return builder_adopt(b, val);
 }
 /**
- * @brief 往数组类型的json中追加一个元素
- * 
- * @param json JSON数组
- * @param val 加入到数组的元素，必须是堆分配拥有所有权的JSON值
- * @details
- *  json_add_element会转移val的所有权，所以调用json_add_element之后不用考虑释放val的问题
+ * @brief 结束构建，取出构建好的值并释放构建器
+ * @param b 构建器，可以为NULL
+ * @return JSON* 构建好的值；构建过程中出过错、容器没有结束或者没有值时返回NULL，错误输出到stderr
  */
-JSON *json_add_element(JSON *json, JSON *val)
+JSON *json_builder_finish(json_builder *b)
 {
-    assert(json);
-    assert(json->type == JSON_ARR);
-    assert(!(json->arr.count > 0 && json->arr.elems == NULL));
+    JSON *json = NULL;
+    U32 i;
 
-    //想想：为啥不用assert检查val？
-    //TODO:
-    // 扩容指针数组（首次分配或扩容）
-    size_t new_count = json->arr.count + 1;
-    JSON **new_elems = realloc(json->arr.elems, new_count * sizeof(JSON*));
-    if (!new_elems) {
-        if (val) json_free(val);
+    if (!b)
         return NULL;
+    if (!b->error && b->depth)
+        builder_fail(b, "unclosed container");
+    if (!b->error && b->nvals != 1)
+        builder_fail(b, "no value");
+    if (!b->error) {
+        json = root_detach(&b->vals[0]);
+        if (json)
+            b->nvals = 0;
+        else
+            builder_fail(b, "out of memory");
     }
-
-    // 追加元素并更新元数据
-    json->arr.elems = new_elems;
-    json->arr.elems[json->arr.count] = val; // 转移所有权
-    json->arr.count = new_count;
-
-    return val; // 返回val以支持链式调用
+    if (b->error)
+        fprintf(stderr, "json_builder_finish: %s\n", b->error);
+    for (i = 0; i < b->nvals; ++i)
+        value_clear(&b->vals[i]);
+    free(b->vals);
+    free(b->frames);
+    free(b->keys);
+    free(b->kbuf);
+    free(b);
+    return json;
 }
 
 #if ACTIVE_PLAN == 1
@@ -428,7 +6330,7 @@ static const JSON *get_child(const JSON *json, const char *key, json_e expect_ty
     child = json_get_member(json, key);
     if (!child)
         return NULL;
-    if (child->type != expect_type)
+    if (json_type(child) != expect_type)
         return NULL;
     return child;
 }
@@ -441,10 +6343,20 @@ static const JSON *get_child(const JSON *json, const char *key, json_e expect_ty
  */
 double json_obj_get_num(const JSON *json, const char *key, double def)
 {
-    const JSON *child = get_child(json, key, JSON_NUM);
-    if (!child)
-        return def;
-    return child->num;
+    const JSON *child = json_get_member(json, key);
+    return child ? json_num(child, def) : def;
+}
+/**
+ * 获取JSON对象中键名为key的整数，如果获取不到，或者不是整数，返回def
+ * @param json json对象
+ * @param key  成员键名
+ * @param def  取不到结果时返回的默认值
+ * @return long long 获取到的整数，取值规则同json_int
+ */
+long long json_obj_get_int(const JSON *json, const char *key, long long def)
+{
+    const JSON *child = json_get_member(json, key);
+    return child ? json_int(child, def) : def;
 }
 /**
  * 获取JSON对象中键名为key的BOOL值，如果获取不到，或者类型不对，返回false
@@ -454,10 +6366,7 @@ double json_obj_get_num(const JSON *json, const char *key, double def)
  */
 BOOL json_obj_get_bool(const JSON *json, const char *key)
 {
-    const JSON *child = get_child(json, key, JSON_BOL);
-    if (!child)
-        return FALSE;
-    return child->bol;
+    return json_bool(get_child(json, key, JSON_BOL));
 }
 /**
  * 获取JSON对象中键名为key的值，如果获取不到，则返回缺省值def
@@ -477,43 +6386,96 @@ BOOL json_obj_get_bool(const JSON *json, const char *key)
  */
 const char *json_obj_get_str(const JSON *json, const char *key, const char *def)
 {
-    const JSON *child = get_child(json, key, JSON_STR);
-    if (!child)
-        return def;
-    return child->str;
+    return json_str(get_child(json, key, JSON_STR), def);
+}
+
+/**
+ * @brief 对象中键名为key的值槽位，没有返回NULL
+ */
+static value *obj_slot(JSON *json, const char *key)
+{
+    return obj_find(as_obj(json), key, strlen(key));
+}
+/**
+ * @brief 把整数val写入槽位slot，big是预先为超出48位的val分配的bigint
+ */
+static void slot_put_int(value *slot, JSON *big, long long val)
+{
+    if (big)
+        slot_move_in(slot, big);
+    else
+        slot_init(slot, int_word(val));
 }
 
 int json_obj_set_num(JSON *json, const char *key, double val)
 {
     //TODO:
-    if (!json || json->type != JSON_OBJ || !key) return -1;
+    if (!json || json_type(json) != JSON_OBJ || !key) return -1;
     
     // 查找现有成员
-    JSON *existing = (JSON*)json_get_member(json, key);
+    value *existing = obj_slot(json, key);
+    if (existing) {
+        // 已存在则修改值，原来是整数的改为数值
+        json_e type = word_type(existing->w);
+        if (type == JSON_INT) {
+            value_clear(existing);
+            slot_init(existing, num_word(val));
+        } else if (type == JSON_NUM) {
+            existing->w = num_word(val);
+        } else {
+            return -1;
+        }
+    } else {
+        // 不存在则直接在对象中新建
+        value *slot = obj_push(json, key);
+        if (!slot) return -1;
+        slot_init(slot, num_word(val));
+    }
+    return 0;
+}
+
+int json_obj_set_int(JSON *json, const char *key, long long val)
+{
+    JSON *big = NULL;
+
+    if (!json || json_type(json) != JSON_OBJ || !key) return -1;
+    if (val < INT_INLINE_MIN || val > INT_INLINE_MAX) {
+        big = json_new_int(val);
+        if (!big) return -1;
+    }
+
+    value *existing = obj_slot(json, key);
     if (existing) {
-        // 已存在则修改值
-        if (existing->type != JSON_NUM) return -1;
-        existing->num = val;
+        // 已存在的数值或整数改为整数
+        if (word_type(existing->w) != JSON_INT && word_type(existing->w) != JSON_NUM) {
+            json_free(big);
+            return -1;
+        }
+        value_clear(existing);
     } else {
-        // 不存在则新建
-        JSON *new_val = json_new_num(val);
-        if (!new_val || !json_add_member(json, key, new_val)) return -1;
+        existing = obj_push(json, key);
+        if (!existing) {
+            json_free(big);
+            return -1;
+        }
     }
+    slot_put_int(existing, big, val);
     return 0;
 }
 
 int json_obj_set_bool(JSON *json, const char *key, BOOL val)
 {
     //TODO:
-    if (!json || json->type != JSON_OBJ || !key) return -1;
+    if (!json || json_type(json) != JSON_OBJ || !key) return -1;
     
     JSON *existing = (JSON*)json_get_member(json, key);
     if (existing) {
-        if (existing->type != JSON_BOL) return -1;
-        existing->bol = val;
+        if (json_type(existing) != JSON_BOL) return -1;
+        existing->w = BOX(TAG_BOOL, val ? TRUE : FALSE);
     } else {
-        JSON *new_val = json_new_bool(val);
-        if (!new_val || !json_add_member(json, key, new_val)) return -1;
+        value *slot = obj_push(json, key);
+        if (!slot) return -1;
+        slot_init(slot, BOX(TAG_BOOL, val ? TRUE : FALSE));
     }
     return 0;
 }
@@ -521,84 +6483,143 @@ int json_obj_set_bool(JSON *json, const char *key, BOOL val)
 int json_obj_set_str(JSON *json, const char *key, const char *val)
 {
     //TODO:
-    if (!json || json->type != JSON_OBJ || !key || !val) return -1;
-    
+    if (!json || json_type(json) != JSON_OBJ || !key || !val) return -1;
+
+    size_t len = strlen(val);
+    char *copy = malloc(len + 1);
+    if (!copy) return -1;
+    memcpy(copy, val, len + 1);
+    return json_obj_set_str_owned(json, key, copy);
+}
+/**
+ * @brief 同json_obj_set_str，但直接使用调用者malloc的字符串，不复制
+ * @param val 以'\0'结尾的合法UTF-8字符串，所有权转给json，失败时也会被释放
+ * @return int 0成功，<0失败
+ */
+int json_obj_set_str_owned(JSON *json, const char *key, char *val)
+{
+    if (!json || json_type(json) != JSON_OBJ || !key || !val) {
+        free(val);
+        return -1;
+    }
+
     JSON *existing = (JSON*)json_get_member(json, key);
     if (existing) {
-        if (existing->type != JSON_STR) return -1;
-        free(existing->str);
-        existing->str = strdup(val);
-        if (!existing->str) return -1;
+        size_t len = strlen(val);
+        if (json_type(existing) != JSON_STR || !str_utf8_valid(val, len)) {
+            free(val);
+            return -1;
+        }
+        string *str = as_str(existing);
+        if (str->str)
+            STAT_FREE(JSON_STR, str->len + 1);
+        free(str->str);
+        str->str = val;
+        str->len = len;
+        STAT_ALLOC(JSON_STR, len + 1);
     } else {
-        JSON *new_val = json_new_str(val);
-        if (!new_val || !json_add_member(json, key, new_val)) return -1;
+        JSON *new_val = json_new_str_owned(val);
+        if (!new_val) return -1;
+        value *slot = obj_push(json, key);
+        if (!slot) {
+            json_free(new_val);
+            return -1;
+        }
+        slot_move_in(slot, new_val);
     }
     return 0;
 }
 
 int json_arr_count(const JSON *json)
 {
-    if (!json || json->type != JSON_ARR)
+    if (!json || json_type(json) != JSON_ARR)
         return -1;
-    return json->arr.count;
+    return as_arr(json)->count;
+}
+/**
+ * @brief 获取数组第idx个元素的槽位，json不是数组或越界时返回NULL
+ */
+static const value *arr_slot(const JSON *json, int idx)
+{
+    if (!json || json_type(json) != JSON_ARR || idx < 0 || idx >= as_arr(json)->count)
+        return NULL;
+    return &as_arr(json)->elems[idx];
 }
 
 double json_arr_get_num(const JSON *json, int idx, double def)
 {
     //TODO:
-    if (!json || json->type != JSON_ARR || idx < 0 || idx >= json->arr.count)
-        return def;
-    
-    const JSON *elem = json->arr.elems[idx];
-    return (elem && elem->type == JSON_NUM) ? elem->num : def;
+    const value *slot = arr_slot(json, idx);
+    return slot ? json_num(slot_value(slot), def) : def;
+}
+
+long long json_arr_get_int(const JSON *json, int idx, long long def)
+{
+    const value *slot = arr_slot(json, idx);
+    return slot ? json_int(slot_value(slot), def) : def;
 }
 
 BOOL json_arr_get_bool(const JSON *json, int idx)
 {
     //TODO:
-    if (!json || json->type != JSON_ARR || idx < 0 || idx >= json->arr.count)
-        return FALSE;
-    
-    const JSON *elem = json->arr.elems[idx];
-    return (elem && elem->type == JSON_BOL) ? elem->bol : FALSE;
+    const value *slot = arr_slot(json, idx);
+    return slot ? json_bool(slot) : FALSE;
 }
 
 const char *json_arr_get_str(const JSON *json, int idx, const char *def)
 {
     //TODO:
-    if (!json || json->type != JSON_ARR || idx < 0 || idx >= json->arr.count)
-        return def;
-    
-    const JSON *elem = json->arr.elems[idx];
-    return (elem && elem->type == JSON_STR) ? elem->str : def;
+    const value *slot = arr_slot(json, idx);
+    return slot ? json_str(slot_value(slot), def) : def;
 }
 
 int json_arr_add_num(JSON *json, double val)
 {
     //TODO:
-    if (!json || json->type != JSON_ARR) return -1;
-    
-    JSON *new_elem = json_new_num(val);
-    if (!new_elem) return -1;
+    if (!json || json_type(json) != JSON_ARR) return -1;
     
-    return json_add_element(json, new_elem) ? 0 : -1;
+    value *slot = arr_push(json);
+    if (!slot) return -1;
+    slot_init(slot, num_word(val));
+    return 0;
+}
+
+int json_arr_add_int(JSON *json, long long val)
+{
+    JSON *big = NULL;
+
+    if (!json || json_type(json) != JSON_ARR) return -1;
+    if (val < INT_INLINE_MIN || val > INT_INLINE_MAX) {
+        big = json_new_int(val);
+        if (!big) return -1;
+    }
+
+    value *slot = arr_push(json);
+    if (!slot) {
+        json_free(big);
+        return -1;
+    }
+    slot_put_int(slot, big, val);
+    arr_note(as_arr(json), slot->w);
+    return 0;
 }
 
 int json_arr_add_bool(JSON *json, BOOL val)
 {
     //TODO:
-    if (!json || json->type != JSON_ARR) return -1;
+    if (!json || json_type(json) != JSON_ARR) return -1;
     
-    JSON *new_elem = json_new_bool(val);
-    if (!new_elem) return -1;
-
-    return json_add_element(json, new_elem) ? 0 : -1;
+    value *slot = arr_push(json);
+    if (!slot) return -1;
+    slot_init(slot, BOX(TAG_BOOL, val ? TRUE : FALSE));
+    arr_note(as_arr(json), slot->w);
+    return 0;
 }
 
 int json_arr_add_str(JSON *json, const char *val)
 {
     //TODO:
-    if (!json || json->type != JSON_ARR || !val) return -1;
+    if (!json || json_type(json) != JSON_ARR || !val) return -1;
     
     JSON *new_elem = json_new_str(val);
     if (!new_elem) return -1;
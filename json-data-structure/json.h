@@ -1,6 +1,9 @@
 #ifndef JSON_H_
 #define JSON_H_
 
+#include <stdio.h>
+#include <stddef.h>
+
 /**
  *  想想：
  *  1. 你的JSON接口是为什么场景设计的？
@@ -16,10 +19,12 @@ typedef enum json_e {
     JSON_STR,           //字符串类型
     JSON_ARR,           //数组类型
     JSON_OBJ,           //对象类型
+    JSON_INT,           //64位整数类型
 } json_e;
 
 typedef unsigned int BOOL;
 typedef unsigned int U32;
+typedef unsigned long long U64;
 typedef struct value JSON;
 
 #define TRUE 1
@@ -31,22 +36,84 @@ typedef struct value JSON;
 JSON *json_new(json_e type);
 json_e json_type(const JSON *json);
 void json_free(JSON *json);
+void json_free_deferred(JSON *json);
+void json_reclaim_drain(void);
 
 int json_save(const JSON *json, const char *fname);
+int json_save_parallel(const JSON *json, const char *fname, U32 nthreads);
+typedef void (*json_save_cb)(void *arg, const char *fname, int ret);
+int json_save_async(JSON *json, const char *fname, json_save_cb done, void *arg);
+void json_save_drain(void);
+JSON *json_parse(const char *text, size_t len);
+JSON *json_parse_parallel(const char *text, size_t len, U32 nthreads);
+JSON *json_load(const char *fname);
+char *json_dump(const JSON *json, size_t *len);
 
 double json_num(const JSON *json, double def);
+long long json_int(const JSON *json, long long def);
 BOOL json_bool(const JSON *json);
 const char *json_str(const JSON *json, const char *def);
+size_t json_str_len(const JSON *json);
 
 JSON *json_new_num(double val);
+JSON *json_new_int(long long val);
 JSON *json_new_bool(BOOL val);
 JSON *json_new_str(const char *str);
+JSON *json_new_strn(const char *str, size_t len);
+JSON *json_new_str_owned(char *str);
 
 const JSON *json_get_member(const JSON *json, const char *key);
+const JSON *json_get_membern(const JSON *json, const char *key, size_t keylen);
 const JSON *json_get_element(const JSON *json, U32 idx);
+int json_obj_count(const JSON *json);
+const JSON *json_get_member_at(const JSON *json, U32 idx, const char **key);
+
+/**
+ * @brief 对象成员和数组元素的迭代器，放在栈上，不分配内存；字段供内部使用
+ */
+typedef struct json_iter {
+    const JSON *json;   //被遍历的容器
+    const void *slot;   //下一个值的槽位
+    const void *end;    //槽位数组的结尾
+    const void *key;    //对象下一个成员的键名
+    U32 mods;           //开始时容器的增删次数，没有定义NDEBUG时用于发现遍历期间的修改
+} json_iter;
+
+int json_obj_iter_begin(const JSON *json, json_iter *it);
+const JSON *json_obj_iter_next(json_iter *it, const char **key, size_t *klen);
+int json_arr_iter_begin(const JSON *json, json_iter *it);
+const JSON *json_arr_iter_next(json_iter *it);
 
+/**
+ * @brief json_get_member_ic的调用点缓存，初始化为{0}
+ */
+typedef struct json_ic {
+    U64 word;           //上次查到的形状和下标，内部使用
+} json_ic;
+
+const JSON *json_get_member_ic(const JSON *json, const char *key, json_ic *ic);
+/**
+ * 按键名取成员，每个调用点自带一个静态缓存；key必须是字符串字面量，用到了GCC的语句表达式
+ */
+#define JSON_GET_MEMBER(json, key) \
+    ({ static json_ic json_ic_; json_get_member_ic((json), "" key, &json_ic_); })
+
+/*
+ * 注意，和最初的版本不同：数值、48位以内的整数、BOOL和null加入容器后内容直接写在槽位里，
+ * val在json_add_member/json_add_element成功时就已经释放，不能再使用，只能通过返回值访问，
+ * 返回值在该容器再次增删成员后失效；字符串、超出48位的整数、数组和对象保持原地址，返回的就是val。
+ */
 JSON *json_add_member(JSON *json, const char *key, JSON *val);
 JSON *json_add_element(JSON *json, JSON *val);
+JSON *json_remove_member(JSON *json, const char *key, BOOL ordered);
+JSON *json_remove_element(JSON *json, U32 idx, BOOL ordered);
+JSON *json_take_member(JSON *json, const char *key);
+JSON *json_take_element(JSON *json, U32 idx);
+JSON *json_move_member(JSON *dst, const char *key, JSON *src, const char *srckey);
+
+#define JSON_MERGE_REPLACE  0x0     //json_merge：两边都是数组时用src的数组替换dst的
+#define JSON_MERGE_APPEND   0x1     //json_merge：两边都是数组时把src的元素追加到dst的后面
+int json_merge(JSON *dst, JSON *src, U32 flags);
 /*
 在完成API的设计初稿的时候，要写个demo，验证API设计OK，并找到API实现当中需要注意的问题。
 比如下述代码，如果要这样写，对json_new，json_add_member有什么要求？怎么保证内存不会泄漏？不出错？
@@ -75,19 +142,24 @@ json_free(json);
 //  方案1
 //-----------------------------------------------------------------------------
 double json_obj_get_num(const JSON *json, const char *key, double def);
+long long json_obj_get_int(const JSON *json, const char *key, long long def);
 BOOL json_obj_get_bool(const JSON *json, const char *key);
 const char *json_obj_get_str(const JSON *json, const char *key, const char *def);
 
 int json_arr_count(const JSON *json); 
 double json_arr_get_num(const JSON *json, int idx, double def);
+long long json_arr_get_int(const JSON *json, int idx, long long def);
 BOOL json_arr_get_bool(const JSON *json, int idx);
 const char *json_arr_get_str(const JSON *json, int idx, const char *def); 
 
 int json_obj_set_num(JSON *json, const char *key, double val);
+int json_obj_set_int(JSON *json, const char *key, long long val);
 int json_obj_set_bool(JSON *json, const char *key, BOOL val);
 int json_obj_set_str(JSON *json, const char *key, const char *val);
+int json_obj_set_str_owned(JSON *json, const char *key, char *val);
 
 int json_arr_add_num(JSON *json, double val);
+int json_arr_add_int(JSON *json, long long val);
 int json_arr_add_bool(JSON *json, BOOL val);
 int json_arr_add_str(JSON *json, const char *val);
 
@@ -164,6 +236,221 @@ json_free(json);
 //  TODO: 增加你认为还应该增加的接口
 //-----------------------------------------------------------------------------
 
+//-----------------------------------------------------------------------------
+//  运行统计：编译json.c时定义JSON_STATS才会启用，否则统计代码不参与编译
+//-----------------------------------------------------------------------------
+#define JSON_TYPE_COUNT     (JSON_INT + 1)
+#define JSON_LAT_BUCKETS    24      //延时直方图桶数，第i桶统计耗时在[2^i, 2^(i+1))微秒的次数
+
+/**
+ * @brief 运行统计数据，字节数按所属JSON值的类型归类(如值的槽位数组和私有形状算在JSON_OBJ下)
+ */
+typedef struct json_stats {
+    U64 nodes_alloc[JSON_TYPE_COUNT];   //分配的JSON值个数
+    U64 nodes_freed[JSON_TYPE_COUNT];   //释放的JSON值个数
+    U64 bytes_alloc[JSON_TYPE_COUNT];   //分配的字节数
+    U64 bytes_freed[JSON_TYPE_COUNT];   //释放的字节数
+    U64 member_reallocs;                //json_add_member中realloc的次数
+    U64 element_reallocs;               //json_add_element中realloc的次数
+    U64 member_cmps;                    //json_get_member中键名比较的次数
+    U64 save_bytes;                     //json_save写出的字节数
+    U64 save_lat[JSON_LAT_BUCKETS];     //json_save耗时直方图
+    U64 load_lat[JSON_LAT_BUCKETS];     //加载JSON耗时直方图
+} json_stats;
+
+int json_stats_get(json_stats *stats);
+void json_stats_reset(void);
+void json_stats_dump(FILE *fp);
+
+//-----------------------------------------------------------------------------
+//  内存占用统计
+//-----------------------------------------------------------------------------
+#define JSON_MEM_TOPN   8       //最多报告几棵最重的子树
+
+/**
+ * @brief 一棵子树的内存占用
+ */
+typedef struct json_mem_top {
+    const JSON *node;   //子树的根，为数组或对象
+    U64 nodes;          //子树中的JSON值个数
+    U64 bytes;          //子树占用的总字节数
+} json_mem_top;
+
+/**
+ * @brief JSON值的内存占用报告，字节数都是从分配器实际占用的角度计算的
+ */
+typedef struct json_mem_report {
+    U64 nodes;          //JSON值个数
+    U64 containers;     //数组和对象的个数
+    U64 slots_used;     //容器中已使用的元素/键值对个数
+    U64 slots_cap;      //容器已分配内存可容纳的元素/键值对个数
+    U64 node_bytes;     //JSON值结构体本身的字节数
+    U64 slot_bytes;     //容器已使用的元素/键值对数组的字节数
+    U64 key_bytes;      //私有形状的键名字节数(含结尾的'\0')和键名数组，共享形状不属于任何一棵树，不计入
+    U64 str_bytes;      //字符串值的字节数，含结尾的'\0'
+    U64 overhead;       //分配器开销：块头，对齐补齐以及容器的空闲容量
+    U64 total;          //总字节数，即以上各项字节数之和
+    U32 top_count;      //top中有效的项数
+    json_mem_top top[JSON_MEM_TOPN];    //除json本身外最重的几棵子树，按bytes从大到小排序
+} json_mem_report;
+
+int json_memory_usage(const JSON *json, json_mem_report *report);
+
+//-----------------------------------------------------------------------------
+//  数值数组的批量存取
+//-----------------------------------------------------------------------------
+int json_arr_get_nums(const JSON *json, double *out, U32 off, U32 n);
+int json_arr_add_nums(JSON *json, const double *nums, U32 n);
+
+//-----------------------------------------------------------------------------
+//  结构体绑定：按字段描述表在JSON对象和C结构体之间整体转换
+//-----------------------------------------------------------------------------
+#define JSON_BIND_MAX_FIELDS    64      //一张字段描述表最多的字段数
+
+/**
+ * @brief 结构体字段的类型
+ */
+typedef enum json_bind_e {
+    JSON_BIND_BOL,      //BOOL
+    JSON_BIND_INT,      //int
+    JSON_BIND_NUM,      //double
+    JSON_BIND_STR,      //char *，堆分配，用json_bind_free释放
+    JSON_BIND_ARR,      //定长数组，另有一个U32字段记录元素个数
+    JSON_BIND_OBJ,      //嵌套的结构体
+} json_bind_e;
+
+/**
+ * @brief 字段描述，一张描述表是以key为NULL的项结尾的数组，一般用下面的JSON_FIELD_*宏定义
+ */
+typedef struct json_field_desc {
+    const char *key;                    //键名
+    json_bind_e type;                   //字段类型
+    size_t offset;                      //字段在结构体中的偏移
+    double def_num;                     //BOL/INT/NUM字段(或数组元素)的缺省值
+    const char *def_str;                //STR字段(或数组元素)的缺省值，NULL表示缺省为NULL
+    const struct json_field_desc *sub;  //OBJ字段或OBJ元素的描述表
+    json_bind_e elem;                   //ARR字段的元素类型，不能是ARR
+    U32 cap;                            //ARR字段最多能放几个元素
+    size_t elem_size;                   //ARR字段每个元素的字节数
+    size_t count_offset;                //ARR字段元素个数(U32)在结构体中的偏移
+} json_field_desc;
+
+#define JSON_FIELD_BOL(st, member, k, def) \
+    { .key = (k), .type = JSON_BIND_BOL, .offset = offsetof(st, member), .def_num = (def) }
+#define JSON_FIELD_INT(st, member, k, def) \
+    { .key = (k), .type = JSON_BIND_INT, .offset = offsetof(st, member), .def_num = (def) }
+#define JSON_FIELD_NUM(st, member, k, def) \
+    { .key = (k), .type = JSON_BIND_NUM, .offset = offsetof(st, member), .def_num = (def) }
+#define JSON_FIELD_STR(st, member, k, def) \
+    { .key = (k), .type = JSON_BIND_STR, .offset = offsetof(st, member), .def_str = (def) }
+#define JSON_FIELD_OBJ(st, member, k, desc) \
+    { .key = (k), .type = JSON_BIND_OBJ, .offset = offsetof(st, member), .sub = (desc) }
+#define JSON_FIELD_ARR(st, member, count, k, elem_type, desc) \
+    { .key = (k), .type = JSON_BIND_ARR, .offset = offsetof(st, member), .sub = (desc), \
+      .elem = (elem_type), .cap = sizeof(((st *)0)->member) / sizeof(((st *)0)->member[0]), \
+      .elem_size = sizeof(((st *)0)->member[0]), .count_offset = offsetof(st, count) }
+#define JSON_FIELD_END  { .key = NULL }
+
+int json_bind(void *out, const json_field_desc *desc, const JSON *json);
+void json_bind_free(void *out, const json_field_desc *desc);
+JSON *json_unbind(const void *in, const json_field_desc *desc);
+
+//-----------------------------------------------------------------------------
+//  JSON Lines(NDJSON)：每行一个JSON值，多线程解析和输出
+//-----------------------------------------------------------------------------
+typedef struct json_lines json_lines;
+
+/**
+ * @brief json_lines_read交付记录的回调
+ * @param arg 用户参数
+ * @param json 解析出的记录，所有权转给回调；该行有语法错误时为NULL
+ * @param offset 该行在文件中的字节偏移
+ * @return int 0继续，<0停止读取
+ */
+typedef int (*json_lines_cb)(void *arg, JSON *json, U64 offset);
+
+json_lines *json_lines_open(const char *fname, U32 nthreads);
+int json_lines_read(json_lines *lines, BOOL ordered, json_lines_cb cb, void *arg);
+void json_lines_close(json_lines *lines);
+int json_lines_write(const char *fname, const JSON *const *jsons, U32 count, U32 nthreads);
+
+//-----------------------------------------------------------------------------
+//  JSONPath查询：通配符、递归下降、切片和简单过滤条件，结果不拷贝
+//-----------------------------------------------------------------------------
+typedef struct json_path json_path;
+
+/**
+ * @brief 查询结果，items指向树中的JSON值，树释放或修改后失效
+ * @details 初始化为{0}，可在多次查询间复用，用完调用json_result_free
+ */
+typedef struct json_result {
+    const JSON **items;
+    U32 count;
+    U32 cap;
+} json_result;
+
+json_path *json_path_compile(const char *expr);
+int json_path_query(const json_path *path, const JSON *json, json_result *res);
+void json_path_free(json_path *path);
+void json_result_free(json_result *res);
+
+//-----------------------------------------------------------------------------
+//  批量路径查询：路径编译成前缀树，一次遍历找到所有路径
+//-----------------------------------------------------------------------------
+typedef struct json_paths json_paths;
+
+json_paths *json_paths_compile(const char *const paths[], U32 n);
+int json_paths_get(const json_paths *paths, const JSON *json, const JSON *out[]);
+void json_paths_free(json_paths *paths);
+int json_get_many(const JSON *json, const char *const paths[], const JSON *out[], U32 n);
+
+//-----------------------------------------------------------------------------
+//  只读的平铺文档(tape)：整个文档放在一串64位的字和一块字符串区里，跳过子树是O(1)的
+//-----------------------------------------------------------------------------
+typedef struct json_tape json_tape;
+
+#define JSON_TAPE_NONE      0xFFFFFFFFu     //不存在的位置，传给各个接口时返回默认值
+
+json_tape *json_tape_parse(const char *text, size_t len);
+json_tape *json_tape_from(const JSON *json);
+JSON *json_tape_to_json(const json_tape *tape, U32 pos);
+void json_tape_free(json_tape *tape);
+size_t json_tape_bytes(const json_tape *tape);
+
+json_e json_tape_type(const json_tape *tape, U32 pos);
+int json_tape_count(const json_tape *tape, U32 pos);
+U32 json_tape_get_member(const json_tape *tape, U32 pos, const char *key);
+U32 json_tape_get_element(const json_tape *tape, U32 pos, U32 idx);
+U32 json_tape_first(const json_tape *tape, U32 pos);
+U32 json_tape_next(const json_tape *tape, U32 pos);
+const char *json_tape_key(const json_tape *tape, U32 pos, size_t *len);
+double json_tape_num(const json_tape *tape, U32 pos, double def);
+long long json_tape_int(const json_tape *tape, U32 pos, long long def);
+BOOL json_tape_bool(const json_tape *tape, U32 pos);
+const char *json_tape_str(const json_tape *tape, U32 pos, const char *def);
+size_t json_tape_str_len(const json_tape *tape, U32 pos);
+
+//-----------------------------------------------------------------------------
+//  自底向上构建：按先序依次给出容器的开始、键名、值和结束，容器结束时一次分配到最终大小
+//  出错后的调用什么也不做，错误在json_builder_finish时报告
+//-----------------------------------------------------------------------------
+typedef struct json_builder json_builder;
+
+json_builder *json_builder_new(void);
+int json_builder_begin_obj(json_builder *b);
+int json_builder_begin_arr(json_builder *b);
+int json_builder_key(json_builder *b, const char *key);
+int json_builder_keyn(json_builder *b, const char *key, size_t len);
+int json_builder_end(json_builder *b);
+int json_builder_null(json_builder *b);
+int json_builder_bool(json_builder *b, BOOL val);
+int json_builder_int(json_builder *b, long long val);
+int json_builder_num(json_builder *b, double val);
+int json_builder_str(json_builder *b, const char *str);
+int json_builder_strn(json_builder *b, const char *str, size_t len);
+int json_builder_value(json_builder *b, JSON *val);
+JSON *json_builder_finish(json_builder *b);
+
 
 #endif
 
@@ -0,0 +1,1186 @@
+#include "json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+//  代码生成工具，用法：./json_gen <样例.json> <前缀> <输出文件名(不含扩展名)>
+//  根据样例文档的结构生成C结构体，以及直接在JSON文本上工作的专用加载/输出函数：
+//  1. <前缀>_parse 不构建JSON树，键名在编译期已知，按长度和首字节switch分派，不逐个strcmp
+//  2. <前缀>_write 输出紧凑的JSON文本，键名连同标点都是常量字符串
+//  3. <前缀>_free 释放加载时分配的字符串和数组
+//  样例中的数值映射为double，字符串映射为char *，数组映射为指针加个数，
+//  对象数组的元素结构是所有元素成员的并集；null、空数组和数组的数组无法推断类型，跳过并给出警告
+//  键名转换成的字段名是C关键字或者和别的字段重复时加后缀，嵌套结构名重复时也加后缀；
+//  生成的加载函数和json_parse一样校验语法和UTF-8，只是字符串字段是C字符串，不接受\u0000
+
+/**
+ * @brief 从样例推断出的值的结构
+ */
+typedef struct shape shape;
+struct shape {
+    json_e type;        //JSON_BOL/JSON_NUM/JSON_STR/JSON_ARR/JSON_OBJ
+    char *name;         //JSON_OBJ：结构体名；JSON_ARR：函数名前缀，函数名带_list后缀
+    shape *elem;        //JSON_ARR：元素的结构
+    U32 count;          //JSON_OBJ：成员个数
+    char **keys;        //JSON_OBJ：成员的键名
+    char **fields;      //JSON_OBJ：成员对应的C字段名
+    shape **members;    //JSON_OBJ：成员的结构
+};
+
+/**
+ * @brief 生成的代码用到了哪些运行时函数
+ */
+typedef struct gen_uses {
+    BOOL bol;
+    BOOL num;
+    BOOL str;
+    BOOL arr;
+} gen_uses;
+
+static shape *shape_new(const JSON *json, const char *name);
+
+//  C关键字，以及生成的代码中会被当作宏展开的名字，不能用作字段名和前缀
+static const char *const c_reserved[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else",
+    "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "register",
+    "restrict", "return", "short", "signed", "sizeof", "static", "struct", "switch", "typedef",
+    "union", "unsigned", "void", "volatile", "while", "_Alignas", "_Alignof", "_Atomic", "_Bool",
+    "_Complex", "_Generic", "_Imaginary", "_Noreturn", "_Static_assert", "_Thread_local",
+    "NULL", "EOF", "TRUE", "FALSE", "errno", "stdin", "stdout", "stderr", "assert",
+};
+
+//  生成代码中运行时函数等的名字，结构体名不能和它们重复
+static const char *const runtime_names[] = {
+    "GEN_MAX_DEPTH", "gen_ctx", "gen_ws", "gen_lit", "gen_null", "gen_open", "gen_next", "gen_span",
+    "gen_hex4", "gen_put", "gen_decode", "gen_key", "gen_scan_num", "gen_skip", "gen_grow",
+    "gen_bool", "gen_write_bool", "gen_num", "gen_write_num", "gen_str", "gen_write_str",
+};
+
+/**
+ * @brief 已经用掉的结构体名和函数名前缀，拼接出来的嵌套结构名可能重复
+ */
+static struct {
+    char **items;
+    U32 count;
+} names;
+
+static BOOL is_reserved(const char *name)
+{
+    U32 i;
+
+    for (i = 0; i < sizeof(c_reserved) / sizeof(c_reserved[0]); ++i) {
+        if (strcmp(c_reserved[i], name) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * @brief 名字name加上后缀suffix是否已被占用
+ */
+static BOOL name_taken(const char *name, const char *suffix)
+{
+    size_t len = strlen(name);
+    U32 i;
+
+    for (i = 0; i < names.count; ++i) {
+        if (strncmp(names.items[i], name, len) == 0 && strcmp(names.items[i] + len, suffix) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+/**
+ * @brief 登记用掉的名字name加上后缀suffix
+ * @return int 0成功，<0失败
+ */
+static int name_keep(const char *name, const char *suffix)
+{
+    char **items = realloc(names.items, (names.count + 1) * sizeof(char *));
+    char *item = malloc(strlen(name) + strlen(suffix) + 1);
+
+    if (items)
+        names.items = items;
+    if (!items || !item) {
+        free(item);
+        return -1;
+    }
+    sprintf(item, "%s%s", name, suffix);
+    names.items[names.count++] = item;
+    return 0;
+}
+static void names_free(void)
+{
+    while (names.count)
+        free(names.items[--names.count]);
+    free(names.items);
+    names.items = NULL;
+}
+/**
+ * @brief 拼接出一个新的名字a_b，已被占用时加上_2、_3……后缀，并登记下来
+ * @param arr 是否数组，数组的函数名还要用到a_b_list
+ * @return char* 新名字，失败返回NULL
+ */
+static char *name_join(const char *a, const char *b, BOOL arr)
+{
+    size_t len = strlen(a) + strlen(b) + 1;
+    char *name = malloc(len + 16);
+    U32 i;
+
+    if (!name)
+        return NULL;
+    sprintf(name, "%s_%s", a, b);
+    for (i = 2; name_taken(name, "") || (arr && name_taken(name, "_list")); ++i)
+        sprintf(name + len, "_%u", i);
+    if (name_keep(name, "") < 0 || (arr && name_keep(name, "_list") < 0)) {
+        free(name);
+        return NULL;
+    }
+    return name;
+}
+/**
+ * @brief 字段名field在对象结构obj中是否已被占用，数组字段还占用field_count
+ * @param arr 新字段是否数组
+ */
+static BOOL field_taken(const shape *obj, const char *field, BOOL arr)
+{
+    size_t len = strlen(field);
+    U32 i;
+
+    for (i = 0; i < obj->count; ++i) {
+        const char *f = obj->fields[i];
+        size_t n = strlen(f);
+        if (strcmp(f, field) == 0)
+            return TRUE;
+        if (obj->members[i]->type == JSON_ARR && len == n + 6
+            && strncmp(field, f, n) == 0 && strcmp(field + n, "_count") == 0)
+            return TRUE;
+        if (arr && n == len + 6 && strncmp(f, field, len) == 0 && strcmp(f + len, "_count") == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+/**
+ * @brief 把键名转换为合法的C标识符，是关键字时加上_后缀，和已有字段重复时加上_2、_3……后缀
+ * @param arr 是否数组字段
+ */
+static char *field_name(const shape *obj, const char *key, BOOL arr)
+{
+    char *field = malloc(strlen(key) + 18), *p = field;
+    const char *k;
+    size_t len;
+    U32 i = 1;
+
+    if (!field)
+        return NULL;
+    if (isdigit((unsigned char)key[0]) || !key[0])
+        *p++ = '_';
+    for (k = key; *k; ++k)
+        *p++ = isalnum((unsigned char)*k) ? *k : '_';
+    *p = '\0';
+    if (is_reserved(field))
+        strcat(field, "_");
+    len = strlen(field);
+    while (field_taken(obj, field, arr))
+        sprintf(field + len, "_%u", ++i);
+    if (p != field + len || i > 1)
+        fprintf(stderr, "json_gen: %s.%s: field renamed to %s\n", obj->name, key, field);
+    return field;
+}
+static void shape_free(shape *sh)
+{
+    U32 i;
+
+    if (!sh)
+        return;
+    for (i = 0; i < sh->count; ++i) {
+        free(sh->keys[i]);
+        free(sh->fields[i]);
+        shape_free(sh->members[i]);
+    }
+    free(sh->keys);
+    free(sh->fields);
+    free(sh->members);
+    shape_free(sh->elem);
+    free(sh->name);
+    free(sh);
+}
+/**
+ * @brief 往对象结构中加入成员key，已有同名成员时忽略
+ * @return int 0成功，<0失败
+ */
+static int shape_add(shape *obj, const char *key, const JSON *val)
+{
+    shape *member;
+    char *field;
+    U32 i;
+
+    for (i = 0; i < obj->count; ++i) {
+        if (strcmp(obj->keys[i], key) == 0)
+            return 0;
+    }
+    field = field_name(obj, key, json_type(val) == JSON_ARR);
+    if (!field)
+        return -1;
+    char *name = name_join(obj->name, field, json_type(val) == JSON_ARR);
+    member = name ? shape_new(val, name) : NULL;
+    free(name);
+    if (!member) {
+        free(field);
+        if (json_type(val) == JSON_NONE || json_type(val) == JSON_ARR) {
+            fprintf(stderr, "json_gen: %s.%s: cannot infer type, skipped\n", obj->name, key);
+            return 0;
+        }
+        return -1;
+    }
+    obj->keys = realloc(obj->keys, (obj->count + 1) * sizeof(char *));
+    obj->fields = realloc(obj->fields, (obj->count + 1) * sizeof(char *));
+    obj->members = realloc(obj->members, (obj->count + 1) * sizeof(shape *));
+    if (!obj->keys || !obj->fields || !obj->members) {
+        free(field);
+        shape_free(member);
+        return -1;
+    }
+    obj->keys[obj->count] = strdup(key);
+    obj->fields[obj->count] = field;
+    obj->members[obj->count++] = member;
+    return 0;
+}
+/**
+ * @brief 把对象类型的样例json中的成员都并入对象结构obj
+ */
+static int shape_merge(shape *obj, const JSON *json)
+{
+    const char *key;
+    const JSON *val;
+    json_iter it;
+
+    json_obj_iter_begin(json, &it);
+    while ((val = json_obj_iter_next(&it, &key, NULL)) != NULL) {
+        if (shape_add(obj, key, val) < 0)
+            return -1;
+    }
+    return 0;
+}
+/**
+ * @brief 样例值的类型，整数和数值一样生成double字段
+ */
+static json_e sample_type(const JSON *json)
+{
+    return json_type(json) == JSON_INT ? JSON_NUM : json_type(json);
+}
+/**
+ * @brief 根据样例json推断结构
+ * @param name 对象的结构体名或数组字段的函数名
+ * @return shape* 推断出的结构，无法推断时返回NULL
+ */
+static shape *shape_new(const JSON *json, const char *name)
+{
+    shape *sh = calloc(1, sizeof(shape));
+    const JSON *elem;
+    U32 i;
+
+    if (!sh)
+        return NULL;
+    sh->type = sample_type(json);
+    sh->name = strdup(name);
+    if (!sh->name)
+        goto failed_;
+    switch (sh->type) {
+    case JSON_NONE:
+        goto failed_;
+    case JSON_OBJ:
+        if (shape_merge(sh, json) < 0)
+            goto failed_;
+        break;
+    case JSON_ARR:
+        elem = json_get_element(json, 0);
+        if (!elem || json_type(elem) == JSON_ARR)
+            goto failed_;
+        sh->elem = shape_new(elem, name);
+        if (!sh->elem)
+            goto failed_;
+        for (i = 1; (elem = json_get_element(json, i)) != NULL; ++i) {
+            if (sample_type(elem) != sh->elem->type) {
+                fprintf(stderr, "json_gen: %s[%u]: type differs from [0], ignored\n", name, i);
+                continue;
+            }
+            if (sh->elem->type == JSON_OBJ && shape_merge(sh->elem, elem) < 0)
+                goto failed_;
+        }
+        break;
+    default:
+        break;
+    }
+    return sh;
+failed_:
+    shape_free(sh);
+    return NULL;
+}
+/**
+ * @brief 统计生成的代码要用到哪些运行时函数
+ */
+static void shape_uses(const shape *sh, gen_uses *uses)
+{
+    U32 i;
+
+    switch (sh->type) {
+    case JSON_BOL: uses->bol = TRUE; break;
+    case JSON_NUM: uses->num = TRUE; break;
+    case JSON_STR: uses->str = TRUE; break;
+    case JSON_ARR:
+        uses->arr = TRUE;
+        shape_uses(sh->elem, uses);
+        break;
+    case JSON_OBJ:
+        for (i = 0; i < sh->count; ++i)
+            shape_uses(sh->members[i], uses);
+        break;
+    default:
+        break;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//  输出代码
+//-----------------------------------------------------------------------------
+/**
+ * @brief 输出C字符串字面量的内容(不含两边的双引号)
+ */
+static void emit_cstr(FILE *fp, const char *str)
+{
+    for (; *str; ++str) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20 || c >= 0x7F)
+            fprintf(fp, "\\%03o", c);
+        else
+            fputc(c, fp);
+    }
+}
+/**
+ * @brief 输出JSON字符串的内容转义后再作为C字符串字面量的内容
+ */
+static void emit_json_cstr(FILE *fp, const char *str)
+{
+    for (; *str; ++str) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\\\\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\\\u%04x", c);
+        else if (c >= 0x7F)
+            fprintf(fp, "\\%03o", c);
+        else
+            fputc(c, fp);
+    }
+}
+/**
+ * @brief 输出字符常量
+ */
+static void emit_char(FILE *fp, unsigned char c)
+{
+    if (isalnum(c) || c == '_' || c == '-' || c == '.' || c == ' ')
+        fprintf(fp, "'%c'", c);
+    else
+        fprintf(fp, "%u", c);
+}
+/**
+ * @brief 字段的C类型
+ */
+static const char *c_type(const shape *sh)
+{
+    switch (sh->type) {
+    case JSON_BOL: return "BOOL ";
+    case JSON_NUM: return "double ";
+    case JSON_STR: return "char *";
+    default:       return "";
+    }
+}
+/**
+ * @brief 输出结构体定义，嵌套的结构体先输出
+ */
+static void emit_struct(FILE *fp, const shape *sh)
+{
+    U32 i;
+
+    for (i = 0; i < sh->count; ++i) {
+        const shape *m = sh->members[i];
+        if (m->type == JSON_OBJ)
+            emit_struct(fp, m);
+        else if (m->type == JSON_ARR && m->elem->type == JSON_OBJ)
+            emit_struct(fp, m->elem);
+    }
+    fprintf(fp, "typedef struct %s {\n", sh->name);
+    for (i = 0; i < sh->count; ++i) {
+        const shape *m = sh->members[i];
+        switch (m->type) {
+        case JSON_OBJ:
+            fprintf(fp, "    %s %s;\n", m->name, sh->fields[i]);
+            break;
+        case JSON_ARR:
+            if (m->elem->type == JSON_OBJ)
+                fprintf(fp, "    %s *%s;\n", m->elem->name, sh->fields[i]);
+            else
+                fprintf(fp, "    %s*%s;\n", c_type(m->elem), sh->fields[i]);
+            fprintf(fp, "    U32 %s_count;\n", sh->fields[i]);
+            break;
+        default:
+            fprintf(fp, "    %s%s;\n", c_type(m), sh->fields[i]);
+            break;
+        }
+    }
+    fprintf(fp, "} %s;\n\n", sh->name);
+}
+/**
+ * @brief 解析一个sh类型的值到out的函数调用
+ */
+static void emit_parse_call(FILE *fp, const shape *sh, const char *out)
+{
+    switch (sh->type) {
+    case JSON_BOL: fprintf(fp, "gen_bool(ctx, %s)", out); break;
+    case JSON_NUM: fprintf(fp, "gen_num(ctx, %s)", out); break;
+    case JSON_STR: fprintf(fp, "gen_str(ctx, %s)", out); break;
+    case JSON_OBJ: fprintf(fp, "parse_%s(ctx, %s)", sh->name, out); break;
+    default: break;
+    }
+}
+/**
+ * @brief 按键名的长度和首字节分派，匹配后解析成员
+ */
+static void emit_dispatch(FILE *fp, const shape *sh)
+{
+    size_t len, max = 0;
+    U32 i, j;
+    BOOL *done = calloc(sh->count + 1, sizeof(BOOL));
+
+    for (i = 0; i < sh->count; ++i) {
+        if (strlen(sh->keys[i]) > max)
+            max = strlen(sh->keys[i]);
+    }
+    fprintf(fp, "        switch (len) {\n");
+    for (len = 1; len <= max; ++len) {
+        BOOL has_len = FALSE;
+        for (i = 0; i < sh->count; ++i) {
+            if (strlen(sh->keys[i]) != len || done[i])
+                continue;
+            if (!has_len)
+                fprintf(fp, "        case %lu:\n            switch (key[0]) {\n", len);
+            has_len = TRUE;
+            fprintf(fp, "            case ");
+            emit_char(fp, sh->keys[i][0]);
+            fprintf(fp, ":\n");
+            for (j = i; j < sh->count; ++j) {
+                char out[256];
+                if (done[j] || strlen(sh->keys[j]) != len || sh->keys[j][0] != sh->keys[i][0])
+                    continue;
+                done[j] = TRUE;
+                fprintf(fp, "                if (");
+                if (len > 1) {
+                    fprintf(fp, "memcmp(key + 1, \"");
+                    emit_cstr(fp, sh->keys[j] + 1);
+                    fprintf(fp, "\", %lu) == 0", len - 1);
+                } else {
+                    fprintf(fp, "1");
+                }
+                fprintf(fp, ") {\n                    if (");
+                if (sh->members[j]->type == JSON_ARR) {
+                    fprintf(fp, "parse_%s_list(ctx, &out->%s, &out->%s_count)",
+                            sh->members[j]->name, sh->fields[j], sh->fields[j]);
+                } else {
+                    snprintf(out, sizeof(out), "&out->%s", sh->fields[j]);
+                    emit_parse_call(fp, sh->members[j], out);
+                }
+                fprintf(fp, " < 0)\n                        return -1;\n"
+                            "                    continue;\n                }\n");
+            }
+            fprintf(fp, "                break;\n");
+        }
+        if (has_len)
+            fprintf(fp, "            }\n            break;\n");
+    }
+    fprintf(fp, "        }\n");
+    free(done);
+}
+/**
+ * @brief 输出数组字段的解析、输出函数
+ */
+static void emit_array(FILE *fp, const shape *sh)
+{
+    const shape *e = sh->elem;
+    char type[256];
+
+    if (e->type == JSON_OBJ)
+        snprintf(type, sizeof(type), "%s ", e->name);
+    else
+        snprintf(type, sizeof(type), "%s", c_type(e));
+    fprintf(fp,
+        "static int parse_%s_list(gen_ctx *ctx, %s**items, U32 *count)\n"
+        "{\n"
+        "    int ret = gen_open(ctx, '[', ']');\n"
+        "\n"
+        "    if (ret <= 0)\n"
+        "        return ret;\n"
+        "    do {\n"
+        "        if (gen_grow((void **)items, *count, sizeof(**items)) < 0)\n"
+        "            return -1;\n"
+        "        if (", sh->name, type);
+    emit_parse_call(fp, e, "&(*items)[(*count)++]");
+    fprintf(fp,
+        " < 0)\n"
+        "            return -1;\n"
+        "    } while ((ret = gen_next(ctx, ']')) > 0);\n"
+        "    return ret;\n"
+        "}\n\n");
+
+    fprintf(fp,
+        "static void write_%s_list(FILE *fp, %sconst *items, U32 count)\n"
+        "{\n"
+        "    U32 i;\n"
+        "\n"
+        "    fputc('[', fp);\n"
+        "    for (i = 0; i < count; ++i) {\n"
+        "        if (i)\n"
+        "            fputc(',', fp);\n", sh->name, type);
+    switch (e->type) {
+    case JSON_BOL: fprintf(fp, "        gen_write_bool(fp, items[i]);\n"); break;
+    case JSON_NUM: fprintf(fp, "        gen_write_num(fp, items[i]);\n"); break;
+    case JSON_STR: fprintf(fp, "        gen_write_str(fp, items[i]);\n"); break;
+    default:       fprintf(fp, "        write_%s(fp, &items[i]);\n", e->name); break;
+    }
+    fprintf(fp, "    }\n    fputc(']', fp);\n}\n\n");
+}
+/**
+ * @brief 输出对象结构体的解析、输出和释放函数，嵌套结构的函数先输出
+ */
+static void emit_object(FILE *fp, const shape *sh)
+{
+    U32 i;
+
+    for (i = 0; i < sh->count; ++i) {
+        const shape *m = sh->members[i];
+        if (m->type == JSON_OBJ) {
+            emit_object(fp, m);
+        } else if (m->type == JSON_ARR) {
+            if (m->elem->type == JSON_OBJ)
+                emit_object(fp, m->elem);
+            emit_array(fp, m);
+        }
+    }
+
+    fprintf(fp,
+        "static int parse_%s(gen_ctx *ctx, %s *out)\n"
+        "{\n"
+        "    const char *key;\n"
+        "    size_t len;\n"
+        "    int ret = gen_open(ctx, '{', '}');\n"
+        "\n"
+        "    if (ret <= 0)\n"
+        "        return ret;\n"
+        "    do {\n"
+        "        if (gen_key(ctx, &key, &len) < 0)\n"
+        "            return -1;\n", sh->name, sh->name);
+    if (sh->count)
+        emit_dispatch(fp, sh);
+    fprintf(fp,
+        "        if (gen_skip(ctx) < 0)\n"
+        "            return -1;\n"
+        "    } while ((ret = gen_next(ctx, '}')) > 0);\n"
+        "    return ret;\n"
+        "}\n\n");
+
+    fprintf(fp, "static void write_%s(FILE *fp, const %s *in)\n{\n", sh->name, sh->name);
+    for (i = 0; i < sh->count; ++i) {
+        const shape *m = sh->members[i];
+        fprintf(fp, "    fputs(\"%c\\\"", i ? ',' : '{');
+        emit_json_cstr(fp, sh->keys[i]);
+        fprintf(fp, "\\\":\", fp);\n");
+        switch (m->type) {
+        case JSON_BOL: fprintf(fp, "    gen_write_bool(fp, in->%s);\n", sh->fields[i]); break;
+        case JSON_NUM: fprintf(fp, "    gen_write_num(fp, in->%s);\n", sh->fields[i]); break;
+        case JSON_STR: fprintf(fp, "    gen_write_str(fp, in->%s);\n", sh->fields[i]); break;
+        case JSON_OBJ: fprintf(fp, "    write_%s(fp, &in->%s);\n", m->name, sh->fields[i]); break;
+        case JSON_ARR:
+            fprintf(fp, "    write_%s_list(fp, in->%s, in->%s_count);\n", m->name, sh->fields[i], sh->fields[i]);
+            break;
+        default: break;
+        }
+    }
+    fprintf(fp, "    fputs(\"%s}\", fp);\n}\n\n", sh->count ? "" : "{");
+
+    fprintf(fp, "static void free_%s(%s *in)\n{\n", sh->name, sh->name);
+    for (i = 0; i < sh->count; ++i) {
+        const shape *m = sh->members[i];
+        const char *f = sh->fields[i];
+        if (m->type == JSON_STR) {
+            fprintf(fp, "    free(in->%s);\n", f);
+        } else if (m->type == JSON_OBJ) {
+            fprintf(fp, "    free_%s(&in->%s);\n", m->name, f);
+        } else if (m->type == JSON_ARR) {
+            if (m->elem->type == JSON_STR)
+                fprintf(fp, "    for (U32 i = 0; i < in->%s_count; ++i)\n        free(in->%s[i]);\n", f, f);
+            else if (m->elem->type == JSON_OBJ)
+                fprintf(fp, "    for (U32 i = 0; i < in->%s_count; ++i)\n        free_%s(&in->%s[i]);\n",
+                        f, m->elem->name, f);
+            fprintf(fp, "    free(in->%s);\n", f);
+        }
+    }
+    fprintf(fp, "    (void)in;\n}\n\n");
+}
+
+//  生成代码中的运行时函数，按需输出
+static const char runtime_base[] =
+"#define GEN_MAX_DEPTH 512    /* 和json_parse一样，跳过的值最多嵌套的层数 */\n"
+"\n"
+"typedef struct gen_ctx {\n"
+"    const char *cur;\n"
+"    const char *end;\n"
+"    int depth;\n"
+"} gen_ctx;\n"
+"\n"
+"static void gen_ws(gen_ctx *ctx)\n"
+"{\n"
+"    while (ctx->cur < ctx->end && (*ctx->cur == ' ' || *ctx->cur == '\\t'\n"
+"           || *ctx->cur == '\\n' || *ctx->cur == '\\r'))\n"
+"        ++ctx->cur;\n"
+"}\n"
+"\n"
+"/* 跳过字面量lit，不匹配时返回-1 */\n"
+"static int gen_lit(gen_ctx *ctx, const char *lit)\n"
+"{\n"
+"    size_t len = strlen(lit);\n"
+"\n"
+"    if ((size_t)(ctx->end - ctx->cur) < len || memcmp(ctx->cur, lit, len) != 0)\n"
+"        return -1;\n"
+"    ctx->cur += len;\n"
+"    return 0;\n"
+"}\n"
+"\n"
+"/* 当前值是null时跳过它，返回1 */\n"
+"static int gen_null(gen_ctx *ctx)\n"
+"{\n"
+"    gen_ws(ctx);\n"
+"    return gen_lit(ctx, \"null\") == 0;\n"
+"}\n"
+"\n"
+"/* 进入数组或对象，返回1表示有内容，0表示为空或null，<0语法错误 */\n"
+"static int gen_open(gen_ctx *ctx, char open, char close)\n"
+"{\n"
+"    if (gen_null(ctx))\n"
+"        return 0;\n"
+"    if (ctx->cur >= ctx->end || *ctx->cur != open)\n"
+"        return -1;\n"
+"    ++ctx->cur;\n"
+"    gen_ws(ctx);\n"
+"    if (ctx->cur < ctx->end && *ctx->cur == close) {\n"
+"        ++ctx->cur;\n"
+"        return 0;\n"
+"    }\n"
+"    return 1;\n"
+"}\n"
+"\n"
+"/* 返回1表示后面还有元素，0表示遇到结尾，<0语法错误 */\n"
+"static int gen_next(gen_ctx *ctx, char close)\n"
+"{\n"
+"    gen_ws(ctx);\n"
+"    if (ctx->cur < ctx->end && (*ctx->cur == ',' || *ctx->cur == close))\n"
+"        return *ctx->cur++ == ',';\n"
+"    return -1;\n"
+"}\n"
+"\n"
+"/* 跳过字符串，返回字符串的内容和长度(未解码) */\n"
+"static int gen_span(gen_ctx *ctx, const char **str, size_t *len)\n"
+"{\n"
+"    const char *p;\n"
+"\n"
+"    if (ctx->cur >= ctx->end || *ctx->cur != '\"')\n"
+"        return -1;\n"
+"    for (p = ctx->cur + 1; p < ctx->end && *p != '\"'; ++p) {\n"
+"        if (*p == '\\\\')\n"
+"            ++p;\n"
+"    }\n"
+"    if (p >= ctx->end)\n"
+"        return -1;\n"
+"    *str = ctx->cur + 1;\n"
+"    *len = p - *str;\n"
+"    ctx->cur = p + 1;\n"
+"    return 0;\n"
+"}\n"
+"\n"
+"/* 读4位十六进制数，非法时返回-1 */\n"
+"static int gen_hex4(const char *p, const char *q, unsigned *code)\n"
+"{\n"
+"    int i;\n"
+"\n"
+"    if (q - p < 4)\n"
+"        return -1;\n"
+"    for (*code = 0, i = 0; i < 4; ++i) {\n"
+"        char c = p[i];\n"
+"        *code <<= 4;\n"
+"        if (c >= '0' && c <= '9')\n"
+"            *code |= c - '0';\n"
+"        else if (c >= 'a' && c <= 'f')\n"
+"            *code |= c - 'a' + 10;\n"
+"        else if (c >= 'A' && c <= 'F')\n"
+"            *code |= c - 'A' + 10;\n"
+"        else\n"
+"            return -1;\n"
+"    }\n"
+"    return 0;\n"
+"}\n"
+"\n"
+"/* 把码点code按UTF-8写到out，out为NULL时只计算字节数 */\n"
+"static int gen_put(char *out, unsigned code)\n"
+"{\n"
+"    if (code < 0x80) {\n"
+"        if (out)\n"
+"            out[0] = (char)code;\n"
+"        return 1;\n"
+"    }\n"
+"    if (code < 0x800) {\n"
+"        if (out) {\n"
+"            out[0] = (char)(0xC0 | code >> 6);\n"
+"            out[1] = (char)(0x80 | (code & 0x3F));\n"
+"        }\n"
+"        return 2;\n"
+"    }\n"
+"    if (code < 0x10000) {\n"
+"        if (out) {\n"
+"            out[0] = (char)(0xE0 | code >> 12);\n"
+"            out[1] = (char)(0x80 | (code >> 6 & 0x3F));\n"
+"            out[2] = (char)(0x80 | (code & 0x3F));\n"
+"        }\n"
+"        return 3;\n"
+"    }\n"
+"    if (out) {\n"
+"        out[0] = (char)(0xF0 | code >> 18);\n"
+"        out[1] = (char)(0x80 | (code >> 12 & 0x3F));\n"
+"        out[2] = (char)(0x80 | (code >> 6 & 0x3F));\n"
+"        out[3] = (char)(0x80 | (code & 0x3F));\n"
+"    }\n"
+"    return 4;\n"
+"}\n"
+"\n"
+"/*\n"
+" * 校验并解码字符串原文[p, q)，规则和json_parse相同：拒绝控制字符、非法转义、单独的代理和非法UTF-8，\n"
+" * 代理对合成一个码点；只是字段是C字符串，\\u0000也拒绝。out为NULL时只校验。\n"
+" * 返回解码后的字节数，<0非法\n"
+" */\n"
+"static long gen_decode(const char *p, const char *q, char *out)\n"
+"{\n"
+"    static const unsigned min[] = {0, 0x80, 0x800, 0x10000};\n"
+"    long n = 0;\n"
+"    unsigned code, low;\n"
+"    int k, i;\n"
+"\n"
+"    while (p < q) {\n"
+"        unsigned char c = *p++;\n"
+"        if (c >= 0x20 && c < 0x80 && c != '\\\\') {\n"
+"            if (out)\n"
+"                out[n] = (char)c;\n"
+"            ++n;\n"
+"            continue;\n"
+"        }\n"
+"        if (c < 0x20)\n"
+"            return -1;\n"
+"        if (c >= 0x80) {\n"
+"            k = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;\n"
+"            if (!k || c > 0xF4 || q - p < k)\n"
+"                return -1;\n"
+"            code = c & (0x3F >> k);\n"
+"            for (i = 0; i < k; ++i) {\n"
+"                if ((p[i] & 0xC0) != 0x80)\n"
+"                    return -1;\n"
+"                code = code << 6 | (p[i] & 0x3F);\n"
+"            }\n"
+"            if (code < min[k] || (code >= 0xD800 && code <= 0xDFFF) || code > 0x10FFFF)\n"
+"                return -1;\n"
+"            p += k;\n"
+"        } else {\n"
+"            if (p >= q)\n"
+"                return -1;\n"
+"            switch (*p++) {\n"
+"            case '\"':  code = '\"';  break;\n"
+"            case '\\\\': code = '\\\\'; break;\n"
+"            case '/':  code = '/';  break;\n"
+"            case 'b':  code = '\\b'; break;\n"
+"            case 'f':  code = '\\f'; break;\n"
+"            case 'n':  code = '\\n'; break;\n"
+"            case 'r':  code = '\\r'; break;\n"
+"            case 't':  code = '\\t'; break;\n"
+"            case 'u':\n"
+"                if (gen_hex4(p, q, &code) < 0)\n"
+"                    return -1;\n"
+"                p += 4;\n"
+"                if (code >= 0xD800 && code <= 0xDBFF) {\n"
+"                    if (q - p < 6 || p[0] != '\\\\' || p[1] != 'u' || gen_hex4(p + 2, q, &low) < 0\n"
+"                        || low < 0xDC00 || low > 0xDFFF)\n"
+"                        return -1;\n"
+"                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);\n"
+"                    p += 6;\n"
+"                } else if ((code >= 0xDC00 && code <= 0xDFFF) || code == 0) {\n"
+"                    return -1;\n"
+"                }\n"
+"                break;\n"
+"            default:\n"
+"                return -1;\n"
+"            }\n"
+"        }\n"
+"        n += gen_put(out ? out + n : NULL, code);\n"
+"    }\n"
+"    if (out)\n"
+"        out[n] = '\\0';\n"
+"    return n;\n"
+"}\n"
+"\n"
+"/* 读出键名和后面的冒号，键名中的转义字符不解码，因而不会和任何已知键名匹配 */\n"
+"static int gen_key(gen_ctx *ctx, const char **key, size_t *len)\n"
+"{\n"
+"    gen_ws(ctx);\n"
+"    if (gen_span(ctx, key, len) < 0 || gen_decode(*key, *key + *len, NULL) < 0)\n"
+"        return -1;\n"
+"    gen_ws(ctx);\n"
+"    if (ctx->cur >= ctx->end || *ctx->cur != ':')\n"
+"        return -1;\n"
+"    ++ctx->cur;\n"
+"    return 0;\n"
+"}\n"
+"\n"
+"/* 按JSON的语法扫描数值，返回数值的结尾，非法时返回NULL */\n"
+"static const char *gen_scan_num(const gen_ctx *ctx)\n"
+"{\n"
+"    const char *p = ctx->cur, *end = ctx->end;\n"
+"\n"
+"    if (p < end && *p == '-')\n"
+"        ++p;\n"
+"    if (p < end && *p == '0') {\n"
+"        ++p;\n"
+"    } else if (p < end && *p >= '1' && *p <= '9') {\n"
+"        while (p < end && *p >= '0' && *p <= '9')\n"
+"            ++p;\n"
+"    } else {\n"
+"        return NULL;\n"
+"    }\n"
+"    if (p < end && *p == '.') {\n"
+"        if (++p >= end || *p < '0' || *p > '9')\n"
+"            return NULL;\n"
+"        while (p < end && *p >= '0' && *p <= '9')\n"
+"            ++p;\n"
+"    }\n"
+"    if (p < end && (*p == 'e' || *p == 'E')) {\n"
+"        if (++p < end && (*p == '+' || *p == '-'))\n"
+"            ++p;\n"
+"        if (p >= end || *p < '0' || *p > '9')\n"
+"            return NULL;\n"
+"        while (p < end && *p >= '0' && *p <= '9')\n"
+"            ++p;\n"
+"    }\n"
+"    return p;\n"
+"}\n"
+"\n"
+"/* 跳过一个不认识的成员值，和json_parse一样校验语法 */\n"
+"static int gen_skip(gen_ctx *ctx)\n"
+"{\n"
+"    const char *str;\n"
+"    size_t len;\n"
+"    char close;\n"
+"    int ret;\n"
+"\n"
+"    gen_ws(ctx);\n"
+"    if (ctx->cur >= ctx->end)\n"
+"        return -1;\n"
+"    switch (*ctx->cur) {\n"
+"    case '\"':\n"
+"        return gen_span(ctx, &str, &len) < 0 || gen_decode(str, str + len, NULL) < 0 ? -1 : 0;\n"
+"    case 't':\n"
+"        return gen_lit(ctx, \"true\");\n"
+"    case 'f':\n"
+"        return gen_lit(ctx, \"false\");\n"
+"    case 'n':\n"
+"        return gen_lit(ctx, \"null\");\n"
+"    case '[': case '{':\n"
+"        if (ctx->depth >= GEN_MAX_DEPTH)\n"
+"            return -1;\n"
+"        close = *ctx->cur == '[' ? ']' : '}';\n"
+"        ret = gen_open(ctx, *ctx->cur, close);\n"
+"        if (ret <= 0)\n"
+"            return ret;\n"
+"        ++ctx->depth;\n"
+"        do {\n"
+"            if ((close == '}' && gen_key(ctx, &str, &len) < 0) || gen_skip(ctx) < 0)\n"
+"                return -1;\n"
+"        } while ((ret = gen_next(ctx, close)) > 0);\n"
+"        --ctx->depth;\n"
+"        return ret;\n"
+"    default:\n"
+"        str = gen_scan_num(ctx);\n"
+"        if (!str)\n"
+"            return -1;\n"
+"        ctx->cur = str;\n"
+"        return 0;\n"
+"    }\n"
+"}\n"
+"\n";
+
+static const char runtime_arr[] =
+"/* 元素个数是2的幂时容量翻倍，新元素清零 */\n"
+"static int gen_grow(void **items, U32 count, size_t size)\n"
+"{\n"
+"    if ((count & (count - 1)) == 0) {\n"
+"        void *p = realloc(*items, (count ? count * 2 : 1) * size);\n"
+"        if (!p)\n"
+"            return -1;\n"
+"        *items = p;\n"
+"    }\n"
+"    memset((char *)*items + count * size, 0, size);\n"
+"    return 0;\n"
+"}\n"
+"\n";
+
+static const char runtime_bol[] =
+"static int gen_bool(gen_ctx *ctx, BOOL *out)\n"
+"{\n"
+"    if (gen_null(ctx))\n"
+"        return 0;\n"
+"    if (ctx->end - ctx->cur >= 4 && memcmp(ctx->cur, \"true\", 4) == 0) {\n"
+"        ctx->cur += 4;\n"
+"        *out = TRUE;\n"
+"        return 0;\n"
+"    }\n"
+"    if (ctx->end - ctx->cur >= 5 && memcmp(ctx->cur, \"false\", 5) == 0) {\n"
+"        ctx->cur += 5;\n"
+"        *out = FALSE;\n"
+"        return 0;\n"
+"    }\n"
+"    return -1;\n"
+"}\n"
+"\n"
+"static void gen_write_bool(FILE *fp, BOOL val)\n"
+"{\n"
+"    fputs(val ? \"true\" : \"false\", fp);\n"
+"}\n"
+"\n";
+
+static const char runtime_num[] =
+"/* 不超过15位的整数直接累加，结果是精确的；其余交给strtod */\n"
+"static int gen_num(gen_ctx *ctx, double *out)\n"
+"{\n"
+"    const char *p, *digits, *end;\n"
+"    long long n = 0;\n"
+"    char buf[64], *s = buf;\n"
+"\n"
+"    if (gen_null(ctx))\n"
+"        return 0;\n"
+"    end = gen_scan_num(ctx);\n"
+"    if (!end)\n"
+"        return -1;\n"
+"    digits = ctx->cur + (*ctx->cur == '-');\n"
+"    for (p = digits; p < end && *p >= '0' && *p <= '9' && p - digits <= 15; ++p)\n"
+"        n = n * 10 + (*p - '0');\n"
+"    if (p == end && p - digits <= 15) {\n"
+"        *out = *ctx->cur == '-' ? -(double)n : (double)n;\n"
+"    } else {\n"
+"        if (end - ctx->cur >= (long)sizeof(buf) && !(s = malloc(end - ctx->cur + 1)))\n"
+"            return -1;\n"
+"        memcpy(s, ctx->cur, end - ctx->cur);\n"
+"        s[end - ctx->cur] = '\\0';\n"
+"        *out = strtod(s, NULL);\n"
+"        if (s != buf)\n"
+"            free(s);\n"
+"    }\n"
+"    ctx->cur = end;\n"
+"    return 0;\n"
+"}\n"
+"\n"
+"/* 先试15位有效数字，不能精确还原时才用17位 */\n"
+"static void gen_write_num(FILE *fp, double val)\n"
+"{\n"
+"    char buf[32];\n"
+"\n"
+"    if (val != val || val - val != 0) {\n"
+"        fputs(\"null\", fp);\n"
+"        return;\n"
+"    }\n"
+"    snprintf(buf, sizeof(buf), \"%.15g\", val);\n"
+"    if (strtod(buf, NULL) != val)\n"
+"        snprintf(buf, sizeof(buf), \"%.17g\", val);\n"
+"    fputs(buf, fp);\n"
+"}\n"
+"\n";
+
+static const char runtime_str[] =
+"static int gen_str(gen_ctx *ctx, char **out)\n"
+"{\n"
+"    const char *str;\n"
+"    size_t len;\n"
+"\n"
+"    if (gen_null(ctx))\n"
+"        return 0;\n"
+"    if (gen_span(ctx, &str, &len) < 0)\n"
+"        return -1;\n"
+"    free(*out);\n"
+"    *out = malloc(len + 1);\n"
+"    if (!*out)\n"
+"        return -1;\n"
+"    return gen_decode(str, str + len, *out) < 0 ? -1 : 0;\n"
+"}\n"
+"\n"
+"static void gen_write_str(FILE *fp, const char *str)\n"
+"{\n"
+"    if (!str) {\n"
+"        fputs(\"null\", fp);\n"
+"        return;\n"
+"    }\n"
+"    fputc('\"', fp);\n"
+"    for (; *str; ++str) {\n"
+"        unsigned char c = *str;\n"
+"        if (c == '\"' || c == '\\\\')\n"
+"            fprintf(fp, \"\\\\%c\", c);\n"
+"        else if (c == '\\n')\n"
+"            fputs(\"\\\\n\", fp);\n"
+"        else if (c < 0x20)\n"
+"            fprintf(fp, \"\\\\u%04x\", c);\n"
+"        else\n"
+"            fputc(c, fp);\n"
+"    }\n"
+"    fputc('\"', fp);\n"
+"}\n"
+"\n";
+
+/**
+ * @brief 输出头文件
+ */
+static int emit_header(const char *fname, const char *guard, const shape *root)
+{
+    FILE *fp = fopen(fname, "w");
+
+    if (!fp)
+        return -1;
+    fprintf(fp, "// 由json_gen生成，不要手工修改\n");
+    fprintf(fp, "#ifndef %s\n#define %s\n\n#include \"json.h\"\n\n", guard, guard);
+    emit_struct(fp, root);
+    fprintf(fp, "int %s_parse(const char *text, size_t len, %s *out);\n", root->name, root->name);
+    fprintf(fp, "int %s_write(const %s *in, FILE *fp);\n", root->name, root->name);
+    fprintf(fp, "void %s_free(%s *in);\n\n#endif\n", root->name, root->name);
+    return fclose(fp);
+}
+/**
+ * @brief 输出源文件
+ */
+static int emit_source(const char *fname, const char *header, const shape *root)
+{
+    FILE *fp = fopen(fname, "w");
+    gen_uses uses = {0};
+
+    if (!fp)
+        return -1;
+    shape_uses(root, &uses);
+    fprintf(fp, "// 由json_gen生成，不要手工修改\n");
+    fprintf(fp, "#include \"%s\"\n#include <stdlib.h>\n#include <string.h>\n\n", header);
+    fputs(runtime_base, fp);
+    if (uses.arr)
+        fputs(runtime_arr, fp);
+    if (uses.bol)
+        fputs(runtime_bol, fp);
+    if (uses.num)
+        fputs(runtime_num, fp);
+    if (uses.str)
+        fputs(runtime_str, fp);
+    emit_object(fp, root);
+
+    fprintf(fp,
+        "/**\n"
+        " * @brief 直接从JSON文本加载%s，不构建JSON树\n"
+        " * @return int 0成功，<0语法错误或类型不符，失败时out中已分配的内容都已释放\n"
+        " * @details 不认识的成员跳过；值为null的成员保持为0\n"
+        " */\n"
+        "int %s_parse(const char *text, size_t len, %s *out)\n"
+        "{\n"
+        "    gen_ctx ctx = {text, text + len, 0};\n"
+        "\n"
+        "    memset(out, 0, sizeof(*out));\n"
+        "    if (parse_%s(&ctx, out) < 0)\n"
+        "        goto failed_;\n"
+        "    gen_ws(&ctx);\n"
+        "    if (ctx.cur != ctx.end)\n"
+        "        goto failed_;\n"
+        "    return 0;\n"
+        "failed_:\n"
+        "    free_%s(out);\n"
+        "    memset(out, 0, sizeof(*out));\n"
+        "    return -1;\n"
+        "}\n\n", root->name, root->name, root->name, root->name, root->name);
+    fprintf(fp,
+        "/**\n"
+        " * @brief 把%s输出为紧凑的JSON文本\n"
+        " * @return int 0成功，<0写文件失败\n"
+        " */\n"
+        "int %s_write(const %s *in, FILE *fp)\n"
+        "{\n"
+        "    write_%s(fp, in);\n"
+        "    return ferror(fp) ? -1 : 0;\n"
+        "}\n\n", root->name, root->name, root->name, root->name);
+    fprintf(fp,
+        "void %s_free(%s *in)\n"
+        "{\n"
+        "    free_%s(in);\n"
+        "    memset(in, 0, sizeof(*in));\n"
+        "}\n", root->name, root->name, root->name);
+    return fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    char hname[256], cname[256], guard[sizeof(hname) + 1], *p;
+    const char *base;
+    shape *root;
+    JSON *json;
+    int ret;
+    U32 i;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <sample.json> <prefix> <output>\n", argv[0]);
+        return 1;
+    }
+    json = json_load(argv[1]);
+    if (!json || json_type(json) != JSON_OBJ) {
+        fprintf(stderr, "json_gen: %s is not a JSON object\n", argv[1]);
+        json_free(json);
+        return 1;
+    }
+    // 前缀本身、对外的三个函数名和运行时的名字先登记，嵌套结构的名字不能和它们重复
+    for (p = argv[2]; isalnum((unsigned char)*p) || *p == '_'; ++p)
+        ;
+    if (*p || !argv[2][0] || isdigit((unsigned char)argv[2][0]) || is_reserved(argv[2])) {
+        fprintf(stderr, "json_gen: prefix %s is not a valid C identifier\n", argv[2]);
+        json_free(json);
+        return 1;
+    }
+    root = NULL;
+    ret = name_keep(argv[2], "") < 0 || name_keep(argv[2], "_parse") < 0
+          || name_keep(argv[2], "_write") < 0 || name_keep(argv[2], "_free") < 0;
+    for (i = 0; !ret && i < sizeof(runtime_names) / sizeof(runtime_names[0]); ++i)
+        ret = name_taken(runtime_names[i], "") ? 0 : name_keep(runtime_names[i], "") < 0;
+    if (!ret)
+        root = shape_new(json, argv[2]);
+    json_free(json);
+    if (!root) {
+        names_free();
+        return 1;
+    }
+
+    snprintf(hname, sizeof(hname), "%s.h", argv[3]);
+    snprintf(cname, sizeof(cname), "%s.c", argv[3]);
+    base = strrchr(hname, '/') ? strrchr(hname, '/') + 1 : hname;
+    snprintf(guard, sizeof(guard), "%s_", base);
+    for (p = guard; *p; ++p)
+        *p = isalnum((unsigned char)*p) ? toupper((unsigned char)*p) : '_';
+
+    ret = emit_header(hname, guard, root) < 0 || emit_source(cname, base, root) < 0;
+    if (ret)
+        perror("json_gen");
+    shape_free(root);
+    names_free();
+    return ret;
+}
@@ -0,0 +1,440 @@
+#include "json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//-----------------------------------------------------------------------------
+//  JSON Lines(NDJSON)：每行一个JSON值
+//  JSON字符串里不会出现未转义的换行，所以'\n'一定是记录的边界，不用跟踪字符串状态就能分片。
+//  读：文件映射到内存后按大小切成分片，工作线程各自领取分片，把其中的每一行解析成JSON树；
+//      调用线程按分片收取结果并调用回调，所以回调总在调用线程上执行，不用考虑线程安全。
+//  写：记录按批分给工作线程输出成文本，调用线程按批的顺序写入文件。
+//  工作线程最多领先调用线程LINES_WINDOW * 线程数个分片，避免回调慢时结果堆积占满内存。
+//-----------------------------------------------------------------------------
+#define LINES_CHUNK_MIN     4096            //分片的最小字节数
+#define LINES_CHUNK_MAX     (4 << 20)       //分片的最大字节数
+#define LINES_CHUNKS        16              //每个线程大约分到几个分片，分片多了负载更均衡
+#define LINES_WINDOW        4               //每个线程最多领先几个分片(批)
+#define LINES_BATCH         256             //写的时候每批几条记录
+
+/**
+ * @brief 打开的JSON Lines文件
+ */
+struct json_lines {
+    const char *data;   //映射到内存的文件内容
+    size_t size;        //文件大小
+    size_t chunk;       //分片的名义大小，实际分片边界会挪到下一个换行之后
+    U32 nthreads;       //工作线程数
+};
+
+/**
+ * @brief 一条解析出的记录
+ */
+typedef struct lines_rec {
+    JSON *json;         //解析结果，语法错误时为NULL
+    U64 offset;         //该行在文件中的偏移
+} lines_rec;
+
+/**
+ * @brief 一个分片的解析结果，或者一批记录的输出文本
+ */
+typedef struct lines_batch {
+    lines_rec *recs;    //读：解析出的记录
+    U32 count;          //读：recs中的记录数
+    char *text;         //写：输出的文本
+    size_t len;         //写：text的长度
+    BOOL failed;        //处理时内存不足
+    BOOL ready;         //工作线程已经处理完
+    BOOL taken;         //调用线程已经取走
+} lines_batch;
+
+/**
+ * @brief 一次读或写的工作队列，工作线程和调用线程共享
+ */
+typedef struct lines_job {
+    const json_lines *lines;    //读：打开的文件
+    const JSON *const *jsons;   //写：待输出的记录
+    U32 count;                  //写：记录数
+    lines_batch *batches;       //每个分片(批)一项
+    U32 nbatches;               //分片(批)数
+    U32 next;                   //下一个待领取的分片(批)
+    U32 low;                    //最小的还没取走的分片(批)
+    U32 window;                 //工作线程最多领先low几个分片(批)
+    BOOL stop;                  //调用线程要求停止
+    pthread_mutex_t lock;
+    pthread_cond_t produced;    //有分片(批)处理完了
+    pthread_cond_t consumed;    //low前进了或者要求停止
+} lines_job;
+
+/**
+ * @brief 线程数为0时取CPU核数
+ */
+static U32 lines_threads(U32 nthreads)
+{
+    long n;
+
+    if (nthreads)
+        return nthreads;
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (U32)n : 1;
+}
+/**
+ * @brief 打开JSON Lines文件，准备多线程解析
+ *
+ * @param fname 文件名
+ * @param nthreads 解析用的线程数，0表示CPU核数
+ * @return json_lines* 打开的文件，失败返回NULL
+ */
+json_lines *json_lines_open(const char *fname, U32 nthreads)
+{
+    json_lines *lines;
+    struct stat st;
+    int fd;
+
+    if (!fname)
+        return NULL;
+    fd = open(fname, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    lines = calloc(1, sizeof(json_lines));
+    if (!lines || fstat(fd, &st) < 0)
+        goto failed_;
+    lines->size = st.st_size;
+    lines->nthreads = lines_threads(nthreads);
+    if (lines->size) {
+        void *data = mmap(NULL, lines->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+            goto failed_;
+        madvise(data, lines->size, MADV_SEQUENTIAL);
+        lines->data = data;
+    }
+    close(fd);
+    lines->chunk = lines->size / ((size_t)lines->nthreads * LINES_CHUNKS);
+    if (lines->chunk < LINES_CHUNK_MIN)
+        lines->chunk = LINES_CHUNK_MIN;
+    if (lines->chunk > LINES_CHUNK_MAX)
+        lines->chunk = LINES_CHUNK_MAX;
+    return lines;
+failed_:
+    close(fd);
+    free(lines);
+    return NULL;
+}
+/**
+ * @brief 关闭JSON Lines文件
+ */
+void json_lines_close(json_lines *lines)
+{
+    if (!lines)
+        return;
+    if (lines->data)
+        munmap((void *)lines->data, lines->size);
+    free(lines);
+}
+/**
+ * @brief 第idx个分片实际的起点：名义起点之后(含名义起点)第一行的行首
+ */
+static size_t chunk_start(const json_lines *lines, U32 idx)
+{
+    size_t pos = (size_t)idx * lines->chunk;
+    const char *nl;
+
+    if (pos == 0)
+        return 0;
+    if (pos >= lines->size)
+        return lines->size;
+    nl = memchr(lines->data + pos - 1, '\n', lines->size - pos + 1);
+    return nl ? (size_t)(nl - lines->data) + 1 : lines->size;
+}
+/**
+ * @brief 解析一个分片中的每一行，空行跳过
+ * @return int 0成功，<0内存不足
+ */
+static int parse_chunk(const json_lines *lines, U32 idx, lines_batch *batch)
+{
+    const char *p = lines->data + chunk_start(lines, idx);
+    const char *end = lines->data + chunk_start(lines, idx + 1);
+    U32 cap = 0;
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *eol = nl ? nl : end, *q;
+
+        for (q = p; q < eol && (*q == ' ' || *q == '\t' || *q == '\r'); ++q)
+            ;
+        if (q < eol) {
+            if (batch->count == cap) {
+                lines_rec *recs = realloc(batch->recs, (cap ? cap * 2 : 64) * sizeof(lines_rec));
+                if (!recs)
+                    return -1;
+                batch->recs = recs;
+                cap = cap ? cap * 2 : 64;
+            }
+            batch->recs[batch->count].json = json_parse(p, eol - p);
+            batch->recs[batch->count++].offset = p - lines->data;
+        }
+        p = eol + 1;
+    }
+    return 0;
+}
+/**
+ * @brief 释放分片中还没交给回调的记录
+ */
+static void batch_clear(lines_batch *batch)
+{
+    U32 i;
+
+    for (i = 0; i < batch->count; ++i)
+        json_free(batch->recs[i].json);
+    free(batch->recs);
+    free(batch->text);
+    memset(batch, 0, sizeof(*batch));
+}
+static int render_batch(lines_job *job, U32 idx);
+
+/**
+ * @brief 工作线程：领取分片(批)处理，直到全部领完或者要求停止
+ */
+static void *lines_worker(void *arg)
+{
+    lines_job *job = arg;
+    U32 idx;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        while (!job->stop && job->next < job->nbatches && job->next >= job->low + job->window)
+            pthread_cond_wait(&job->consumed, &job->lock);
+        if (job->stop || job->next >= job->nbatches) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        idx = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        if (job->lines)
+            job->batches[idx].failed = parse_chunk(job->lines, idx, &job->batches[idx]) < 0;
+        else
+            job->batches[idx].failed = render_batch(job, idx) < 0;
+
+        pthread_mutex_lock(&job->lock);
+        job->batches[idx].ready = TRUE;
+        pthread_cond_broadcast(&job->produced);
+        pthread_mutex_unlock(&job->lock);
+    }
+    return NULL;
+}
+/**
+ * @brief 初始化工作队列并启动工作线程
+ * @return U32 成功启动的线程数，0表示失败
+ */
+static U32 job_start(lines_job *job, U32 nbatches, U32 nthreads, pthread_t *tids)
+{
+    U32 i;
+
+    job->nbatches = nbatches;
+    job->window = nthreads * LINES_WINDOW;
+    job->batches = calloc(nbatches ? nbatches : 1, sizeof(lines_batch));
+    if (!job->batches)
+        return 0;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->produced, NULL);
+    pthread_cond_init(&job->consumed, NULL);
+    for (i = 0; i < nthreads; ++i) {
+        if (pthread_create(&tids[i], NULL, lines_worker, job) != 0)
+            break;
+    }
+    return i;
+}
+/**
+ * @brief 要求停止，等待工作线程退出，释放没取走的结果
+ */
+static void job_finish(lines_job *job, pthread_t *tids, U32 nthreads)
+{
+    U32 i;
+
+    pthread_mutex_lock(&job->lock);
+    job->stop = TRUE;
+    pthread_cond_broadcast(&job->consumed);
+    pthread_mutex_unlock(&job->lock);
+    for (i = 0; i < nthreads; ++i)
+        pthread_join(tids[i], NULL);
+    for (i = 0; i < job->nbatches; ++i)
+        batch_clear(&job->batches[i]);
+    free(job->batches);
+    pthread_cond_destroy(&job->consumed);
+    pthread_cond_destroy(&job->produced);
+    pthread_mutex_destroy(&job->lock);
+}
+/**
+ * @brief 调用线程取走一个处理完的分片(批)
+ * @param ordered 是否必须按顺序取
+ * @return U32 分片(批)的序号
+ */
+static U32 job_take(lines_job *job, BOOL ordered)
+{
+    U32 idx;
+
+    pthread_mutex_lock(&job->lock);
+    for (;;) {
+        if (ordered) {
+            if (job->batches[job->low].ready)
+                break;
+        } else {
+            for (idx = job->low; idx < job->next && !(job->batches[idx].ready
+                 && !job->batches[idx].taken); ++idx)
+                ;
+            if (idx < job->next)
+                break;
+        }
+        pthread_cond_wait(&job->produced, &job->lock);
+    }
+    if (ordered)
+        idx = job->low;
+    job->batches[idx].taken = TRUE;
+    pthread_mutex_unlock(&job->lock);
+    return idx;
+}
+/**
+ * @brief 调用线程用完了一个分片(批)，推进low，让工作线程可以继续领取
+ */
+static void job_done(lines_job *job, U32 idx)
+{
+    batch_clear(&job->batches[idx]);
+    pthread_mutex_lock(&job->lock);
+    job->batches[idx].taken = TRUE;
+    while (job->low < job->nbatches && job->batches[job->low].taken)
+        ++job->low;
+    pthread_cond_broadcast(&job->consumed);
+    pthread_mutex_unlock(&job->lock);
+}
+/**
+ * @brief 多线程解析文件中的每一行，逐条交给回调处理
+ *
+ * @param lines json_lines_open打开的文件
+ * @param ordered TRUE按文件中的顺序交付；FALSE哪个分片先解析完先交付，吞吐更高
+ * @param cb 回调，在调用线程上执行，记录的所有权转给回调
+ * @param arg 回调的用户参数
+ * @return int 0成功，<0失败，回调返回<0时停止并返回回调的返回值
+ * @details 空行跳过；语法错误的行以json为NULL交给回调，由回调决定是否继续
+ */
+int json_lines_read(json_lines *lines, BOOL ordered, json_lines_cb cb, void *arg)
+{
+    lines_job job;
+    pthread_t *tids;
+    U32 nthreads, started, idx, i;
+    int ret = 0;
+
+    if (!lines || !cb)
+        return -1;
+    memset(&job, 0, sizeof(job));
+    job.lines = lines;
+    nthreads = lines->nthreads;
+    tids = calloc(nthreads, sizeof(pthread_t));
+    if (!tids)
+        return -1;
+    started = job_start(&job, (lines->size + lines->chunk - 1) / lines->chunk, nthreads, tids);
+    if (!started) {
+        if (job.batches)
+            job_finish(&job, tids, 0);
+        free(tids);
+        return job.nbatches ? -1 : 0;
+    }
+    while (ret >= 0 && job.low < job.nbatches) {
+        idx = job_take(&job, ordered);
+        for (i = 0; i < job.batches[idx].count && ret >= 0; ++i) {
+            lines_rec *rec = &job.batches[idx].recs[i];
+            ret = cb(arg, rec->json, rec->offset);
+            rec->json = NULL;
+        }
+        if (ret >= 0 && job.batches[idx].failed)
+            ret = -1;
+        job_done(&job, idx);
+    }
+    job_finish(&job, tids, started);
+    free(tids);
+    return ret < 0 ? ret : 0;
+}
+/**
+ * @brief 工作线程把一批记录输出成文本，每条一行
+ * @return int 0成功，<0内存不足
+ */
+static int render_batch(lines_job *job, U32 idx)
+{
+    lines_batch *batch = &job->batches[idx];
+    U32 i, end = idx * LINES_BATCH + LINES_BATCH;
+    size_t cap = 0;
+
+    if (end > job->count)
+        end = job->count;
+    for (i = idx * LINES_BATCH; i < end; ++i) {
+        size_t len = 4;
+        char *text = job->jsons[i] ? json_dump(job->jsons[i], &len) : NULL;
+
+        if (!text && job->jsons[i])
+            return -1;
+        if (batch->len + len + 1 > cap) {
+            char *buf;
+            cap = (batch->len + len + 1) * 2;
+            buf = realloc(batch->text, cap);
+            if (!buf) {
+                free(text);
+                return -1;
+            }
+            batch->text = buf;
+        }
+        memcpy(batch->text + batch->len, text ? text : "null", len);
+        batch->text[batch->len + len] = '\n';
+        batch->len += len + 1;
+        free(text);
+    }
+    return 0;
+}
+/**
+ * @brief 多线程把一批JSON值输出为JSON Lines文件，每个值一行，顺序不变
+ *
+ * @param fname 文件名，已存在时覆盖
+ * @param jsons 待输出的JSON值，NULL输出为null
+ * @param count JSON值的个数
+ * @param nthreads 输出用的线程数，0表示CPU核数
+ * @return int 0成功，<0失败
+ */
+int json_lines_write(const char *fname, const JSON *const *jsons, U32 count, U32 nthreads)
+{
+    lines_job job;
+    pthread_t *tids;
+    U32 started, idx;
+    FILE *fp;
+    int ret = 0;
+
+    if (!fname || (count && !jsons))
+        return -1;
+    fp = fopen(fname, "w");
+    if (!fp)
+        return -2;
+    memset(&job, 0, sizeof(job));
+    job.jsons = jsons;
+    job.count = count;
+    nthreads = lines_threads(nthreads);
+    tids = calloc(nthreads, sizeof(pthread_t));
+    started = tids ? job_start(&job, (count + LINES_BATCH - 1) / LINES_BATCH, nthreads, tids) : 0;
+    if (!started && count)
+        ret = -1;
+    while (ret == 0 && job.low < job.nbatches) {
+        idx = job_take(&job, TRUE);
+        if (job.batches[idx].failed || fwrite(job.batches[idx].text, 1, job.batches[idx].len, fp)
+            != job.batches[idx].len)
+            ret = -1;
+        job_done(&job, idx);
+    }
+    if (job.batches)
+        job_finish(&job, tids, started);
+    free(tids);
+    if (fclose(fp) != 0)
+        ret = -1;
+    return ret;
+}
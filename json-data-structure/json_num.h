@@ -0,0 +1,29 @@
+#ifndef JSON_NUM_H_
+#define JSON_NUM_H_
+
+#include "json.h"
+
+//-----------------------------------------------------------------------------
+//  数值和文本的互相转换，json.c内部使用，不对外公开
+//-----------------------------------------------------------------------------
+#define NUM_FORMAT_MAX      32      //num_format输出的最大长度(含'\0')
+
+/**
+ * @brief 把double输出成能精确还原的最短十进制文本
+ * @param num 有限的double，NaN和无穷大由调用方处理
+ * @param buf 输出缓冲区，至少NUM_FORMAT_MAX字节，结果以'\0'结尾
+ * @return int 文本长度
+ * @details 有小数部分且绝对值在1e-6到1e15之间的直接写出，其余用科学计数法，如1e+2、1e+15、1.5e-7；
+ *          不带小数点和指数的文本会被解析成整数，所以1e15以内的整数由调用方按整数输出
+ */
+int num_format(double num, char *buf);
+/**
+ * @brief 把[begin, end)之间的十进制文本转换成最接近的double
+ * @param begin 文本开始，已经按JSON数值的语法检查过
+ * @param end 文本结束，不要求以'\0'结尾
+ * @param out 输出转换结果
+ * @return int 0成功，<0失败(内存不足)
+ */
+int num_parse(const char *begin, const char *end, double *out);
+
+#endif
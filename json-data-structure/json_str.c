@@ -0,0 +1,363 @@
+#include <string.h>
+#include <pthread.h>
+#include "json_str.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define STR_X86     1
+#endif
+
+//-----------------------------------------------------------------------------
+//  字符串的UTF-8校验和转义字符查找
+//  大部分字符串都是ASCII而且不需要转义，向量指令一次检查16/32字节，干净的块直接跳过，
+//  只有碰到需要处理的字节才停下来交给调用方或者逐字节的慢路径。
+//  UTF-8校验：
+//      AVX2：Keiser-Lemire查表法，用每个字节和前一个字节的高低4位查三张表，
+//            三个结果按位与不为0就是非法的两字节组合，再检查三、四字节序列的后续字节个数；
+//      SSE2：没有查表指令，只用来跳过纯ASCII的块，其余逐个字符检查；
+//      其他平台：每次8字节跳过ASCII，其余逐个字符检查。
+//-----------------------------------------------------------------------------
+#define STR_ASCII_MASK      0x8080808080808080ULL
+
+/**
+ * @brief 各指令集的实现
+ */
+typedef struct str_ops {
+    BOOL (*utf8_valid)(const char *str, size_t len);
+    size_t (*escape_scan)(const char *str, size_t len);
+    size_t (*yaml_scan)(const char *str, size_t len);
+} str_ops;
+
+static str_ops ops;
+static pthread_once_t ops_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief 检查s[i]开始的一个非ASCII字符
+ * @return size_t 字符的字节数，非法时返回0
+ */
+static size_t utf8_char(const unsigned char *s, size_t i, size_t len)
+{
+    unsigned char c = s[i], lo = 0x80, hi = 0xBF;
+    size_t n, k;
+
+    if (c >= 0xC2 && c <= 0xDF)
+        n = 2;
+    else if (c >= 0xE0 && c <= 0xEF)
+        n = 3;
+    else if (c >= 0xF0 && c <= 0xF4)
+        n = 4;
+    else
+        return 0;   // 单独的后续字节、0xC0/0xC1开头的超长编码、超过U+10FFFF
+    if (len - i < n)
+        return 0;
+    // 第二个字节的范围排除超长编码、代理区和超过U+10FFFF的码点
+    if (c == 0xE0)
+        lo = 0xA0;
+    else if (c == 0xED)
+        hi = 0x9F;
+    else if (c == 0xF0)
+        lo = 0x90;
+    else if (c == 0xF4)
+        hi = 0x8F;
+    if (s[i + 1] < lo || s[i + 1] > hi)
+        return 0;
+    for (k = 2; k < n; ++k) {
+        if ((s[i + k] & 0xC0) != 0x80)
+            return 0;
+    }
+    return n;
+}
+/**
+ * @brief 从i开始逐字节校验到结尾
+ */
+static BOOL utf8_tail(const unsigned char *s, size_t i, size_t len)
+{
+    while (i < len) {
+        size_t n = s[i] < 0x80 ? 1 : utf8_char(s, i, len);
+        if (!n)
+            return FALSE;
+        i += n;
+    }
+    return TRUE;
+}
+
+static BOOL utf8_scalar(const char *str, size_t len)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    size_t i = 0;
+    U64 w;
+
+    while (i < len) {
+        if (i + 8 <= len) {
+            memcpy(&w, s + i, sizeof(w));
+            if (!(w & STR_ASCII_MASK)) {
+                i += 8;
+                continue;
+            }
+        }
+        size_t n = s[i] < 0x80 ? 1 : utf8_char(s, i, len);
+        if (!n)
+            return FALSE;
+        i += n;
+    }
+    return TRUE;
+}
+/**
+ * @brief 逐字节查找，yaml为TRUE时多找':'和'#'
+ */
+static size_t scan_scalar(const char *str, size_t i, size_t len, BOOL yaml)
+{
+    for (; i < len; ++i) {
+        unsigned char c = str[i];
+        if (c < 0x20 || c == '"' || c == '\\' || (yaml && (c == ':' || c == '#')))
+            return i;
+    }
+    return len;
+}
+
+static size_t escape_scalar(const char *str, size_t len)
+{
+    return scan_scalar(str, 0, len, FALSE);
+}
+
+static size_t yaml_scalar(const char *str, size_t len)
+{
+    return scan_scalar(str, 0, len, TRUE);
+}
+
+#ifdef STR_X86
+//-----------------------------------------------------------------------------
+//  SSE2
+//-----------------------------------------------------------------------------
+static BOOL utf8_sse2(const char *str, size_t len)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    size_t i = 0;
+
+    while (i + 16 <= len) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)));
+        if (!mask) {
+            i += 16;
+            continue;
+        }
+        i += __builtin_ctz(mask);
+        size_t n = utf8_char(s, i, len);
+        if (!n)
+            return FALSE;
+        i += n;
+    }
+    return utf8_tail(s, i, len);
+}
+/**
+ * @brief 16字节里需要处理的字节的掩码
+ */
+static int scan_mask_sse2(__m128i v, BOOL yaml)
+{
+    __m128i hit = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v);    // v <= 0x1F
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    if (yaml) {
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(':')));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('#')));
+    }
+    return _mm_movemask_epi8(hit);
+}
+
+static size_t scan_sse2(const char *str, size_t len, BOOL yaml)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        int mask = scan_mask_sse2(_mm_loadu_si128((const __m128i *)(str + i)), yaml);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return scan_scalar(str, i, len, yaml);
+}
+
+static size_t escape_sse2(const char *str, size_t len)
+{
+    return scan_sse2(str, len, FALSE);
+}
+
+static size_t yaml_sse2(const char *str, size_t len)
+{
+    return scan_sse2(str, len, TRUE);
+}
+//-----------------------------------------------------------------------------
+//  AVX2
+//-----------------------------------------------------------------------------
+#define TOO_SHORT       (1 << 0)    // 11______ 0_______ 或 11______ 11______
+#define TOO_LONG        (1 << 1)    // 0_______ 10______
+#define OVERLONG_3      (1 << 2)    // 11100000 100_____
+#define TOO_LARGE       (1 << 3)    // 11110100 1001____ 等超过U+10FFFF的
+#define SURROGATE       (1 << 4)    // 11101101 101_____
+#define OVERLONG_2      (1 << 5)    // 1100000_ 10______
+#define TOO_LARGE_1000  (1 << 6)    // 11110101 1000____ 等
+#define OVERLONG_4      (1 << 6)    // 11110000 1000____
+#define TWO_CONTS       (1 << 7)    // 10______ 10______
+#define CARRY           (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#define LOOKUP16(...)   _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+/**
+ * @brief 在前一个块的末尾和当前块之间错开n个字节，得到每个字节前面第n个字节
+ */
+#define PREV(in, prev, n) \
+    _mm256_alignr_epi8(in, _mm256_permute2x128_si256(prev, in, 0x21), 16 - (n))
+
+__attribute__((target("avx2")))
+static __m256i shr4(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+/**
+ * @brief 检查一个32字节的块，返回值不为0说明有非法的序列
+ */
+__attribute__((target("avx2")))
+static __m256i utf8_block_avx2(__m256i in, __m256i prev)
+{
+    const __m256i byte1_high = LOOKUP16(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m256i byte1_low = LOOKUP16(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m256i byte2_high = LOOKUP16(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+    __m256i prev1 = PREV(in, prev, 1);
+    __m256i sc = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(byte1_high, shr4(prev1)),
+                         _mm256_shuffle_epi8(byte1_low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+        _mm256_shuffle_epi8(byte2_high, shr4(in)));
+    // 前面第2个字节是三、四字节序列的开头，或者前面第3个字节是四字节序列的开头时，当前字节必须是后续字节
+    __m256i third = _mm256_subs_epu8(PREV(in, prev, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(PREV(in, prev, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must, sc);
+}
+
+__attribute__((target("avx2")))
+static BOOL utf8_avx2(const char *str, size_t len)
+{
+    // 块的最后三个字节里有还没结束的多字节序列时不为0
+    const __m256i incomplete_max = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    __m256i prev = _mm256_setzero_si256(), err = prev, incomplete = prev, in;
+    char tail[32] = {0};
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        in = _mm256_loadu_si256((const __m256i *)(str + i));
+        if (!_mm256_movemask_epi8(in)) {
+            err = _mm256_or_si256(err, incomplete);     // 纯ASCII的块，只要求前一个块没有截断的序列
+        } else {
+            err = _mm256_or_si256(err, utf8_block_avx2(in, prev));
+            incomplete = _mm256_subs_epu8(in, incomplete_max);
+        }
+        prev = in;
+    }
+    // 剩下的不足32字节补0，0是ASCII，结尾截断的序列也能在这一块里查出来
+    memcpy(tail, str + i, len - i);
+    in = _mm256_loadu_si256((const __m256i *)tail);
+    err = _mm256_or_si256(err, utf8_block_avx2(in, prev));
+    return _mm256_testz_si256(err, err);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *str, size_t len, BOOL yaml)
+{
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(str + i));
+        __m256i hit = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v);
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        if (yaml) {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')));
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#')));
+        }
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return scan_scalar(str, i, len, yaml);
+}
+
+__attribute__((target("avx2")))
+static size_t escape_avx2(const char *str, size_t len)
+{
+    return scan_avx2(str, len, FALSE);
+}
+
+__attribute__((target("avx2")))
+static size_t yaml_avx2(const char *str, size_t len)
+{
+    return scan_avx2(str, len, TRUE);
+}
+#endif
+
+/**
+ * @brief 按CPU支持的指令集选择实现，只执行一次
+ */
+static void ops_init(void)
+{
+    ops.utf8_valid = utf8_scalar;
+    ops.escape_scan = escape_scalar;
+    ops.yaml_scan = yaml_scalar;
+#ifdef STR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ops.utf8_valid = utf8_avx2;
+        ops.escape_scan = escape_avx2;
+        ops.yaml_scan = yaml_avx2;
+    } else {
+        ops.utf8_valid = utf8_sse2;
+        ops.escape_scan = escape_sse2;
+        ops.yaml_scan = yaml_sse2;
+    }
+#endif
+}
+
+BOOL str_utf8_valid(const char *str, size_t len)
+{
+    pthread_once(&ops_once, ops_init);
+    return ops.utf8_valid(str, len);
+}
+
+size_t str_escape_scan(const char *str, size_t len)
+{
+    pthread_once(&ops_once, ops_init);
+    return ops.escape_scan(str, len);
+}
+
+size_t str_yaml_scan(const char *str, size_t len)
+{
+    pthread_once(&ops_once, ops_init);
+    return ops.yaml_scan(str, len);
+}
@@ -0,0 +1,27 @@
+#ifndef JSON_STR_H_
+#define JSON_STR_H_
+
+#include "json.h"
+
+//-----------------------------------------------------------------------------
+//  字符串的UTF-8校验和转义字符查找，json.c内部使用，不对外公开
+//  按CPU支持的指令集在第一次调用时选择AVX2、SSE2或者逐字节的实现
+//-----------------------------------------------------------------------------
+/**
+ * @brief 检查[str, str + len)是不是合法的UTF-8
+ * @return BOOL 合法返回TRUE；超长编码、代理区(U+D800~U+DFFF)、超过U+10FFFF或者截断的序列返回FALSE
+ */
+BOOL str_utf8_valid(const char *str, size_t len);
+/**
+ * @brief 查找第一个输出成JSON字符串时需要转义的字节：控制字符、双引号、反斜杠
+ * @return size_t 该字节的偏移，没有时返回len
+ */
+size_t str_escape_scan(const char *str, size_t len);
+/**
+ * @brief 查找第一个输出成YAML时可能需要加引号的字节：需要转义的字节再加上':'和'#'
+ * @return size_t 该字节的偏移，没有时返回len
+ * @details ':'和'#'只有在特定的上下文里才需要加引号，由调用方判断
+ */
+size_t str_yaml_scan(const char *str, size_t len);
+
+#endif
@@ -1,8 +1,18 @@
 #include "json.h"
 #include "xtest.h"
+#include "config_gen.h"
+#include "gt_gen.h"
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 //  完成使用场景的测试
 TEST(test, scene)
@@ -124,7 +134,7 @@ TEST(json_save, special_str)
 {
     JSON *json;
     buf_t result;
-    const char *expect = "hello\nworld";
+    const char *expect = "\"hello\\nworld\"";
 
     json = json_new_str("hello\nworld");
     EXPECT_EQ(0, json_save(json, "test.yml"));
@@ -135,6 +145,38 @@ TEST(json_save, special_str)
     json_free(json);
 }
 
+TEST(json_save, quoted_str)
+{
+    static const char *const strs[] = {"", "true", "123", "1.5e3", " lead", "a: b", "a #b", "-x",
+                                       "say \"hi\"\ttab", "http://host:80/a#b", "C:\\dir", "中文"};
+    static const char *const expect =
+        "\n- \"\""
+        "\n- \"true\""
+        "\n- \"123\""
+        "\n- \"1.5e3\""
+        "\n- \" lead\""
+        "\n- \"a: b\""
+        "\n- \"a #b\""
+        "\n- \"-x\""
+        "\n- \"say \\\"hi\\\"\\ttab\""
+        "\n- http://host:80/a#b"
+        "\n- C:\\dir"
+        "\n- 中文"
+        "\n- \"key: 1\": x";
+    JSON *json = json_new(JSON_ARR), *obj = json_new(JSON_OBJ);
+    buf_t result;
+
+    for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); ++i)
+        ASSERT_TRUE(json_add_element(json, json_new_str(strs[i])) != NULL);
+    json_add_member(obj, "key: 1", json_new_str("x"));
+    json_add_element(json, obj);
+    EXPECT_EQ(0, json_save(json, "test_quoted.yml"));
+    EXPECT_EQ(0, read_file(&result, "test_quoted.yml"));
+    EXPECT_STREQ(expect, result.str);
+    free(result.str);
+    json_free(json);
+}
+
 TEST(json_save, obj)
 {
     JSON *json;
@@ -332,6 +374,143 @@ TEST(json_array, invalid_access) {
     ASSERT_EQ(0, json_arr_get_num(arr, 999, 0));
     json_free(arr);
 }
+//  标量移入数组内部存放，数组和对象加入后保持原地址，还可以继续添加成员
+TEST(json_array, move_in)
+{
+    JSON *arr = json_new(JSON_ARR);
+    JSON *obj = json_new(JSON_OBJ);
+
+    ASSERT_TRUE(json_add_element(arr, obj) == obj);
+    ASSERT_TRUE(json_add_member(obj, "port", json_new_num(80)) != NULL);
+    JSON *num = json_add_element(arr, json_new_num(3.14));
+    ASSERT_TRUE(num != NULL);
+    EXPECT_EQ(3.14, json_num(num, 0));
+    for (int i = 0; i < 100; ++i)
+        ASSERT_EQ(0, json_arr_add_num(arr, i));
+
+    EXPECT_EQ(102, json_arr_count(arr));
+    EXPECT_TRUE(json_get_element(arr, 0) == obj);
+    EXPECT_EQ(80, json_obj_get_num(json_get_element(arr, 0), "port", 0));
+    EXPECT_EQ(3.14, json_arr_get_num(arr, 1, 0));
+    EXPECT_EQ(99, json_arr_get_num(arr, 101, 0));
+    EXPECT_TRUE(json_add_element(arr, NULL) == NULL);
+    EXPECT_EQ(102, json_arr_count(arr));
+    json_free(arr);
+}
+//  json_add_member/json_add_element的返回值：写在槽位里的标量返回槽位，字符串、大整数和容器保持原地址
+TEST(json_object, move_in_contract)
+{
+    JSON *obj = json_new(JSON_OBJ);
+    JSON *str = json_new_str("200.200.3.61");
+    JSON *big = json_new_int(133333333333333333LL);
+    JSON *sub = json_new(JSON_OBJ);
+    const JSON *num;
+
+    EXPECT_TRUE(json_add_member(obj, "ip", str) == str);
+    EXPECT_TRUE(json_add_member(obj, "big", big) == big);
+    EXPECT_TRUE(json_add_member(obj, "sub", sub) == sub);
+    //数值、小整数、BOOL和null的val已经释放，只能用返回值，和json_get_member取到的相同
+    num = json_add_member(obj, "port", json_new_num(389));
+    EXPECT_TRUE(num == json_get_member(obj, "port"));
+    EXPECT_EQ(389, json_num(num, 0));
+    EXPECT_TRUE(json_add_member(obj, "on", json_new_bool(TRUE)) == json_get_member(obj, "on"));
+    //之后再增加成员时返回值可能失效，地址不变的那些仍然可用
+    for (int i = 0; i < 100; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "k%d", i);
+        json_obj_set_num(obj, key, i);
+    }
+    EXPECT_STREQ("200.200.3.61", json_str(str, NULL));
+    EXPECT_TRUE(json_int(big, 0) == 133333333333333333LL);
+    EXPECT_EQ(0, json_obj_set_bool(sub, "enable", TRUE));
+    EXPECT_EQ(TRUE, json_obj_get_bool(json_get_member(obj, "sub"), "enable"));
+    EXPECT_EQ(389, json_obj_get_num(obj, "port", 0));
+    json_free(obj);
+}
+TEST(json_array, bulk_nums)
+{
+    JSON *arr = json_new(JSON_ARR);
+    double in[1000], out[1000];
+
+    for (int i = 0; i < 1000; ++i)
+        in[i] = i * 0.5;
+    ASSERT_EQ(0, json_arr_add_num(arr, -1));
+    ASSERT_EQ(0, json_arr_add_nums(arr, in, 1000));
+    EXPECT_EQ(1001, json_arr_count(arr));
+    EXPECT_EQ(499.5, json_arr_get_num(arr, 1000, 0));
+
+    EXPECT_EQ(1000, json_arr_get_nums(arr, out, 1, 1000));
+    EXPECT_EQ(0, memcmp(in, out, sizeof(in)));
+    EXPECT_EQ(1, json_arr_get_nums(arr, out, 1000, 10));   //越界部分不读
+    EXPECT_EQ(499.5, out[0]);
+    EXPECT_EQ(0, json_arr_get_nums(arr, out, 2000, 10));
+
+    //  NaN也能正确存取
+    double nan = 0.0 / 0.0;
+    ASSERT_EQ(0, json_arr_add_nums(arr, &nan, 1));
+    EXPECT_EQ(JSON_NUM, json_type(json_get_element(arr, 1001)));
+    EXPECT_TRUE(json_arr_get_num(arr, 1001, 0) != json_arr_get_num(arr, 1001, 0));
+
+    //  加入非数值元素后，范围内有非数值则整体失败
+    ASSERT_EQ(0, json_arr_add_str(arr, "text"));
+    EXPECT_EQ(2, json_arr_get_nums(arr, out, 0, 2));
+    EXPECT_EQ(-1, json_arr_get_nums(arr, out, 1000, 10));
+    EXPECT_EQ(-1, json_arr_get_nums(NULL, out, 0, 1));
+    EXPECT_EQ(-1, json_arr_add_nums(NULL, in, 1));
+    json_free(arr);
+}
+
+//  整数数组和数值数组一样不用逐个取值和释放，各种建数组的方式都要能批量读取
+TEST(json_array, int_nums)
+{
+    const char *text = "[130,131,132]";
+    JSON *arr = json_parse(text, strlen(text));
+    json_builder *b = json_builder_new();
+    double out[3002];
+    char *big;
+    size_t len;
+
+    ASSERT_TRUE(arr != NULL);
+    EXPECT_EQ(JSON_INT, json_type(json_get_element(arr, 1)));
+    EXPECT_EQ(3, json_arr_get_nums(arr, out, 0, 3));
+    EXPECT_EQ(131, out[1]);
+    EXPECT_EQ(0, json_arr_add_num(arr, 0.5));
+    EXPECT_EQ(0, json_arr_add_int(arr, -(1LL << 40)));
+    EXPECT_EQ(3, json_arr_get_nums(arr, out, 2, 3));
+    EXPECT_EQ(132, out[0]);
+    EXPECT_EQ(0.5, out[1]);
+    EXPECT_TRUE(out[2] == -(double)(1LL << 40));
+
+    //  超出48位的整数和其他类型一样需要逐个处理
+    EXPECT_EQ(0, json_arr_add_int(arr, 1LL << 50));
+    EXPECT_EQ(6, json_arr_get_nums(arr, out, 0, 10));
+    EXPECT_TRUE(out[5] == (double)(1LL << 50));
+
+    //  构建器和并行解析出来的整数数组，合并时追加到数值数组后面
+    json_builder_begin_arr(b);
+    for (int i = 0; i < 3000; ++i)
+        json_builder_int(b, i * 7919);
+    json_builder_end(b);
+    JSON *ints = json_builder_finish(b);
+    ASSERT_TRUE(ints != NULL);
+    big = json_dump(ints, &len);
+    json_free(ints);
+    ints = json_parse_parallel(big, len, 4);
+    ASSERT_TRUE(ints != NULL);
+    free(big);
+    JSON *dst = json_new(JSON_OBJ), *src = json_new(JSON_OBJ);
+    JSON *nums = json_add_member(dst, "v", json_new(JSON_ARR));
+    json_arr_add_num(nums, 0.25);
+    json_add_member(src, "v", ints);
+    EXPECT_EQ(0, json_merge(dst, src, JSON_MERGE_APPEND));
+    EXPECT_EQ(3000, json_arr_get_nums(nums, out, 1, 3000));
+    EXPECT_TRUE(out[2999] == 2999.0 * 7919);
+    EXPECT_EQ(0, json_arr_add_str(nums, "text"));
+    EXPECT_EQ(-1, json_arr_get_nums(nums, out, 0, 3002));
+    json_free(dst);
+    json_free(arr);
+}
+
 TEST(json_nested, complex) {
     JSON *root = json_new(JSON_OBJ);
     JSON *services = json_new(JSON_ARR);
@@ -457,6 +636,1715 @@ TEST(json_array, add_bool) {
     json_free(arr);
     json_free(not_arr);
 }
+TEST(json_parse, values)
+{
+    const char *text = " {\"a\": [1, -2.5e2, true, false, null, \"x\\\"\\u4e2d\\ud83d\\ude00\"],"
+                       " \"b\": {}, \"c\": [], \"a\": 0} ";
+    JSON *json = json_parse(text, strlen(text));
+    const JSON *arr;
+    const char *key;
+
+    ASSERT_TRUE(json != NULL);
+    EXPECT_EQ(4, json_obj_count(json));
+    arr = json_get_member(json, "a");   //重复的键名，取先出现的
+    ASSERT_EQ(JSON_ARR, json_type(arr));
+    EXPECT_EQ(6, json_arr_count(arr));
+    EXPECT_EQ(-250, json_arr_get_num(arr, 1, 0));
+    EXPECT_EQ(TRUE, json_arr_get_bool(arr, 2));
+    EXPECT_EQ(JSON_NONE, json_type(json_get_element(arr, 4)));
+    EXPECT_STREQ("x\"\xe4\xb8\xad\xf0\x9f\x98\x80", json_arr_get_str(arr, 5, NULL));
+    EXPECT_EQ(0, json_obj_count(json_get_member(json, "b")));
+    EXPECT_EQ(JSON_OBJ, json_type(json_get_member_at(json, 1, &key)));
+    EXPECT_STREQ("b", key);
+    EXPECT_TRUE(json_get_member_at(json, 4, &key) == NULL);
+    json_free(json);
+
+    //  文本不要求以'\0'结尾，顶层也可以是标量
+    json = json_parse("12345", 3);
+    EXPECT_EQ(123, json_num(json, 0));
+    json_free(json);
+}
+
+TEST(json_int, construct_and_access)
+{
+    json_stats st;
+
+    json_stats_reset();
+    JSON *small = json_new_int(-389);
+    JSON *big = json_new_int(9007199254740993LL);     //2^53+1，double表示不了
+    EXPECT_EQ(JSON_INT, json_type(small));
+    EXPECT_EQ(JSON_INT, json_type(big));
+    EXPECT_EQ(-389, json_int(small, 0));
+    EXPECT_TRUE(json_int(big, 0) == 9007199254740993LL);
+    EXPECT_EQ(-389, json_num(small, 0));
+    EXPECT_EQ(7, json_int(NULL, 7));
+    json_free(small);
+
+    JSON *obj = json_new(JSON_OBJ);
+    JSON *arr = json_add_member(obj, "arr", json_new(JSON_ARR));
+    EXPECT_EQ(0, json_obj_set_int(obj, "maxcnt", 133333333333LL));
+    EXPECT_EQ(0, json_obj_set_int(obj, "min", INT64_MIN));
+    EXPECT_EQ(0, json_obj_set_num(obj, "ratio", 2.0));
+    EXPECT_TRUE(json_obj_get_int(obj, "maxcnt", 0) == 133333333333LL);
+    EXPECT_TRUE(json_obj_get_int(obj, "min", 0) == INT64_MIN);
+    EXPECT_EQ(2, json_obj_get_int(obj, "ratio", 0));        //整数值的JSON_NUM也能取出
+    EXPECT_EQ(133333333333.0, json_obj_get_num(obj, "maxcnt", 0));
+    //数值和整数可以互相覆盖，其他类型不行
+    EXPECT_EQ(0, json_obj_set_num(obj, "min", 0.5));
+    EXPECT_EQ(JSON_NUM, json_type(json_get_member(obj, "min")));
+    EXPECT_EQ(0, json_obj_set_int(obj, "ratio", INT64_MAX));
+    EXPECT_TRUE(json_obj_get_int(obj, "ratio", 0) == INT64_MAX);
+    EXPECT_EQ(0, json_obj_set_str(obj, "s", "x"));
+    EXPECT_EQ(-1, json_obj_set_int(obj, "s", 1));
+    EXPECT_EQ(0, json_obj_get_int(obj, "min", 0));           //0.5不是整数
+
+    EXPECT_EQ(0, json_arr_add_int(arr, 1));
+    EXPECT_EQ(0, json_arr_add_int(arr, -(1LL << 60)));
+    EXPECT_EQ(0, json_arr_add_num(arr, 2.5));
+    EXPECT_TRUE(json_arr_get_int(arr, 1, 0) == -(1LL << 60));
+    EXPECT_EQ(2.5, json_arr_get_num(arr, 2, 0));
+    EXPECT_EQ(-7, json_arr_get_int(arr, 2, -7));
+    double nums[3];
+    EXPECT_EQ(3, json_arr_get_nums(arr, nums, 0, 3));
+    EXPECT_EQ(1, nums[0]);
+    json_add_element(arr, big);
+    json_free(obj);
+
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i) {
+        EXPECT_EQ(st.nodes_alloc[i], st.nodes_freed[i]);
+        EXPECT_EQ(st.bytes_alloc[i], st.bytes_freed[i]);
+    }
+}
+
+TEST(json_int, parse_and_print)
+{
+    const char *text = "[133333333333,9223372036854775807,-9223372036854775808,"
+                       "9223372036854775808,1.5,0,-17,12345678901234567890,1e3]";
+    static const json_e types[] = {JSON_INT, JSON_INT, JSON_INT, JSON_NUM, JSON_NUM,
+                                   JSON_INT, JSON_INT, JSON_NUM, JSON_NUM};
+    JSON *json = json_parse(text, strlen(text));
+    size_t len;
+    char *out;
+    buf_t result;
+
+    ASSERT_TRUE(json != NULL);
+    for (int i = 0; i < json_arr_count(json); ++i)
+        EXPECT_EQ(types[i], json_type(json_get_element(json, i)));
+    EXPECT_TRUE(json_arr_get_int(json, 1, 0) == INT64_MAX);
+    EXPECT_TRUE(json_arr_get_int(json, 2, 0) == INT64_MIN);
+    out = json_dump(json, &len);
+    EXPECT_STREQ("[133333333333,9223372036854775807,-9223372036854775808,"
+                 "9.223372036854776e+18,1.5,0,-17,1.2345678901234567e+19,1000]", out);
+    free(out);
+
+    JSON *yml = json_new(JSON_OBJ);
+    json_add_member(yml, "maxcnt", json_new_int(133333333333LL));
+    json_add_member(yml, "big", json_new_int(INT64_MIN));
+    EXPECT_EQ(0, json_save(yml, "test_int.yml"));
+    EXPECT_EQ(0, read_file(&result, "test_int.yml"));
+    EXPECT_STREQ("maxcnt: 133333333333\nbig: -9223372036854775808", result.str);
+    free(result.str);
+    json_free(yml);
+    json_free(json);
+}
+
+TEST(json_number, shortest_text)
+{
+    const char *text = "[0.1,3.14159265358979,-2.5e-7,1e21,0.3333333333333333,5e-324,"
+                       "1.7976931348623157e308,123456.789,1E15,0.000001]";
+    JSON *json = json_parse(text, strlen(text));
+    size_t len;
+    char *out;
+    buf_t result;
+
+    ASSERT_TRUE(json != NULL);
+    out = json_dump(json, &len);
+    EXPECT_STREQ("[0.1,3.14159265358979,-2.5e-7,1e+21,0.3333333333333333,5e-324,"
+                 "1.7976931348623157e+308,123456.789,1e+15,0.000001]", out);
+    free(out);
+    json_free(json);
+
+    JSON *yml = json_new(JSON_OBJ);
+    json_add_member(yml, "pi", json_new_num(3.14159265358979));
+    json_add_member(yml, "big", json_new_num(1e300));
+    json_add_member(yml, "inf", json_new_num(-1.0 / 0.0));
+    EXPECT_EQ(0, json_save(yml, "test_num.yml"));
+    EXPECT_EQ(0, read_file(&result, "test_num.yml"));
+    EXPECT_STREQ("pi: 3.14159265358979\nbig: 1e+300\ninf: -.inf", result.str);
+    free(result.str);
+    json_free(yml);
+}
+
+TEST(json_number, random_round_trip)
+{
+    U64 seed = 0x9E3779B97F4A7C15ULL, bits;
+    size_t len;
+    int bad = 0;
+
+    for (int i = 0; i < 200000; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        bits = seed;
+        if (i & 1)  //一半是任意的位模式，一半限制在常见的数量级
+            bits = (bits & 0x800FFFFFFFFFFFFFULL) | ((U64)(1023 - 40 + (seed >> 52) % 80) << 52);
+        double num;
+        memcpy(&num, &bits, sizeof(num));
+        if (num != num || num - num != 0)
+            continue;
+        JSON *json = json_new_num(num);
+        char *out = json_dump(json, &len);
+        JSON *back = json_parse(out, len);
+        if (!back || !(json_num(back, 0) == num)) {
+            if (++bad <= 5)
+                printf("%.17g -> %s\n", num, out);
+        }
+        json_free(back);
+        free(out);
+        json_free(json);
+    }
+    EXPECT_EQ(0, bad);
+}
+
+//  NaN-boxing的边界：NaN规整、有符号零、无穷大、非规格化数，以及位模式落在标签区的double
+TEST(json_number, boxing_edges)
+{
+    static const U64 boxed[] = {0xFFF8000000000001ULL, 0xFFF9000000000005ULL, 0xFFFC000000000000ULL,
+                                0xFFFFFFFFFFFFFFFFULL, 0x7FF8000000000001ULL, 0x7FFFFFFFFFFFFFFFULL};
+    double nums[6], num;
+    JSON *json, *arr = json_new(JSON_ARR);
+
+    // 任意载荷的NaN都规整为同一个NaN，类型仍是数值，不会被当成整数、字符串或容器
+    for (int i = 0; i < 6; ++i) {
+        memcpy(&nums[i], &boxed[i], sizeof(double));
+        json = json_new_num(nums[i]);
+        EXPECT_EQ(JSON_NUM, json_type(json));
+        num = json_num(json, 0);
+        EXPECT_TRUE(num != num);
+        json_free(json);
+        EXPECT_EQ(0, json_arr_add_num(arr, nums[i]));
+    }
+    EXPECT_EQ(0, json_arr_add_nums(arr, nums, 6));
+    for (int i = 0; i < 12; ++i) {
+        EXPECT_EQ(JSON_NUM, json_type(json_get_element(arr, i)));
+        num = json_num(json_get_element(arr, i), 0);
+        EXPECT_TRUE(num != num);
+    }
+    json_free(arr);
+
+    // 有符号零、无穷大和非规格化数原样保存
+    json = json_new_num(-0.0);
+    EXPECT_EQ(JSON_NUM, json_type(json));
+    EXPECT_TRUE(signbit(json_num(json, 1)));
+    json_free(json);
+    json = json_new_num(0.0);
+    EXPECT_FALSE(signbit(json_num(json, 1)));
+    json_free(json);
+    json = json_new_num(1.0 / 0.0);
+    EXPECT_TRUE(json_num(json, 0) == 1.0 / 0.0);
+    json_free(json);
+    json = json_new_num(-1.0 / 0.0);
+    EXPECT_TRUE(json_num(json, 0) == -1.0 / 0.0);
+    json_free(json);
+    json = json_new_num(4.9e-324);
+    EXPECT_TRUE(json_num(json, 0) == 4.9e-324);
+    json_free(json);
+
+    // 经过文本往返：有限值数值不变，NaN和无穷大输出null
+    const char *text = "[-0.0,4.9e-324,2.2250738585072009e-308,-1.7976931348623157e308,1e400,-1e400]";
+    size_t len;
+    char *out;
+    arr = json_parse(text, strlen(text));
+    ASSERT_TRUE(arr != NULL);
+    EXPECT_TRUE(signbit(json_num(json_get_element(arr, 0), 1)));
+    EXPECT_TRUE(json_num(json_get_element(arr, 4), 0) == 1.0 / 0.0);
+    EXPECT_TRUE(json_num(json_get_element(arr, 5), 0) == -1.0 / 0.0);
+    EXPECT_EQ(0, json_arr_add_num(arr, nums[0]));
+    out = json_dump(arr, &len);
+    EXPECT_STREQ("[0,5e-324,2.225073858507201e-308,-1.7976931348623157e+308,null,null,null]", out);
+    json = json_parse(out, len);
+    ASSERT_TRUE(json != NULL);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_TRUE(json_num(json_get_element(json, i), 1) == json_num(json_get_element(arr, i), 2));
+    EXPECT_EQ(JSON_NONE, json_type(json_get_element(json, 6)));
+    free(out);
+    json_free(json);
+    json_free(arr);
+}
+
+TEST(json_new_str, invalid_utf8)
+{
+    static const char *const bad[] = {"\xC0\xAF", "\xE0\x80\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80",
+                                      "\xF8\x88\x80\x80\x80", "\x80", "\xE4\xB8", "\xFF"};
+    char text[128];
+    JSON *obj = json_new(JSON_OBJ);
+
+    // 放在长串的中间和结尾，向量实现的分块边界两边都要覆盖
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        for (int pos = 0; pos < 70; pos += 31) {
+            memset(text, 'a', sizeof(text));
+            memcpy(text + pos, bad[i], strlen(bad[i]));
+            text[pos + strlen(bad[i]) + (pos ? 7 : 0)] = '\0';
+            EXPECT_TRUE(json_new_str(text) == NULL);
+        }
+    }
+    memset(text, 'a', 100);
+    strcpy(text + 60, "中文😀ü");
+    JSON *ok = json_new_str(text);
+    EXPECT_TRUE(ok != NULL);
+    json_free(ok);
+
+    EXPECT_EQ(0, json_obj_set_str(obj, "k", "中文"));
+    EXPECT_EQ(-1, json_obj_set_str(obj, "k", "\xED\xA0\x80"));
+    EXPECT_EQ(-1, json_obj_set_str(obj, "k2", "\xC3"));
+    EXPECT_STREQ("中文", json_obj_get_str(obj, "k", NULL));
+    json_free(obj);
+
+    EXPECT_TRUE(json_parse("\"\xE4\xB8\"", 4) == NULL);
+    EXPECT_TRUE(json_parse("\"\\udc00\"", 8) == NULL);
+    ok = json_parse("\"\xE4\xB8\xAD\\u00fc\"", 11);
+    ASSERT_TRUE(ok != NULL);
+    EXPECT_STREQ("中ü", json_str(ok, NULL));
+    json_free(ok);
+}
+
+TEST(json_str, length_and_nul)
+{
+    const char *text = "{\"a\\u0000b\":1,\"a\":2,\"s\":\"x\\u0000y\",\"\":3}";
+    JSON *json = json_parse(text, strlen(text));
+    JSON *bin = json_new_strn("p\0q", 3);
+    size_t len;
+    char *out;
+
+    ASSERT_TRUE(json != NULL);
+    EXPECT_EQ(1, json_num(json_get_membern(json, "a\0b", 3), 0));
+    EXPECT_EQ(2, json_num(json_get_membern(json, "abc", 1), 0));     // 键名不要求以'\0'结尾
+    EXPECT_EQ(3, json_num(json_get_membern(json, "", 0), 0));
+    EXPECT_TRUE(json_get_membern(json, "a\0", 2) == NULL);
+    const JSON *s = json_get_member(json, "s");
+    EXPECT_EQ(3, json_str_len(s));
+    EXPECT_TRUE(memcmp(json_str(s, NULL), "x\0y", 4) == 0);
+    out = json_dump(json, &len);
+    EXPECT_STREQ(text, out);
+    free(out);
+    json_free(json);
+
+    ASSERT_TRUE(bin != NULL);
+    EXPECT_EQ(3, json_str_len(bin));
+    EXPECT_EQ(0, json_str_len(NULL));
+    EXPECT_TRUE(json_new_strn("\xC3", 1) == NULL);
+    out = json_dump(bin, &len);
+    EXPECT_STREQ("\"p\\u0000q\"", out);
+    free(out);
+    json_free(bin);
+}
+
+TEST(json_shape, shared_and_private)
+{
+    const char *text = "[{\"ip\":\"a\",\"port\":1},{\"ip\":\"b\",\"port\":2},"
+                       "{\"a\":0,\"b\":1,\"c\":2,\"d\":3,\"e\":4,\"f\":5,\"g\":6,\"h\":7,\"a\":8,\"i\":9}]";
+    JSON *json = json_parse(text, strlen(text)), *big = json_new(JSON_OBJ);
+    json_mem_report mem;
+    char key[16], *out;
+
+    //键名序列相同的对象共享形状，键名不算在树里
+    ASSERT_TRUE(json != NULL);
+    EXPECT_EQ(0, json_memory_usage(json, &mem));
+    EXPECT_EQ(0, mem.key_bytes);
+    EXPECT_STREQ("b", json_str(json_get_member(json_get_element(json, 1), "ip"), NULL));
+    //键名多时查找表，重复的键取第一个
+    const JSON *many = json_get_element(json, 2);
+    EXPECT_EQ(0, json_num(json_get_member(many, "a"), -1));
+    EXPECT_EQ(9, json_num(json_get_member(many, "i"), -1));
+    EXPECT_TRUE(json_get_member(many, "z") == NULL);
+    out = json_dump(json, NULL);
+    EXPECT_STREQ(text, out);
+    free(out);
+    json_free(json);
+
+    //键名太多的对象改用私有形状，键名随对象释放
+    for (int i = 0; i < 40; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        json_obj_set_num(big, key, i);
+    }
+    EXPECT_EQ(40, json_obj_count(big));
+    EXPECT_EQ(0, json_num(json_get_member(big, "k0"), -1));
+    EXPECT_EQ(39, json_num(json_get_member(big, "k39"), -1));
+    EXPECT_EQ(0, json_memory_usage(big, &mem));
+    EXPECT_GT(mem.key_bytes, 40 * 3);
+    json_free(big);
+}
+
+TEST(json_shape, inline_cache)
+{
+    const char *text = "[{\"ip\":1,\"x\":0},{\"ip\":2,\"x\":0},{\"x\":0,\"ip\":3},{\"y\":0},{\"ip\":5,\"x\":0}]";
+    JSON *json = json_parse(text, strlen(text)), *big = json_new(JSON_OBJ);
+    char key[16];
+    double sum = 0;
+    int missing = 0;
+
+    ASSERT_TRUE(json != NULL);
+    //同一个调用点遇到不同形状的对象、缺少的键名和私有形状的对象，结果都和json_get_member一样
+    for (int i = 0; i < 40; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        json_obj_set_num(big, key, i);
+    }
+    json_obj_set_num(big, "ip", 100);
+    json_add_element(json, big);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < json_arr_count(json); ++i) {
+            const JSON *rec = json_get_element(json, i);
+            const JSON *ip = JSON_GET_MEMBER(rec, "ip");
+            EXPECT_TRUE(ip == json_get_member(rec, "ip"));
+            if (ip)
+                sum += json_num(ip, 0);
+            else
+                ++missing;
+        }
+    }
+    EXPECT_EQ(2 * 111, sum);
+    EXPECT_EQ(2, missing);
+    EXPECT_TRUE(JSON_GET_MEMBER(json, "ip") == NULL);     //不是对象
+    json_free(json);
+}
+
+TEST(json_iter, members_and_elements)
+{
+    const char *text = "{\"a\":1,\"b\\u0000c\":[1,2.5,3],\"d\":{},\"e\":[\"x\",null,true]}";
+    const char *keys[] = {"a", "b", "d", "e"};
+    const size_t klens[] = {1, 3, 1, 1};
+    JSON *json = json_parse(text, strlen(text));
+    const JSON *val, *elem;
+    const char *key;
+    size_t klen;
+    json_iter it, sub;
+    double sum = 0;
+    int n = 0;
+
+    ASSERT_TRUE(json != NULL);
+    ASSERT_EQ(0, json_obj_iter_begin(json, &it));
+    while ((val = json_obj_iter_next(&it, &key, &klen)) != NULL) {
+        ASSERT_LT(n, 4);
+        EXPECT_STREQ(keys[n], key);
+        EXPECT_EQ(klens[n], klen);
+        EXPECT_TRUE(val == json_get_member_at(json, n, NULL));
+        ++n;
+    }
+    EXPECT_EQ(4, n);
+    EXPECT_TRUE(json_obj_iter_next(&it, NULL, NULL) == NULL);  //遍历完一直返回NULL
+
+    //全数值数组和混合数组都能遍历
+    ASSERT_EQ(0, json_arr_iter_begin(json_get_membern(json, "b\0c", 3), &sub));
+    while ((elem = json_arr_iter_next(&sub)) != NULL)
+        sum += json_num(elem, 0);
+    EXPECT_EQ(6.5, sum);
+    ASSERT_EQ(0, json_arr_iter_begin(json_get_member(json, "e"), &sub));
+    EXPECT_STREQ("x", json_str(json_arr_iter_next(&sub), NULL));
+    EXPECT_EQ(JSON_NONE, json_type(json_arr_iter_next(&sub)));
+    EXPECT_EQ(TRUE, json_bool(json_arr_iter_next(&sub)));
+    EXPECT_TRUE(json_arr_iter_next(&sub) == NULL);
+
+    //空容器和类型不对的情况
+    ASSERT_EQ(0, json_obj_iter_begin(json_get_member(json, "d"), &sub));
+    EXPECT_TRUE(json_obj_iter_next(&sub, &key, NULL) == NULL);
+    EXPECT_EQ(-1, json_arr_iter_begin(json, &sub));
+    EXPECT_TRUE(json_arr_iter_next(&sub) == NULL);
+    EXPECT_EQ(-1, json_obj_iter_begin(NULL, &sub));
+    EXPECT_TRUE(json_obj_iter_next(&sub, &key, NULL) == NULL);
+    json_free(json);
+}
+
+#ifndef NDEBUG
+/**
+ * @brief 在子进程中取迭代器的下一个值，返回子进程是否因为assert失败而退出
+ */
+static BOOL iter_aborts(json_iter *it, BOOL obj)
+{
+    int status;
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        fclose(stderr);     //不输出assert的提示
+        if (obj)
+            json_obj_iter_next(it, NULL, NULL);
+        else
+            json_arr_iter_next(it);
+        _exit(0);
+    }
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+TEST(json_iter, detects_changes)
+{
+    JSON *obj = json_new(JSON_OBJ), *arr = json_new(JSON_ARR);
+    json_iter it;
+    char key[16];
+
+    for (int i = 0; i < 40; ++i) {      //键名多，用私有形状，不保持顺序时直接交换
+        snprintf(key, sizeof(key), "k%d", i);
+        json_obj_set_int(obj, key, i);
+        json_add_element(arr, json_new_int(i));
+    }
+    //删一个再加一个，个数和槽位数组都没变，仍然能发现
+    ASSERT_EQ(0, json_obj_iter_begin(obj, &it));
+    EXPECT_TRUE(json_obj_iter_next(&it, NULL, NULL) != NULL);
+    json_free(json_remove_member(obj, "k0", FALSE));
+    json_obj_set_int(obj, "k0", 0);
+    EXPECT_TRUE(iter_aborts(&it, TRUE));
+    ASSERT_EQ(0, json_arr_iter_begin(arr, &it));
+    json_free(json_remove_element(arr, 0, FALSE));
+    json_add_element(arr, json_new_int(0));
+    EXPECT_TRUE(iter_aborts(&it, FALSE));
+    //只改值不算修改
+    ASSERT_EQ(0, json_obj_iter_begin(obj, &it));
+    json_obj_set_int(obj, "k1", 100);
+    EXPECT_FALSE(iter_aborts(&it, TRUE));
+    json_free(obj);
+    json_free(arr);
+}
+#endif
+
+TEST(json_remove, members)
+{
+    const char *text = "{\"a\":1,\"b\":\"x\",\"c\":[1,2],\"d\":true,\"b\":2}";
+    const char *rest = "{\"a\":1,\"c\":[1,2],\"d\":true,\"b\":2}";
+    JSON *json = json_parse(text, strlen(text)), *expect = json_parse(rest, strlen(rest)), *val;
+    const JSON *c;
+    const char *key;
+    buf_t result, want;
+    char *out;
+
+    ASSERT_TRUE(json != NULL);
+    //按顺序删除只留下空位，同一个调用点缓存的下标落在空位上时找后面同名的成员
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass) {
+            val = json_remove_member(json, "b", TRUE);
+            EXPECT_STREQ("x", json_str(val, NULL));
+            json_free(val);
+        }
+        EXPECT_TRUE(JSON_GET_MEMBER(json, "b") == json_get_member(json, "b"));
+    }
+    EXPECT_EQ(2, json_num(json_get_member(json, "b"), 0));
+    EXPECT_EQ(4, json_obj_count(json));
+    EXPECT_TRUE(json_get_member_at(json, 1, &key) == json_get_member(json, "c"));
+    EXPECT_STREQ("c", key);
+    out = json_dump(json, NULL);
+    EXPECT_STREQ(rest, out);
+    free(out);
+    //YAML输出和没有删除过成员的对象一样
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+    EXPECT_EQ(0, json_save(expect, "test.yml"));
+    EXPECT_EQ(0, read_file(&want, "test.yml"));
+    EXPECT_STREQ(want.str, result.str);
+    free(result.str);
+    free(want.str);
+
+    //共享形状不保持顺序时也只留下空位，取出的容器保持原地址
+    c = json_get_member(json, "c");
+    val = json_remove_member(json, "c", FALSE);
+    EXPECT_TRUE(val == c);
+    json_free(val);
+    EXPECT_TRUE(json_remove_member(json, "c", FALSE) == NULL);
+    out = json_dump(json, NULL);
+    EXPECT_STREQ("{\"a\":1,\"d\":true,\"b\":2}", out);
+    free(out);
+
+    //空位超过一半时一起去掉
+    json_free(json_remove_member(json, "a", TRUE));
+    json_free(json_remove_member(json, "d", TRUE));
+    EXPECT_EQ(1, json_obj_count(json));
+    EXPECT_EQ(2, json_num(JSON_GET_MEMBER(json, "b"), 0));
+    json_free(json_remove_member(json, "b", FALSE));
+    out = json_dump(json, NULL);
+    EXPECT_STREQ("{}", out);
+    free(out);
+    json_free(expect);
+    json_free(json);
+}
+
+TEST(json_remove, shared_shape_unordered)
+{
+    const char *keys[] = {"a", "b", "c", "d"};
+    const char *text = "[{\"a\":0,\"b\":1,\"c\":2,\"d\":3},{\"a\":0,\"b\":1,\"c\":2,\"d\":3},"
+                       "{\"a\":0,\"b\":1,\"c\":2,\"d\":3},{\"a\":0,\"b\":1,\"c\":2,\"d\":3}]";
+    JSON *json = json_parse(text, strlen(text)), *obj;
+    json_mem_report report;
+
+    ASSERT_TRUE(json != NULL);
+    //每个对象删掉不同的成员，其余成员保持原来的顺序，不会换出新的键名顺序
+    for (U32 i = 0; i < 4; ++i) {
+        obj = (JSON *)json_get_element(json, i);
+        json_free(json_remove_member(obj, keys[i], FALSE));
+        EXPECT_EQ(3, json_obj_count(obj));
+        for (U32 j = 0, n = 0; j < 4; ++j) {
+            if (j == i)
+                continue;
+            EXPECT_EQ(j, json_int(json_get_member(obj, keys[j]), -1));
+            EXPECT_EQ(j, json_int(json_get_member_at(obj, n++, NULL), -1));
+        }
+    }
+    //再删一个时空位超过一半，压实后键名相同的对象仍然共享形状
+    for (U32 i = 0; i < 4; ++i)
+        json_free(json_remove_member((JSON *)json_get_element(json, i), keys[(i + 1) % 4], FALSE));
+    EXPECT_EQ(0, json_memory_usage(json, &report));
+    EXPECT_EQ(0, report.key_bytes);
+    json_free(json);
+}
+
+TEST(json_remove, private_shape_and_elements)
+{
+    const char *text = "[1,\"s\",2.5,{\"x\":1},4]";
+    JSON *obj, *arr, *val;
+    json_stats st;
+    char key[16];
+    char *out;
+
+    json_stats_reset();
+    obj = json_new(JSON_OBJ);
+    for (int i = 0; i < 40; ++i) {      //键名多，用私有形状
+        snprintf(key, sizeof(key), "k%d", i);
+        json_obj_set_int(obj, key, i);
+    }
+    for (int i = 0; i < 40; i += 2) {
+        snprintf(key, sizeof(key), "k%d", i);
+        val = json_remove_member(obj, key, TRUE);
+        EXPECT_EQ(i, json_int(val, -1));
+        json_free(val);
+    }
+    EXPECT_EQ(20, json_obj_count(obj));
+    for (int i = 0; i < 20; ++i)
+        EXPECT_EQ(2 * i + 1, json_int(json_get_member_at(obj, i, NULL), -1));
+    //最后一个成员挪到最前面，空位随后一起去掉
+    json_free(json_remove_member(obj, "k1", FALSE));
+    EXPECT_EQ(19, json_obj_count(obj));
+    EXPECT_EQ(39, json_int(json_get_member_at(obj, 0, NULL), -1));
+    EXPECT_EQ(37, json_int(json_get_member(obj, "k37"), -1));
+    EXPECT_TRUE(json_get_member(obj, "k1") == NULL);
+
+    arr = json_parse(text, strlen(text));
+    ASSERT_TRUE(arr != NULL);
+    val = json_remove_element(arr, 1, TRUE);
+    EXPECT_STREQ("s", json_str(val, NULL));
+    json_free(val);
+    json_free(json_remove_element(arr, 0, FALSE));
+    EXPECT_TRUE(json_remove_element(arr, 3, FALSE) == NULL);
+    EXPECT_TRUE(json_remove_element(obj, 0, FALSE) == NULL);
+    out = json_dump(arr, NULL);
+    EXPECT_STREQ("[4,2.5,{\"x\":1}]", out);
+    free(out);
+    json_free(arr);
+    json_free(obj);
+
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i) {
+        EXPECT_EQ(st.nodes_alloc[i], st.nodes_freed[i]);
+        EXPECT_EQ(st.bytes_alloc[i], st.bytes_freed[i]);
+    }
+}
+
+TEST(json_move, owned_strings)
+{
+    JSON *obj, *str;
+    json_stats st;
+    char *buf;
+
+    json_stats_reset();
+    obj = json_new(JSON_OBJ);
+    //字符串直接接管，不再复制
+    buf = strdup("hello");
+    str = json_new_str_owned(buf);
+    EXPECT_TRUE(json_str(str, NULL) == buf);
+    json_add_member(obj, "a", str);
+    buf = strdup("world");
+    EXPECT_EQ(0, json_obj_set_str_owned(obj, "a", buf));
+    EXPECT_TRUE(json_obj_get_str(obj, "a", NULL) == buf);
+    buf = strdup("new");
+    EXPECT_EQ(0, json_obj_set_str_owned(obj, "b", buf));
+    EXPECT_TRUE(json_obj_get_str(obj, "b", NULL) == buf);
+    //失败时字符串也被释放
+    json_obj_set_int(obj, "n", 1);
+    EXPECT_EQ(-1, json_obj_set_str_owned(obj, "n", strdup("x")));
+    EXPECT_TRUE(json_new_str_owned(strdup("\xff")) == NULL);
+    EXPECT_EQ(0, json_obj_set_str(obj, "a", "copied"));
+    EXPECT_STREQ("copied", json_obj_get_str(obj, "a", NULL));
+    json_free(obj);
+
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i) {
+        EXPECT_EQ(st.nodes_alloc[i], st.nodes_freed[i]);
+        EXPECT_EQ(st.bytes_alloc[i], st.bytes_freed[i]);
+    }
+}
+
+TEST(json_move, members_between_objects)
+{
+    const char *text = "{\"cfg\":{\"ip\":\"1.1.1.1\",\"port\":80,\"dns\":[1,2]},\"site\":{\"port\":8080}}";
+    JSON *json = json_parse(text, strlen(text)), *cfg, *site, *val;
+    const JSON *dns;
+    json_stats st;
+    char *out;
+
+    ASSERT_TRUE(json != NULL);
+    json_stats_reset();
+    cfg = (JSON *)json_get_member(json, "cfg");
+    site = (JSON *)json_get_member(json, "site");
+    //容器整个挪过去，地址不变；已有的成员被替换
+    dns = json_get_member(cfg, "dns");
+    EXPECT_TRUE(json_move_member(site, "dns", cfg, "dns") == dns);
+    EXPECT_EQ(80, json_int(json_move_member(site, "port", cfg, "port"), 0));
+    EXPECT_TRUE(json_move_member(site, "x", cfg, "missing") == NULL);
+    //同一个对象里相当于改名
+    EXPECT_STREQ("1.1.1.1", json_str(json_move_member(cfg, "addr", cfg, "ip"), NULL));
+    out = json_dump(json, NULL);
+    EXPECT_STREQ("{\"cfg\":{\"addr\":\"1.1.1.1\"},\"site\":{\"port\":80,\"dns\":[1,2]}}", out);
+    free(out);
+    //只搬动槽位，没有分配新内存
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i)
+        EXPECT_EQ(0, st.bytes_alloc[i]);
+
+    val = json_take_member(site, "dns");
+    EXPECT_TRUE(val == dns);
+    json_free(json_take_element(val, 0));
+    EXPECT_EQ(2, json_arr_get_int(val, 0, 0));
+    EXPECT_TRUE(json_take_element(val, 1) == NULL);
+    json_free(val);
+    json_free(json_take_member(json, "cfg"));
+    json_free(json_take_member(json, "site"));
+    EXPECT_EQ(0, json_obj_count(json));
+    json_free(json);
+}
+
+TEST(json_builder, nested_tree)
+{
+    const char *expect = "{\"basic\":{\"enable\":true,\"ip\":\"200.200.3.61\",\"port\":389,"
+                         "\"big\":9007199254740993,\"dns\":[\"200.200.0.1\",\"200.0.0.254\"],"
+                         "\"none\":null,\"empty\":{}},\"nums\":[1.5,-2,[]],\"ex\":[1]}";
+    json_builder *b;
+    json_stats st;
+    JSON *json;
+    char *out;
+
+    json_stats_reset();
+    b = json_builder_new();
+    json_builder_begin_obj(b);
+    json_builder_key(b, "basic");
+    json_builder_begin_obj(b);
+    json_builder_key(b, "enable");
+    json_builder_bool(b, TRUE);
+    json_builder_key(b, "ip");
+    json_builder_str(b, "200.200.3.61");
+    json_builder_key(b, "port");
+    json_builder_int(b, 389);
+    json_builder_key(b, "big");
+    json_builder_int(b, 9007199254740993LL);
+    json_builder_key(b, "dns");
+    json_builder_begin_arr(b);
+    json_builder_str(b, "200.200.0.1");
+    json_builder_strn(b, "200.0.0.254!", 11);
+    json_builder_end(b);
+    json_builder_keyn(b, "none!", 4);
+    json_builder_null(b);
+    json_builder_key(b, "empty");
+    json_builder_begin_obj(b);
+    json_builder_end(b);
+    json_builder_end(b);
+    json_builder_key(b, "nums");
+    json_builder_begin_arr(b);
+    json_builder_num(b, 1.5);
+    json_builder_num(b, -2);
+    json_builder_begin_arr(b);
+    json_builder_end(b);
+    json_builder_end(b);
+    json_builder_key(b, "ex");
+    json_builder_value(b, json_parse("[1]", 3));
+    json_builder_end(b);
+    json = json_builder_finish(b);
+    ASSERT_TRUE(json != NULL);
+
+    out = json_dump(json, NULL);
+    EXPECT_STREQ(expect, out);
+    free(out);
+    //非空容器的槽位数组都只分配一次，[1]是解析出来的
+    EXPECT_EQ(0, json_stats_get(&st));
+    EXPECT_EQ(2, st.member_reallocs);
+    EXPECT_EQ(3, st.element_reallocs);
+    json_free(json);
+
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i) {
+        EXPECT_EQ(st.nodes_alloc[i], st.nodes_freed[i]);
+        EXPECT_EQ(st.bytes_alloc[i], st.bytes_freed[i]);
+    }
+}
+
+TEST(json_builder, sticky_errors)
+{
+    json_builder *b;
+    json_stats st;
+    JSON *json;
+
+    json_stats_reset();
+    //出错后的调用都返回-1，交进来的值也被释放
+    b = json_builder_new();
+    EXPECT_EQ(0, json_builder_begin_arr(b));
+    EXPECT_EQ(0, json_builder_str(b, "s"));
+    EXPECT_EQ(-1, json_builder_key(b, "k"));
+    EXPECT_EQ(-1, json_builder_int(b, 2));
+    EXPECT_EQ(-1, json_builder_value(b, json_new_str("x")));
+    EXPECT_EQ(-1, json_builder_end(b));
+    EXPECT_TRUE(json_builder_finish(b) == NULL);
+
+    b = json_builder_new();
+    json_builder_begin_obj(b);
+    EXPECT_EQ(-1, json_builder_int(b, 1));      //缺键名
+    EXPECT_TRUE(json_builder_finish(b) == NULL);
+    b = json_builder_new();
+    json_builder_begin_obj(b);
+    json_builder_key(b, "a");
+    EXPECT_EQ(-1, json_builder_end(b));         //缺值
+    EXPECT_TRUE(json_builder_finish(b) == NULL);
+    b = json_builder_new();
+    json_builder_begin_obj(b);
+    json_builder_key(b, "a");
+    json_builder_begin_arr(b);
+    json_builder_str(b, "s");
+    EXPECT_TRUE(json_builder_finish(b) == NULL);    //容器没有结束
+    b = json_builder_new();
+    json_builder_int(b, 1);
+    EXPECT_EQ(-1, json_builder_int(b, 2));      //顶层只能有一个值
+    EXPECT_EQ(-1, json_builder_end(b));
+    EXPECT_TRUE(json_builder_finish(b) == NULL);
+    EXPECT_TRUE(json_builder_finish(json_builder_new()) == NULL);
+    EXPECT_EQ(-1, json_builder_int(NULL, 1));
+    EXPECT_TRUE(json_builder_finish(NULL) == NULL);
+
+    //顶层可以是标量
+    b = json_builder_new();
+    json_builder_str(b, "only");
+    json = json_builder_finish(b);
+    EXPECT_STREQ("only", json_str(json, NULL));
+    json_free(json);
+    b = json_builder_new();
+    json_builder_int(b, -7);
+    json = json_builder_finish(b);
+    EXPECT_EQ(-7, json_int(json, 0));
+    json_free(json);
+
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i) {
+        EXPECT_EQ(st.nodes_alloc[i], st.nodes_freed[i]);
+        EXPECT_EQ(st.bytes_alloc[i], st.bytes_freed[i]);
+    }
+}
+
+TEST(json_merge, overlay)
+{
+    const char *defaults = "{\"basic\":{\"ip\":\"0.0.0.0\",\"port\":80,\"dns\":[\"1.1.1.1\"]},"
+                           "\"log\":{\"level\":1},\"tags\":[1]}";
+    const char *site = "{\"basic\":{\"port\":8080,\"dns\":[\"8.8.8.8\"]},\"log\":3,\"new\":{\"a\":[]}}";
+    const char *host = "{\"basic\":{\"ip\":\"10.0.0.1\",\"dns\":[\"9.9.9.9\"]},\"tags\":[2,3]}";
+    JSON *json = json_parse(defaults, strlen(defaults));
+    JSON *src = json_parse(site, strlen(site)), *src2 = json_parse(host, strlen(host));
+    const JSON *basic = json_get_member(json, "basic");
+    const JSON *added = json_get_member(src, "new");
+    json_stats st;
+    char *out;
+
+    ASSERT_TRUE(json != NULL && src != NULL && src2 != NULL);
+    json_stats_reset();
+    //对象递归合并，其余替换；src的节点直接挪进来，不分配新节点
+    EXPECT_EQ(0, json_merge(json, src, JSON_MERGE_REPLACE));
+    EXPECT_TRUE(json_get_member(json, "basic") == basic);
+    EXPECT_TRUE(json_get_member(json, "new") == added);
+    EXPECT_EQ(0, json_merge(json, src2, JSON_MERGE_APPEND));
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i)
+        EXPECT_EQ(0, st.nodes_alloc[i]);
+    out = json_dump(json, NULL);
+    EXPECT_STREQ("{\"basic\":{\"ip\":\"10.0.0.1\",\"port\":8080,\"dns\":[\"8.8.8.8\",\"9.9.9.9\"]},"
+                 "\"log\":3,\"tags\":[1,2,3],\"new\":{\"a\":[]}}", out);
+    free(out);
+
+    //不是对象时什么也不合并，src照样释放
+    EXPECT_EQ(-1, json_merge(json, json_new_str("x"), 0));
+    EXPECT_EQ(-1, json_merge((JSON *)json_get_member(json, "tags"), json_new(JSON_OBJ), 0));
+    EXPECT_EQ(-1, json_merge(json, NULL, 0));
+    json_free(json);
+}
+
+TEST(json_merge, large_objects)
+{
+    JSON *dst, *src;
+    json_stats st;
+    char key[16];
+
+    dst = json_new(JSON_OBJ);
+    src = json_new(JSON_OBJ);
+    for (int i = 0; i < 2000; ++i) {
+        snprintf(key, sizeof(key), "k%d", i);
+        json_obj_set_int(dst, key, i);
+        snprintf(key, sizeof(key), "k%d", i + 1000);
+        json_obj_set_int(src, key, -i);
+    }
+    json_free(json_remove_member(dst, "k5", TRUE));     //空位不进索引
+    json_free(json_remove_member(src, "k2500", TRUE));
+    json_stats_reset();
+    EXPECT_EQ(0, json_merge(dst, src, 0));
+    //有索引时每个键名只比较常数次
+    EXPECT_EQ(0, json_stats_get(&st));
+    EXPECT_LT(st.member_cmps, 3 * 2000);
+    EXPECT_EQ(2998, json_obj_count(dst));
+    EXPECT_EQ(4, json_obj_get_int(dst, "k4", 0));
+    EXPECT_TRUE(json_get_member(dst, "k5") == NULL);
+    EXPECT_EQ(-999, json_obj_get_int(dst, "k1999", 0));
+    EXPECT_EQ(-1999, json_obj_get_int(dst, "k2999", 0));
+    EXPECT_TRUE(json_get_member(dst, "k2500") == NULL);
+    json_free(dst);
+}
+
+TEST(json_parse, errors)
+{
+    const char *bad[] = {"", "{", "[1,]", "{\"a\" 1}", "{\"a\":1,}", "tru", "01", "1.", "-",
+                         "\"abc", "\"\\x\"", "\"\\ud800\"", "[1] 2", "{1:2}"};
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i)
+        EXPECT_TRUE(json_parse(bad[i], strlen(bad[i])) == NULL);
+    EXPECT_TRUE(json_load("./not_exist.json") == NULL);
+}
+
+TEST(json_dump, round_trip)
+{
+    const char *text = "{\"a\":[1,-2.5,0.1,1e+300,true,null,\"q\\\"\\\\\\n\\u0001\"],\"b\":{}}";
+    JSON *json = json_parse(text, strlen(text));
+    size_t len;
+    char *out = json_dump(json, &len);
+
+    ASSERT_TRUE(out != NULL);
+    EXPECT_STREQ(text, out);
+    EXPECT_EQ(strlen(text), len);
+    free(out);
+    json_free(json);
+}
+
+typedef struct lines_sum {
+    U32 count;      //收到的记录数
+    U32 bad;        //语法错误的行数
+    double sum;     //各记录id之和
+    double last;    //上一条记录的id，-1表示乱序
+    U32 stop_at;    //收到几条后停止，0表示不停止
+} lines_sum;
+
+static int lines_collect(void *arg, JSON *json, U64 offset)
+{
+    lines_sum *s = arg;
+    double id = json ? json_obj_get_num(json, "id", -1) : -1;
+
+    (void)offset;
+    if (!json)
+        ++s->bad;
+    if (s->last >= 0 && id >= 0)
+        s->last = id > s->last ? id : -1;
+    s->sum += json ? id : 0;
+    json_free(json);
+    return ++s->count == s->stop_at ? -5 : 0;
+}
+
+TEST(json_lines, write_and_read)
+{
+    enum { N = 5000 };
+    static const JSON *recs[N];
+    JSON *objs[N];
+    json_lines *lines;
+    lines_sum ordered = {0, 0, 0, 0, 0}, unordered = {0, 0, 0, -1, 0}, stop = {0, 0, 0, -1, 100};
+    FILE *fp;
+
+    for (int i = 0; i < N; ++i) {
+        objs[i] = json_new(JSON_OBJ);
+        json_obj_set_num(objs[i], "id", i + 1);
+        json_obj_set_str(objs[i], "name", "json lines record with some padding text");
+        recs[i] = objs[i];
+    }
+    ASSERT_EQ(0, json_lines_write("./test_lines.jsonl", recs, N, 4));
+    for (int i = 0; i < N; ++i)
+        json_free(objs[i]);
+    fp = fopen("./test_lines.jsonl", "a");   //追加空行和一条语法错误的行
+    fputs("\r\n{\"id\": \n", fp);
+    fclose(fp);
+
+    lines = json_lines_open("./test_lines.jsonl", 4);
+    ASSERT_TRUE(lines != NULL);
+    EXPECT_EQ(0, json_lines_read(lines, TRUE, lines_collect, &ordered));
+    EXPECT_EQ(N + 1, ordered.count);
+    EXPECT_EQ(1, ordered.bad);
+    EXPECT_EQ(N, ordered.last);     //按顺序交付
+    EXPECT_EQ(N * (N + 1) / 2.0, ordered.sum);
+
+    EXPECT_EQ(0, json_lines_read(lines, FALSE, lines_collect, &unordered));
+    EXPECT_EQ(N + 1, unordered.count);
+    EXPECT_EQ(N * (N + 1) / 2.0, unordered.sum);
+
+    EXPECT_EQ(-5, json_lines_read(lines, FALSE, lines_collect, &stop));
+    EXPECT_EQ(100, stop.count);
+    json_lines_close(lines);
+    EXPECT_TRUE(json_lines_open("./not_exist.jsonl", 1) == NULL);
+}
+
+/**
+ * @brief 构造约1MB的JSON文本，字符串中故意带上括号、逗号和转义的双引号
+ */
+static char *make_big_text(BOOL obj, size_t *len)
+{
+    JSON *json = json_new(obj ? JSON_OBJ : JSON_ARR);
+    char key[32];
+    char *text;
+
+    for (int i = 0; i < 20000; ++i) {
+        JSON *rec = json_new(JSON_OBJ);
+        json_obj_set_num(rec, "id", i);
+        json_obj_set_str(rec, "s", "a,]\"}{[\\");
+        JSON *nums = json_add_member(rec, "n", json_new(JSON_ARR));
+        json_arr_add_num(nums, i * 0.5);
+        json_arr_add_bool(nums, i % 2);
+        snprintf(key, sizeof(key), "k%d", i);
+        if (obj)
+            json_add_member(json, key, rec);
+        else
+            json_add_element(json, i % 3 ? rec : (json_free(rec), json_new_num(i)));
+    }
+    text = json_dump(json, len);
+    json_free(json);
+    return text;
+}
+
+TEST(json_parse_parallel, same_as_serial)
+{
+    for (int obj = 0; obj < 2; ++obj) {
+        size_t len, out_len;
+        char *text = make_big_text(obj, &len);
+        JSON *json = json_parse_parallel(text, len, 4);
+        char *out;
+
+        ASSERT_TRUE(json != NULL);
+        EXPECT_EQ(20000, obj ? json_obj_count(json) : json_arr_count(json));
+        out = json_dump(json, &out_len);
+        EXPECT_EQ(len, out_len);
+        EXPECT_EQ(0, memcmp(text, out, len));
+        free(out);
+        json_free(json);
+
+        //  首尾括号不配对时和json_parse一样失败
+        text[len - 1] = obj ? ']' : '}';
+        EXPECT_TRUE(json_parse(text, len) == NULL);
+        EXPECT_TRUE(json_parse_parallel(text, len, 4) == NULL);
+        text[len - 1] = obj ? '}' : ']';
+
+        //  中间某个元素有语法错误时整体失败，已解析的部分全部释放
+        memcpy(strstr(text + len / 2, "\"id\":"), "\"id\"-", 5);
+        EXPECT_TRUE(json_parse_parallel(text, len, 4) == NULL);
+        free(text);
+    }
+}
+
+//  并行解析大对象时各段的键名不进共享形状的转换表，解析再多不同的大对象，新对象仍能共享形状
+TEST(json_parse_parallel, keys_not_interned)
+{
+    size_t cap = 1200 << 10, len;
+    char *text = malloc(cap), pad[1501], key[32];
+    json_mem_report mem;
+
+    ASSERT_TRUE(text != NULL);
+    memset(pad, 'x', 1500);
+    pad[1500] = '\0';
+    for (int o = 0; o < 40; ++o) {
+        len = 0;
+        for (int k = 0; k < 700; ++k)
+            len += snprintf(text + len, cap - len, "%c\"o%d_k%d\":\"%s\"", k ? ',' : '{', o, k, pad);
+        text[len++] = '}';
+        JSON *json = json_parse_parallel(text, len, 4);
+        ASSERT_TRUE(json != NULL);
+        EXPECT_EQ(700, json_obj_count(json));
+        snprintf(key, sizeof(key), "o%d_k699", o);
+        EXPECT_EQ(1500, json_str_len(json_get_member(json, key)));
+        json_free(json);
+    }
+    free(text);
+
+    const char *small = "{\"fresh_a\":1,\"fresh_b\":2}";
+    JSON *json = json_parse(small, strlen(small));
+    ASSERT_TRUE(json != NULL);
+    EXPECT_EQ(0, json_memory_usage(json, &mem));
+    EXPECT_EQ(0, mem.key_bytes);
+    json_free(json);
+}
+
+TEST(json_save_parallel, same_as_serial)
+{
+    for (int obj = 0; obj < 2; ++obj) {
+        size_t len;
+        char *text = make_big_text(obj, &len);
+        JSON *json = json_parse(text, len);
+        buf_t serial, parallel;
+
+        ASSERT_TRUE(json != NULL);
+        EXPECT_EQ(0, json_save(json, "test-serial.yml"));
+        EXPECT_EQ(0, json_save_parallel(json, "test-parallel.yml", 4));
+        EXPECT_EQ(0, read_file(&serial, "test-serial.yml"));
+        EXPECT_EQ(0, read_file(&parallel, "test-parallel.yml"));
+        EXPECT_EQ(serial.size, parallel.size);
+        EXPECT_EQ(0, strcmp(serial.str, parallel.str));
+        free(serial.str);
+        free(parallel.str);
+        json_free(json);
+        free(text);
+    }
+    EXPECT_EQ(-1, json_save_parallel(NULL, "test-parallel.yml", 4));
+}
+
+static int async_gate;      //为1时第一个保存的回调卡住保存线程，好让后面的保存排队合并
+
+static void async_done(void *arg, const char *fname, int ret)
+{
+    int *results = arg;
+
+    while (__atomic_load_n(&async_gate, __ATOMIC_ACQUIRE))
+        usleep(1000);
+    results[ret == 0 ? 0 : 1]++;
+    (void)fname;
+}
+
+TEST(json_save_async, coalesce_and_replace)
+{
+    int blocker[2] = {0, 0}, results[2] = {0, 0};
+    buf_t result;
+
+    __atomic_store_n(&async_gate, 1, __ATOMIC_RELEASE);
+    EXPECT_EQ(0, json_save_async(json_new_str("first"), "test-async-a.yml", async_done, blocker));
+
+    EXPECT_EQ(0, json_save_async(json_new_str("v1"), "test-async-b.yml", async_done, results));
+    EXPECT_EQ(0, json_save_async(json_new_str("v2"), "test-async-b.yml", async_done, results));
+    EXPECT_EQ(0, json_save_async(json_new_num(3), "test-async-b.yml", async_done, results));
+    __atomic_store_n(&async_gate, 0, __ATOMIC_RELEASE);
+    json_save_drain();
+
+    EXPECT_EQ(1, blocker[0]);
+    EXPECT_EQ(3, results[0]);       //三次保存合并成一次写入，都收到成功
+    EXPECT_EQ(0, results[1]);
+    EXPECT_EQ(0, read_file(&result, "test-async-b.yml"));
+    EXPECT_EQ(0, strcmp(result.str, "3"));
+    free(result.str);
+    EXPECT_EQ(-1, json_save_async(NULL, "test-async-b.yml", NULL, NULL));
+
+    //目录不存在时创建临时文件失败，回调收到错误
+    EXPECT_EQ(0, json_save_async(json_new_str("x"), "no-such-dir/test.yml", async_done, results));
+    json_save_drain();
+    EXPECT_EQ(1, results[1]);
+}
+
+static JSON *make_path_doc(void)
+{
+    const char *text =
+        "{\"basic\": {\"ip\": \"200.200.3.61\", \"dns\": [\"1.1.1.1\", \"2.2.2.2\", \"3.3.3.3\"]},"
+        " \"advance\": {\"dns\": [{\"ip\": \"10.0.0.1\", \"name\": \"huabei\", \"weight\": 3},"
+        "                         {\"ip\": \"10.0.0.2\", \"name\": \"huanan\", \"weight\": 7},"
+        "                         {\"ip\": \"10.0.0.3\", \"name\": \"huabei\"}],"
+        "              \"a b\": {\"ip\": \"10.0.0.9\"}}}";
+    return json_parse(text, strlen(text));
+}
+
+/**
+ * @brief 查询并把结果用'|'连接起来，字符串原样输出，数值输出整数部分
+ */
+static const char *path_join(const JSON *json, const char *expr)
+{
+    static char out[256];
+    json_result res = {0};
+    json_path *path = json_path_compile(expr);
+    size_t len = 0;
+
+    out[0] = '\0';
+    if (!path || json_path_query(path, json, &res) < 0) {
+        json_path_free(path);
+        return "<error>";
+    }
+    for (U32 i = 0; i < res.count; ++i) {
+        const JSON *v = res.items[i];
+        len += snprintf(out + len, sizeof(out) - len, "%s", i ? "|" : "");
+        if (json_type(v) == JSON_STR)
+            len += snprintf(out + len, sizeof(out) - len, "%s", json_str(v, ""));
+        else if (json_type(v) == JSON_NUM || json_type(v) == JSON_INT)
+            len += snprintf(out + len, sizeof(out) - len, "%d", (int)json_num(v, 0));
+        else
+            len += snprintf(out + len, sizeof(out) - len, "<%d>", json_type(v));
+    }
+    json_result_free(&res);
+    json_path_free(path);
+    return out;
+}
+
+TEST(json_path, selectors)
+{
+    JSON *json = make_path_doc();
+
+    ASSERT_TRUE(json != NULL);
+    EXPECT_STREQ("2.2.2.2", path_join(json, "basic.dns[1]"));
+    EXPECT_STREQ("3.3.3.3", path_join(json, "$.basic.dns[-1]"));
+    EXPECT_STREQ("10.0.0.1|10.0.0.2|10.0.0.3", path_join(json, "$.advance.dns[*].ip"));
+    EXPECT_STREQ("200.200.3.61|10.0.0.1|10.0.0.2|10.0.0.3|10.0.0.9", path_join(json, "$..ip"));
+    EXPECT_STREQ("2.2.2.2|3.3.3.3", path_join(json, "$.basic.dns[1:]"));
+    EXPECT_STREQ("3.3.3.3|2.2.2.2|1.1.1.1", path_join(json, "$.basic.dns[::-1]"));
+    EXPECT_STREQ("1.1.1.1|3.3.3.3", path_join(json, "$.basic.dns[0:5:2]"));
+    EXPECT_STREQ("10.0.0.9", path_join(json, "$.advance['a b'].ip"));
+    EXPECT_STREQ("200.200.3.61", path_join(json, "$['basic'][\"ip\"]"));
+    EXPECT_STREQ("", path_join(json, "$.basic.dns[3]"));
+    EXPECT_STREQ("", path_join(json, "$.basic.ip.x"));
+    EXPECT_STREQ("<5>", path_join(json, "$"));
+    json_free(json);
+}
+
+TEST(json_path, filters)
+{
+    JSON *json = make_path_doc();
+
+    ASSERT_TRUE(json != NULL);
+    EXPECT_STREQ("10.0.0.1|10.0.0.3", path_join(json, "$.advance.dns[?(@.name == 'huabei')].ip"));
+    EXPECT_STREQ("10.0.0.2", path_join(json, "$..dns[?(@.weight > 3)].ip"));
+    EXPECT_STREQ("3|7", path_join(json, "$..[?@.weight].weight"));
+    EXPECT_STREQ("10.0.0.2|10.0.0.3", path_join(json, "$.advance.dns[?(@.weight != 3)].ip"));
+    EXPECT_STREQ("2.2.2.2", path_join(json, "$.basic.dns[?(@ == \"2.2.2.2\")]"));
+
+    EXPECT_TRUE(json_path_compile("$.basic[") == NULL);
+    EXPECT_TRUE(json_path_compile("$.basic[]") == NULL);
+    EXPECT_TRUE(json_path_compile("$.basic.") == NULL);
+    EXPECT_TRUE(json_path_compile("$['basic") == NULL);
+    EXPECT_TRUE(json_path_compile("$[?(@.a == )]") == NULL);
+    EXPECT_TRUE(json_path_compile("$[1:2:3:4]") == NULL);
+    EXPECT_EQ(-1, json_path_query(NULL, json, NULL));
+    json_free(json);
+}
+
+TEST(json_get_many, shared_prefixes)
+{
+    static const char *const paths[] = {
+        "basic.ip", "basic.dns[0]", "basic.dns[2]", "basic.dns[3]",
+        "advance.dns[1].name", "advance.a b.ip", "missing.x", "basic.ip", "basic",
+    };
+    const U32 n = sizeof(paths) / sizeof(paths[0]);
+    const JSON *out[sizeof(paths) / sizeof(paths[0])];
+    JSON *json = make_path_doc();
+
+    ASSERT_TRUE(json != NULL);
+    EXPECT_EQ(7, json_get_many(json, paths, out, n));
+    EXPECT_STREQ("200.200.3.61", json_str(out[0], ""));
+    EXPECT_STREQ("1.1.1.1", json_str(out[1], ""));
+    EXPECT_STREQ("3.3.3.3", json_str(out[2], ""));
+    EXPECT_TRUE(out[3] == NULL);
+    EXPECT_STREQ("huanan", json_str(out[4], ""));
+    EXPECT_STREQ("10.0.0.9", json_str(out[5], ""));
+    EXPECT_TRUE(out[6] == NULL);
+    EXPECT_TRUE(out[7] == out[0]);
+    EXPECT_TRUE(out[8] == json_get_member(json, "basic"));
+
+    //编译一次反复使用，重复的键取第一个
+    const char *dup = "{\"a\": 1, \"a\": 2, \"b\": [true]}";
+    JSON *other = json_parse(dup, strlen(dup));
+    static const char *const ab[] = {"a", "b[0]"};
+    json_paths *compiled = json_paths_compile(ab, 2);
+    ASSERT_TRUE(compiled != NULL);
+    EXPECT_EQ(2, json_paths_get(compiled, other, out));
+    EXPECT_EQ(1, json_num(out[0], 0));
+    EXPECT_EQ(TRUE, json_bool(out[1]));
+    EXPECT_EQ(0, json_paths_get(compiled, json, out));
+    json_paths_free(compiled);
+    json_free(other);
+
+    static const char *const bad[] = {"basic.", "a..b", "[x]", "a[1]b", ""};
+    for (U32 i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i)
+        EXPECT_EQ(-2, json_get_many(json, &bad[i], out, 1));
+    json_free(json);
+}
+
+TEST(json_tape, accessors)
+{
+    const char *text = "{\"a\": [1, 2.5, \"x\\u0000y\", true, null], \"b\": {\"c\": false},"
+                       " \"a\": 3, \"big\": 12345678901234567890, \"i\": -9007199254740993}";
+    json_tape *tape = json_tape_parse(text, strlen(text));
+    U32 a, c, n = 0;
+    size_t len;
+
+    ASSERT_TRUE(tape != NULL);
+    EXPECT_EQ(JSON_OBJ, json_tape_type(tape, 0));
+    EXPECT_EQ(5, json_tape_count(tape, 0));
+    a = json_tape_get_member(tape, 0, "a");    //重复的键取第一个
+    EXPECT_EQ(JSON_ARR, json_tape_type(tape, a));
+    EXPECT_EQ(5, json_tape_count(tape, a));
+    EXPECT_EQ(1, json_tape_int(tape, json_tape_get_element(tape, a, 0), 0));
+    EXPECT_EQ(2.5, json_tape_num(tape, json_tape_get_element(tape, a, 1), 0));
+    EXPECT_EQ(3, json_tape_str_len(tape, json_tape_get_element(tape, a, 2)));
+    EXPECT_TRUE(memcmp("x\0y", json_tape_str(tape, json_tape_get_element(tape, a, 2), ""), 4) == 0);
+    EXPECT_EQ(TRUE, json_tape_bool(tape, json_tape_get_element(tape, a, 3)));
+    EXPECT_EQ(JSON_NONE, json_tape_type(tape, json_tape_get_element(tape, a, 4)));
+    EXPECT_EQ(JSON_TAPE_NONE, json_tape_get_element(tape, a, 5));
+    EXPECT_EQ(-9007199254740993LL, json_tape_int(tape, json_tape_get_member(tape, 0, "i"), 0));
+    EXPECT_EQ(1.2345678901234567e19, json_tape_num(tape, json_tape_get_member(tape, 0, "big"), 0));
+
+    //找不到时一路返回默认值，可以连着写
+    EXPECT_EQ(FALSE, json_tape_bool(tape, json_tape_get_member(tape, json_tape_get_member(tape, 0, "b"), "c")));
+    EXPECT_EQ(7, json_tape_num(tape, json_tape_get_member(tape, json_tape_get_member(tape, 0, "x"), "c"), 7));
+    EXPECT_STREQ("def", json_tape_str(tape, json_tape_get_element(tape, 0, 0), "def"));
+    EXPECT_EQ(-1, json_tape_count(tape, JSON_TAPE_NONE));
+
+    //遍历时跳过整个子树
+    for (c = json_tape_first(tape, 0); c != JSON_TAPE_NONE; c = json_tape_next(tape, c), ++n) {
+        if (n == 2) {
+            EXPECT_STREQ("a", json_tape_key(tape, c, &len));
+            EXPECT_EQ(1, len);
+            EXPECT_EQ(3, json_tape_int(tape, c, 0));
+        }
+    }
+    EXPECT_EQ(5, n);
+    EXPECT_TRUE(json_tape_key(tape, a, NULL) == NULL);
+    EXPECT_TRUE(json_tape_bytes(tape) > 0);
+    json_tape_free(tape);
+
+    const char *bad[] = {"", "[1,]", "{\"a\" 1}", "{\"a\":1,}", "tru", "[1] 2", "{1:2}", "\"\\ud800\""};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i)
+        EXPECT_TRUE(json_tape_parse(bad[i], strlen(bad[i])) == NULL);
+}
+
+TEST(json_tape, tree_round_trip)
+{
+    const char *text = "{\"s\":\"\\u4e2d\",\"n\":[1,2,3.5],\"m\":[null,false,{\"k\":[]},{}],"
+                       "\"big\":-9223372036854775808,\"d\":1e+300}";
+    JSON *json = json_parse(text, strlen(text)), *back, *sub;
+    json_tape *tape, *copy;
+    char *out;
+
+    ASSERT_TRUE(json != NULL);
+    tape = json_tape_from(json);
+    ASSERT_TRUE(tape != NULL);
+    back = json_tape_to_json(tape, 0);
+    ASSERT_TRUE(back != NULL);
+    out = json_dump(back, NULL);
+    EXPECT_STREQ("{\"s\":\"中\",\"n\":[1,2,3.5],\"m\":[null,false,{\"k\":[]},{}],"
+                 "\"big\":-9223372036854775808,\"d\":1e+300}", out);
+    free(out);
+    EXPECT_EQ(JSON_INT, json_type(json_get_member(back, "big")));
+    EXPECT_EQ(3.5, json_num(json_get_element(json_get_member(back, "n"), 2), 0));
+
+    //直接解析出的tape和从树转换的一样
+    copy = json_tape_parse(text, strlen(text));
+    ASSERT_TRUE(copy != NULL);
+    sub = json_tape_to_json(copy, json_tape_get_member(copy, 0, "m"));
+    ASSERT_TRUE(sub != NULL);
+    out = json_dump(sub, NULL);
+    EXPECT_STREQ("[null,false,{\"k\":[]},{}]", out);
+    free(out);
+    EXPECT_TRUE(json_tape_to_json(copy, JSON_TAPE_NONE) == NULL);
+    json_free(sub);
+    json_tape_free(copy);
+    json_tape_free(tape);
+    json_free(back);
+    json_free(json);
+}
+
+TEST(json_memory_usage, scalar_str)
+{
+    json_mem_report report;
+    JSON *str = json_new_str("200.200.3.61");
+
+    EXPECT_EQ(0, json_memory_usage(str, &report));
+    EXPECT_EQ(1, report.nodes);
+    EXPECT_EQ(0, report.containers);
+    EXPECT_EQ(strlen("200.200.3.61") + 1, report.str_bytes);
+    EXPECT_EQ(0, report.top_count);
+    EXPECT_EQ(report.node_bytes + report.slot_bytes + report.key_bytes
+        + report.str_bytes + report.overhead, report.total);
+    EXPECT_EQ(-1, json_memory_usage(NULL, &report));
+    json_free(str);
+}
+
+TEST(json_memory_usage, heaviest_subtrees)
+{
+    json_mem_report report;
+    JSON *root = json_new(JSON_OBJ);
+    JSON *small = json_new(JSON_ARR);
+    JSON *big = json_new(JSON_ARR);
+
+    json_add_member(root, "small", small);
+    json_add_member(root, "big", big);
+    json_arr_add_num(small, 1);
+    for (int i = 0; i < 100; ++i)
+        json_arr_add_str(big, "200.200.0.1");
+
+    EXPECT_EQ(0, json_memory_usage(root, &report));
+    EXPECT_EQ(104, report.nodes);
+    EXPECT_EQ(3, report.containers);
+    EXPECT_EQ(103, report.slots_used);
+    EXPECT_GE(report.slots_cap, report.slots_used);
+    EXPECT_EQ(0, report.key_bytes);     //键名在共享形状里，不属于这棵树
+    EXPECT_EQ(100 * (strlen("200.200.0.1") + 1), report.str_bytes);
+    ASSERT_EQ(2, report.top_count);
+    EXPECT_TRUE(report.top[0].node == big);
+    EXPECT_EQ(101, report.top[0].nodes);
+    EXPECT_TRUE(report.top[1].node == small);
+    EXPECT_GT(report.top[0].bytes, report.top[1].bytes);
+    EXPECT_LT(report.top[0].bytes, report.total);
+    json_free(root);
+}
+
+typedef struct bind_host {
+    char *name;
+    double weight;
+} bind_host;
+
+typedef struct bind_cfg {
+    char *ip;
+    int port;
+    BOOL enable;
+    int ports[3];
+    U32 port_count;
+    bind_host hosts[2];
+    U32 host_count;
+    bind_host primary;
+} bind_cfg;
+
+static const json_field_desc bind_host_fields[] = {
+    JSON_FIELD_STR(bind_host, name, "name", "none"),
+    JSON_FIELD_NUM(bind_host, weight, "weight", 1.5),
+    JSON_FIELD_END
+};
+
+static const json_field_desc bind_cfg_fields[] = {
+    JSON_FIELD_STR(bind_cfg, ip, "ip", "127.0.0.1"),
+    JSON_FIELD_INT(bind_cfg, port, "port", 80),
+    JSON_FIELD_BOL(bind_cfg, enable, "enable", TRUE),
+    JSON_FIELD_ARR(bind_cfg, ports, port_count, "ports", JSON_BIND_INT, NULL),
+    JSON_FIELD_ARR(bind_cfg, hosts, host_count, "hosts", JSON_BIND_OBJ, bind_host_fields),
+    JSON_FIELD_OBJ(bind_cfg, primary, "primary", bind_host_fields),
+    JSON_FIELD_END
+};
+
+TEST(json_bind, fields_and_defaults)
+{
+    JSON *json = json_new(JSON_OBJ);
+    JSON *ports = json_add_member(json, "ports", json_new(JSON_ARR));
+    JSON *hosts = json_add_member(json, "hosts", json_new(JSON_ARR));
+    JSON *host = json_add_element(hosts, json_new(JSON_OBJ));
+    bind_cfg cfg;
+
+    json_obj_set_str(json, "ip", "200.200.3.61");
+    json_obj_set_str(json, "port", "not a number");     //类型不匹配取缺省值
+    json_obj_set_num(json, "unknown", 1);               //多余的成员忽略
+    for (int i = 0; i < 5; ++i)
+        json_arr_add_num(ports, 130 + i);               //超出容量的元素忽略
+    json_obj_set_str(host, "name", "huanan");
+    json_add_element(hosts, json_new_num(3));           //类型不匹配的元素取缺省值
+
+    ASSERT_EQ(0, json_bind(&cfg, bind_cfg_fields, json));
+    EXPECT_STREQ("200.200.3.61", cfg.ip);
+    EXPECT_EQ(80, cfg.port);
+    EXPECT_EQ(TRUE, cfg.enable);
+    ASSERT_EQ(3, cfg.port_count);
+    EXPECT_EQ(132, cfg.ports[2]);
+    ASSERT_EQ(2, cfg.host_count);
+    EXPECT_STREQ("huanan", cfg.hosts[0].name);
+    EXPECT_EQ(1.5, cfg.hosts[0].weight);
+    EXPECT_STREQ("none", cfg.hosts[1].name);
+    EXPECT_STREQ("none", cfg.primary.name);
+    json_bind_free(&cfg, bind_cfg_fields);
+    EXPECT_TRUE(cfg.ip == NULL);
+    EXPECT_TRUE(cfg.hosts[0].name == NULL);
+
+    //  不是对象时全部取缺省值
+    ASSERT_EQ(0, json_bind(&cfg, bind_cfg_fields, NULL));
+    EXPECT_STREQ("127.0.0.1", cfg.ip);
+    EXPECT_EQ(0, cfg.port_count);
+    json_bind_free(&cfg, bind_cfg_fields);
+    json_free(json);
+}
+
+TEST(json_bind, int_out_of_range)
+{
+    const char *text = "{\"port\":133333333333,\"ports\":[1e300,-2147483648,2147483647.5]}";
+    JSON *json = json_parse(text, strlen(text));
+    bind_cfg cfg;
+
+    ASSERT_TRUE(json != NULL);
+    ASSERT_EQ(0, json_bind(&cfg, bind_cfg_fields, json));
+    EXPECT_EQ(80, cfg.port);            //int放不下，取缺省值而不是截断
+    ASSERT_EQ(3, cfg.port_count);
+    EXPECT_EQ(0, cfg.ports[0]);
+    EXPECT_TRUE(cfg.ports[1] == INT_MIN);
+    EXPECT_EQ(0, cfg.ports[2]);
+    json_bind_free(&cfg, bind_cfg_fields);
+    json_free(json);
+
+    json = json_new(JSON_OBJ);
+    json_obj_set_num(json, "port", 0.0 / 0.0);
+    ASSERT_EQ(0, json_bind(&cfg, bind_cfg_fields, json));
+    EXPECT_EQ(80, cfg.port);
+    json_bind_free(&cfg, bind_cfg_fields);
+    json_free(json);
+}
+
+TEST(json_bind, unbind_round_trip)
+{
+    bind_cfg in = {
+        .ip = "10.0.0.1", .port = 8080, .enable = FALSE,
+        .ports = {1, 2}, .port_count = 2,
+        .hosts = {{"a", 2}, {NULL, 3}}, .host_count = 2,
+        .primary = {"p", 0.5},
+    };
+    bind_cfg out;
+    JSON *json = json_unbind(&in, bind_cfg_fields);
+    json_mem_report mem;
+
+    ASSERT_TRUE(json != NULL);
+    //  所有容器都按准确大小分配，每个容器最多因分配器对齐多出一个槽位
+    ASSERT_EQ(0, json_memory_usage(json, &mem));
+    EXPECT_TRUE(mem.slots_cap - mem.slots_used <= mem.containers);
+    EXPECT_EQ(JSON_NONE, json_type(json_get_member(json_get_element(json_get_member(json, "hosts"), 1), "name")));
+
+    ASSERT_EQ(0, json_bind(&out, bind_cfg_fields, json));
+    EXPECT_STREQ("10.0.0.1", out.ip);
+    EXPECT_EQ(8080, out.port);
+    EXPECT_EQ(FALSE, out.enable);
+    EXPECT_EQ(2, out.port_count);
+    EXPECT_EQ(2, out.ports[1]);
+    EXPECT_STREQ("a", out.hosts[0].name);
+    EXPECT_STREQ("none", out.hosts[1].name);
+    EXPECT_EQ(3, out.hosts[1].weight);
+    EXPECT_EQ(0.5, out.primary.weight);
+    json_bind_free(&out, bind_cfg_fields);
+    json_free(json);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_gen生成的专用加载/输出函数，make gen由config.json和gen_test.json生成
+//----------------------------------------------------------------------------------------------------
+
+/**
+ * @brief 把生成的write函数的输出收集到堆中的字符串
+ */
+#define GEN_WRITE(fn, in, out) do {                                     \
+        size_t len_;                                                    \
+        FILE *fp_ = open_memstream(&(out), &len_);                      \
+        ASSERT_TRUE(fp_ != NULL);                                       \
+        EXPECT_EQ(0, fn(in, fp_));                                      \
+        fclose(fp_);                                                    \
+    } while (0)
+
+/**
+ * @brief 两段JSON文本由json_parse解析后是否相同
+ */
+static BOOL same_json(const char *a, const char *b)
+{
+    JSON *ja = json_parse(a, strlen(a)), *jb = json_parse(b, strlen(b));
+    char *da = ja ? json_dump(ja, NULL) : NULL, *db = jb ? json_dump(jb, NULL) : NULL;
+    BOOL same = da && db && strcmp(da, db) == 0;
+
+    free(da);
+    free(db);
+    json_free(ja);
+    json_free(jb);
+    return same;
+}
+
+TEST(json_gen, round_trip)
+{
+    buf_t doc;
+    config cfg, again;
+    char *out, *out2;
+
+    ASSERT_EQ(0, read_file(&doc, "config.json"));
+    ASSERT_EQ(0, config_parse(doc.str, strlen(doc.str), &cfg));
+    EXPECT_EQ(133333333333.0, cfg.basic.maxcnt);
+    ASSERT_EQ(2, cfg.advance.dns_count);
+    EXPECT_STREQ("huabei", cfg.advance.dns[1].name);
+    GEN_WRITE(config_write, &cfg, out);
+    EXPECT_TRUE(same_json(doc.str, out));
+
+    ASSERT_EQ(0, config_parse(out, strlen(out), &again));
+    GEN_WRITE(config_write, &again, out2);
+    EXPECT_STREQ(out, out2);
+    config_free(&cfg);
+    config_free(&again);
+    free(out);
+    free(out2);
+    free(doc.str);
+}
+
+//  键名转换成重复的字段名、关键字和宏时加后缀，嵌套结构名重复时也加后缀
+TEST(json_gen, field_names)
+{
+    buf_t doc;
+    gt out;
+    char *text;
+
+    ASSERT_EQ(0, read_file(&doc, "gen_test.json"));
+    ASSERT_EQ(0, gt_parse(doc.str, strlen(doc.str), &out));
+    EXPECT_EQ(1, out.a_b);
+    EXPECT_EQ(2, out.a_b_2);
+    EXPECT_EQ(3, out.int_);
+    EXPECT_EQ(2, out.x_count);
+    EXPECT_EQ(4, out.x_count_2);
+    EXPECT_EQ(1, out.parse.q);
+    EXPECT_EQ(1, out.o.list.z);
+    ASSERT_EQ(1, out.o_list_count);
+    EXPECT_EQ(TRUE, out.o_list[0].k);
+    EXPECT_EQ(FALSE, out.TRUE_);
+    GEN_WRITE(gt_write, &out, text);
+    EXPECT_TRUE(same_json(doc.str, text));
+    gt_free(&out);
+    free(text);
+    free(doc.str);
+}
+
+//  生成的加载函数和json_parse的规则相同，不认识的成员也要校验
+TEST(json_gen, same_rules_as_parse)
+{
+    static const char *const bad[] = {
+        "{\"s\":\"\\ud83d\"}", "{\"s\":\"\\ude00x\"}", "{\"s\":\"\\ud83d\\u0041\"}", "{\"s\":\"\\x\"}",
+        "{\"s\":\"a\x01\"}", "{\"s\":\"\xC0\xAF\"}", "{\"s\":\"\xED\xA0\x80\"}", "{\"s\":\"\xF4\x90\x80\x80\"}",
+        "{\"int\":1.2.3}", "{\"int\":1e}", "{\"int\":01}", "{\"int\":-}", "{\"int\":.5}", "{\"int\":1.}",
+        "{\"int\":+1}", "{\"zz\":tru}", "{\"zz\":[1 2]}", "{\"zz\":{\"k\" 1}}", "{\"zz\":[1,]}",
+        "{\"zz\":\"\\x\"}", "{\"zz\":01}", "{\"zz\":\"\x01\"}", "{\"\\x\":1}", "{\"zz\":[}", "{\"zz\":{]}",
+    };
+    const char *good = "{\"s\":\"\\ud83d\\ude00\\u00e9\\/\",\"zz\":[1,{\"k\":[true,false,null,\"\\u00e9\",-0.5e+3]}],"
+                       "\"int\":12345678901234567890,\"a_b\":-0}";
+    gt out;
+    JSON *json;
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+        EXPECT_TRUE(json_parse(bad[i], strlen(bad[i])) == NULL);
+        EXPECT_EQ(-1, gt_parse(bad[i], strlen(bad[i]), &out));
+    }
+
+    //  代理对合成一个码点，解码结果和json_parse相同
+    json = json_parse(good, strlen(good));
+    ASSERT_TRUE(json != NULL);
+    ASSERT_EQ(0, gt_parse(good, strlen(good), &out));
+    EXPECT_STREQ("\xF0\x9F\x98\x80\xC3\xA9/", out.s);
+    EXPECT_STREQ(json_obj_get_str(json, "s", NULL), out.s);
+    EXPECT_EQ(json_obj_get_num(json, "int", 0), out.int_);
+    EXPECT_TRUE(signbit(out.a_b_2));
+    gt_free(&out);
+    json_free(json);
+
+    //  json_parse把\u0000解码成字符串中间的'\0'，C字符串字段放不下，生成的代码拒绝
+    EXPECT_EQ(-1, gt_parse("{\"s\":\"a\\u0000b\"}", 16, &out));
+}
+
+#ifdef JSON_STATS
+TEST(json_stats, alloc_and_free)
+{
+    json_stats st;
+
+    json_stats_reset();
+    JSON *obj = json_new(JSON_OBJ);
+    json_add_member(obj, "ip", json_new_str("200.200.3.61"));
+    json_add_member(obj, "port", json_new_num(389));
+    EXPECT_EQ(0, json_stats_get(&st));
+    EXPECT_EQ(1, st.nodes_alloc[JSON_OBJ]);
+    EXPECT_EQ(1, st.nodes_alloc[JSON_STR]);
+    EXPECT_EQ(1, st.nodes_alloc[JSON_NUM]);
+    EXPECT_EQ(1, st.member_reallocs);
+    EXPECT_GT(st.member_cmps, 0);
+
+    json_free(obj);
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i) {
+        EXPECT_EQ(st.nodes_alloc[i], st.nodes_freed[i]);
+        EXPECT_EQ(st.bytes_alloc[i], st.bytes_freed[i]);
+    }
+}
+
+TEST(json_free_deferred, frees_everything)
+{
+    json_stats st;
+
+    json_stats_reset();
+    for (int round = 0; round < 3; ++round) {
+        JSON *root = json_new(JSON_OBJ);
+        JSON *deep = root;
+        for (int i = 0; i < 100; ++i) {     //比回收线程的初始栈深
+            JSON *next = json_new(i % 2 ? JSON_OBJ : JSON_ARR);
+            deep = json_type(deep) == JSON_OBJ ? json_add_member(deep, "next", next)
+                                               : json_add_element(deep, next);
+        }
+        JSON *wide = json_add_member(root, "wide", json_new(JSON_ARR));
+        for (int i = 0; i < 10000; ++i) {
+            JSON *rec = json_add_element(wide, json_new(JSON_OBJ));
+            json_obj_set_str(rec, "s", "text");
+            json_obj_set_num(rec, "n", i);
+            json_obj_set_bool(rec, "b", i % 2);
+            json_add_member(rec, "none", json_new(JSON_NONE));
+        }
+        JSON *packed = json_add_member(root, "packed", json_new(JSON_ARR));
+        for (int i = 0; i < 100; ++i)
+            json_arr_add_num(packed, i);
+        json_free_deferred(root);
+    }
+    json_free_deferred(json_new_str("scalar root"));
+    json_free_deferred(NULL);
+    json_reclaim_drain();
+
+    EXPECT_EQ(0, json_stats_get(&st));
+    for (int i = 0; i < JSON_TYPE_COUNT; ++i) {
+        EXPECT_EQ(st.nodes_alloc[i], st.nodes_freed[i]);
+        EXPECT_EQ(st.bytes_alloc[i], st.bytes_freed[i]);
+    }
+    json_reclaim_drain();   //队列为空时立即返回
+}
+
+TEST(json_stats, save)
+{
+    json_stats st;
+    buf_t result;
+    U64 saves = 0;
+
+    json_stats_reset();
+    JSON *json = json_new_str("hello world");
+    EXPECT_EQ(0, json_save(json, "test_stats.yml"));
+    EXPECT_EQ(0, read_file(&result, "test_stats.yml"));
+    EXPECT_EQ(0, json_stats_get(&st));
+    EXPECT_EQ(strlen(result.str), st.save_bytes);
+    for (int i = 0; i < JSON_LAT_BUCKETS; ++i)
+        saves += st.save_lat[i];
+    EXPECT_EQ(1, saves);
+    free(result.str);
+    json_free(json);
+}
+
+static void *stats_worker(void *arg)
+{
+    json_free(json_new_num(1));
+    return NULL;
+}
+
+//  退出线程的计数在读取时也要合并进来
+TEST(json_stats, merge_threads)
+{
+    json_stats st;
+    pthread_t tid;
+
+    json_stats_reset();
+    ASSERT_EQ(0, pthread_create(&tid, NULL, stats_worker, NULL));
+    pthread_join(tid, NULL);
+    json_free(json_new_num(2));
+    EXPECT_EQ(0, json_stats_get(&st));
+    EXPECT_EQ(2, st.nodes_alloc[JSON_NUM]);
+    EXPECT_EQ(2, st.nodes_freed[JSON_NUM]);
+
+    json_stats_reset();
+    EXPECT_EQ(0, json_stats_get(&st));
+    EXPECT_EQ(0, st.nodes_alloc[JSON_NUM]);
+}
+#endif //JSON_STATS
+
 int main(int argc, char **argv)
 {
 	return xtest_start_test(argc, argv);